@@ -0,0 +1,467 @@
+// Minimal benchmark harness shared by the clibox benchmarks.
+//
+// Each benchmark program registers cases with Suite::add() and calls
+// Suite::main(). Command line:
+//
+//   --filter TEXT      Only run the cases whose name contains TEXT
+//   --json FILE        Write the results as JSON
+//   --baseline FILE    Compare with the JSON results of a previous run
+//   --threshold PCT    Slowdown reported as regression (default: 10)
+//   --min-time SECS    Minimum measured time of a repetition (default: 0.2)
+//   --repetitions N    Measured repetitions of each case (default: 5)
+//
+// Programs can declare their own "--NAME VALUE" options with Suite::param()
+// before calling Suite::parse(), then register their cases and call run().
+//
+// The exit status is 1 if a case is slower than its baseline by more than
+// the threshold. The best of the repetitions is compared: it is the least
+// sensitive to noise of other processes.
+#ifndef CLIBOX_BENCH_HPP
+#define CLIBOX_BENCH_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace clibox::bench
+{
+
+/// Prevent the compiler from optimizing a result away.
+template<typename T>
+inline void do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// Redirect stdout to /dev/null while in scope (kernels that print).
+class SilenceStdout
+{
+    int m_saved = -1;
+public:
+    SilenceStdout()
+    {
+        std::cout.flush();
+        m_saved = ::dup(STDOUT_FILENO);
+        int null = ::open("/dev/null", O_WRONLY);
+        ::dup2(null, STDOUT_FILENO);
+        ::close(null);
+    }
+    ~SilenceStdout()
+    {
+        std::cout.flush();
+        ::dup2(m_saved, STDOUT_FILENO);
+        ::close(m_saved);
+    }
+    SilenceStdout(SilenceStdout const&) = delete;
+    SilenceStdout& operator=(SilenceStdout const&) = delete;
+};
+
+/// JSON document, parsed into a tree (baseline files of any layout).
+struct JsonValue
+{
+    enum class kind { null, boolean, number, string, array, object };
+
+    kind                                           type    = kind::null;
+    bool                                           boolean = false;
+    double                                         number  = 0;
+    std::string                                    text;
+    std::vector<JsonValue>                         items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    /// Member of an object, nullptr if missing or not an object.
+    JsonValue const* get(std::string const& key) const
+    {
+        for(auto const& m: members) {
+            if(m.first == key) { return &m.second; }
+        }
+        return nullptr;
+    }
+
+    /// Parse a whole document; throws std::runtime_error on a syntax error.
+    static JsonValue parse(std::string const& text)
+    {
+        std::size_t pos = 0;
+        auto value = JsonValue::parse_value(text, pos, 0);
+        JsonValue::skip_space(text, pos);
+        if(pos != text.size()) { JsonValue::fail(pos, "trailing characters"); }
+        return value;
+    }
+
+private:
+
+    [[noreturn]] static void fail(std::size_t pos, const char* what)
+    {
+        throw std::runtime_error("invalid JSON at offset " + std::to_string(pos) + ": " + what);
+    }
+
+    static void skip_space(std::string const& t, std::size_t& pos)
+    {
+        while(pos < t.size() && (t[pos] == ' ' || t[pos] == '\t' || t[pos] == '\r' || t[pos] == '\n')) { pos++; }
+    }
+
+    static void expect(std::string const& t, std::size_t& pos, const char* word)
+    {
+        auto len = std::strlen(word);
+        if(t.compare(pos, len, word) != 0) { JsonValue::fail(pos, "unexpected token"); }
+        pos += len;
+    }
+
+    static std::string parse_string(std::string const& t, std::size_t& pos)
+    {
+        std::string out;
+        pos++; // Opening quote
+        for(;;)
+        {
+            if(pos >= t.size()) { JsonValue::fail(pos, "unterminated string"); }
+            char c = t[pos++];
+            if(c == '"') { return out; }
+            if(c != '\\') { out += c; continue; }
+            if(pos >= t.size()) { JsonValue::fail(pos, "unterminated string"); }
+            char e = t[pos++];
+            switch(e)
+            {
+            case '"': case '\\': case '/': out += e; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                if(pos + 4 > t.size()) { JsonValue::fail(pos, "invalid escape"); }
+                unsigned cp = static_cast<unsigned>(std::stoul(t.substr(pos, 4), nullptr, 16));
+                pos += 4;
+                // UTF-8 (surrogate pairs are kept as two sequences).
+                if(cp < 0x80) { out += static_cast<char>(cp); }
+                else if(cp < 0x800) {
+                    out += static_cast<char>(0xC0 | (cp >> 6));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                } else {
+                    out += static_cast<char>(0xE0 | (cp >> 12));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default: JsonValue::fail(pos - 1, "invalid escape");
+            }
+        }
+    }
+
+    static JsonValue parse_value(std::string const& t, std::size_t& pos, int depth)
+    {
+        if(depth > 64) { JsonValue::fail(pos, "nested too deeply"); }
+        JsonValue v;
+        JsonValue::skip_space(t, pos);
+        if(pos >= t.size()) { JsonValue::fail(pos, "unexpected end"); }
+        char c = t[pos];
+        if(c == '{' || c == '[')
+        {
+            const char close = c == '{' ? '}' : ']';
+            v.type = c == '{' ? kind::object : kind::array;
+            pos++;
+            JsonValue::skip_space(t, pos);
+            if(pos < t.size() && t[pos] == close) { pos++; return v; }
+            for(;;)
+            {
+                if(v.type == kind::object)
+                {
+                    JsonValue::skip_space(t, pos);
+                    if(pos >= t.size() || t[pos] != '"') { JsonValue::fail(pos, "expected a key"); }
+                    auto key = JsonValue::parse_string(t, pos);
+                    JsonValue::skip_space(t, pos);
+                    JsonValue::expect(t, pos, ":");
+                    v.members.emplace_back(std::move(key), JsonValue::parse_value(t, pos, depth + 1));
+                } else {
+                    v.items.push_back(JsonValue::parse_value(t, pos, depth + 1));
+                }
+                JsonValue::skip_space(t, pos);
+                if(pos < t.size() && t[pos] == ',') { pos++; continue; }
+                if(pos < t.size() && t[pos] == close) { pos++; return v; }
+                JsonValue::fail(pos, "expected ',' or a closing bracket");
+            }
+        }
+        if(c == '"')
+        {
+            v.type = kind::string;
+            v.text = JsonValue::parse_string(t, pos);
+            return v;
+        }
+        if(c == 't' || c == 'f')
+        {
+            v.type    = kind::boolean;
+            v.boolean = c == 't';
+            JsonValue::expect(t, pos, v.boolean ? "true" : "false");
+            return v;
+        }
+        if(c == 'n')
+        {
+            JsonValue::expect(t, pos, "null");
+            return v;
+        }
+        char* end = nullptr;
+        v.type   = kind::number;
+        v.number = std::strtod(t.c_str() + pos, &end);
+        if(end == t.c_str() + pos) { JsonValue::fail(pos, "unexpected token"); }
+        pos = static_cast<std::size_t>(end - t.c_str());
+        return v;
+    }
+};
+
+struct Result
+{
+    std::string name;
+    double      best_ns   = 0;   // Best repetition, per operation
+    double      median_ns = 0;   // Median repetition, per operation
+    double      mb_per_s  = 0;   // From the best repetition, 0 if no byte count
+    long        iterations = 0;  // Operations per repetition
+};
+
+class Suite
+{
+    struct Case
+    {
+        std::string           name;
+        std::size_t           bytes;   // Bytes processed per operation (0 => unknown)
+        std::function<void()> fn;
+        bool                  calibrate;
+    };
+
+    std::string         m_name;
+    std::vector<Case>   m_cases;
+    double              m_min_time    = 0.2;
+    int                 m_repetitions = 5;
+    double              m_threshold   = 10;
+    std::string         m_filter, m_json, m_baseline;
+    std::map<std::string, std::string> m_params;
+
+public:
+
+    explicit Suite(std::string name): m_name(std::move(name)) { }
+
+    /// Register a fast operation, run as many times as needed per repetition.
+    void add(std::string name, std::size_t bytes, std::function<void()> fn)
+    {
+        m_cases.push_back({std::move(name), bytes, std::move(fn), true});
+    }
+
+    /// Register a long operation (a whole program run), run once per repetition.
+    void add_once(std::string name, std::size_t bytes, std::function<void()> fn)
+    {
+        m_cases.push_back({std::move(name), bytes, std::move(fn), false});
+    }
+
+    /// Default number of measured repetitions of each case.
+    void repetitions(int n)
+    {
+        m_repetitions = std::max(1, n);
+    }
+
+    /// Declare a program specific option "--name VALUE".
+    void param(std::string const& name, std::string default_value)
+    {
+        m_params[name] = std::move(default_value);
+    }
+
+    std::string const& param(std::string const& name) const
+    {
+        return m_params.at(name);
+    }
+
+    /// Parse the command line; exits on error.
+    void parse(int argc, char** argv)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if(i + 1 >= argc) {
+                    std::cerr << " [ERROR] missing value of " << arg << "\n";
+                    std::exit(EXIT_FAILURE);
+                }
+                return argv[++i];
+            };
+            auto param = arg.size() > 2 ? m_params.find(arg.substr(2)) : m_params.end();
+            if(param != m_params.end())     { param->second = value(); }
+            else if(arg == "--filter")      { m_filter      = value(); }
+            else if(arg == "--json")        { m_json        = value(); }
+            else if(arg == "--baseline")    { m_baseline    = value(); }
+            else if(arg == "--threshold")   { m_threshold   = std::stod(value()); }
+            else if(arg == "--min-time")    { m_min_time    = std::stod(value()); }
+            else if(arg == "--repetitions") { m_repetitions = std::max(1, std::stoi(value())); }
+            else {
+                std::cerr << " [ERROR] unknown option " << arg << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    int main(int argc, char** argv)
+    {
+        this->parse(argc, argv);
+        return this->run();
+    }
+
+    /// Run the cases; returns the exit status of the program.
+    int run()
+    {
+        std::vector<Result> results;
+        std::cout << std::left << std::setw(44) << "BENCHMARK" << std::right
+                  << std::setw(14) << "BEST(ns)" << std::setw(14) << "MEDIAN(ns)"
+                  << std::setw(12) << "MB/s" << "\n";
+        for(auto& c: m_cases)
+        {
+            if(!m_filter.empty() && c.name.find(m_filter) == std::string::npos) { continue; }
+            auto r = this->measure_case(c);
+            std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(14) << r.best_ns
+                      << std::setw(14) << r.median_ns << std::setw(12) << r.mb_per_s << std::endl;
+            results.push_back(r);
+        }
+        if(!m_json.empty()) { this->write_json(m_json, results); }
+        if(!m_baseline.empty()) {
+            return this->compare(m_baseline, results, m_threshold) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+private:
+
+    Result measure_case(Case& c)
+    {
+        using clock = std::chrono::steady_clock;
+        auto measure = [&](long n) {
+            auto start = clock::now();
+            for(long k = 0; k < n; k++) { c.fn(); }
+            return std::chrono::duration<double>(clock::now() - start).count();
+        };
+
+        // Warm up (page cache, branch predictors) and calibration.
+        long iterations = 1;
+        double elapsed  = measure(1);
+        while(c.calibrate && elapsed < m_min_time && iterations < (1L << 30))
+        {
+            iterations *= elapsed > 0 ? std::clamp<long>(static_cast<long>(m_min_time / elapsed), 2, 10) : 10;
+            elapsed = measure(iterations);
+        }
+
+        std::vector<double> times;
+        for(int k = 0; k < m_repetitions; k++) {
+            times.push_back(measure(iterations) * 1e9 / static_cast<double>(iterations));
+        }
+        std::sort(times.begin(), times.end());
+        Result r;
+        r.name       = c.name;
+        r.best_ns    = times.front();
+        r.median_ns  = times[times.size() / 2];
+        r.mb_per_s   = c.bytes > 0 ? static_cast<double>(c.bytes) / r.best_ns * 1e3 : 0;
+        r.iterations = iterations;
+        return r;
+    }
+
+    void write_json(std::string const& file, std::vector<Result> const& results) const
+    {
+        std::ofstream ofs(file);
+        ofs << std::setprecision(6) << "{\n  \"suite\": \"" << m_name << "\",\n  \"results\": [\n";
+        for(std::size_t i = 0; i < results.size(); i++)
+        {
+            auto const& r = results[i];
+            std::string name;
+            for(char c: r.name) {
+                if(c == '"' || c == '\\') { name += '\\'; }
+                name += c;
+            }
+            ofs << "    {\"name\": \"" << name << "\", \"best_ns\": " << r.best_ns
+                << ", \"median_ns\": " << r.median_ns << ", \"mb_per_s\": " << r.mb_per_s
+                << ", \"iterations\": " << r.iterations << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        ofs << "  ]\n}\n";
+    }
+
+    /// The "name" and "best_ns" of every entry of "results" in a JSON file
+    /// (whatever its layout); throws std::runtime_error if it is invalid.
+    static std::map<std::string, double> read_json(std::string const& file)
+    {
+        std::ifstream ifs(file);
+        if(!ifs) {
+            throw std::runtime_error("unable to open " + file);
+        }
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        auto doc     = JsonValue::parse(ss.str());
+        auto results = doc.get("results");
+        if(results == nullptr || results->type != JsonValue::kind::array) {
+            throw std::runtime_error("no \"results\" array in " + file);
+        }
+        std::map<std::string, double> best;
+        for(auto const& r: results->items)
+        {
+            auto name = r.get("name");
+            auto ns   = r.get("best_ns");
+            if(name == nullptr || name->type != JsonValue::kind::string
+               || ns == nullptr || ns->type != JsonValue::kind::number) {
+                throw std::runtime_error("result without \"name\" or \"best_ns\" in " + file);
+            }
+            best[name->text] = ns->number;
+        }
+        return best;
+    }
+
+    bool compare(std::string const& file, std::vector<Result> const& results, double threshold) const
+    {
+        std::map<std::string, double> baseline;
+        try {
+            baseline = Suite::read_json(file);
+        } catch(std::exception const& ex) {
+            std::cerr << " [ERROR] baseline: " << ex.what() << "\n";
+            return false;
+        }
+        bool ok = true;
+        std::size_t missing = 0;
+        for(auto const& r: results)
+        {
+            auto it = baseline.find(r.name);
+            if(it == baseline.end() || it->second <= 0)
+            {
+                // A case without baseline is not compared: say so.
+                missing++;
+                std::cout << " [NO BASELINE] " << r.name << "\n";
+                continue;
+            }
+            double change = (r.best_ns / it->second - 1.0) * 100.0;
+            if(change > threshold)
+            {
+                ok = false;
+                std::cout << " [REGRESSION] ";
+            } else {
+                std::cout << " [OK]         ";
+            }
+            std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed
+                      << std::setprecision(1) << std::setw(12) << it->second << " -> "
+                      << std::setw(12) << r.best_ns << " ns (" << std::showpos << change
+                      << std::noshowpos << "%)\n";
+        }
+        if(missing != 0) {
+            std::cerr << " [WARN] " << missing << " case(s) without baseline in " << file << "\n";
+        }
+        return ok;
+    }
+};
+
+} // namespace clibox::bench
+
+#endif // CLIBOX_BENCH_HPP
@@ -0,0 +1,110 @@
+// End-to-end benchmarks: run the clibox binaries against the generated corpora.
+//
+// Usage: bench_e2e --bin DIRECTORY --corpus DIRECTORY [harness options]
+//
+// The corpus is created by gen_corpus. The output of the programs goes to
+// /dev/null; every case is one program run, repeated --repetitions times.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "bench.hpp"
+
+extern char** environ;
+
+namespace fs = std::filesystem;
+
+/// Run a program with its output discarded; exits if it fails (a failing
+/// run would be measured as a very fast one).
+void run_program(std::vector<std::string> const& args)
+{
+    std::vector<char*> argv;
+    for(auto const& a: args) { argv.push_back(const_cast<char*>(a.c_str())); }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    ::posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid = -1;
+    int rc = ::posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    ::posix_spawn_file_actions_destroy(&actions);
+    int status = 0;
+    if(rc != 0 || ::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::string cmd;
+        for(auto const& a: args) { cmd += (cmd.empty() ? "" : " ") + a; }
+        std::cerr << " [ERROR] command failed: " << cmd << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+std::size_t tree_size(fs::path const& dir)
+{
+    std::size_t size = 0;
+    for(auto const& e: fs::recursive_directory_iterator(dir)) {
+        if(e.is_regular_file()) { size += e.file_size(); }
+    }
+    return size;
+}
+
+int main(int argc, char** argv)
+{
+    using namespace clibox::bench;
+    Suite suite("e2e");
+    suite.param("bin", "bin");
+    suite.param("corpus", "bench-corpus");
+    suite.repetitions(3);
+    suite.parse(argc, argv);
+
+    fs::path bin    = suite.param("bin");
+    fs::path corpus = suite.param("corpus");
+    auto tree  = (corpus / "tree").string();
+    auto log   = (corpus / "huge.log").string();
+    auto image = (corpus / "image.bin").string();
+    if(!fs::exists(image))
+    {
+        std::cerr << " [ERROR] corpus not found in " << corpus << " (run gen_corpus)\n";
+        return EXIT_FAILURE;
+    }
+    auto tool = [&](const char* name) { return (bin / name).string(); };
+    auto tree_bytes  = tree_size(tree);
+    auto log_bytes   = fs::file_size(log);
+    auto image_bytes = fs::file_size(image);
+
+    struct Command
+    {
+        std::string              name;
+        std::size_t              bytes;
+        std::vector<std::string> args;
+    };
+    std::vector<Command> commands = {
+          {"cb.ls/tree_recursive",         0,           {tool("cb.ls"), tree, "-r", "-p"}}
+        , {"cb.rename/tree_dry_run",       0,           {tool("cb.rename"), tree, "--recursive", "--silent"}}
+        , {"cb.text-search/tree_hit",      tree_bytes,  {tool("cb.text-search"), "dir", "timeout", tree, "-r"
+                                                         , "-e", ".cpp", "-e", ".hpp", "-e", ".txt", "-e", ".log", "-e", ".md"}}
+        , {"cb.text-search/tree_miss",     tree_bytes,  {tool("cb.text-search"), "dir", "zzyzx", tree, "-r"
+                                                         , "-e", ".cpp", "-e", ".hpp", "-e", ".txt", "-e", ".log", "-e", ".md"}}
+        , {"cb.text-search/log_hit",       log_bytes,   {tool("cb.text-search"), "file", "ERROR", log}}
+        , {"cb.text-search/log_regex",     log_bytes,   {tool("cb.text-search"), "file", "--regex"
+                                                         , "retry=[0-9]+", log}}
+        , {"cb.text-search/log_fuzzy",     log_bytes,   {tool("cb.text-search"), "file", "--fuzzy", "1"
+                                                         , "conection", log}}
+        , {"cb.hextool/dump-strings",      image_bytes, {tool("cb.hextool"), "dump-strings", image}}
+        , {"cb.hextool/dump-bytes",        image_bytes, {tool("cb.hextool"), "dump-bytes", image, "--size", "0"}}
+        , {"cb.hextool/find",              image_bytes, {tool("cb.hextool"), "find", image, "50 4B 03 04"}}
+        , {"cb.hextool/carve_list",        image_bytes, {tool("cb.hextool"), "carve", image, "--list"}}
+        , {"cb.hextool/entropy",           image_bytes, {tool("cb.hextool"), "entropy", image}}
+        , {"cb.hextool/hash",              image_bytes, {tool("cb.hextool"), "hash", image}}
+    };
+    for(auto& c: commands)
+    {
+        if(!fs::exists(c.args[0])) { continue; }
+        suite.add_once(c.name, c.bytes, [args = c.args]{ run_program(args); });
+    }
+    return suite.run();
+}
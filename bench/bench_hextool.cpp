@@ -0,0 +1,49 @@
+// Microbenchmarks of the cb.hextool kernels (output to /dev/null).
+#define CLIBOX_NO_MAIN
+#include "../hextool.cpp"
+
+#include "bench.hpp"
+#include "corpus.hpp"
+
+int main(int argc, char** argv)
+{
+    using namespace clibox::bench;
+    Suite suite("hextool");
+    suite.param("image", "");
+    suite.parse(argc, argv);
+
+    // Binary image: from --image or generated in the temporary directory.
+    static std::string image = suite.param("image");
+    bool remove_image = image.empty();
+    if(remove_image)
+    {
+        image = (std::filesystem::temp_directory_path() / "clibox-bench-image.bin").string();
+        generate_image(image, 16 << 20);
+    }
+    const std::size_t size = std::filesystem::file_size(image);
+
+    suite.add("command_strings", size, []{
+        SilenceStdout silence;
+        command_strings(image);
+    });
+    suite.add("dump_binary_t<u8>", size, []{
+        SilenceStdout silence;
+        dump_binary_t<std::uint8_t>(image, 0, 0);
+    });
+    suite.add("dump_binary_t<i32>", size, []{
+        SilenceStdout silence;
+        dump_binary_t<std::int32_t>(image, 0, 0);
+    });
+    suite.add("dump_binary_t<u32>/big_endian", size, []{
+        SilenceStdout silence;
+        dump_binary_t<std::uint32_t>(image, 0, 0, byte_order::big);
+    });
+    suite.add("dump_binary_t<f64>", size, []{
+        SilenceStdout silence;
+        dump_binary_t<double>(image, 0, 0);
+    });
+
+    int status = suite.run();
+    if(remove_image) { std::filesystem::remove(image); }
+    return status;
+}
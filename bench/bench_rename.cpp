@@ -0,0 +1,51 @@
+// Microbenchmarks of the cb.rename kernels.
+#define CLIBOX_NO_MAIN
+#include "../rename.cpp"
+
+#include "bench.hpp"
+#include "corpus.hpp"
+
+int main(int argc, char** argv)
+{
+    using namespace clibox::bench;
+    Suite suite("rename");
+
+    // File names in the style of the generated tree.
+    static std::vector<std::string> names;
+    Rng rng;
+    auto const& words = corpus_words();
+    for(int i = 0; i < 10000; i++)
+    {
+        names.push_back(words[rng.below(words.size())] + " " + words[rng.below(words.size())]
+                        + " (" + std::to_string(i) + ") [" + words[rng.below(words.size())]
+                        + "] & co, live.....mp3");
+    }
+    std::size_t names_bytes = 0;
+    for(auto const& n: names) { names_bytes += n.size(); }
+
+    // Same list as rename_files_fix().
+    static const std::vector<std::tuple<std::string, std::string>> fixes = {
+          {" ",   "_"}, {",",   "-"}, {"&",   "-"}, {"--",  "-"}, {"---", "-"}
+        , {"(",   "" }, {")",   "" }, {"[",   "" }, {"]",   "" }
+        , {".....", "_"}, {"....", "_"}, {"..", "_"}, {"...", "_"}
+    };
+    static const std::string text = corpus_text(1 << 20);
+
+    suite.add("replace_string/names_10k", names_bytes, []{
+        std::size_t size = 0;
+        for(auto const& n: names) { size += replace_string(n, " ", "_").size(); }
+        do_not_optimize(size);
+    });
+    suite.add("replace_string/text_1MiB_dense", text.size(), []{
+        do_not_optimize(replace_string(text, " ", "_").size());
+    });
+    suite.add("replace_string/text_1MiB_grow", text.size(), []{
+        do_not_optimize(replace_string(text, "error", "failure").size());
+    });
+    suite.add("repladce_string_list/names_10k", names_bytes, []{
+        std::size_t size = 0;
+        for(auto const& n: names) { size += repladce_string_list(n, fixes).size(); }
+        do_not_optimize(size);
+    });
+    return suite.main(argc, argv);
+}
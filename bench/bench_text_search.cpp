@@ -0,0 +1,112 @@
+// Microbenchmarks of the cb.text-search kernels.
+#define CLIBOX_NO_MAIN
+#include "../text-search.cpp"
+
+#include "bench.hpp"
+#include "corpus.hpp"
+
+int main(int argc, char** argv)
+{
+    using namespace clibox::bench;
+    Suite suite("text-search");
+
+    // Lines as read by search_file(), and a whole buffer.
+    static std::vector<std::string> lines;
+    {
+        std::stringstream ss{ corpus_text(1 << 20) };
+        std::string line;
+        while(std::getline(ss, line)) { lines.push_back(line); }
+    }
+    static const std::string buffer = corpus_text(1 << 22);
+    std::size_t lines_bytes = 0;
+    for(auto const& l: lines) { lines_bytes += l.size() + 1; }
+
+    struct Pattern { const char* name; std::string text; };
+    static const Pattern patterns[] = {
+          {"short_hit",  "error"}
+        , {"short_miss", "zzyzx"}
+        , {"long_hit",   "connection timeout"}
+        , {"long_miss",  "this pattern does not occur anywhere"}
+    };
+    for(auto const& p: patterns)
+    {
+        suite.add(std::string("contains_string2/lines_1MiB/") + p.name, lines_bytes, [&p]{
+            std::size_t count = 0;
+            for(auto const& l: lines) { count += strutils::contains_string2(p.text, l); }
+            do_not_optimize(count);
+        });
+        suite.add(std::string("contains_string2/buffer_4MiB/") + p.name, buffer.size(), [&p]{
+            do_not_optimize(strutils::contains_string2(p.text, buffer));
+        });
+    }
+    suite.add("to_lowercase/lines_1MiB", lines_bytes, []{
+        std::size_t size = 0;
+        for(auto const& l: lines) { size += strutils::to_lowercase(l).size(); }
+        do_not_optimize(size);
+    });
+
+    // Multilingual text: the blocks with non-ASCII bytes are decoded.
+    static const std::string utf8 = []
+    {
+        const char* words[] = {"Ошибка", "СОЕДИНЕНИЯ", "Fehler", "Straße", "ÉCHEC", "connexion"
+                               , "错误", "超时", "ΣΦΑΛΜΑ", "timeout", "retry=3", "Ελλάδα"};
+        Rng rng;
+        std::string text;
+        while(text.size() < (1 << 22))
+        {
+            text += words[rng.below(std::size(words))];
+            text += rng.below(12) == 0 ? '\n' : ' ';
+        }
+        return text;
+    }();
+    static std::string folded;
+    suite.add("casefold::fold/ascii_4MiB", buffer.size(), []{
+        casefold::fold(buffer, folded);
+        do_not_optimize(folded.data());
+    });
+    suite.add("casefold::fold/utf8_4MiB", utf8.size(), []{
+        casefold::fold(utf8, folded);
+        do_not_optimize(folded.data());
+    });
+
+    // Verification of fuzzy candidates, line by line and four lines per step.
+    static const fuzzy::Pattern fuzzy_pattern("conection timeout", 2);
+    static std::vector<std::string_view> views(lines.begin(), lines.end());
+    static std::vector<char> found(views.size());
+    suite.add("fuzzy::matches/lines_1MiB", lines_bytes, []{
+        std::size_t count = 0;
+        for(auto const& v: views) { count += fuzzy::matches(fuzzy_pattern, v); }
+        do_not_optimize(count);
+    });
+    suite.add("fuzzy::matches/batch_lines_1MiB", lines_bytes, []{
+        fuzzy::matches(fuzzy_pattern, views.data(), views.size(), reinterpret_cast<bool*>(found.data()));
+        do_not_optimize(found.data());
+    });
+
+    // Selection of files: hundreds of suffixes and globs over generated names.
+    static std::vector<std::string> paths;
+    {
+        Rng rng;
+        auto const& words = corpus_words();
+        const char* suffixes[] = {".cpp", ".hpp", ".txt", ".log", ".md", ".json", ".tar.gz", ".o"};
+        for(int i = 0; i < 100000; i++)
+        {
+            paths.push_back(words[rng.below(words.size())] + "/" + words[rng.below(words.size())]
+                            + "_" + std::to_string(i) + suffixes[rng.below(std::size(suffixes))]);
+        }
+    }
+    std::size_t paths_bytes = 0;
+    for(auto const& p: paths) { paths_bytes += p.size(); }
+    static selector::FileSelector selection;
+    for(int i = 0; i < 200; i++) { selection.add_extension(".ext" + std::to_string(i)); }
+    for(int i = 0; i < 100; i++) { selection.add_glob("!*_" + std::to_string(i) + "?.o"); }
+    selection.add_extension(".cpp");
+    selection.add_glob("*.t[a-z]t");
+    selection.add_glob("!build/**");
+    suite.add("FileSelector/paths_100k", paths_bytes, []{
+        std::size_t count = 0;
+        for(auto const& p: paths) { count += selection.selects_entry(p, ""); }
+        do_not_optimize(count);
+    });
+    return suite.main(argc, argv);
+}
@@ -0,0 +1,183 @@
+// Deterministic synthetic corpora for the clibox benchmarks.
+//
+// The same seed and scale always produce the same bytes on every platform:
+// the generator is splitmix64 and does not use the <random> distributions,
+// whose output differs between standard libraries.
+#ifndef CLIBOX_BENCH_CORPUS_HPP
+#define CLIBOX_BENCH_CORPUS_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+namespace clibox::bench
+{
+
+class Rng
+{
+    std::uint64_t m_state;
+public:
+    explicit Rng(std::uint64_t seed = 0x5EEDC11B0CULL): m_state(seed) { }
+
+    std::uint64_t next()
+    {
+        std::uint64_t z = (m_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /// Number in [0, n).
+    std::uint64_t below(std::uint64_t n) { return this->next() % n; }
+};
+
+inline const std::vector<std::string>& corpus_words()
+{
+    static const std::vector<std::string> words = {
+        "server", "request", "timeout", "connection", "buffer", "thread", "memory"
+      , "config", "socket", "handler", "process", "signal", "cache", "module", "error"
+      , "worker", "client", "session", "value", "index", "record", "stream", "packet"
+      , "queue", "token", "parser", "file", "user", "retry", "latency", "the", "of"
+      , "and", "to", "in", "is", "for", "on", "with", "at", "by", "from", "not", "was"
+    };
+    return words;
+}
+
+/// A line of log text (without the newline).
+inline std::string corpus_log_line(Rng& rng, std::uint64_t line_number)
+{
+    static const char* levels[] = {"DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR"};
+    auto const& words = corpus_words();
+    char head[64];
+    std::snprintf(head, sizeof(head), "2024-01-%02u %02u:%02u:%02u.%03u [%s] ",
+                  static_cast<unsigned>(1 + line_number / 2000000 % 28),
+                  static_cast<unsigned>(line_number / 90000 % 24),
+                  static_cast<unsigned>(line_number / 1500 % 60),
+                  static_cast<unsigned>(line_number / 25 % 60),
+                  static_cast<unsigned>(rng.below(1000)),
+                  levels[rng.below(6)]);
+    std::string line = head;
+    auto count = 4 + rng.below(12);
+    for(std::uint64_t i = 0; i < count; i++)
+    {
+        line += words[rng.below(words.size())];
+        line += (rng.below(8) == 0) ? "=" + std::to_string(rng.below(100000)) + " " : " ";
+    }
+    return line;
+}
+
+/// Text of about 'size' bytes made of log lines.
+inline std::string corpus_text(std::size_t size, std::uint64_t seed = 1)
+{
+    Rng rng(seed);
+    std::string text;
+    text.reserve(size + 256);
+    for(std::uint64_t n = 0; text.size() < size; n++) {
+        text += corpus_log_line(rng, n);
+        text += '\n';
+    }
+    text.resize(size);
+    return text;
+}
+
+/// Log file of 'size' bytes.
+inline void generate_log(std::filesystem::path const& file, std::size_t size, std::uint64_t seed = 2)
+{
+    Rng rng(seed);
+    std::ofstream ofs(file, std::ios::binary);
+    std::string block;
+    std::size_t written = 0;
+    for(std::uint64_t n = 0; written < size; n++)
+    {
+        block += corpus_log_line(rng, n);
+        block += '\n';
+        if(block.size() >= (1 << 20) || written + block.size() >= size)
+        {
+            auto len = std::min(block.size(), size - written);
+            ofs.write(block.data(), static_cast<std::streamsize>(len));
+            written += len;
+            block.clear();
+        }
+    }
+}
+
+/** @brief Binary image of 'size' bytes.
+ *
+ *  Mix of random blocks, zero runs, text runs (for 'strings') and
+ *  embedded file signatures (PNG, ZIP, ELF, PDF) for signature scans.
+ */
+inline void generate_image(std::filesystem::path const& file, std::size_t size, std::uint64_t seed = 3)
+{
+    static const std::string signatures[] = {
+        std::string("\x89PNG\r\n\x1a\n", 8), std::string("PK\x03\x04", 4)
+      , std::string("\x7f" "ELF", 4), std::string("%PDF-1.4\n", 9)
+    };
+    Rng rng(seed);
+    std::vector<char> block(1 << 16);
+    std::ofstream ofs(file, std::ios::binary);
+    for(std::size_t written = 0; written < size; written += block.size())
+    {
+        switch(rng.below(8))
+        {
+        case 0:
+            std::memset(block.data(), 0, block.size());
+            break;
+        case 1:
+        {
+            auto text = corpus_text(block.size(), rng.next());
+            std::memcpy(block.data(), text.data(), block.size());
+            break;
+        }
+        default:
+            for(std::size_t i = 0; i < block.size(); i += 8)
+            {
+                auto v = rng.next();
+                std::memcpy(block.data() + i, &v, 8);
+            }
+        }
+        auto const& sig = signatures[rng.below(4)];
+        std::memcpy(block.data() + rng.below(block.size() - sig.size()), sig.data(), sig.size());
+        ofs.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), size - written)));
+    }
+}
+
+/** @brief Directory tree: 'depth' levels of 'fanout' subdirectories, each
+ *  holding 'files' small files.
+ *
+ *  File names contain spaces, brackets and repeated dots (input for
+ *  cb.rename); contents are log lines (input for cb.text-search).
+ */
+inline void generate_tree(std::filesystem::path const& root, unsigned depth, unsigned fanout
+                          , unsigned files, std::uint64_t seed = 4)
+{
+    static const char* extensions[] = {".cpp", ".hpp", ".txt", ".log", ".md"};
+    Rng rng(seed);
+    std::vector<std::pair<std::filesystem::path, unsigned>> pending{{root, 0}};
+    while(!pending.empty())
+    {
+        auto [dir, level] = pending.back();
+        pending.pop_back();
+        std::filesystem::create_directories(dir);
+        for(unsigned f = 0; f < files; f++)
+        {
+            auto const& words = corpus_words();
+            auto name = words[rng.below(words.size())] + " (" + std::to_string(f) + ") ["
+                        + words[rng.below(words.size())] + "]..." + extensions[rng.below(5)];
+            std::ofstream ofs(dir / name, std::ios::binary);
+            auto lines = 10 + rng.below(200);
+            for(std::uint64_t n = 0; n < lines; n++) { ofs << corpus_log_line(rng, n) << '\n'; }
+        }
+        if(level + 1 >= depth) { continue; }
+        for(unsigned d = 0; d < fanout; d++) {
+            pending.emplace_back(dir / ("dir" + std::to_string(d)), level + 1);
+        }
+    }
+}
+
+} // namespace clibox::bench
+
+#endif // CLIBOX_BENCH_CORPUS_HPP
@@ -0,0 +1,48 @@
+// Generate the deterministic corpora used by the end-to-end benchmarks.
+//
+// Usage: gen_corpus <DIRECTORY> [SCALE]
+//
+//   DIRECTORY/tree/       Deep directory tree of small text files
+//   DIRECTORY/huge.log    Log file of SCALE x 64 MiB
+//   DIRECTORY/image.bin   Binary image of SCALE x 64 MiB
+//
+// Existing files of the same scale are kept (DIRECTORY/.scale).
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <filesystem>
+
+#include "corpus.hpp"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cerr << " Usage: " << argv[0] << " <DIRECTORY> [SCALE]\n";
+        return EXIT_FAILURE;
+    }
+    fs::path dir  = argv[1];
+    unsigned scale = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 1;
+
+    std::string stamp;
+    std::ifstream(dir / ".scale") >> stamp;
+    if(stamp == std::to_string(scale) && fs::exists(dir / "image.bin"))
+    {
+        std::cout << " [INFO] Corpus up to date: " << dir << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    using namespace clibox::bench;
+    fs::remove_all(dir / "tree");
+    fs::create_directories(dir);
+    std::cout << " [INFO] Generating " << dir / "tree" << "\n";
+    generate_tree(dir / "tree", 6, 3, 8);
+    std::cout << " [INFO] Generating " << dir / "huge.log" << "\n";
+    generate_log(dir / "huge.log", std::size_t{scale} << 26);
+    std::cout << " [INFO] Generating " << dir / "image.bin" << "\n";
+    generate_image(dir / "image.bin", std::size_t{scale} << 26);
+    std::ofstream(dir / ".scale") << scale << "\n";
+    return EXIT_SUCCESS;
+}
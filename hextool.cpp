@@ -3,9 +3,48 @@
 #include <filesystem>
 #include <bitset>
 #include <cstring> // strtok
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <map>
+#include <limits>
+#include <charconv>
+#include <string_view>
+#include <fstream>
+#include <optional>
+#include <numeric>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <csignal>
 
 #include <CLI/CLI.hpp>
 
+//---- Linux/POSIX specific Headers ---//
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <poll.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#endif
+
+#include "stats.hpp"
+
+namespace stats = clibox::stats;
+
 using ByteArray = std::vector<char>;
 
 /** Print byte array as string and non-printable chars as hexadecimal */
@@ -56,84 +95,483 @@ auto open_binary_file(std::string const& file) -> std::ifstream
 }
 
 
-/// Dump all printable characters for a binary file
-void command_strings(std::string const& file)
+/** @brief Read-only memory mapping of a whole file.
+ *
+ *  The mapping is released when the object goes out of scope. Empty
+ *  files are valid and yield a null data() pointer with size() == 0.
+ */
+class MappedFile
 {
-    enum class strings_state {
-         initial
-        , printable
-        , skip
-        , end
-    };
+    int           m_fd   = -1;
+    std::uint8_t* m_data = nullptr;
+    std::size_t   m_size = 0;
+public:
+
+    explicit MappedFile(std::string const& file)
+    {
+        using namespace std::string_literals;
+
+        m_fd = ::open(file.c_str(), O_RDONLY);
+        if(m_fd < 0) {
+            throw std::runtime_error("Error: Unable to open file: "s + file);
+        }
+        struct stat st{};
+        if(::fstat(m_fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            ::close(m_fd);
+            throw std::runtime_error("Error: Not a regular file: "s + file);
+        }
+        m_size = static_cast<std::size_t>(st.st_size);
+        if(m_size == 0) { return; }
 
-    auto ifs = open_binary_file(file);
+        void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if(p == MAP_FAILED) {
+            ::close(m_fd);
+            throw std::runtime_error("Error: Unable to map file: "s + file);
+        }
+        m_data = static_cast<std::uint8_t*>(p);
+        stats::add(stats::counter::files);
+        stats::add(stats::counter::bytes_read, m_size);
+        stats::add(stats::counter::syscalls, 3);
+    }
 
-    auto print_byte = [](std::uint8_t x)
+    ~MappedFile()
     {
-        std::cout << static_cast<char>(x);
-       // std::cout << "(" << static_cast<int>(x) << ") ";
-    };
+        if(m_data != nullptr) { ::munmap(m_data, m_size); }
+        if(m_fd >= 0) { ::close(m_fd); }
+    }
 
-    auto is_printable = [](std::uint8_t ch) -> bool
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    const std::uint8_t* data() const { return m_data; }
+    std::size_t         size() const { return m_size; }
+    int                 fd()   const { return m_fd;   }
+
+    /// Hint the kernel about the access pattern of the whole mapping.
+    void advise(int advice) const
     {
-        if(ch == '\r' || ch == '\n')
-            return false;
-        return std::isprint(ch);
-    };
+        if(m_data != nullptr) { ::madvise(m_data, m_size, advice); }
+    }
+
+    /// Hint the kernel about the access pattern of a range of the mapping.
+    void advise_range(std::size_t offset, std::size_t length, int advice) const
+    {
+        if(m_data == nullptr || offset >= m_size) { return; }
+        // madvise() requires a page aligned address.
+        auto page  = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto first = offset / page * page;
+        ::madvise(m_data + first, std::min(m_size, offset + length) - first, advice);
+    }
+};
 
-    std::uint8_t byte = 0x00;
-    auto state = strings_state::initial;
-    std::stringstream buffer;
+/// Inputs which can only be read sequentially: '-' (stdin), pipes,
+/// sockets, character and block devices.
+bool is_stream_input(std::string const& file)
+{
+    if(file == "-") { return true; }
+    struct stat st{};
+    return ::stat(file.c_str(), &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+/** @brief Sequential reader of non-seekable inputs through a fixed buffer.
+ *
+ *  The window [data(), data() + size()) holds the bytes of the input
+ *  starting at offset(). Consumed bytes are dropped from the front and
+ *  the remaining ones are moved back to the start of the buffer before
+ *  each refill, so that kernels written for memory mapped files can be
+ *  applied to the window as a plain contiguous array.
+ */
+class StreamReader
+{
+    int                       m_fd     = -1;
+    bool                      m_owner  = false;
+    std::vector<std::uint8_t> m_buffer;
+    std::size_t               m_begin  = 0;
+    std::size_t               m_end    = 0;
+    std::uint64_t             m_offset = 0;
+    bool                      m_eof    = false;
+public:
 
-    while(ifs)
+    /// Open a file for reading, '-' stands for the standard input.
+    explicit StreamReader(std::string const& file, std::size_t capacity = 1 << 20)
+        : m_buffer(capacity)
     {
-        if(state == strings_state::initial)
-        {
-            buffer.str("");
+        using namespace std::string_literals;
 
-            ifs >> byte;
-            if(is_printable(byte)){
-                // print_byte(byte);
-                buffer << byte;
-                state = strings_state::printable;
-                continue;
+        if(file == "-") {
+            m_fd = STDIN_FILENO;
+            return;
+        }
+        m_fd = ::open(file.c_str(), O_RDONLY);
+        if(m_fd < 0) {
+            throw std::runtime_error("Error: Unable to open file: "s + file);
+        }
+        m_owner = true;
+        ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    ~StreamReader()
+    {
+        if(m_owner) { ::close(m_fd); }
+    }
+
+    StreamReader(StreamReader const&) = delete;
+    StreamReader& operator=(StreamReader const&) = delete;
+
+    const std::uint8_t* data()     const { return m_buffer.data() + m_begin; }
+    std::size_t         size()     const { return m_end - m_begin; }
+    std::size_t         capacity() const { return m_buffer.size(); }
+    /// Offset in the input of the first byte of the window.
+    std::uint64_t       offset()   const { return m_offset; }
+    /// True after the end of input was reached (no more bytes to be read).
+    bool                eof()      const { return m_eof; }
+
+    /** @brief Read until the window holds at least n bytes or the input ends.
+     *  @return Number of bytes available in the window.
+     */
+    std::size_t fill(std::size_t n)
+    {
+        using namespace std::string_literals;
+
+        n = std::min(n, m_buffer.size());
+        if(this->size() >= n || m_eof) { return this->size(); }
+        if(m_begin + n > m_buffer.size())
+        {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_begin, this->size());
+            m_end  -= m_begin;
+            m_begin = 0;
+        }
+        stats::ScopedPhase timer(stats::phase::read);
+        while(this->size() < n)
+        {
+            auto r = ::read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end);
+            stats::add(stats::counter::syscalls);
+            if(r < 0 && errno == EINTR) { continue; }
+            if(r < 0) {
+                throw std::runtime_error("Error: read failure: "s + std::strerror(errno));
             }
-            state = strings_state::skip;
-            continue;
+            if(r == 0) {
+                m_eof = true;
+                break;
+            }
+            m_end += static_cast<std::size_t>(r);
+            stats::add(stats::counter::bytes_read, static_cast<std::size_t>(r));
         }
+        return this->size();
+    }
+
+    /// Drop n bytes (at most size()) from the front of the window.
+    void consume(std::size_t n)
+    {
+        n = std::min(n, this->size());
+        m_begin  += n;
+        m_offset += n;
+        if(m_begin == m_end) { m_begin = m_end = 0; }
+    }
 
-        if(state == strings_state::skip)
+    /** @brief Move n bytes forward by reading and discarding data.
+     *  @return Number of bytes actually skipped (less than n at end of input).
+     */
+    std::uint64_t skip(std::uint64_t n)
+    {
+        std::uint64_t done = 0;
+        while(done < n)
         {
-            ifs >> byte;
-            if(is_printable(byte)){
-                // print_byte(byte);
-                buffer << byte;
-                state = strings_state::printable;
-                continue;
+            if(this->size() == 0 && this->fill(m_buffer.size()) == 0) { break; }
+            auto k = static_cast<std::size_t>(std::min<std::uint64_t>(n - done, this->size()));
+            this->consume(k);
+            done += k;
+        }
+        return done;
+    }
+};
+
+/** @brief Apply a window kernel to a whole stream.
+ *
+ *  The kernel is invoked as fn(data, end, limit, base): it owns the
+ *  positions [0, end) of the window and may read up to data[limit - 1]
+ *  so that items (patterns, records) crossing a window boundary are
+ *  seen once. The last 'overlap' bytes of each window are presented
+ *  again at the start of the next one. The first byte of the window is
+ *  at offset 'base' of the input.
+ */
+template<typename Kernel>
+void scan_stream(StreamReader& in, std::size_t overlap, Kernel&& fn)
+{
+    if(overlap >= in.capacity() / 2) {
+        throw std::runtime_error("Error: pattern or window too large for stream input");
+    }
+    for(;;)
+    {
+        std::size_t n = in.fill(in.capacity());
+        if(n == 0) { break; }
+        std::size_t end = in.eof() ? n : n - overlap;
+        fn(in.data(), end, n, in.offset());
+        in.consume(end);
+        if(in.eof()) { break; }
+    }
+}
+
+/** @brief Buffered writer on top of a raw file descriptor.
+ *
+ *  Avoids iostream formatting overhead for bulk output; data is flushed
+ *  with write(2) whenever the buffer fills up and on destruction.
+ */
+class OutputBuffer
+{
+    int               m_fd;
+    std::vector<char> m_buffer;
+    std::size_t       m_pos = 0;
+public:
+
+    explicit OutputBuffer(int fd = STDOUT_FILENO, std::size_t capacity = 1 << 20)
+        : m_fd(fd), m_buffer(capacity)
+    { }
+
+    ~OutputBuffer() { this->flush(); }
+
+    OutputBuffer(OutputBuffer const&) = delete;
+    OutputBuffer& operator=(OutputBuffer const&) = delete;
+
+    /// Reserve at least n contiguous bytes and return a pointer to them.
+    /// The caller must report how many bytes were used with commit().
+    char* reserve(std::size_t n)
+    {
+        if(m_pos + n > m_buffer.size()) {
+            this->flush();
+            if(n > m_buffer.size()) { m_buffer.resize(n); }
+        }
+        return m_buffer.data() + m_pos;
+    }
+
+    void commit(std::size_t n) { m_pos += n; }
+
+    void write(const char* data, std::size_t n)
+    {
+        std::memcpy(this->reserve(n), data, n);
+        m_pos += n;
+    }
+
+    void write(std::string_view s) { this->write(s.data(), s.size()); }
+
+    void put(char ch)
+    {
+        *this->reserve(1) = ch;
+        m_pos += 1;
+    }
+
+    void flush()
+    {
+        stats::ScopedPhase timer(stats::phase::output);
+        std::size_t done = 0;
+        while(done < m_pos)
+        {
+            auto n = ::write(m_fd, m_buffer.data() + done, m_pos - done);
+            stats::add(stats::counter::syscalls);
+            if(n < 0 && errno == EINTR) { continue; }
+            // Reader went away (for instance: hextool ... | head).
+            if(n <= 0) { break; }
+            done += static_cast<std::size_t>(n);
+        }
+        stats::add(stats::counter::bytes_written, done);
+        m_pos = 0;
+    }
+};
+
+/// Lookup tables used for fast formatting of binary data.
+namespace tables
+{
+    constexpr char hex_digits[] = "0123456789abcdef";
+
+    /// Two lowercase hexadecimal digits for every byte value.
+    constexpr auto hex_pairs = []
+    {
+        std::array<std::array<char, 2>, 256> t{};
+        for(int i = 0; i < 256; i++) {
+            t[i][0] = hex_digits[i >> 4];
+            t[i][1] = hex_digits[i & 0xF];
+        }
+        return t;
+    }();
+
+    /// Cells "xx  " (hex pair followed by blanks) for every byte value.
+    constexpr auto hex_cells = []
+    {
+        std::array<std::array<char, 4>, 256> t{};
+        for(int i = 0; i < 256; i++) {
+            t[i] = { hex_digits[i >> 4], hex_digits[i & 0xF], ' ', ' ' };
+        }
+        return t;
+    }();
+
+    /// True for printable ASCII characters (blank included).
+    constexpr auto printable = []
+    {
+        std::array<bool, 256> t{};
+        for(int i = 0x20; i < 0x7F; i++) { t[i] = true; }
+        return t;
+    }();
+
+    /// Printable ASCII character for every byte value, '.' otherwise.
+    constexpr auto ascii = []
+    {
+        std::array<char, 256> t{};
+        for(int i = 0; i < 256; i++) {
+            t[i] = (i >= 0x20 && i < 0x7F) ? static_cast<char>(i) : '.';
+        }
+        return t;
+    }();
+} // * --- End of namespace tables --- * //
+
+/// Write a zero-padded hexadecimal offset with 'width' digits (width is even).
+inline char* format_offset(char* out, std::uint64_t offset, int width)
+{
+    for(int i = width - 2; i >= 0; i -= 2)
+    {
+        auto const& p = tables::hex_pairs[offset & 0xFF];
+        out[i]     = p[0];
+        out[i + 1] = p[1];
+        offset >>= 8;
+    }
+    return out + width;
+}
+
+/** @brief Canonical hexdump (offset | hex | ASCII) of a memory region.
+ *
+ *  Output layout is the same as 'hexdump -C', 16 bytes per row:
+ *  @code
+ *   00000000  4d 5a 90 00 03 00 00 00  04 00 00 00 ff ff 00 00  |MZ..............|
+ *  @endcode
+ *
+ *  @param out         - Output buffer.
+ *  @param data        - Pointer to the first byte to be displayed.
+ *  @param size        - Number of bytes to be displayed.
+ *  @param base_offset - Offset of the first byte (shown in the first column).
+ */
+void dump_hex_canonical(OutputBuffer& out, const std::uint8_t* data
+                        , std::size_t size, std::uint64_t base_offset)
+{
+    constexpr std::size_t row_bytes = 16;
+    // Row: offset + 2 spaces + 16 * 3 + 1 extra space + " |" + 16 + "|\n"
+    constexpr std::size_t row_max   = 16 + 2 + row_bytes * 3 + 1 + 2 + row_bytes + 2;
+
+    const int width = (base_offset + size) > 0xFFFFFFFFULL ? 16 : 8;
+
+    for(std::size_t pos = 0; pos < size; pos += row_bytes)
+    {
+        std::size_t n = std::min(row_bytes, size - pos);
+        const std::uint8_t* row = data + pos;
+
+        char* line = out.reserve(row_max);
+        char* p = format_offset(line, base_offset + pos, width);
+        *p++ = ' ';
+        *p++ = ' ';
+
+        if(n == row_bytes)
+        {
+            // Full row: one 4 bytes store per byte, the 4th byte (blank) is
+            // overwritten by the next cell.
+            for(std::size_t i = 0; i < 8; i++, p += 3) {
+                std::memcpy(p, tables::hex_cells[row[i]].data(), 4);
+            }
+            *p++ = ' ';
+            for(std::size_t i = 8; i < 16; i++, p += 3) {
+                std::memcpy(p, tables::hex_cells[row[i]].data(), 4);
+            }
+        } else
+        {
+            for(std::size_t i = 0; i < row_bytes; i++, p += 3)
+            {
+                if(i == 8) { *p++ = ' '; }
+                if(i < n) {
+                    std::memcpy(p, tables::hex_cells[row[i]].data(), 3);
+                } else {
+                    std::memset(p, ' ', 3);
+                }
             }
-            state = strings_state::skip;
-            continue;
         }
 
-        if(state == strings_state::printable)
+        *p++ = ' ';
+        *p++ = '|';
+        for(std::size_t i = 0; i < n; i++) { *p++ = tables::ascii[row[i]]; }
+        *p++ = '|';
+        *p++ = '\n';
+
+        out.commit(static_cast<std::size_t>(p - line));
+    }
+}
+
+/** @brief Extract runs of printable characters from consecutive blocks.
+ *
+ *  The pending run is carried from one block to the next, so the input
+ *  can be either a whole memory mapped file or the windows of a stream.
+ */
+class StringsExtractor
+{
+    OutputBuffer&     m_out;
+    std::size_t       m_min_length;
+    std::vector<char> m_run;
+public:
+
+    StringsExtractor(OutputBuffer& out, std::size_t min_length)
+        : m_out(out), m_min_length(std::max<std::size_t>(min_length, 1))
+    { }
+
+    void feed(const std::uint8_t* data, std::size_t size)
+    {
+        std::size_t pos = 0;
+        while(pos < size)
         {
-            ifs >> byte;
-            if(is_printable(byte)){
-                // print_byte(byte);
-                buffer << byte;
-                state = strings_state::printable;
-                continue;
+            std::size_t first = pos;
+            while(pos < size && tables::printable[data[pos]]) { pos++; }
+            if(pos == size) {
+                // The run may continue in the next block.
+                m_run.insert(m_run.end(), data + first, data + pos);
+                break;
             }
+            this->emit(data + first, pos - first);
+            while(pos < size && !tables::printable[data[pos]]) { pos++; }
+        }
+    }
 
-            if(buffer.str().size() >= 3)
-                std::cout << buffer.str() << std::endl;
+    /// Flush the run at end of input.
+    void finish() { this->emit(nullptr, 0); }
 
-            buffer.str(""); // Reset buffer
-            state = strings_state::skip;
-            continue;
+private:
+
+    void emit(const std::uint8_t* data, std::size_t n)
+    {
+        if(m_run.size() + n >= m_min_length)
+        {
+            m_out.write(m_run.data(), m_run.size());
+            m_out.write(reinterpret_cast<const char*>(data), n);
+            m_out.put('\n');
         }
+        m_run.clear();
+    }
+};
+
+/// Dump all printable characters for a binary file
+void command_strings(std::string const& file)
+{
+    OutputBuffer out;
+    StringsExtractor extractor(out, 3);
 
+    if(is_stream_input(file))
+    {
+        StreamReader in(file);
+        while(in.fill(in.capacity()) > 0)
+        {
+            extractor.feed(in.data(), in.size());
+            in.consume(in.size());
+        }
+    } else
+    {
+        auto fmap = MappedFile(file);
+        fmap.advise(MADV_SEQUENTIAL);
+        extractor.feed(fmap.data(), fmap.size());
     }
+    extractor.finish();
 }
 
 
@@ -147,143 +585,3952 @@ enum class data_type
     , t_flt64,
 };
 
-template<typename T>
-void dump_binary_t(std::string const& file, size_t size,  long offset)
+/// Byte order of multi-byte values stored in a binary file.
+enum class byte_order
 {
-    auto ifs = open_binary_file(file);
-    if(offset > 0){ ifs.seekg(offset); }
+      little
+    , big
+};
+
+/** @brief Parse data type name (or legacy numeric code) used by --type
+ *
+ *  Accepted names: byte, char, i8, i16, i32, i64, u8, u16, u32, u64,
+ *  f32 (flt32), f64 (flt64). Numeric codes follow the declaration
+ *  order of data_type, so that old invocations such as '--type 3' still work.
+ */
+auto parse_data_type(std::string const& name) -> data_type
+{
+    using namespace std::string_literals;
 
-    std::vector<T> arr(size);
-    ifs.read(reinterpret_cast<char*>(arr.data()), arr.size() * sizeof(T));
+    static const std::map<std::string, data_type> names = {
+          {"byte", data_type::t_byte},  {"char", data_type::t_char}
+        , {"i8",   data_type::t_i8},    {"i16",  data_type::t_i16}
+        , {"i32",  data_type::t_i32},   {"i64",  data_type::t_i64}
+        , {"u8",   data_type::t_u8},    {"u16",  data_type::t_u16}
+        , {"u32",  data_type::t_u32},   {"u64",  data_type::t_u64}
+        , {"f32",  data_type::t_flt32}, {"flt32", data_type::t_flt32}
+        , {"f64",  data_type::t_flt64}, {"flt64", data_type::t_flt64}
+    };
 
-    std::cout << "\n";
+    auto it = names.find(name);
+    if(it != names.end()) { return it->second; }
 
-    if constexpr (std::is_same<T, char>::value)
+    int code = -1;
+    auto [ptr, ec] = std::from_chars(name.data(), name.data() + name.size(), code);
+    if(ec == std::errc() && ptr == name.data() + name.size()
+       && code >= 0 && code <= static_cast<int>(data_type::t_flt64))
     {
-        size_t count = 0;
+        return static_cast<data_type>(code);
+    }
+    throw std::runtime_error("Error: invalid data type: "s + name);
+}
 
-        for(const auto& ch: arr)
-        {
-            if(count == 15){
-                count = 0;
-                std::cout << "\n";
-            } else {
-                count++;
-            }
+auto parse_byte_order(std::string const& name) -> byte_order
+{
+    using namespace std::string_literals;
+    if(name == "little" || name == "le") { return byte_order::little; }
+    if(name == "big"    || name == "be") { return byte_order::big;    }
+    throw std::runtime_error("Error: invalid byte order: "s + name);
+}
 
-            if(ch == '\r'){
-                std::cout <<  "\\r";
-                continue;
-            }
-            if(ch == '\n'){
-                std::cout << "\\n";
-                continue;
-            }
-            if(ch == '\t'){
-                std::cout << "\\t";
-                continue;
-            }
+/// Reverse the byte order of an arithmetic value.
+template<typename T>
+auto byte_swap(T value) -> T
+{
+    static_assert(std::is_arithmetic<T>::value, "Arithmetic type required");
 
-            if(std::isprint(ch))
-                std::cout << std::setfill(' ') << std::setw(3) << ch;
-            else
-                std::cout << std::setfill(' ') << std::setw(3)
-                          << " " << "\\x" << std::hex << std::setw(2) << std::setfill('0')
-                          << (0xFF & static_cast<int>(ch))
-                          << std::dec;
-        }
+    if constexpr (sizeof(T) == 1) {
+        return value;
+    } else {
+        using U = std::conditional_t<sizeof(T) == 2, std::uint16_t
+                , std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>>;
+        U bits;
+        std::memcpy(&bits, &value, sizeof(T));
+        if constexpr (sizeof(T) == 2) bits = __builtin_bswap16(bits);
+        if constexpr (sizeof(T) == 4) bits = __builtin_bswap32(bits);
+        if constexpr (sizeof(T) == 8) bits = __builtin_bswap64(bits);
+        std::memcpy(&value, &bits, sizeof(T));
+        return value;
+    }
+}
+
+/// Load a value T from a possibly unaligned address with a given byte order.
+template<typename T>
+auto load_value(const std::uint8_t* p, byte_order order) -> T
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    constexpr auto native = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+                          ? byte_order::little : byte_order::big;
+    return order == native ? value : byte_swap(value);
+}
 
+/// Store a value T at a possibly unaligned address in little-endian order.
+template<typename T>
+void store_le(void* p, T value)
+{
+    if constexpr (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__) { value = byte_swap(value); }
+    std::memcpy(p, &value, sizeof(T));
+}
 
-    } else if constexpr (std::is_same<T, std::uint8_t>::value)
+/** @brief Format an array of values of type T held in memory.
+ *
+ *  The type std::byte selects the canonical hexdump layout.
+ *
+ *  @param data   - Pointer to the first element.
+ *  @param count  - Number of elements.
+ *  @param start  - Offset in the file of the first element.
+ *  @param order  - Byte order of multi-byte values.
+ *  @param width  - Number of digits of the offset column.
+ */
+template<typename T>
+void dump_values(OutputBuffer& out, const std::uint8_t* data, std::size_t count
+                 , std::uint64_t start, byte_order order, int width)
+{
+    if constexpr (std::is_same<T, std::byte>::value)
     {
-        std::cout << std::hex << std::uppercase;
-
-        size_t count = 0;
+        dump_hex_canonical(out, data, count, start);
+    }
+    else if constexpr (std::is_same<T, char>::value)
+    {
+        // Every character is displayed in a 4 columns cell (plus a blank
+        // separator), 16 cells per row.
+        constexpr std::size_t row_cells = 16;
 
-        for(auto const& x: arr){
-            std::cout << std::setfill('0') << std::setw(2)
-                      << static_cast<int>(x) << " ";
-            if(count == 15){
-                count = 0;
-                std::cout << "\n";
-                continue;
+        for(std::size_t pos = 0; pos < count; pos += row_cells)
+        {
+            std::size_t n = std::min(row_cells, count - pos);
+            char* line = out.reserve(16 + 2 + row_cells * 5 + 1);
+            char* p = format_offset(line, start + pos, width);
+            *p++ = ' ';
+            for(std::size_t i = 0; i < n; i++, p += 4)
+            {
+                auto ch = data[pos + i];
+                *p++ = ' ';
+                p[0] = ' '; p[1] = ' '; p[2] = ' ';
+                if(ch == '\r' || ch == '\n' || ch == '\t') {
+                    p[2] = '\\';
+                    p[3] = ch == '\r' ? 'r' : (ch == '\n' ? 'n' : 't');
+                } else if(ch >= 0x20 && ch < 0x7F) {
+                    p[3] = static_cast<char>(ch);
+                } else {
+                    p[0] = '\\';
+                    p[1] = 'x';
+                    p[2] = tables::hex_pairs[ch][0];
+                    p[3] = tables::hex_pairs[ch][1];
+                }
             }
-            count++;
+            *p++ = '\n';
+            out.commit(static_cast<std::size_t>(p - line));
         }
-        std::cout << "\n";
-    } else {
+    }
+    else
+    {
+        // Numeric values: offset of first value followed by 8 values per row.
+        constexpr std::size_t row_values = 8;
+        constexpr std::size_t cell_width = std::is_floating_point<T>::value
+                                         ? 26 : std::numeric_limits<T>::digits10 + 3;
 
-        for(auto const& x: arr)
-            std::cout << x << " ";
-        std::cout << "\n";
+        for(std::size_t pos = 0; pos < count; pos += row_values)
+        {
+            std::size_t n = std::min(row_values, count - pos);
+            char* line = out.reserve(16 + 1 + row_values * (cell_width + 1) + 1);
+            char* p = format_offset(line, start + pos * sizeof(T), width);
+            *p++ = ':';
+
+            for(std::size_t i = 0; i < n; i++)
+            {
+                char cell[cell_width];
+                T value = load_value<T>(data + (pos + i) * sizeof(T), order);
+                auto res = std::to_chars(cell, cell + cell_width, value);
+                auto len = static_cast<std::size_t>(res.ptr - cell);
+                // Right-align values so that columns line up.
+                std::size_t pad = len < cell_width ? cell_width - len : 0;
+                std::memset(p, ' ', pad + 1);
+                std::memcpy(p + pad + 1, cell, len);
+                p += pad + 1 + len;
+            }
+            *p++ = '\n';
+            out.commit(static_cast<std::size_t>(p - line));
+        }
     }
 }
 
-void dump_binary(std::string const& file, data_type type, size_t size,  long offset)
+/** @brief Dump an array of values of type T stored in a file.
+ *
+ *  Regular files are memory mapped, other inputs (stdin as '-', pipes,
+ *  devices) are read sequentially and the bytes before the offset are
+ *  discarded.
+ *
+ *  @param file   - Binary file to be read.
+ *  @param size   - Number of elements; 0 means up to the end of file.
+ *  @param offset - Offset in bytes of the first element.
+ *  @param order  - Byte order of multi-byte values.
+ */
+template<typename T>
+void dump_binary_t(std::string const& file, size_t size,  long offset
+                   , byte_order order = byte_order::little)
 {
-    if(type == data_type::t_char)
-        dump_binary_t<char>(file, size, offset);
+    auto start = static_cast<std::size_t>(std::max(offset, 0L));
+    OutputBuffer out;
+
+    if(is_stream_input(file))
+    {
+        // Blocks of whole elements (a multiple of the 16 bytes row).
+        constexpr std::size_t block = std::size_t{1} << 16;
+        StreamReader in(file, block * sizeof(T));
+        if(in.skip(start) < start) {
+            throw std::runtime_error("Error: offset beyond end of file");
+        }
+        std::size_t remaining = (size == 0) ? std::numeric_limits<std::size_t>::max() : size;
+        while(remaining > 0)
+        {
+            std::size_t n = std::min(in.fill(in.capacity()) / sizeof(T), remaining);
+            if(n == 0) { break; }
+            std::uint64_t base = in.offset();
+            // Offsets widen after 4 GB; the total size is not known in advance.
+            const int width = (base + n * sizeof(T)) > 0xFFFFFFFFULL ? 16 : 8;
+            dump_values<T>(out, in.data(), n, base, order, width);
+            in.consume(n * sizeof(T));
+            remaining -= n;
+        }
+        return;
+    }
 
-    if(type == data_type::t_byte)
-        dump_binary_t<uint8_t>(file, size, offset);
+    auto fmap = MappedFile(file);
+    if(start > fmap.size()) {
+        throw std::runtime_error("Error: offset beyond end of file");
+    }
+
+    std::size_t available = (fmap.size() - start) / sizeof(T);
+    std::size_t count = (size == 0) ? available : std::min(size, available);
+    const int width = (start + count * sizeof(T)) > 0xFFFFFFFFULL ? 16 : 8;
 
-    if(type == data_type::t_i16)
-        dump_binary_t<uint16_t>(file, size, offset);
+    fmap.advise(MADV_SEQUENTIAL);
+    dump_values<T>(out, fmap.data() + start, count, start, order, width);
 }
 
-int main(int argc, char** argv)
+void dump_binary(std::string const& file, data_type type, size_t size,  long offset
+                 , byte_order order = byte_order::little)
 {
-    CLI::App app{ "hextool - Tool for analysis of binary files"};
-    //app.footer("\n Creator: Somebody else.");
+    switch(type)
+    {
+    case data_type::t_byte:  dump_binary_t<std::byte>(file, size, offset, order);     break;
+    case data_type::t_char:  dump_binary_t<char>(file, size, offset, order);          break;
+    case data_type::t_i8:    dump_binary_t<std::int8_t>(file, size, offset, order);   break;
+    case data_type::t_i16:   dump_binary_t<std::int16_t>(file, size, offset, order);  break;
+    case data_type::t_i32:   dump_binary_t<std::int32_t>(file, size, offset, order);  break;
+    case data_type::t_i64:   dump_binary_t<std::int64_t>(file, size, offset, order);  break;
+    case data_type::t_u8:    dump_binary_t<std::uint8_t>(file, size, offset, order);  break;
+    case data_type::t_u16:   dump_binary_t<std::uint16_t>(file, size, offset, order); break;
+    case data_type::t_u32:   dump_binary_t<std::uint32_t>(file, size, offset, order); break;
+    case data_type::t_u64:   dump_binary_t<std::uint64_t>(file, size, offset, order); break;
+    case data_type::t_flt32: dump_binary_t<float>(file, size, offset, order);         break;
+    case data_type::t_flt64: dump_binary_t<double>(file, size, offset, order);        break;
+    }
+}
 
-     // Dump printable characters of a binary file
-    auto cmd_strings = app.add_subcommand("dump-strings",
-                                          "Dump all printable strings of a binary file");
+//------------------------------------------------------------------//
+//         Parallel processing of file chunks                       //
+//------------------------------------------------------------------//
 
-    std::string file;
-    cmd_strings->add_option("<FILE>", file)->required();
+/** @brief Process chunks in parallel and consume their results in order.
+ *
+ *  Worker threads call 'work(chunk_index)' and the calling thread
+ *  receives the results through 'emit(result)' in chunk order. At most
+ *  4 * jobs results are kept in flight, so memory usage does not depend
+ *  on the number of chunks.
+ *
+ *  @tparam Result - Value returned by the work function.
+ */
+template<typename Result, typename Work, typename Emit>
+void process_chunks_ordered(std::size_t nchunks, unsigned jobs, Work&& work, Emit&& emit)
+{
+    if(jobs <= 1 || nchunks <= 1)
+    {
+        for(std::size_t i = 0; i < nchunks; i++) {
+            Result r = work(i);
+            emit(r);
+        }
+        return;
+    }
 
-    auto cmd_dump = app.add_subcommand("dump-bytes"
-                                       , "Read binary file at some offset");
+    const std::size_t window = 4 * static_cast<std::size_t>(jobs);
+    std::vector<std::optional<Result>> slots(window);
+    std::mutex              mtx;
+    std::condition_variable cv;
+    std::size_t next_chunk   = 0;  // Next chunk to be taken by a worker
+    std::size_t next_emitted = 0;  // Next chunk to be consumed in order
+    std::exception_ptr error   = nullptr;
 
-    cmd_dump->add_option("<FILE>", file)->required();
+    auto worker = [&]
+    {
+        for(;;)
+        {
+            std::size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]{ return error || next_chunk >= nchunks
+                                       || next_chunk < next_emitted + window; });
+                if(error || next_chunk >= nchunks) { return; }
+                index = next_chunk++;
+            }
+            try {
+                Result r = work(index);
+                std::lock_guard<std::mutex> lock(mtx);
+                slots[index % window] = std::move(r);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(!error) { error = std::current_exception(); }
+            }
+            cv.notify_all();
+        }
+    };
 
-    long offset = -1;
-    cmd_dump->add_option("--offset", offset);
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < jobs; i++) { threads.emplace_back(worker); }
 
-    size_t size = 1;
-    cmd_dump->add_option("--size", size);
+    for(std::size_t i = 0; i < nchunks; i++)
+    {
+        std::optional<Result> r;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]{ return error || slots[i % window].has_value(); });
+            if(error) { break; }
+            r.swap(slots[i % window]);
+            next_emitted = i + 1;
+        }
+        cv.notify_all();
+        // The workers must be stopped and joined before an error in emit
+        // leaves this function.
+        try {
+            emit(*r);
+        } catch(...) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(!error) { error = std::current_exception(); }
+            }
+            cv.notify_all();
+            break;
+        }
+    }
 
-    data_type dtype = data_type::t_byte;
-    cmd_dump->add_set("--type", dtype,
-                      {data_type::t_char, data_type::t_byte, data_type::t_i16}
-                      ,"Set display type => char (0), byte (1), i16 (3)" );
+    for(auto& t: threads) { t.join(); }
+    if(error) { std::rethrow_exception(error); }
+}
 
-    // ----- Parse Arguments ---------//
-    try {
-        app.require_subcommand();
-        app.validate_positionals();
-        CLI11_PARSE(app, argc, argv);
-    } catch (std::exception& ex) {
-        std::cout << ex.what() << std::endl;
-        return EXIT_FAILURE;
-    }
+/// Number of worker threads requested by a -j option, 0 => all cores.
+inline unsigned resolve_jobs(unsigned jobs)
+{
+    if(jobs != 0) { return jobs; }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
 
-    //------ Program Actions ---------//
+//------------------------------------------------------------------//
+//         Binary pattern search                                    //
+//------------------------------------------------------------------//
 
-    if(*cmd_strings)
-    {
-        std::cout << " Selected file: " << file << "\n";
-        command_strings(file);
+/** @brief Byte pattern with wildcards.
+ *
+ *  A byte 'b' at position i matches when (b & mask[i]) == value[i], so
+ *  that '??' is encoded as mask 0x00 and a nibble wildcard such as '4?'
+ *  as mask 0xF0.
+ */
+struct BytePattern
+{
+    std::string               text;
+    std::vector<std::uint8_t> value;
+    std::vector<std::uint8_t> mask;
+    // Positions of the two anchor bytes used by the SIMD prefilter.
+    std::size_t               anchor1 = 0;
+    std::size_t               anchor2 = 0;
 
-        return EXIT_SUCCESS;
+    std::size_t size() const { return value.size(); }
+
+    bool match_at(const std::uint8_t* p) const
+    {
+        for(std::size_t i = 0; i < value.size(); i++) {
+            if((p[i] & mask[i]) != value[i]) { return false; }
+        }
+        return true;
     }
+};
 
-    if(*cmd_dump)
+/** Approximate frequency rank of byte values in typical binary files
+ *  (executables, disk images, documents). Higher => more common. */
+constexpr auto byte_frequency_rank = []
+{
+    std::array<std::uint8_t, 256> t{};
+    for(int b = 0; b < 256; b++)
     {
-        dump_binary(file, dtype, size, offset);
+        std::uint8_t r = 40;
+        if(b >= 0x01 && b <= 0x0F)  { r = 90;  }
+        if(b >= '0'  && b <= '9')   { r = 110; }
+        if(b >= 'A'  && b <= 'Z')   { r = 100; }
+        if(b >= 'a'  && b <= 'z')   { r = 140; }
+        if(b == 'e'  || b == 't' || b == 'a' || b == 'o' || b == 'i' || b == 'n')  { r = 170; }
+        // Frequent x86-64 opcodes and ModRM bytes
+        if(b == 0x48 || b == 0x89 || b == 0x8B || b == 0xE8 || b == 0x24 || b == 0x44) { r = 150; }
+        if(b == 0x20 || b == 0x0A) { r = 190; }
+        if(b == 0xFF) { r = 220; }
+        if(b == 0x00) { r = 255; }
+        t[b] = r;
+    }
+    return t;
+}();
+
+/** @brief Parse a hexadecimal byte pattern.
+ *
+ *  Bytes are written as two hexadecimal digits, separated or not by
+ *  blanks: "4D 5A ?? ?? 50 45", "4D5A????5045". A question mark replaces
+ *  a nibble ('4?', '?D') and '??' (or a lone '?') matches any byte.
+ */
+auto parse_byte_pattern(std::string const& text) -> BytePattern
+{
+    using namespace std::string_literals;
+
+    BytePattern pat;
+    pat.text = text;
+
+    auto nibble = [&](char ch, std::uint8_t& val, std::uint8_t& msk) -> bool
+    {
+        if(ch == '?') { val = 0; msk = 0; return true; }
+        if(ch >= '0' && ch <= '9') { val = ch - '0';      msk = 0xF; return true; }
+        if(ch >= 'a' && ch <= 'f') { val = ch - 'a' + 10; msk = 0xF; return true; }
+        if(ch >= 'A' && ch <= 'F') { val = ch - 'A' + 10; msk = 0xF; return true; }
+        return false;
+    };
+
+    std::size_t i = 0;
+    while(i < text.size())
+    {
+        if(std::isspace(static_cast<unsigned char>(text[i])) || text[i] == ',') { i++; continue; }
+
+        std::uint8_t hv, hm, lv, lm;
+        if(!nibble(text[i], hv, hm)) {
+            throw std::runtime_error("Error: invalid character in pattern: "s + text);
+        }
+        bool lone = i + 1 >= text.size()
+                 || std::isspace(static_cast<unsigned char>(text[i + 1])) || text[i + 1] == ',';
+        if(lone && text[i] == '?') {
+            pat.value.push_back(0);
+            pat.mask.push_back(0);
+            i += 1;
+            continue;
+        }
+        if(lone || !nibble(text[i + 1], lv, lm)) {
+            throw std::runtime_error("Error: incomplete byte in pattern: "s + text);
+        }
+        pat.value.push_back(static_cast<std::uint8_t>(hv << 4 | lv));
+        pat.mask.push_back(static_cast<std::uint8_t>(hm << 4 | lm));
+        i += 2;
+    }
+
+    if(pat.value.empty()) {
+        throw std::runtime_error("Error: empty pattern");
+    }
+
+    // Select the two rarest positions with fixed bits as prefilter anchors.
+    // Fully fixed bytes are preferred over nibble wildcards.
+    auto score = [&](std::size_t k) -> int
+    {
+        if(pat.mask[k] == 0x00) { return -1; }
+        int s = 256 - byte_frequency_rank[pat.value[k]];
+        return pat.mask[k] == 0xFF ? s + 256 : s;
+    };
+    std::vector<std::size_t> order(pat.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end()
+                     , [&](std::size_t a, std::size_t b){ return score(a) > score(b); });
+
+    if(score(order[0]) < 0) {
+        throw std::runtime_error("Error: pattern has no fixed bits: "s + text);
+    }
+    pat.anchor1 = order[0];
+    pat.anchor2 = (order.size() > 1 && score(order[1]) >= 0) ? order[1] : order[0];
+    return pat;
+}
+
+/** @brief Read patterns from a file, one per line.
+ *  Empty lines and lines starting with '#' are ignored. */
+auto read_pattern_file(std::string const& file) -> std::vector<BytePattern>
+{
+    using namespace std::string_literals;
+
+    auto ifs = std::ifstream(file);
+    if(!ifs) {
+        throw std::runtime_error("Error: Unable to open file: "s + file);
+    }
+    std::vector<BytePattern> patterns;
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        auto first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#') { continue; }
+        auto last = line.find_last_not_of(" \t\r");
+        patterns.push_back(parse_byte_pattern(line.substr(first, last - first + 1)));
+    }
+    return patterns;
+}
+
+namespace simd
+{
+#if defined(__x86_64__) || defined(__i386__)
+    inline bool has_avx2()
+    {
+        static const bool flag = __builtin_cpu_supports("avx2");
+        return flag;
+    }
+
+    inline bool has_ssse3()
+    {
+        static const bool flag = __builtin_cpu_supports("ssse3");
+        return flag;
+    }
+
+    /// Candidate positions in [begin, end) whose anchor bytes match, 16 per step.
+    template<typename Callback>
+    std::size_t prefilter_sse2(BytePattern const& pat, const std::uint8_t* data
+                               , std::size_t begin, std::size_t end, Callback&& on_candidate)
+    {
+        const __m128i v1 = _mm_set1_epi8(static_cast<char>(pat.value[pat.anchor1]));
+        const __m128i m1 = _mm_set1_epi8(static_cast<char>(pat.mask[pat.anchor1]));
+        const __m128i v2 = _mm_set1_epi8(static_cast<char>(pat.value[pat.anchor2]));
+        const __m128i m2 = _mm_set1_epi8(static_cast<char>(pat.mask[pat.anchor2]));
+        const std::uint8_t* p1 = data + pat.anchor1;
+        const std::uint8_t* p2 = data + pat.anchor2;
+
+        std::size_t i = begin;
+        for(; i + 16 <= end; i += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1 + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p2 + i));
+            __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(a, m1), v1)
+                                      , _mm_cmpeq_epi8(_mm_and_si128(b, m2), v2));
+            auto bits = static_cast<unsigned>(_mm_movemask_epi8(eq));
+            while(bits != 0)
+            {
+                on_candidate(i + static_cast<std::size_t>(__builtin_ctz(bits)));
+                bits &= bits - 1;
+            }
+        }
+        return i;
+    }
+
+    /// Same as prefilter_sse2(), 32 positions per step.
+    template<typename Callback>
+    __attribute__((target("avx2")))
+    std::size_t prefilter_avx2(BytePattern const& pat, const std::uint8_t* data
+                               , std::size_t begin, std::size_t end, Callback&& on_candidate)
+    {
+        const __m256i v1 = _mm256_set1_epi8(static_cast<char>(pat.value[pat.anchor1]));
+        const __m256i m1 = _mm256_set1_epi8(static_cast<char>(pat.mask[pat.anchor1]));
+        const __m256i v2 = _mm256_set1_epi8(static_cast<char>(pat.value[pat.anchor2]));
+        const __m256i m2 = _mm256_set1_epi8(static_cast<char>(pat.mask[pat.anchor2]));
+        const std::uint8_t* p1 = data + pat.anchor1;
+        const std::uint8_t* p2 = data + pat.anchor2;
+
+        std::size_t i = begin;
+        for(; i + 32 <= end; i += 32)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1 + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p2 + i));
+            __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(a, m1), v1)
+                                         , _mm256_cmpeq_epi8(_mm256_and_si256(b, m2), v2));
+            auto bits = static_cast<unsigned>(_mm256_movemask_epi8(eq));
+            while(bits != 0)
+            {
+                on_candidate(i + static_cast<std::size_t>(__builtin_ctz(bits)));
+                bits &= bits - 1;
+            }
+        }
+        return i;
+    }
+#endif
+} // * --- End of namespace simd --- * //
+
+/** @brief Find all occurrences of a pattern starting in [begin, end).
+ *
+ *  The buffer 'data' must be readable up to 'limit' bytes, a match
+ *  starting at i is only reported if i + pattern size <= limit. Hence a
+ *  chunk of a larger buffer can be scanned with begin/end set to the
+ *  chunk boundaries and limit set to the buffer size: matches crossing
+ *  the chunk end are still found, and reported by exactly one chunk.
+ */
+template<typename Callback>
+void scan_pattern(BytePattern const& pat, const std::uint8_t* data
+                  , std::size_t begin, std::size_t end, std::size_t limit
+                  , Callback&& on_match)
+{
+    if(pat.size() > limit) { return; }
+    end = std::min(end, limit - pat.size() + 1);
+    if(begin >= end) { return; }
+
+    auto verify = [&](std::size_t pos)
+    {
+        if(pat.match_at(data + pos)) { on_match(pos); }
+    };
+
+    std::size_t i = begin;
+#if defined(__x86_64__) || defined(__i386__)
+    // Vector loads read anchor bytes up to 'i + anchor + width', which
+    // stay within the buffer because 'end' was clamped to limit - size + 1.
+    if(simd::has_avx2())
+        i = simd::prefilter_avx2(pat, data, i, end, verify);
+    i = simd::prefilter_sse2(pat, data, i, end, verify);
+#endif
+    for(; i < end; i++) { verify(i); }
+}
+
+/** @brief Search a binary file for one or more byte patterns.
+ *
+ *  @param file     - Binary file to be searched.
+ *  @param patterns - Patterns, see parse_byte_pattern().
+ *  @param jobs     - Number of threads scanning chunks in parallel.
+ */
+void command_find(std::string const& file, std::vector<BytePattern> const& patterns
+                  , unsigned jobs)
+{
+    constexpr std::size_t chunk_size = 4 << 20;
+
+    // (offset, pattern index)
+    using Matches = std::vector<std::pair<std::uint64_t, std::size_t>>;
+
+    auto find_range = [&](const std::uint8_t* data, std::size_t begin, std::size_t end
+                          , std::size_t limit, std::uint64_t base) -> Matches
+    {
+        Matches found;
+        // Patterns are scanned one after another over the same chunk,
+        // which is still in cache after the first pass.
+        for(std::size_t k = 0; k < patterns.size(); k++) {
+            scan_pattern(patterns[k], data, begin, end, limit
+                         , [&](std::size_t pos){ found.emplace_back(base + pos, k); });
+        }
+        if(patterns.size() > 1) { std::sort(found.begin(), found.end()); }
+        return found;
+    };
+
+    OutputBuffer out;
+    std::size_t count = 0;
+
+    auto emit = [&](Matches const& found)
+    {
+        for(auto const& [pos, k]: found)
+        {
+            char* line = out.reserve(64 + patterns[k].text.size());
+            char* p = line;
+            *p++ = '0';
+            *p++ = 'x';
+            p = format_offset(p, pos, 16);
+            *p++ = ' ';
+            p = std::to_chars(p, p + 24, pos).ptr;
+            *p++ = ' ';
+            std::memcpy(p, patterns[k].text.data(), patterns[k].text.size());
+            p += patterns[k].text.size();
+            *p++ = '\n';
+            out.commit(static_cast<std::size_t>(p - line));
+        }
+        count += found.size();
+        stats::add(stats::counter::matches, found.size());
+    };
+
+    if(is_stream_input(file))
+    {
+        // Matches crossing a window boundary are found in the next window.
+        std::size_t longest = 1;
+        for(auto const& pat: patterns) { longest = std::max(longest, pat.size()); }
+        StreamReader in(file, std::max(chunk_size, 4 * longest));
+        scan_stream(in, longest - 1, [&](const std::uint8_t* data, std::size_t end
+                                         , std::size_t limit, std::uint64_t base)
+        {
+            emit(find_range(data, 0, end, limit, base));
+        });
+    } else
+    {
+        auto fmap = MappedFile(file);
+        fmap.advise(MADV_SEQUENTIAL);
+        const std::uint8_t* data  = fmap.data();
+        const std::size_t   total = fmap.size();
+        const std::size_t nchunks = (total + chunk_size - 1) / chunk_size;
+
+        auto work = [&](std::size_t chunk) -> Matches
+        {
+            std::size_t begin = chunk * chunk_size;
+            return find_range(data, begin, std::min(begin + chunk_size, total), total, 0);
+        };
+        process_chunks_ordered<Matches>(nchunks, resolve_jobs(jobs), work, emit);
+    }
+    out.flush();
+    std::cerr << " [INFO] Matches found: " << count << "\n";
+}
+
+//------------------------------------------------------------------//
+//         Multi-pattern search                                     //
+//------------------------------------------------------------------//
+
+/** @brief Search many patterns in a single pass over a buffer.
+ *
+ *  Patterns are spread over 8 buckets. For the first two bytes of every
+ *  pattern, lookup tables indexed by nibble give the set of buckets
+ *  that may start at a position (same idea as the "Teddy" algorithm).
+ *  With SSSE3 the tables are applied to 16 positions at a time with
+ *  pshufb; only positions with a non-empty bucket set are verified.
+ */
+class MultiPatternScanner
+{
+    std::vector<BytePattern>              m_patterns;
+    std::array<std::vector<std::size_t>, 8> m_buckets;
+    // Bucket bits for byte 0 and byte 1, indexed by low / high nibble.
+    alignas(16) std::array<std::uint8_t, 16> m_lo0{}, m_hi0{}, m_lo1{}, m_hi1{};
+    // Same information indexed by full byte value for the scalar path.
+    std::array<std::uint8_t, 256> m_byte0{}, m_byte1{};
+    std::size_t m_min_size = 0;
+    std::size_t m_max_size = 0;
+
+public:
+
+    explicit MultiPatternScanner(std::vector<BytePattern> patterns)
+        : m_patterns(std::move(patterns))
+    {
+        m_min_size = std::numeric_limits<std::size_t>::max();
+        for(std::size_t k = 0; k < m_patterns.size(); k++)
+        {
+            auto const& pat = m_patterns[k];
+            auto bit = static_cast<std::uint8_t>(1u << (k % 8));
+            m_buckets[k % 8].push_back(k);
+            m_min_size = std::min(m_min_size, pat.size());
+            m_max_size = std::max(m_max_size, pat.size());
+
+            // Patterns of a single byte accept any second byte.
+            std::uint8_t v1 = pat.size() > 1 ? pat.value[1] : 0;
+            std::uint8_t k1 = pat.size() > 1 ? pat.mask[1]  : 0;
+
+            for(int n = 0; n < 16; n++)
+            {
+                if((n & (pat.mask[0] & 0xF)) == (pat.value[0] & 0xF)) m_lo0[n] |= bit;
+                if((n & (pat.mask[0] >> 4))  == (pat.value[0] >> 4))  m_hi0[n] |= bit;
+                if((n & (k1 & 0xF)) == (v1 & 0xF)) m_lo1[n] |= bit;
+                if((n & (k1 >> 4))  == (v1 >> 4))  m_hi1[n] |= bit;
+            }
+        }
+        for(int b = 0; b < 256; b++)
+        {
+            m_byte0[b] = m_lo0[b & 0xF] & m_hi0[b >> 4];
+            m_byte1[b] = m_lo1[b & 0xF] & m_hi1[b >> 4];
+        }
+    }
+
+    std::vector<BytePattern> const& patterns() const { return m_patterns; }
+    std::size_t max_size() const { return m_max_size; }
+
+    /** @brief Report all matches starting in [begin, end) as (position, pattern index).
+     *  Same buffer contract as scan_pattern(). Matches are reported in
+     *  increasing position order. */
+    template<typename Callback>
+    void scan(const std::uint8_t* data, std::size_t begin, std::size_t end
+              , std::size_t limit, Callback&& on_match) const
+    {
+        if(m_patterns.empty() || m_min_size > limit) { return; }
+        end = std::min(end, limit - m_min_size + 1);
+        if(begin >= end) { return; }
+
+        auto verify = [&](std::size_t pos, unsigned buckets)
+        {
+            while(buckets != 0)
+            {
+                unsigned b = static_cast<unsigned>(__builtin_ctz(buckets));
+                buckets &= buckets - 1;
+                for(auto k: m_buckets[b])
+                {
+                    auto const& pat = m_patterns[k];
+                    if(pos + pat.size() <= limit && pat.match_at(data + pos))
+                        on_match(pos, k);
+                }
+            }
+        };
+
+        std::size_t i = begin;
+#if defined(__x86_64__) || defined(__i386__)
+        // The second byte is loaded at i + 1, keep one byte of margin.
+        if(simd::has_ssse3() && end < limit)
+            i = this->scan_ssse3(data, i, end, verify);
+#endif
+        for(; i < end; i++)
+        {
+            unsigned buckets = m_byte0[data[i]];
+            // On the last byte only single byte patterns may match, which
+            // is checked by verify().
+            if(i + 1 < limit) { buckets &= m_byte1[data[i + 1]]; }
+            if(buckets != 0) { verify(i, buckets); }
+        }
+    }
+
+private:
+
+#if defined(__x86_64__) || defined(__i386__)
+    template<typename Verify>
+    __attribute__((target("ssse3")))
+    std::size_t scan_ssse3(const std::uint8_t* data, std::size_t begin, std::size_t end
+                           , Verify&& verify) const
+    {
+        const __m128i lo0 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_lo0.data()));
+        const __m128i hi0 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_hi0.data()));
+        const __m128i lo1 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_lo1.data()));
+        const __m128i hi1 = _mm_load_si128(reinterpret_cast<const __m128i*>(m_hi1.data()));
+        const __m128i nib = _mm_set1_epi8(0x0F);
+        const __m128i zero = _mm_setzero_si128();
+
+        std::size_t i = begin;
+        // Loads of byte 1 read up to i + 16, which is <= end < limit.
+        for(; i + 16 <= end; i += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+            __m128i ca = _mm_and_si128(_mm_shuffle_epi8(lo0, _mm_and_si128(a, nib))
+                                      , _mm_shuffle_epi8(hi0, _mm_and_si128(_mm_srli_epi16(a, 4), nib)));
+            __m128i cb = _mm_and_si128(_mm_shuffle_epi8(lo1, _mm_and_si128(b, nib))
+                                      , _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(b, 4), nib)));
+            __m128i c = _mm_and_si128(ca, cb);
+            auto bits = static_cast<unsigned>(~_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero))) & 0xFFFF;
+            if(bits == 0) { continue; }
+
+            alignas(16) std::uint8_t sets[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(sets), c);
+            while(bits != 0)
+            {
+                unsigned j = static_cast<unsigned>(__builtin_ctz(bits));
+                bits &= bits - 1;
+                verify(i + j, sets[j]);
+            }
+        }
+        return i;
+    }
+#endif
+};
+
+/** @brief Position of the first occurrence of a pattern starting in [begin, end).
+ *  The range is scanned in blocks of growing size, so that the cost
+ *  depends on the distance to the match rather than on 'end'. */
+auto find_first_pattern(BytePattern const& pat, const std::uint8_t* data
+                        , std::size_t begin, std::size_t end, std::size_t limit)
+    -> std::optional<std::size_t>
+{
+    std::size_t block = 64 << 10;
+    for(std::size_t pos = begin; pos < end; pos += block, block = std::min(block * 2, std::size_t(16) << 20))
+    {
+        std::optional<std::size_t> found;
+        scan_pattern(pat, data, pos, std::min(pos + block, end), limit
+                     , [&](std::size_t p){ if(!found) { found = p; } });
+        if(found) { return found; }
+    }
+    return std::nullopt;
+}
+
+//------------------------------------------------------------------//
+//         File carving                                             //
+//------------------------------------------------------------------//
+
+/// File signature used for carving embedded files.
+struct CarveSignature
+{
+    std::string                name;
+    std::string                extension;
+    BytePattern                header;
+    std::optional<BytePattern> footer;
+    // Bytes following the footer which still belong to the file.
+    std::size_t                footer_extra = 0;
+    std::size_t                max_length   = 0;
+};
+
+/// Parse sizes such as 4096, 64K, 20M, 2G.
+auto parse_size(std::string const& text) -> std::size_t
+{
+    using namespace std::string_literals;
+
+    std::size_t value = 0;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if(ec != std::errc()) {
+        throw std::runtime_error("Error: invalid size: "s + text);
+    }
+    std::string suffix(ptr, text.data() + text.size());
+    if(suffix == "" || suffix == "B") { return value; }
+    if(suffix == "K" || suffix == "k") { return value << 10; }
+    if(suffix == "M" || suffix == "m") { return value << 20; }
+    if(suffix == "G" || suffix == "g") { return value << 30; }
+    throw std::runtime_error("Error: invalid size suffix: "s + text);
+}
+
+/// Signatures used by 'carve' when no table is given.
+const char* default_carve_table = R"(
+# name  ext   header             footer[+extra]      max-length
+jpeg    jpg   FFD8FF             FFD9                 20M
+png     png   89504E470D0A1A0A   49454E44AE426082     50M
+gif     gif   474946383?61       003B                 20M
+zip     zip   504B0304           504B0506+18          1G
+pdf     pdf   255044462D         2525454F46           100M
+elf     elf   7F454C46           -                    50M
+)";
+
+/** @brief Parse a signature table.
+ *
+ *  One signature per line with blank separated fields:
+ *  @code
+ *     <name> <extension> <header> <footer>[+<extra>] <max-length>
+ *  @endcode
+ *  Header and footer are hex patterns without blanks ('?' wildcards are
+ *  allowed). A footer '-' means that files are carved with their
+ *  maximum length. Lines starting with '#' are comments.
+ */
+auto parse_carve_table(std::istream& is) -> std::vector<CarveSignature>
+{
+    using namespace std::string_literals;
+
+    std::vector<CarveSignature> table;
+    std::string line;
+    while(std::getline(is, line))
+    {
+        std::stringstream ss(line);
+        std::string name, ext, header, footer, maxlen;
+        if(!(ss >> name) || name[0] == '#') { continue; }
+        if(!(ss >> ext >> header >> footer >> maxlen)) {
+            throw std::runtime_error("Error: invalid signature line: "s + line);
+        }
+        CarveSignature sig;
+        sig.name       = name;
+        sig.extension  = ext;
+        sig.header     = parse_byte_pattern(header);
+        sig.max_length = parse_size(maxlen);
+        if(footer != "-")
+        {
+            auto plus = footer.find('+');
+            if(plus != std::string::npos) {
+                sig.footer_extra = parse_size(footer.substr(plus + 1));
+                footer = footer.substr(0, plus);
+            }
+            sig.footer = parse_byte_pattern(footer);
+        }
+        table.push_back(std::move(sig));
+    }
+    return table;
+}
+
+/// Write a whole buffer to a file descriptor, retrying short writes.
+void write_all(int fd, const std::uint8_t* data, std::size_t length)
+{
+    using namespace std::string_literals;
+    while(length > 0)
+    {
+        auto n = ::write(fd, data, length);
+        stats::add(stats::counter::syscalls);
+        if(n < 0 && errno == EINTR) { continue; }
+        if(n <= 0) {
+            throw std::runtime_error("Error: failed to write data: "s + std::strerror(errno));
+        }
+        stats::add(stats::counter::bytes_written, static_cast<std::size_t>(n));
+        data   += n;
+        length -= static_cast<std::size_t>(n);
+    }
+}
+
+/** @brief Copy a file range between two descriptors inside the kernel.
+ *
+ *  Uses copy_file_range(2) and falls back to sendfile(2) when the file
+ *  systems do not support it, data is never copied through user space.
+ */
+void copy_range(int fd_in, std::uint64_t offset, std::size_t length, int fd_out)
+{
+    using namespace std::string_literals;
+
+    auto off_in = static_cast<off_t>(offset);
+    bool use_sendfile = false;
+
+    while(length > 0)
+    {
+        ssize_t n;
+        if(!use_sendfile)
+        {
+            n = ::copy_file_range(fd_in, &off_in, fd_out, nullptr, length, 0);
+            if(n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+                         || errno == EOPNOTSUPP)) {
+                use_sendfile = true;
+                continue;
+            }
+        } else {
+            n = ::sendfile(fd_out, fd_in, &off_in, length);
+        }
+        if(n < 0 && errno == EINTR) { continue; }
+        if(n <= 0) {
+            throw std::runtime_error("Error: failed to copy data: "s + std::strerror(errno));
+        }
+        length -= static_cast<std::size_t>(n);
+    }
+}
+
+/** @brief Carve embedded files out of a binary image.
+ *
+ *  All headers are located with a single multi-pattern pass over the
+ *  mapped image. The extent of each file ends after the first footer
+ *  found within max-length bytes; headers without footer are skipped.
+ *  Signatures without footer are carved with max-length bytes (limited
+ *  by the end of the image).
+ *
+ *  @param file      - Image file.
+ *  @param table     - Signatures.
+ *  @param outdir    - Directory where carved files are written.
+ *  @param list_only - If true, only print the extents.
+ *  @param jobs      - Number of threads scanning chunks in parallel.
+ */
+void command_carve(std::string const& file, std::vector<CarveSignature> const& table
+                   , std::string const& outdir, bool list_only, unsigned jobs)
+{
+    using namespace std::string_literals;
+    constexpr std::size_t chunk_size = 16 << 20;
+
+    std::vector<BytePattern> headers;
+    for(auto const& sig: table) { headers.push_back(sig.header); }
+    MultiPatternScanner scanner(std::move(headers));
+
+    if(!list_only) { std::filesystem::create_directories(outdir); }
+
+    std::size_t count = 0;
+    std::uint64_t carved_bytes = 0;
+
+    auto output_path = [&](std::uint64_t offset, CarveSignature const& sig) -> std::string
+    {
+        char name[32];
+        *format_offset(name, offset, 16) = '\0';
+        return (std::filesystem::path(outdir)
+                / (sig.name + "-" + name + "." + sig.extension)).string();
+    };
+
+    auto create_output = [&](std::string const& path) -> int
+    {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) {
+            throw std::runtime_error("Error: Unable to create file: "s + path
+                                     + ": " + std::strerror(errno));
+        }
+        return fd;
+    };
+
+    auto report = [&](std::uint64_t offset, CarveSignature const& sig, std::uint64_t length)
+    {
+        char name[32];
+        *format_offset(name, offset, 16) = '\0';
+        std::cout << "0x" << name << " " << std::setw(12) << length
+                  << " " << std::setw(6) << sig.name;
+        if(!list_only) { std::cout << " " << output_path(offset, sig); }
+        std::cout << "\n";
+        count++;
+        carved_bytes += length;
+        stats::add(stats::counter::matches);
+    };
+
+    if(is_stream_input(file))
+    {
+        // The input cannot be read twice, so every header found opens a
+        // carve which receives the following bytes as they stream through,
+        // until its footer (or maximum length) is reached.
+        struct OpenCarve
+        {
+            std::uint64_t                offset;
+            std::size_t                  sig;
+            int                          fd;
+            std::uint64_t                written;     // Absolute offset of next byte to write
+            std::uint64_t                search_from; // Next footer start position to test
+            std::optional<std::uint64_t> stop;
+        };
+        std::vector<OpenCarve> open;
+
+        std::size_t overlap = 0;
+        for(auto const& sig: table)
+        {
+            overlap = std::max(overlap, sig.header.size() - 1);
+            if(sig.footer) { overlap = std::max(overlap, sig.footer->size() - 1); }
+        }
+
+        auto discard = [&](OpenCarve& c)
+        {
+            if(c.fd >= 0) {
+                ::close(c.fd);
+                ::unlink(output_path(c.offset, table[c.sig]).c_str());
+            }
+        };
+
+        StreamReader in(file, chunk_size);
+        try
+        {
+            scan_stream(in, overlap, [&](const std::uint8_t* data, std::size_t end
+                                         , std::size_t limit, std::uint64_t base)
+            {
+                scanner.scan(data, 0, end, limit, [&](std::size_t pos, std::size_t k)
+                {
+                    std::uint64_t offset = base + pos;
+                    int fd = list_only ? -1 : create_output(output_path(offset, table[k]));
+                    open.push_back({offset, k, fd, offset, offset + table[k].header.size(), {}});
+                });
+
+                const bool last = in.eof();
+                const std::uint64_t owned_end = base + end;
+
+                for(auto& c: open)
+                {
+                    auto const& sig = table[c.sig];
+                    const std::uint64_t cap = c.offset + sig.max_length;
+                    if(!c.stop && !sig.footer) {
+                        c.stop = cap;
+                    }
+                    if(!c.stop && c.search_from < owned_end && c.search_from < cap)
+                    {
+                        std::size_t from  = static_cast<std::size_t>(c.search_from - base);
+                        std::size_t lim   = static_cast<std::size_t>(std::min<std::uint64_t>(base + limit, cap) - base);
+                        auto ft = find_first_pattern(*sig.footer, data, from, end, lim);
+                        if(ft) { c.stop = base + *ft + sig.footer->size() + sig.footer_extra; }
+                        c.search_from = owned_end;
+                    }
+                    if(!c.stop && (c.search_from + sig.footer->size() > cap || last))
+                    {
+                        // Footer not found within the maximum length.
+                        discard(c);
+                        c.sig = table.size();
+                        continue;
+                    }
+
+                    std::uint64_t hi = last ? base + limit : owned_end;
+                    if(c.stop) { hi = std::min(hi, *c.stop); }
+                    if(c.fd >= 0 && hi > c.written) {
+                        write_all(c.fd, data + (c.written - base), static_cast<std::size_t>(hi - c.written));
+                    }
+                    c.written = std::max(c.written, hi);
+
+                    if(c.stop && (c.written >= *c.stop || last))
+                    {
+                        if(c.fd >= 0) { ::close(c.fd); }
+                        report(c.offset, sig, c.written - c.offset);
+                        c.sig = table.size();
+                    }
+                }
+                open.erase(std::remove_if(open.begin(), open.end()
+                                          , [&](OpenCarve const& c){ return c.sig == table.size(); })
+                           , open.end());
+            });
+        } catch(...)
+        {
+            for(auto& c: open) { discard(c); }
+            throw;
+        }
+    } else
+    {
+        auto fmap = MappedFile(file);
+        const std::uint8_t* data  = fmap.data();
+        const std::size_t   total = fmap.size();
+        const std::size_t nchunks = (total + chunk_size - 1) / chunk_size;
+
+        // (header offset, signature index, length)
+        struct Extent { std::uint64_t offset; std::size_t sig; std::size_t length; };
+
+        auto work = [&](std::size_t chunk) -> std::vector<Extent>
+        {
+            std::vector<Extent> found;
+            std::size_t begin = chunk * chunk_size;
+            std::size_t end   = std::min(begin + chunk_size, total);
+            fmap.advise_range(begin, end - begin, MADV_SEQUENTIAL);
+
+            scanner.scan(data, begin, end, total, [&](std::size_t pos, std::size_t k)
+            {
+                auto const& sig = table[k];
+                std::size_t limit = std::min(total, pos + sig.max_length);
+                if(!sig.footer) {
+                    found.push_back({pos, k, limit - pos});
+                    return;
+                }
+                auto ft = find_first_pattern(*sig.footer, data, pos + sig.header.size(), limit, limit);
+                if(ft) {
+                    std::size_t stop = std::min(total, *ft + sig.footer->size() + sig.footer_extra);
+                    found.push_back({pos, k, stop - pos});
+                }
+            });
+            return found;
+        };
+
+        auto emit = [&](std::vector<Extent> const& found)
+        {
+            for(auto const& e: found)
+            {
+                auto const& sig = table[e.sig];
+                if(!list_only)
+                {
+                    // Errors (disk full, ...) reach the caller through
+                    // process_chunks_ordered, without a truncated file.
+                    auto path = output_path(e.offset, sig);
+                    int fd = create_output(path);
+                    try { copy_range(fmap.fd(), e.offset, e.length, fd); }
+                    catch(...) { ::close(fd); ::unlink(path.c_str()); throw; }
+                    ::close(fd);
+                }
+                report(e.offset, sig, e.length);
+            }
+        };
+
+        process_chunks_ordered<std::vector<Extent>>(nchunks, resolve_jobs(jobs), work, emit);
+    }
+    std::cerr << " [INFO] Files found: " << count
+              << " ; total size: " << carved_bytes << " bytes\n";
+}
+
+//------------------------------------------------------------------//
+//         Entropy analysis                                         //
+//------------------------------------------------------------------//
+
+using ByteHistogram = std::array<std::uint32_t, 256>;
+
+/** @brief Count byte values of a memory region.
+ *
+ *  Four interleaved sub-histograms are updated so that consecutive
+ *  increments of the same counter do not wait for each other (store to
+ *  load forwarding), then they are summed together.
+ */
+void byte_histogram(const std::uint8_t* data, std::size_t size, ByteHistogram& hist)
+{
+    std::uint32_t lanes[4][256] = {};
+    std::size_t i = 0;
+    for(; i + 16 <= size; i += 16)
+    {
+        std::uint64_t a, b;
+        std::memcpy(&a, data + i, 8);
+        std::memcpy(&b, data + i + 8, 8);
+        for(int k = 0; k < 64; k += 16)
+        {
+            lanes[0][(a >> k) & 0xFF]++;
+            lanes[1][(a >> (k + 8)) & 0xFF]++;
+            lanes[2][(b >> k) & 0xFF]++;
+            lanes[3][(b >> (k + 8)) & 0xFF]++;
+        }
+    }
+    for(; i < size; i++) { lanes[0][data[i]]++; }
+
+    for(int v = 0; v < 256; v++) {
+        hist[v] = lanes[0][v] + lanes[1][v] + lanes[2][v] + lanes[3][v];
+    }
+}
+
+/** @brief Shannon entropy of a sliding window, updated incrementally.
+ *
+ *  With n bytes and counts c[v], the entropy in bits per byte is
+ *  H = log2(n) - (1/n) * sum(c[v] * log2(c[v])). The sum is kept up to
+ *  date when a byte enters or leaves the window by using a table of
+ *  c * log2(c). Table values are stored in fixed point, hence the sum
+ *  is exact and does not depend on the path taken to reach a window
+ *  (results are the same for any number of threads).
+ */
+class SlidingEntropy
+{
+    static constexpr double scale = 16777216.0;  // 2^24
+
+    std::vector<std::int64_t> m_clogc;
+    ByteHistogram             m_hist{};
+    std::int64_t              m_sum = 0;
+    std::size_t               m_window;
+public:
+
+    explicit SlidingEntropy(std::size_t window)
+        : m_clogc(window + 1), m_window(window)
+    {
+        for(std::size_t c = 2; c <= window; c++) {
+            auto x = static_cast<double>(c);
+            m_clogc[c] = std::llround(x * std::log2(x) * scale);
+        }
+    }
+
+    /// Reset the window to the region [data, data + window).
+    void reset(const std::uint8_t* data)
+    {
+        byte_histogram(data, m_window, m_hist);
+        m_sum = 0;
+        for(auto c: m_hist) { m_sum += m_clogc[c]; }
+    }
+
+    /// Remove 'n' bytes from the window and add 'n' new bytes.
+    void slide(const std::uint8_t* leaving, const std::uint8_t* entering, std::size_t n)
+    {
+        for(std::size_t i = 0; i < n; i++)
+        {
+            auto& out = m_hist[leaving[i]];
+            m_sum += m_clogc[out - 1] - m_clogc[out];
+            out--;
+            auto& in = m_hist[entering[i]];
+            m_sum += m_clogc[in + 1] - m_clogc[in];
+            in++;
+        }
+    }
+
+    double entropy() const
+    {
+        auto n = static_cast<double>(m_window);
+        return std::log2(n) - static_cast<double>(m_sum) / scale / n;
+    }
+
+    ByteHistogram const& histogram() const { return m_hist; }
+};
+
+enum class entropy_format
+{
+      csv
+    , binary
+};
+
+/** @brief Sliding window entropy of a binary file.
+ *
+ *  The CSV output has the columns 'offset,entropy' followed by the
+ *  256 byte counts when 'histogram' is set. The binary output is a
+ *  sequence of little-endian records { u64 offset; f32 entropy; }
+ *  (12 bytes, no padding), optionally followed by 256 u32 counts.
+ *
+ *  @param window - Window size in bytes.
+ *  @param step   - Distance between the start of two windows.
+ */
+void command_entropy(std::string const& file, std::size_t window, std::size_t step
+                     , entropy_format format, bool histogram, unsigned jobs)
+{
+    if(window == 0 || step == 0) {
+        throw std::runtime_error("Error: window and step must be greater than zero");
+    }
+
+    const std::size_t record  = 8 + 4 + (histogram ? 256 * 4 : 0);
+
+    // Append the row (CSV line or binary record) of one window.
+    auto append_row = [&](std::string& text, std::uint64_t offset, SlidingEntropy const& ent)
+    {
+        if(format == entropy_format::binary)
+        {
+            char rec[8 + 4 + 256 * 4];
+            auto h32 = static_cast<float>(ent.entropy());
+            store_le(rec, offset);
+            store_le(rec + 8, h32);
+            if(histogram) {
+                auto const& counts = ent.histogram();
+                for(std::size_t i = 0; i < counts.size(); i++) { store_le(rec + 12 + 4 * i, counts[i]); }
+            }
+            text.append(rec, record);
+            return;
+        }
+
+        char line[32];
+        char* p = std::to_chars(line, line + sizeof(line), offset).ptr;
+        *p++ = ',';
+        p = std::to_chars(p, line + sizeof(line), ent.entropy()
+                          , std::chars_format::fixed, 6).ptr;
+        text.append(line, static_cast<std::size_t>(p - line));
+        if(histogram)
+        {
+            for(auto c: ent.histogram())
+            {
+                p = line;
+                *p++ = ',';
+                p = std::to_chars(p, line + sizeof(line), c).ptr;
+                text.append(line, static_cast<std::size_t>(p - line));
+            }
+        }
+        text.push_back('\n');
+    };
+
+    OutputBuffer out;
+    if(format == entropy_format::csv)
+    {
+        out.write("offset,entropy");
+        if(histogram)
+        {
+            for(int v = 0; v < 256; v++)
+            {
+                char col[8] = ",c";
+                char* p = std::to_chars(col + 2, col + sizeof(col), v).ptr;
+                out.write(col, static_cast<std::size_t>(p - col));
+            }
+        }
+        out.put('\n');
+    }
+
+    if(is_stream_input(file))
+    {
+        // Overlapping windows slide over the buffered bytes, the leaving
+        // bytes are still in the buffer when the entering ones are read.
+        StreamReader in(file, std::max<std::size_t>(1 << 20, window + std::min(step, window)));
+        std::size_t n = in.fill(window);
+        if(n == 0) { return; }
+        window = std::min(window, n);
+
+        SlidingEntropy ent(window);
+        std::string text;
+        ent.reset(in.data());
+        append_row(text, in.offset(), ent);
+
+        for(;;)
+        {
+            if(step < window)
+            {
+                if(in.fill(window + step) < window + step) { break; }
+                ent.slide(in.data(), in.data() + window, step);
+                in.consume(step);
+            } else
+            {
+                in.consume(window);
+                if(in.skip(step - window) < step - window || in.fill(window) < window) { break; }
+                ent.reset(in.data());
+            }
+            append_row(text, in.offset(), ent);
+            if(text.size() >= (1 << 20)) {
+                out.write(text);
+                text.clear();
+            }
+        }
+        out.write(text);
+        return;
+    }
+
+    auto fmap = MappedFile(file);
+    const std::uint8_t* data  = fmap.data();
+    const std::size_t   total = fmap.size();
+    if(total == 0) { return; }
+    // Files smaller than a window are analysed as a single window.
+    window = std::min(window, total);
+
+    const std::size_t nwindows = (total - window) / step + 1;
+    // Windows per chunk: about 16 MiB of input per chunk.
+    const std::size_t per_chunk = std::max<std::size_t>(1, (16 << 20) / std::max(step, std::size_t(1)));
+    const std::size_t nchunks = (nwindows + per_chunk - 1) / per_chunk;
+
+    fmap.advise(MADV_SEQUENTIAL);
+
+    // Each chunk formats its rows into a string, written in order.
+    auto work = [&](std::size_t chunk) -> std::string
+    {
+        std::size_t first = chunk * per_chunk;
+        std::size_t last  = std::min(nwindows, first + per_chunk);
+        std::string text;
+        text.reserve((last - first) * (format == entropy_format::csv
+                                       ? (histogram ? 1100 : 32) : record));
+
+        SlidingEntropy ent(window);
+        for(std::size_t w = first; w < last; w++)
+        {
+            std::size_t offset = w * step;
+            // Recount when windows do not overlap or at chunk start.
+            if(w == first || step >= window)
+                ent.reset(data + offset);
+            else
+                ent.slide(data + offset - step, data + offset - step + window, step);
+            append_row(text, offset, ent);
+        }
+        return text;
+    };
+
+    process_chunks_ordered<std::string>(nchunks, resolve_jobs(jobs), work
+                                        , [&](std::string const& s){ out.write(s); });
+}
+
+//------------------------------------------------------------------//
+//         Block hashing                                            //
+//------------------------------------------------------------------//
+
+/// Hash functions: CRC32C, XXH3 (64 bits) and SHA-256.
+namespace hashing
+{
+    //---------- CRC32C (Castagnoli) ---------------------------//
+
+    constexpr auto crc32c_table = []
+    {
+        std::array<std::uint32_t, 256> t{};
+        for(std::uint32_t i = 0; i < 256; i++)
+        {
+            std::uint32_t c = i;
+            for(int k = 0; k < 8; k++) { c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1; }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    inline std::uint32_t crc32c_soft(std::uint32_t crc, const std::uint8_t* p, std::size_t n)
+    {
+        for(std::size_t i = 0; i < n; i++) {
+            crc = crc32c_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    inline std::uint32_t crc32c_sse42(std::uint32_t crc, const std::uint8_t* p, std::size_t n)
+    {
+        std::uint64_t c = crc;
+        std::size_t i = 0;
+        for(; i + 8 <= n; i += 8)
+        {
+            std::uint64_t v;
+            std::memcpy(&v, p + i, 8);
+            c = _mm_crc32_u64(c, v);
+        }
+        auto c32 = static_cast<std::uint32_t>(c);
+        for(; i < n; i++) { c32 = _mm_crc32_u8(c32, p[i]); }
+        return c32;
+    }
+#endif
+
+    inline std::uint32_t crc32c(const std::uint8_t* p, std::size_t n)
+    {
+#if defined(__x86_64__)
+        static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+        if(has_sse42) { return ~crc32c_sse42(~0u, p, n); }
+#endif
+        return ~crc32c_soft(~0u, p, n);
+    }
+
+    //---------- XXH3 64 bits (seed 0) -------------------------//
+
+    namespace xxh3_detail
+    {
+        constexpr std::uint64_t prime32_1 = 0x9E3779B1U;
+        constexpr std::uint64_t prime32_2 = 0x85EBCA77U;
+        constexpr std::uint64_t prime32_3 = 0xC2B2AE3DU;
+        constexpr std::uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+        constexpr std::uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr std::uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+        constexpr std::uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr std::uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+
+        constexpr std::size_t stripe_len   = 64;
+        constexpr std::size_t secret_size  = 192;
+
+        alignas(64) constexpr std::uint8_t secret[secret_size] = {
+            0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+            0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+            0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+            0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+            0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+            0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+            0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+            0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+            0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+            0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+            0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+            0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+        };
+
+        inline std::uint64_t read64(const std::uint8_t* p)
+        {
+            std::uint64_t v;
+            std::memcpy(&v, p, 8);
+            return v;
+        }
+
+        inline std::uint32_t read32(const std::uint8_t* p)
+        {
+            std::uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+
+        inline std::uint64_t rotl64(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline std::uint64_t mul128_fold64(std::uint64_t a, std::uint64_t b)
+        {
+            auto product = static_cast<unsigned __int128>(a) * b;
+            return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+        }
+
+        inline std::uint64_t xxh64_avalanche(std::uint64_t h)
+        {
+            h ^= h >> 33;
+            h *= prime64_2;
+            h ^= h >> 29;
+            h *= prime64_3;
+            h ^= h >> 32;
+            return h;
+        }
+
+        inline std::uint64_t avalanche(std::uint64_t h)
+        {
+            h ^= h >> 37;
+            h *= 0x165667919E3779F9ULL;
+            h ^= h >> 32;
+            return h;
+        }
+
+        inline std::uint64_t rrmxmx(std::uint64_t h, std::uint64_t len)
+        {
+            h ^= rotl64(h, 49) ^ rotl64(h, 24);
+            h *= 0x9FB21C651E98DF25ULL;
+            h ^= (h >> 35) + len;
+            h *= 0x9FB21C651E98DF25ULL;
+            h ^= h >> 28;
+            return h;
+        }
+
+        inline std::uint64_t mix16(const std::uint8_t* in, const std::uint8_t* sec)
+        {
+            return mul128_fold64(read64(in) ^ read64(sec), read64(in + 8) ^ read64(sec + 8));
+        }
+
+        inline std::uint64_t hash_0to16(const std::uint8_t* in, std::size_t len)
+        {
+            if(len > 8)
+            {
+                std::uint64_t lo = read64(in) ^ (read64(secret + 24) ^ read64(secret + 32));
+                std::uint64_t hi = read64(in + len - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+                std::uint64_t acc = len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi);
+                return avalanche(acc);
+            }
+            if(len >= 4)
+            {
+                std::uint64_t in64 = read32(in + len - 4) + (static_cast<std::uint64_t>(read32(in)) << 32);
+                std::uint64_t flip = read64(secret + 8) ^ read64(secret + 16);
+                return rrmxmx(in64 ^ flip, len);
+            }
+            if(len > 0)
+            {
+                std::uint32_t combo = (static_cast<std::uint32_t>(in[0]) << 16)
+                                    | (static_cast<std::uint32_t>(in[len >> 1]) << 24)
+                                    |  static_cast<std::uint32_t>(in[len - 1])
+                                    | (static_cast<std::uint32_t>(len) << 8);
+                std::uint64_t flip = read32(secret) ^ read32(secret + 4);
+                return xxh64_avalanche(combo ^ flip);
+            }
+            return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+        }
+
+        inline std::uint64_t hash_17to128(const std::uint8_t* in, std::size_t len)
+        {
+            std::uint64_t acc = len * prime64_1;
+            if(len > 32)
+            {
+                if(len > 64)
+                {
+                    if(len > 96)
+                    {
+                        acc += mix16(in + 48, secret + 96);
+                        acc += mix16(in + len - 64, secret + 112);
+                    }
+                    acc += mix16(in + 32, secret + 64);
+                    acc += mix16(in + len - 48, secret + 80);
+                }
+                acc += mix16(in + 16, secret + 32);
+                acc += mix16(in + len - 32, secret + 48);
+            }
+            acc += mix16(in, secret);
+            acc += mix16(in + len - 16, secret + 16);
+            return avalanche(acc);
+        }
+
+        inline std::uint64_t hash_129to240(const std::uint8_t* in, std::size_t len)
+        {
+            std::uint64_t acc = len * prime64_1;
+            std::size_t rounds = len / 16;
+            for(std::size_t i = 0; i < 8; i++) { acc += mix16(in + 16 * i, secret + 16 * i); }
+            acc = avalanche(acc);
+            for(std::size_t i = 8; i < rounds; i++) { acc += mix16(in + 16 * i, secret + 16 * (i - 8) + 3); }
+            acc += mix16(in + len - 16, secret + 136 - 17);
+            return avalanche(acc);
+        }
+
+        inline void accumulate_512(std::uint64_t* acc, const std::uint8_t* in, const std::uint8_t* sec)
+        {
+#if defined(__x86_64__)
+            auto* xacc = reinterpret_cast<__m128i*>(acc);
+            for(int i = 0; i < 4; i++)
+            {
+                __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in) + i);
+                __m128i key  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sec) + i);
+                __m128i dk   = _mm_xor_si128(data, key);
+                __m128i dklo = _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i prod = _mm_mul_epu32(dk, dklo);
+                __m128i swap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                xacc[i] = _mm_add_epi64(prod, _mm_add_epi64(xacc[i], swap));
+            }
+#else
+            for(int i = 0; i < 8; i++)
+            {
+                std::uint64_t v  = read64(in + 8 * i);
+                std::uint64_t dk = v ^ read64(sec + 8 * i);
+                acc[i ^ 1] += v;
+                acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32);
+            }
+#endif
+        }
+
+        inline void scramble(std::uint64_t* acc, const std::uint8_t* sec)
+        {
+#if defined(__x86_64__)
+            auto* xacc = reinterpret_cast<__m128i*>(acc);
+            const __m128i prime = _mm_set1_epi32(static_cast<int>(prime32_1));
+            for(int i = 0; i < 4; i++)
+            {
+                __m128i a    = xacc[i];
+                __m128i key  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sec) + i);
+                __m128i dk   = _mm_xor_si128(_mm_xor_si128(a, _mm_srli_epi64(a, 47)), key);
+                __m128i dkhi = _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1));
+                __m128i lo   = _mm_mul_epu32(dk, prime);
+                __m128i hi   = _mm_mul_epu32(dkhi, prime);
+                xacc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+            }
+#else
+            for(int i = 0; i < 8; i++)
+            {
+                std::uint64_t a = acc[i];
+                a ^= a >> 47;
+                a ^= read64(sec + 8 * i);
+                acc[i] = a * prime32_1;
+            }
+#endif
+        }
+
+        inline std::uint64_t hash_long(const std::uint8_t* in, std::size_t len)
+        {
+            alignas(16) std::uint64_t acc[8] = {
+                prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1
+            };
+            constexpr std::size_t stripes_per_block = (secret_size - stripe_len) / 8;
+            constexpr std::size_t block_len = stripe_len * stripes_per_block;
+            const std::size_t nblocks = (len - 1) / block_len;
+
+            for(std::size_t b = 0; b < nblocks; b++)
+            {
+                for(std::size_t s = 0; s < stripes_per_block; s++) {
+                    accumulate_512(acc, in + b * block_len + s * stripe_len, secret + s * 8);
+                }
+                scramble(acc, secret + secret_size - stripe_len);
+            }
+
+            const std::size_t nstripes = ((len - 1) - block_len * nblocks) / stripe_len;
+            for(std::size_t s = 0; s < nstripes; s++) {
+                accumulate_512(acc, in + nblocks * block_len + s * stripe_len, secret + s * 8);
+            }
+            accumulate_512(acc, in + len - stripe_len, secret + secret_size - stripe_len - 7);
+
+            std::uint64_t result = len * prime64_1;
+            for(int i = 0; i < 4; i++) {
+                result += mul128_fold64(acc[2 * i] ^ read64(secret + 11 + 16 * i)
+                                       , acc[2 * i + 1] ^ read64(secret + 11 + 16 * i + 8));
+            }
+            return avalanche(result);
+        }
+    } // * --- End of namespace xxh3_detail --- * //
+
+    inline std::uint64_t xxh3_64(const std::uint8_t* p, std::size_t n)
+    {
+        using namespace xxh3_detail;
+        if(n <= 16)  { return hash_0to16(p, n);    }
+        if(n <= 128) { return hash_17to128(p, n);  }
+        if(n <= 240) { return hash_129to240(p, n); }
+        return hash_long(p, n);
+    }
+
+    //---------- SHA-256 ---------------------------------------//
+
+    alignas(16) constexpr std::uint32_t sha256_k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    /// Process 'nblocks' 64 bytes blocks (portable implementation).
+    inline void sha256_blocks_soft(std::uint32_t state[8], const std::uint8_t* p, std::size_t nblocks)
+    {
+        auto rotr = [](std::uint32_t x, int r){ return (x >> r) | (x << (32 - r)); };
+
+        for(std::size_t b = 0; b < nblocks; b++, p += 64)
+        {
+            std::uint32_t w[64];
+            for(int i = 0; i < 16; i++) {
+                w[i] = static_cast<std::uint32_t>(p[4 * i]) << 24 | static_cast<std::uint32_t>(p[4 * i + 1]) << 16
+                     | static_cast<std::uint32_t>(p[4 * i + 2]) << 8 | p[4 * i + 3];
+            }
+            for(int i = 16; i < 64; i++)
+            {
+                std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            std::uint32_t a = state[0], b2 = state[1], c = state[2], d = state[3]
+                        , e = state[4], f = state[5], g = state[6], h = state[7];
+            for(int i = 0; i < 64; i++)
+            {
+                std::uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                std::uint32_t ch = (e & f) ^ (~e & g);
+                std::uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+                std::uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                std::uint32_t mj = (a & b2) ^ (a & c) ^ (b2 & c);
+                std::uint32_t t2 = s0 + mj;
+                h = g; g = f; f = e; e = d + t1;
+                d = c; c = b2; b2 = a; a = t1 + t2;
+            }
+            state[0] += a; state[1] += b2; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f;  state[6] += g; state[7] += h;
+        }
+    }
+
+#if defined(__x86_64__)
+    /// Process 'nblocks' 64 bytes blocks with the SHA-NI instructions.
+    __attribute__((target("sha,sse4.1,ssse3")))
+    inline void sha256_blocks_shani(std::uint32_t state[8], const std::uint8_t* p, std::size_t nblocks)
+    {
+        const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+        __m128i tmp    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+        __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+        tmp    = _mm_shuffle_epi32(tmp, 0xB1);             // CDAB
+        state1 = _mm_shuffle_epi32(state1, 0x1B);          // EFGH
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);       // CDGH
+
+        for(std::size_t b = 0; b < nblocks; b++, p += 64)
+        {
+            const __m128i abef_save = state0;
+            const __m128i cdgh_save = state1;
+            __m128i msgs[4];
+
+            // 16 groups of 4 rounds, message schedule computed on the fly.
+            #pragma GCC unroll 16
+            for(int g = 0; g < 16; g++)
+            {
+                if(g < 4) {
+                    msgs[g] = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * g)), mask);
+                }
+                __m128i msg = _mm_add_epi32(msgs[g % 4]
+                    , _mm_load_si128(reinterpret_cast<const __m128i*>(&sha256_k[4 * g])));
+                state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                if(g >= 3 && g <= 14)
+                {
+                    __m128i t = _mm_alignr_epi8(msgs[g % 4], msgs[(g + 3) % 4], 4);
+                    msgs[(g + 1) % 4] = _mm_sha256msg2_epu32(
+                        _mm_add_epi32(msgs[(g + 1) % 4], t), msgs[g % 4]);
+                }
+                msg = _mm_shuffle_epi32(msg, 0x0E);
+                state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+                if(g >= 1 && g <= 12) {
+                    msgs[(g + 3) % 4] = _mm_sha256msg1_epu32(msgs[(g + 3) % 4], msgs[g % 4]);
+                }
+            }
+
+            state0 = _mm_add_epi32(state0, abef_save);
+            state1 = _mm_add_epi32(state1, cdgh_save);
+        }
+
+        tmp    = _mm_shuffle_epi32(state0, 0x1B);          // FEBA
+        state1 = _mm_shuffle_epi32(state1, 0xB1);          // DCHG
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0);       // DCBA
+        state1 = _mm_alignr_epi8(state1, tmp, 8);          // ABEF
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+    }
+#endif
+
+    inline void sha256_blocks(std::uint32_t state[8], const std::uint8_t* p, std::size_t nblocks)
+    {
+#if defined(__x86_64__)
+        static const bool has_sha = __builtin_cpu_supports("sha")
+                                 && __builtin_cpu_supports("sse4.1");
+        if(has_sha) { sha256_blocks_shani(state, p, nblocks); return; }
+#endif
+        sha256_blocks_soft(state, p, nblocks);
+    }
+
+    inline std::array<std::uint8_t, 32> sha256(const std::uint8_t* p, std::size_t n)
+    {
+        std::uint32_t state[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        sha256_blocks(state, p, n / 64);
+
+        // Padding: 0x80, zeros and message length in bits (big-endian).
+        std::uint8_t tail[128] = {};
+        std::size_t rest = n % 64;
+        std::memcpy(tail, p + n - rest, rest);
+        tail[rest] = 0x80;
+        std::size_t tail_len = rest < 56 ? 64 : 128;
+        std::uint64_t bits = static_cast<std::uint64_t>(n) * 8;
+        for(int i = 0; i < 8; i++) { tail[tail_len - 1 - i] = static_cast<std::uint8_t>(bits >> (8 * i)); }
+        sha256_blocks(state, tail, tail_len / 64);
+
+        std::array<std::uint8_t, 32> out;
+        for(int i = 0; i < 8; i++)
+            for(int k = 0; k < 4; k++)
+                out[4 * i + k] = static_cast<std::uint8_t>(state[i] >> (24 - 8 * k));
+        return out;
+    }
+} // * --- End of namespace hashing --- * //
+
+enum class hash_algorithm
+{
+      crc32c
+    , xxh3
+    , sha256
+};
+
+auto parse_hash_algorithm(std::string const& name) -> hash_algorithm
+{
+    using namespace std::string_literals;
+    if(name == "crc32c") { return hash_algorithm::crc32c; }
+    if(name == "xxh3")   { return hash_algorithm::xxh3;   }
+    if(name == "sha256") { return hash_algorithm::sha256; }
+    throw std::runtime_error("Error: invalid hash algorithm: "s + name);
+}
+
+auto hash_algorithm_name(hash_algorithm algo) -> const char*
+{
+    switch(algo)
+    {
+    case hash_algorithm::crc32c: return "crc32c";
+    case hash_algorithm::xxh3:   return "xxh3";
+    case hash_algorithm::sha256: return "sha256";
+    }
+    return "";
+}
+
+/// Hash value, stored as big-endian bytes (same as the usual hex notation).
+struct Digest
+{
+    std::array<std::uint8_t, 32> bytes{};
+    std::size_t                  size = 0;
+
+    bool operator==(Digest const& rhs) const
+    {
+        return size == rhs.size && std::equal(bytes.begin(), bytes.begin() + size, rhs.bytes.begin());
+    }
+    bool operator!=(Digest const& rhs) const { return !(*this == rhs); }
+
+    std::string hex() const
+    {
+        std::string s(2 * size, '0');
+        for(std::size_t i = 0; i < size; i++) {
+            s[2 * i]     = tables::hex_pairs[bytes[i]][0];
+            s[2 * i + 1] = tables::hex_pairs[bytes[i]][1];
+        }
+        return s;
+    }
+
+    static Digest from_hex(std::string const& text)
+    {
+        using namespace std::string_literals;
+        Digest d;
+        if(text.size() % 2 != 0 || text.size() > 64) {
+            throw std::runtime_error("Error: invalid digest: "s + text);
+        }
+        d.size = text.size() / 2;
+        for(std::size_t i = 0; i < d.size; i++)
+        {
+            unsigned v = 0;
+            auto [ptr, ec] = std::from_chars(text.data() + 2 * i, text.data() + 2 * i + 2, v, 16);
+            if(ec != std::errc() || ptr != text.data() + 2 * i + 2) {
+                throw std::runtime_error("Error: invalid digest: "s + text);
+            }
+            d.bytes[i] = static_cast<std::uint8_t>(v);
+        }
+        return d;
+    }
+};
+
+auto compute_digest(hash_algorithm algo, const std::uint8_t* p, std::size_t n) -> Digest
+{
+    Digest d;
+    auto store_be = [&](std::uint64_t v, std::size_t size)
+    {
+        d.size = size;
+        for(std::size_t i = 0; i < size; i++) {
+            d.bytes[i] = static_cast<std::uint8_t>(v >> (8 * (size - 1 - i)));
+        }
+    };
+
+    switch(algo)
+    {
+    case hash_algorithm::crc32c: store_be(hashing::crc32c(p, n), 4);  break;
+    case hash_algorithm::xxh3:   store_be(hashing::xxh3_64(p, n), 8); break;
+    case hash_algorithm::sha256:
+        d.bytes = hashing::sha256(p, n);
+        d.size  = 32;
+        break;
+    }
+    return d;
+}
+
+/** @brief Root of the Merkle tree built over block digests.
+ *
+ *  A parent node is the hash of the concatenation of its two children
+ *  digests; when a level has an odd number of nodes, the last one is
+ *  promoted unchanged to the next level.
+ */
+auto merkle_root(hash_algorithm algo, std::vector<Digest> level) -> Digest
+{
+    if(level.empty()) { return compute_digest(algo, nullptr, 0); }
+
+    while(level.size() > 1)
+    {
+        std::vector<Digest> next;
+        for(std::size_t i = 0; i + 1 < level.size(); i += 2)
+        {
+            std::uint8_t buf[64];
+            std::memcpy(buf, level[i].bytes.data(), level[i].size);
+            std::memcpy(buf + level[i].size, level[i + 1].bytes.data(), level[i + 1].size);
+            next.push_back(compute_digest(algo, buf, level[i].size + level[i + 1].size));
+        }
+        if(level.size() % 2 == 1) { next.push_back(level.back()); }
+        level.swap(next);
+    }
+    return level[0];
+}
+
+/** @brief Hash fixed-size blocks of a file in parallel.
+ *
+ *  Blocks are read with pread(2) by the worker threads; each work
+ *  unit covers about 16 MiB of data.
+ *
+ *  @param emit - Called in block order with (block index, digest).
+ */
+template<typename Emit>
+auto hash_file_blocks(std::string const& file, hash_algorithm algo
+                      , std::size_t block_size, unsigned jobs, Emit&& emit) -> std::uint64_t
+{
+    using namespace std::string_literals;
+
+    if(is_stream_input(file))
+    {
+        // Blocks of a stream are read and hashed one after another.
+        StreamReader in(file, block_size);
+        std::size_t index = 0;
+        while(in.fill(block_size) > 0)
+        {
+            emit(index++, compute_digest(algo, in.data(), in.size()));
+            in.consume(in.size());
+        }
+        return in.offset();
+    }
+
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Error: Unable to open file: "s + file);
+    }
+    struct stat st{};
+    ::fstat(fd, &st);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const auto file_size = static_cast<std::uint64_t>(st.st_size);
+    const std::size_t nblocks  = (file_size + block_size - 1) / block_size;
+    const std::size_t per_unit = std::max<std::size_t>(1, (16 << 20) / block_size);
+    const std::size_t nunits   = (nblocks + per_unit - 1) / per_unit;
+
+    auto work = [&](std::size_t unit) -> std::vector<Digest>
+    {
+        thread_local std::vector<std::uint8_t> buffer;
+        buffer.resize(block_size);
+
+        std::vector<Digest> digests;
+        std::size_t first = unit * per_unit;
+        std::size_t last  = std::min(nblocks, first + per_unit);
+        for(std::size_t b = first; b < last; b++)
+        {
+            auto offset = static_cast<std::uint64_t>(b) * block_size;
+            auto length = static_cast<std::size_t>(std::min<std::uint64_t>(block_size, file_size - offset));
+            std::size_t done = 0;
+            while(done < length)
+            {
+                auto n = ::pread(fd, buffer.data() + done, length - done
+                                 , static_cast<off_t>(offset + done));
+                if(n < 0 && errno == EINTR) { continue; }
+                if(n <= 0) {
+                    throw std::runtime_error("Error: failed to read file: "s + file);
+                }
+                done += static_cast<std::size_t>(n);
+            }
+            digests.push_back(compute_digest(algo, buffer.data(), length));
+        }
+        return digests;
+    };
+
+    std::size_t index = 0;
+    try {
+        process_chunks_ordered<std::vector<Digest>>(nunits, resolve_jobs(jobs), work
+            , [&](std::vector<Digest> const& digests)
+              {
+                  for(auto const& d: digests) { emit(index++, d); }
+              });
+    } catch(...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    return file_size;
+}
+
+/** @brief Write a block manifest of a file.
+ *
+ *  Manifest format (text):
+ *  @code
+ *    # hextool block manifest
+ *    algorithm sha256
+ *    block-size 1048576
+ *    file-size 5000000
+ *    block 0 <digest>
+ *    ...
+ *    root <merkle root digest>
+ *  @endcode
+ */
+void command_hash(std::string const& file, hash_algorithm algo, std::size_t block_size
+                  , std::string const& manifest, unsigned jobs)
+{
+    using namespace std::string_literals;
+
+    if(block_size == 0) {
+        throw std::runtime_error("Error: block size must be greater than zero");
+    }
+    std::ofstream ofs;
+    if(!manifest.empty())
+    {
+        ofs.open(manifest);
+        if(!ofs) {
+            throw std::runtime_error("Error: Unable to create file: "s + manifest);
+        }
+    }
+    std::ostream& os = manifest.empty() ? std::cout : ofs;
+
+    os << "# hextool block manifest\n"
+       << "algorithm "  << hash_algorithm_name(algo) << "\n"
+       << "block-size " << block_size << "\n";
+
+    std::vector<Digest> digests;
+    // The size is written after the blocks: it is only known at the end of a stream.
+    auto file_size = hash_file_blocks(file, algo, block_size, jobs
+                                      , [&](std::size_t index, Digest const& d)
+    {
+        os << "block " << index << " " << d.hex() << "\n";
+        digests.push_back(d);
+    });
+    os << "file-size "  << file_size << "\n";
+    auto root = merkle_root(algo, std::move(digests));
+    os << "root " << root.hex() << "\n";
+    std::cerr << " [INFO] Merkle root: " << root.hex() << "\n";
+}
+
+/** @brief Compare a file against a manifest written by command_hash().
+ *  @return true if the file matches the manifest. */
+bool command_verify(std::string const& file, std::string const& manifest, unsigned jobs)
+{
+    using namespace std::string_literals;
+
+    auto ifs = std::ifstream(manifest);
+    if(!ifs) {
+        throw std::runtime_error("Error: Unable to open file: "s + manifest);
+    }
+
+    auto algo = hash_algorithm::sha256;
+    std::size_t   block_size = 0;
+    std::uint64_t old_size   = 0;
+    std::vector<Digest> expected;
+    std::optional<Digest> expected_root;
+
+    std::string line, key;
+    while(std::getline(ifs, line))
+    {
+        std::stringstream ss(line);
+        if(!(ss >> key) || key[0] == '#') { continue; }
+        if(key == "algorithm")  { std::string n; ss >> n; algo = parse_hash_algorithm(n); }
+        else if(key == "block-size") { ss >> block_size; }
+        else if(key == "file-size")  { ss >> old_size;   }
+        else if(key == "root")  { std::string h; ss >> h; expected_root = Digest::from_hex(h); }
+        else if(key == "block")
+        {
+            std::size_t index; std::string h;
+            ss >> index >> h;
+            if(index != expected.size()) {
+                throw std::runtime_error("Error: manifest blocks out of order: "s + line);
+            }
+            expected.push_back(Digest::from_hex(h));
+        }
+    }
+    if(block_size == 0) {
+        throw std::runtime_error("Error: invalid manifest (no block size): "s + manifest);
+    }
+
+    std::size_t changed = 0;
+    std::vector<Digest> digests;
+    auto new_size = hash_file_blocks(file, algo, block_size, jobs, [&](std::size_t index, Digest const& d)
+    {
+        digests.push_back(d);
+        if(index >= expected.size()) {
+            std::cout << " block " << index << " offset " << index * block_size << " added\n";
+            changed++;
+        } else if(d != expected[index]) {
+            std::cout << " block " << index << " offset " << index * block_size << " differs\n";
+            changed++;
+        }
+    });
+    for(std::size_t index = digests.size(); index < expected.size(); index++)
+    {
+        std::cout << " block " << index << " offset " << index * block_size << " removed\n";
+        changed++;
+    }
+    if(new_size != old_size) {
+        std::cout << " file size changed: " << old_size << " => " << new_size << "\n";
+    }
+
+    auto root = merkle_root(algo, std::move(digests));
+    bool root_ok = expected_root && *expected_root == root;
+    std::cout << " [INFO] Blocks changed: " << changed << " ; Merkle root "
+              << (root_ok ? "matches" : "differs") << "\n";
+    return changed == 0 && root_ok;
+}
+
+//------------------------------------------------------------------//
+//         Binary diff                                              //
+//------------------------------------------------------------------//
+
+namespace simd
+{
+    /// Bit i is set when a[i] != b[i], for 64 consecutive bytes.
+    inline std::uint64_t mismatch_mask64_scalar(const std::uint8_t* a, const std::uint8_t* b)
+    {
+        std::uint64_t mask = 0;
+        for(int i = 0; i < 64; i++) {
+            mask |= static_cast<std::uint64_t>(a[i] != b[i]) << i;
+        }
+        return mask;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    inline std::uint64_t mismatch_mask64_sse2(const std::uint8_t* a, const std::uint8_t* b)
+    {
+        std::uint64_t eq = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16 * i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16 * i));
+            eq |= static_cast<std::uint64_t>(
+                      static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)))) << (16 * i);
+        }
+        return ~eq;
+    }
+
+    __attribute__((target("avx2")))
+    inline std::uint64_t mismatch_mask64_avx2(const std::uint8_t* a, const std::uint8_t* b)
+    {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 32));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32));
+        auto lo = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a0, b0)));
+        auto hi = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a1, b1)));
+        return ~(static_cast<std::uint64_t>(hi) << 32 | lo);
+    }
+#endif
+} // * --- End of namespace simd --- * //
+
+/// Range [begin, end) of bytes containing differences.
+struct DiffRange
+{
+    std::uint64_t begin;
+    std::uint64_t end;
+    // Number of differing bytes inside the range.
+    std::uint64_t count;
+};
+
+/** @brief Find ranges of differing bytes in [begin, end).
+ *
+ *  Bytes are compared 64 at a time and runs of differing bytes are
+ *  extracted from the mismatch bit mask. Two runs separated by at most
+ *  'gap' equal bytes are merged into the same range.
+ */
+template<typename Callback>
+void diff_ranges(const std::uint8_t* a, const std::uint8_t* b
+                 , std::size_t begin, std::size_t end, std::size_t gap, Callback&& on_range)
+{
+    using mask_fn = std::uint64_t (*)(const std::uint8_t*, const std::uint8_t*);
+    mask_fn mismatch_mask = &simd::mismatch_mask64_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    mismatch_mask = simd::has_avx2() ? &simd::mismatch_mask64_avx2 : &simd::mismatch_mask64_sse2;
+#endif
+
+    std::optional<DiffRange> open;
+
+    auto add_run = [&](std::uint64_t pos, std::uint64_t len)
+    {
+        if(open && pos - open->end <= gap) {
+            open->end = pos + len;
+            open->count += len;
+            return;
+        }
+        if(open) { on_range(*open); }
+        open = DiffRange{pos, pos + len, len};
+    };
+
+    auto add_mask = [&](std::size_t base, std::uint64_t m)
+    {
+        while(m != 0)
+        {
+            auto j = static_cast<unsigned>(__builtin_ctzll(m));
+            std::uint64_t rest = ~(m >> j);
+            unsigned ones = rest == 0 ? 64 - j : static_cast<unsigned>(__builtin_ctzll(rest));
+            add_run(base + j, ones);
+            m = (ones + j >= 64) ? 0 : m & (~std::uint64_t(0) << (j + ones));
+        }
+    };
+
+    std::size_t i = begin;
+    for(; i + 64 <= end; i += 64)
+    {
+        std::uint64_t m = mismatch_mask(a + i, b + i);
+        if(m != 0) { add_mask(i, m); }
+    }
+    if(i < end)
+    {
+        std::uint64_t m = 0;
+        for(std::size_t k = 0; i + k < end; k++) {
+            m |= static_cast<std::uint64_t>(a[i + k] != b[i + k]) << k;
+        }
+        add_mask(i, m);
+    }
+    if(open) { on_range(*open); }
+}
+
+/** @brief Hexdump rows of two files around a range, '-' rows from the first
+ *  file and '+' rows from the second.
+ *
+ *  The arrays a and b hold the bytes of the files in [base, view_end).
+ */
+void show_diff_range(OutputBuffer& out, const std::uint8_t* a, const std::uint8_t* b
+                     , std::uint64_t base, std::uint64_t view_end
+                     , DiffRange const& r, std::size_t context)
+{
+    // Very large ranges are truncated to their first 16 rows.
+    constexpr std::uint64_t max_shown = 256;
+    std::uint64_t shown_end = std::min(r.end, r.begin + max_shown);
+    std::uint64_t first = std::max(base, (r.begin > context ? r.begin - context : 0) / 16 * 16);
+    std::uint64_t last  = std::min<std::uint64_t>(view_end, shown_end + context);
+
+    char header[128];
+    int n = std::snprintf(header, sizeof(header)
+                          , "@@ 0x%016llx - 0x%016llx  %llu bytes differ @@\n"
+                          , static_cast<unsigned long long>(r.begin)
+                          , static_cast<unsigned long long>(r.end)
+                          , static_cast<unsigned long long>(r.count));
+    out.write(header, static_cast<std::size_t>(n));
+
+    for(std::uint64_t row = first; row < last; row += 16)
+    {
+        auto len = static_cast<std::size_t>(std::min<std::uint64_t>(16, view_end - row));
+        const std::uint8_t* ra = a + (row - base);
+        const std::uint8_t* rb = b + (row - base);
+        if(std::memcmp(ra, rb, len) == 0)
+        {
+            out.put(' ');
+            dump_hex_canonical(out, ra, len, row);
+            continue;
+        }
+        out.put('-');
+        dump_hex_canonical(out, ra, len, row);
+        out.put('+');
+        dump_hex_canonical(out, rb, len, row);
+    }
+    if(shown_end < r.end) {
+        out.write("  ...\n");
+    }
+    out.put('\n');
+}
+
+/** @brief Compare two binary files.
+ *
+ *  Any of the inputs may be a stream ('-' for stdin, pipes, devices); both
+ *  are then read in lockstep through fixed size buffers.
+ *
+ *  @param summary - Only print the number of ranges and differing bytes.
+ *  @param context - Bytes of context shown around each range.
+ *  @param gap     - Ranges separated by up to 'gap' equal bytes are merged.
+ *  @return true if files are equal.
+ */
+bool command_diff(std::string const& file1, std::string const& file2
+                  , bool summary, std::size_t context, std::size_t gap, unsigned jobs)
+{
+    constexpr std::size_t chunk_size = 16 << 20;
+
+    if(file1 == "-" && file2 == "-") {
+        throw std::runtime_error("Error: only one of the inputs can be the standard input");
+    }
+
+    OutputBuffer out;
+    std::uint64_t nranges = 0;
+    std::uint64_t nbytes  = 0;
+    // Ranges are merged across chunk boundaries before being displayed.
+    std::optional<DiffRange> pending;
+
+    // Rows shown around a range, copied when the range is first seen
+    // for stream inputs (whose buffers are reused afterwards).
+    struct DiffView
+    {
+        std::uint64_t             base = 0;
+        std::vector<std::uint8_t> a, b;
+    } view;
+
+    bool                mapped = false;
+    const std::uint8_t* map_a  = nullptr;
+    const std::uint8_t* map_b  = nullptr;
+    std::uint64_t       common = 0;
+
+    auto flush_pending = [&]
+    {
+        if(!pending) { return; }
+        nranges++;
+        nbytes += pending->count;
+        if(!summary)
+        {
+            if(mapped)
+                show_diff_range(out, map_a, map_b, 0, common, *pending, context);
+            else
+                show_diff_range(out, view.a.data(), view.b.data(), view.base
+                                , view.base + view.a.size(), *pending, context);
+        }
+        pending.reset();
+    };
+
+    // Called with the bytes of both files available in [base, base + avail).
+    auto add_range = [&](DiffRange const& r, const std::uint8_t* a, const std::uint8_t* b
+                         , std::uint64_t base, std::uint64_t avail)
+    {
+        if(pending && r.begin - pending->end <= gap) {
+            pending->end = r.end;
+            pending->count += r.count;
+            return;
+        }
+        flush_pending();
+        pending = r;
+        if(a != nullptr && !summary)
+        {
+            std::uint64_t first = std::max(base, (r.begin > context ? r.begin - context : 0) / 16 * 16);
+            std::uint64_t last  = std::min(base + avail, r.begin + 256 + context + 16);
+            view.base = first;
+            view.a.assign(a + (first - base), a + (last - base));
+            view.b.assign(b + (first - base), b + (last - base));
+        }
+    };
+
+    std::uint64_t size1 = 0, size2 = 0;
+    // Bytes following the common part in the longest file (first 16 of them).
+    std::vector<std::uint8_t> tail;
+
+    if(is_stream_input(file1) || is_stream_input(file2))
+    {
+        // Bytes kept before the scan position (context rows) and held back
+        // after it (rows shown after the start of a range).
+        const std::size_t history = context + 16;
+        const std::size_t margin  = 256 + context + 16;
+        StreamReader in1(file1, chunk_size), in2(file2, chunk_size);
+        if(history + margin >= chunk_size / 4) {
+            throw std::runtime_error("Error: context too large for stream input");
+        }
+
+        std::uint64_t scanned = 0;
+        for(;;)
+        {
+            std::size_t n1 = in1.fill(chunk_size);
+            std::size_t n2 = in2.fill(chunk_size);
+            std::size_t avail = std::min(n1, n2);
+            // One of the inputs ended: no more common bytes will come.
+            bool done = (in1.eof() && n1 == avail) || (in2.eof() && n2 == avail);
+            std::uint64_t base = in1.offset();
+            std::size_t begin = static_cast<std::size_t>(scanned - base);
+            std::size_t end   = done ? avail : avail - margin;
+
+            diff_ranges(in1.data(), in2.data(), begin, end, gap, [&](DiffRange r)
+            {
+                r.begin += base;
+                r.end   += base;
+                add_range(r, in1.data(), in2.data(), base, avail);
+            });
+            scanned = base + end;
+            if(done) { break; }
+            in1.consume(end - history);
+            in2.consume(end - history);
+        }
+        common = scanned;
+
+        auto count_tail = [&](StreamReader& in) -> std::uint64_t
+        {
+            in.consume(static_cast<std::size_t>(common - in.offset()));
+            auto n = std::min<std::size_t>(in.fill(16), 16);
+            tail.assign(in.data(), in.data() + n);
+            return common + in.skip(std::numeric_limits<std::uint64_t>::max());
+        };
+        size1 = in1.size() > static_cast<std::size_t>(common - in1.offset()) ? count_tail(in1) : common;
+        size2 = in2.size() > static_cast<std::size_t>(common - in2.offset()) ? count_tail(in2) : common;
+        flush_pending();
+    } else
+    {
+        auto map1 = MappedFile(file1);
+        auto map2 = MappedFile(file2);
+        map1.advise(MADV_SEQUENTIAL);
+        map2.advise(MADV_SEQUENTIAL);
+        mapped = true;
+        map_a  = map1.data();
+        map_b  = map2.data();
+        common = std::min(map1.size(), map2.size());
+        size1  = map1.size();
+        size2  = map2.size();
+        const std::size_t nchunks = (common + chunk_size - 1) / chunk_size;
+
+        auto work = [&](std::size_t chunk) -> std::vector<DiffRange>
+        {
+            std::vector<DiffRange> ranges;
+            std::size_t begin = chunk * chunk_size;
+            std::size_t end   = std::min<std::size_t>(begin + chunk_size, common);
+            diff_ranges(map_a, map_b, begin, end, gap, [&](DiffRange const& r){ ranges.push_back(r); });
+            return ranges;
+        };
+
+        process_chunks_ordered<std::vector<DiffRange>>(nchunks, resolve_jobs(jobs), work
+            , [&](std::vector<DiffRange> const& ranges)
+              {
+                  for(auto const& r: ranges) { add_range(r, nullptr, nullptr, 0, 0); }
+              });
+        flush_pending();
+
+        auto const* longer = size1 > size2 ? map_a : map_b;
+        auto extra = std::max(size1, size2) - common;
+        tail.assign(longer + common, longer + common + std::min<std::uint64_t>(extra, 16));
+    }
+
+    // Extra bytes at the end of the longest file.
+    bool same_size = size1 == size2;
+    if(!same_size)
+    {
+        bool first_longer = size1 > size2;
+        auto extra = static_cast<unsigned long long>(std::max(size1, size2) - common);
+        char line[160];
+        int n = std::snprintf(line, sizeof(line), "@@ tail: %s has %llu extra bytes at 0x%016llx @@\n"
+                              , first_longer ? "first file" : "second file", extra
+                              , static_cast<unsigned long long>(common));
+        out.write(line, static_cast<std::size_t>(n));
+        if(!summary)
+        {
+            out.put(first_longer ? '-' : '+');
+            dump_hex_canonical(out, tail.data(), tail.size(), common);
+            if(extra > 16) { out.write("  ...\n"); }
+        }
+    }
+
+    char line[160];
+    int n = std::snprintf(line, sizeof(line), " [INFO] Ranges: %llu ; differing bytes: %llu ; sizes: %llu / %llu\n"
+                          , static_cast<unsigned long long>(nranges)
+                          , static_cast<unsigned long long>(nbytes)
+                          , static_cast<unsigned long long>(size1)
+                          , static_cast<unsigned long long>(size2));
+    out.write(line, static_cast<std::size_t>(n));
+    return nranges == 0 && same_size;
+}
+
+//------------------------------------------------------------------//
+//         Schema-driven record decoding                            //
+//------------------------------------------------------------------//
+
+/** @brief Decoding plan of fixed-layout records.
+ *
+ *  The plan is compiled once from the schema: every field gets a
+ *  function pointer to a decoder instantiated for its type and byte
+ *  order, which decodes a whole column of a batch of records in a tight
+ *  loop. Formatting of CSV output is done the same way, column by
+ *  column, so there is no dispatch per value.
+ */
+struct DecodePlan
+{
+    /// Decode 'count' values at base + offset + i * stride into 'out'.
+    using decode_fn = void (*)(const std::uint8_t* base, std::size_t stride
+                               , std::size_t count, void* out);
+    /// Format 'count' values as text, 'ends[i]' receives the end of value i.
+    using format_fn = void (*)(const void* column, std::size_t count
+                               , std::string& text, std::vector<std::size_t>& ends);
+
+    struct Field
+    {
+        std::string  name;
+        data_type    type;
+        std::size_t  offset;
+        std::size_t  size;
+        decode_fn    decode;
+        // Decoder to little-endian values, for the binary columnar output.
+        decode_fn    decode_le;
+        format_fn    format;
+    };
+
+    std::vector<Field> fields;
+    std::size_t        stride      = 0;
+    // Bytes of a record which are actually read (end of the last field).
+    std::size_t        record_size = 0;
+};
+
+template<typename T, bool Swap>
+void decode_column(const std::uint8_t* base, std::size_t stride, std::size_t count, void* out)
+{
+    auto* dst = static_cast<T*>(out);
+    for(std::size_t i = 0; i < count; i++, base += stride)
+    {
+        T value;
+        std::memcpy(&value, base, sizeof(T));
+        if constexpr (Swap) { value = byte_swap(value); }
+        dst[i] = value;
+    }
+}
+
+template<typename T>
+void format_column(const void* column, std::size_t count
+                   , std::string& text, std::vector<std::size_t>& ends)
+{
+    const T* values = static_cast<const T*>(column);
+    char buf[32];
+    for(std::size_t i = 0; i < count; i++)
+    {
+        char* p = buf;
+        if constexpr (std::is_same<T, char>::value)
+        {
+            auto ch = static_cast<std::uint8_t>(values[i]);
+            if(ch >= 0x20 && ch < 0x7F && ch != ',' && ch != '"') {
+                *p++ = static_cast<char>(ch);
+            } else {
+                *p++ = '\\'; *p++ = 'x';
+                *p++ = tables::hex_pairs[ch][0];
+                *p++ = tables::hex_pairs[ch][1];
+            }
+        } else {
+            p = std::to_chars(buf, buf + sizeof(buf), values[i]).ptr;
+        }
+        text.append(buf, static_cast<std::size_t>(p - buf));
+        ends.push_back(text.size());
+    }
+}
+
+template<typename T>
+void set_field_functions(DecodePlan::Field& f, bool swap, bool swap_le)
+{
+    f.size      = sizeof(T);
+    f.decode    = swap    ? &decode_column<T, true> : &decode_column<T, false>;
+    f.decode_le = swap_le ? &decode_column<T, true> : &decode_column<T, false>;
+    f.format = &format_column<T>;
+}
+
+/** @brief Compile a record schema into a decoding plan.
+ *
+ *  Schema syntax: comma separated fields '<name>:<type>[le|be]' where the
+ *  type is one of the names accepted by --type of dump-bytes. A field
+ *  'pad<N>' skips N bytes. Example: "ts:u32,id:i16,pad2,value:f64be".
+ *
+ *  @param stride - Distance between two records, 0 => record size.
+ */
+auto compile_schema(std::string const& schema, std::size_t stride, byte_order order) -> DecodePlan
+{
+    using namespace std::string_literals;
+    constexpr auto native = (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+                          ? byte_order::little : byte_order::big;
+
+    DecodePlan plan;
+    std::size_t offset = 0;
+    std::stringstream ss(schema);
+    std::string item;
+
+    while(std::getline(ss, item, ','))
+    {
+        item.erase(std::remove_if(item.begin(), item.end()
+                                  , [](unsigned char c){ return std::isspace(c); }), item.end());
+        if(item.empty()) { continue; }
+
+        auto colon = item.find(':');
+        // Only 'pad<N>' without a type is padding, 'padding:u32' is a field.
+        if(colon == std::string::npos && item.rfind("pad", 0) == 0) {
+            offset += parse_size(item.substr(3));
+            continue;
+        }
+        if(colon == std::string::npos || colon == 0) {
+            throw std::runtime_error("Error: invalid schema field: "s + item);
+        }
+
+        DecodePlan::Field f;
+        f.name = item.substr(0, colon);
+        std::string tname = item.substr(colon + 1);
+        byte_order forder = order;
+        if(tname.size() > 2 && (tname.compare(tname.size() - 2, 2, "le") == 0
+                                || tname.compare(tname.size() - 2, 2, "be") == 0))
+        {
+            forder = parse_byte_order(tname.substr(tname.size() - 2));
+            tname  = tname.substr(0, tname.size() - 2);
+        }
+        f.type   = parse_data_type(tname);
+        f.offset = offset;
+        bool swap    = forder != native;
+        bool swap_le = forder != byte_order::little;
+
+        switch(f.type)
+        {
+        case data_type::t_char:  set_field_functions<char>(f, swap, swap_le);          break;
+        case data_type::t_i8:    set_field_functions<std::int8_t>(f, swap, swap_le);   break;
+        case data_type::t_i16:   set_field_functions<std::int16_t>(f, swap, swap_le);  break;
+        case data_type::t_i32:   set_field_functions<std::int32_t>(f, swap, swap_le);  break;
+        case data_type::t_i64:   set_field_functions<std::int64_t>(f, swap, swap_le);  break;
+        case data_type::t_byte:
+        case data_type::t_u8:    set_field_functions<std::uint8_t>(f, swap, swap_le);  break;
+        case data_type::t_u16:   set_field_functions<std::uint16_t>(f, swap, swap_le); break;
+        case data_type::t_u32:   set_field_functions<std::uint32_t>(f, swap, swap_le); break;
+        case data_type::t_u64:   set_field_functions<std::uint64_t>(f, swap, swap_le); break;
+        case data_type::t_flt32: set_field_functions<float>(f, swap, swap_le);         break;
+        case data_type::t_flt64: set_field_functions<double>(f, swap, swap_le);        break;
+        }
+        offset += f.size;
+        plan.fields.push_back(std::move(f));
+    }
+
+    if(plan.fields.empty()) {
+        throw std::runtime_error("Error: empty schema");
+    }
+    plan.record_size = plan.fields.back().offset + plan.fields.back().size;
+    plan.stride = stride == 0 ? offset : stride;
+    if(plan.stride < plan.record_size) {
+        throw std::runtime_error("Error: stride is smaller than the record size");
+    }
+    return plan;
+}
+
+/** @brief Decode records of a binary file into columns.
+ *
+ *  CSV is written to stdout. The binary columnar format is written to
+ *  'output' and has the following layout, all integers and values in
+ *  little-endian order whatever the byte order of the input fields:
+ *  @code
+ *    char     magic[8] = "HXCOL01\0";
+ *    u32      ncolumns;
+ *    u64      nrows;
+ *    ncolumns x { u8 type (data_type code); u16 name_length; char name[]; }
+ *    ncolumns x { values[nrows] }   // one contiguous array per column
+ *  @endcode
+ *
+ *  @param count  - Maximum number of records, 0 => up to end of file.
+ *  @param offset - Offset of the first record.
+ */
+void command_decode(std::string const& file, DecodePlan const& plan
+                    , std::size_t count, std::size_t offset
+                    , bool binary, std::string const& output)
+{
+    using namespace std::string_literals;
+    constexpr std::size_t batch = 64 << 10;
+
+    const bool stream = is_stream_input(file);
+    std::optional<MappedFile> fmap;
+    std::size_t nrows = 0;
+    if(!stream)
+    {
+        fmap.emplace(file);
+        fmap->advise(MADV_SEQUENTIAL);
+        if(fmap->size() >= offset + plan.record_size) {
+            nrows = (fmap->size() - offset - plan.record_size) / plan.stride + 1;
+        }
+        if(count != 0) { nrows = std::min(nrows, count); }
+    }
+
+    // Column buffers of a batch, 8 bytes per value at most.
+    std::vector<std::vector<std::uint64_t>> columns(plan.fields.size()
+                                                    , std::vector<std::uint64_t>(batch));
+
+    auto make_header = [&](std::uint64_t rows) -> std::string
+    {
+        char buf[12];
+        std::string header("HXCOL01\0", 8);
+        store_le(buf, static_cast<std::uint32_t>(plan.fields.size()));
+        store_le(buf + 4, rows);
+        header.append(buf, 12);
+        for(auto const& f: plan.fields)
+        {
+            auto code = static_cast<std::uint8_t>(f.type);
+            header.push_back(static_cast<char>(code));
+            store_le(buf, static_cast<std::uint16_t>(f.name.size()));
+            header.append(buf, 2);
+            header.append(f.name);
+        }
+        return header;
+    };
+
+    int fd_out = -1;
+    std::vector<std::uint64_t> column_pos;
+    // Stream input: the number of rows is only known at the end, so every
+    // column goes to an anonymous temporary file first.
+    std::vector<int> column_fds;
+
+    auto close_all = [&]
+    {
+        for(int fd: column_fds) { ::close(fd); }
+        if(fd_out >= 0) { ::close(fd_out); }
+    };
+    auto write_failed = [&]
+    {
+        close_all();
+        throw std::runtime_error("Error: failed to write file: "s + output);
+    };
+
+    if(binary)
+    {
+        if(output.empty()) {
+            throw std::runtime_error("Error: binary output requires an output file (-o)");
+        }
+        fd_out = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd_out < 0) {
+            throw std::runtime_error("Error: Unable to create file: "s + output);
+        }
+        if(stream)
+        {
+            auto dir = std::filesystem::path(output).parent_path();
+            if(dir.empty()) { dir = "."; }
+            for(std::size_t k = 0; k < plan.fields.size(); k++)
+            {
+                int fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR, 0600);
+                if(fd < 0) { write_failed(); }
+                column_fds.push_back(fd);
+            }
+        } else
+        {
+            auto header = make_header(nrows);
+            std::uint64_t pos = header.size();
+            for(auto const& f: plan.fields) {
+                column_pos.push_back(pos);
+                pos += f.size * nrows;
+            }
+            if(::pwrite(fd_out, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size())) {
+                write_failed();
+            }
+        }
+    }
+
+    OutputBuffer out;
+    if(!binary)
+    {
+        for(std::size_t k = 0; k < plan.fields.size(); k++)
+        {
+            if(k != 0) { out.put(','); }
+            out.write(plan.fields[k].name);
+        }
+        out.put('\n');
+    }
+
+    std::vector<std::string>              texts(plan.fields.size());
+    std::vector<std::vector<std::size_t>> ends(plan.fields.size());
+
+    // Decode n records starting at 'base' (record index 'first').
+    auto decode_batch = [&](const std::uint8_t* base, std::size_t first, std::size_t n)
+    {
+        for(std::size_t k = 0; k < plan.fields.size(); k++) {
+            auto decode = binary ? plan.fields[k].decode_le : plan.fields[k].decode;
+            decode(base + plan.fields[k].offset, plan.stride, n, columns[k].data());
+        }
+
+        if(binary)
+        {
+            for(std::size_t k = 0; k < plan.fields.size(); k++)
+            {
+                auto bytes = n * plan.fields[k].size;
+                auto data  = reinterpret_cast<const std::uint8_t*>(columns[k].data());
+                if(stream) {
+                    try { write_all(column_fds[k], data, bytes); }
+                    catch(std::runtime_error const&) { write_failed(); }
+                    continue;
+                }
+                auto pos = column_pos[k] + first * plan.fields[k].size;
+                if(::pwrite(fd_out, data, bytes, static_cast<off_t>(pos)) != static_cast<ssize_t>(bytes)) {
+                    write_failed();
+                }
+            }
+            return;
+        }
+
+        for(std::size_t k = 0; k < plan.fields.size(); k++)
+        {
+            texts[k].clear();
+            ends[k].clear();
+            plan.fields[k].format(columns[k].data(), n, texts[k], ends[k]);
+        }
+        // Interleave the formatted columns into rows.
+        for(std::size_t i = 0; i < n; i++)
+        {
+            for(std::size_t k = 0; k < plan.fields.size(); k++)
+            {
+                std::size_t b = i == 0 ? 0 : ends[k][i - 1];
+                if(k != 0) { out.put(','); }
+                out.write(texts[k].data() + b, ends[k][i] - b);
+            }
+            out.put('\n');
+        }
+    };
+
+    if(stream)
+    {
+        // Whole batches of records are buffered (at most 16 MiB).
+        const std::size_t per_fill = std::clamp<std::size_t>((16 << 20) / plan.stride, 1, batch);
+        StreamReader in(file, std::max(per_fill * plan.stride, plan.record_size));
+        if(in.skip(offset) == offset)
+        {
+            while(count == 0 || nrows < count)
+            {
+                std::size_t avail = in.fill(in.capacity());
+                if(avail < plan.record_size) { break; }
+                std::size_t n = std::min(per_fill, (avail - plan.record_size) / plan.stride + 1);
+                if(count != 0) { n = std::min(n, count - nrows); }
+                decode_batch(in.data(), nrows, n);
+                in.consume(n * plan.stride);
+                nrows += n;
+            }
+        }
+        if(binary)
+        {
+            auto header = make_header(nrows);
+            if(::pwrite(fd_out, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size())
+               || ::lseek(fd_out, static_cast<off_t>(header.size()), SEEK_SET) < 0) {
+                write_failed();
+            }
+            for(std::size_t k = 0; k < plan.fields.size(); k++)
+            {
+                try { copy_range(column_fds[k], 0, nrows * plan.fields[k].size, fd_out); }
+                catch(...) { close_all(); throw; }
+            }
+        }
+    } else
+    {
+        for(std::size_t first = 0; first < nrows; first += batch)
+        {
+            std::size_t n = std::min(batch, nrows - first);
+            decode_batch(fmap->data() + offset + first * plan.stride, first, n);
+        }
+    }
+
+    close_all();
+    std::cerr << " [INFO] Records decoded: " << nrows << "\n";
+}
+
+//------------------------------------------------------------------//
+//         In-place patching                                        //
+//------------------------------------------------------------------//
+
+/// Bytes to be written at some offset of a file.
+struct ByteEdit
+{
+    std::uint64_t             offset;
+    std::vector<std::uint8_t> bytes;
+};
+
+/// Parse an offset written in decimal or hexadecimal (0x prefix).
+auto parse_offset(std::string const& text) -> std::uint64_t
+{
+    using namespace std::string_literals;
+    std::uint64_t value = 0;
+    bool hex = text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+    const char* first = text.data() + (hex ? 2 : 0);
+    const char* last  = text.data() + text.size();
+    auto [ptr, ec] = std::from_chars(first, last, value, hex ? 16 : 10);
+    if(ec != std::errc() || ptr != last) {
+        throw std::runtime_error("Error: invalid offset: "s + text);
+    }
+    return value;
+}
+
+/// Parse hexadecimal bytes without wildcards such as "90 90 EB FE".
+auto parse_hex_bytes(std::string const& text) -> std::vector<std::uint8_t>
+{
+    using namespace std::string_literals;
+    auto pat = parse_byte_pattern(text);
+    if(std::any_of(pat.mask.begin(), pat.mask.end(), [](std::uint8_t m){ return m != 0xFF; })) {
+        throw std::runtime_error("Error: wildcards are not allowed in patch bytes: "s + text);
+    }
+    return pat.value;
+}
+
+/// Parse an edit given on the command line as OFFSET:HEX.
+auto parse_edit(std::string const& text) -> ByteEdit
+{
+    using namespace std::string_literals;
+    auto colon = text.find(':');
+    if(colon == std::string::npos) {
+        throw std::runtime_error("Error: invalid edit, expected OFFSET:HEX: "s + text);
+    }
+    return { parse_offset(text.substr(0, colon)), parse_hex_bytes(text.substr(colon + 1)) };
+}
+
+/** @brief Read an edit list, one '<offset> <hex bytes>' edit per line.
+ *  This is also the format of the undo files written by 'patch'. */
+auto read_edit_list(std::string const& file) -> std::vector<ByteEdit>
+{
+    using namespace std::string_literals;
+    auto ifs = std::ifstream(file);
+    if(!ifs) {
+        throw std::runtime_error("Error: Unable to open file: "s + file);
+    }
+    std::vector<ByteEdit> edits;
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        std::stringstream ss(line);
+        std::string offset;
+        if(!(ss >> offset) || offset[0] == '#') { continue; }
+        std::string rest;
+        std::getline(ss, rest);
+        edits.push_back({ parse_offset(offset), parse_hex_bytes(rest) });
+    }
+    return edits;
+}
+
+/** @brief Read an IPS patch file.
+ *
+ *  Records are a 3 bytes big-endian offset and a 2 bytes size followed by
+ *  the data; a size of zero introduces a run-length record (2 bytes count,
+ *  1 byte value). The file starts with "PATCH" and ends with "EOF".
+ */
+auto read_ips_patch(std::string const& file) -> std::vector<ByteEdit>
+{
+    using namespace std::string_literals;
+    auto ifs = std::ifstream(file, std::ios::in | std::ios::binary);
+    if(!ifs) {
+        throw std::runtime_error("Error: Unable to open file: "s + file);
+    }
+    std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(ifs))
+                                   , std::istreambuf_iterator<char>());
+    if(data.size() < 8 || std::memcmp(data.data(), "PATCH", 5) != 0) {
+        throw std::runtime_error("Error: not an IPS patch: "s + file);
+    }
+
+    std::vector<ByteEdit> edits;
+    std::size_t pos = 5;
+    auto need = [&](std::size_t n)
+    {
+        if(pos + n > data.size()) {
+            throw std::runtime_error("Error: truncated IPS patch: "s + file);
+        }
+    };
+    for(;;)
+    {
+        need(3);
+        if(std::memcmp(data.data() + pos, "EOF", 3) == 0) { break; }
+        std::uint64_t offset = std::uint64_t(data[pos]) << 16 | std::uint64_t(data[pos + 1]) << 8 | data[pos + 2];
+        pos += 3;
+        need(2);
+        std::size_t size = std::size_t(data[pos]) << 8 | data[pos + 1];
+        pos += 2;
+        if(size != 0)
+        {
+            need(size);
+            edits.push_back({ offset, { data.begin() + pos, data.begin() + pos + size } });
+            pos += size;
+            continue;
+        }
+        need(3);
+        std::size_t run = std::size_t(data[pos]) << 8 | data[pos + 1];
+        edits.push_back({ offset, std::vector<std::uint8_t>(run, data[pos + 2]) });
+        pos += 3;
+    }
+    return edits;
+}
+
+/** @brief Merge edits into non-overlapping runs sorted by offset.
+ *
+ *  Edits that overlap or touch each other are combined into a single
+ *  run, so that each run is applied with one pwrite(2). Where edits
+ *  overlap, the one given last wins.
+ */
+auto coalesce_edits(std::vector<ByteEdit> const& edits) -> std::vector<ByteEdit>
+{
+    std::vector<std::size_t> order(edits.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                     { return edits[a].offset < edits[b].offset; });
+
+    std::vector<ByteEdit>    runs;
+    std::vector<std::size_t> owner;   // Edit index which wrote each byte of the last run
+
+    for(auto k: order)
+    {
+        auto const& e = edits[k];
+        if(e.bytes.empty()) { continue; }
+
+        if(runs.empty() || e.offset > runs.back().offset + runs.back().bytes.size())
+        {
+            runs.push_back(e);
+            owner.assign(e.bytes.size(), k);
+            continue;
+        }
+        auto& run = runs.back();
+        for(std::size_t i = 0; i < e.bytes.size(); i++)
+        {
+            auto pos = static_cast<std::size_t>(e.offset - run.offset) + i;
+            if(pos == run.bytes.size()) {
+                run.bytes.push_back(e.bytes[i]);
+                owner.push_back(k);
+            } else if(owner[pos] < k) {
+                run.bytes[pos] = e.bytes[i];
+                owner[pos] = k;
+            }
+        }
+    }
+    return runs;
+}
+
+/** @brief Apply edits to a file in place.
+ *
+ *  Only the edited bytes are read and written, the cost depends on the
+ *  number of edits and not on the file size. The original bytes are
+ *  saved to 'undo_file' (in the edit list format) before the file is
+ *  modified, so that 'patch FILE --edits UNDO' reverts the change.
+ */
+void command_patch(std::string const& file, std::vector<ByteEdit> const& edits
+                   , std::string const& undo_file, bool sync, bool dry_run)
+{
+    using namespace std::string_literals;
+
+    // Edits are applied in place, which requires a seekable file.
+    if(is_stream_input(file)) {
+        throw std::runtime_error("Error: patch requires a regular file: "s + file);
+    }
+    auto runs = coalesce_edits(edits);
+
+    int fd = ::open(file.c_str(), dry_run ? O_RDONLY : O_RDWR);
+    if(fd < 0) {
+        throw std::runtime_error("Error: Unable to open file: "s + file);
+    }
+    struct stat st{};
+    ::fstat(fd, &st);
+    auto file_size = static_cast<std::uint64_t>(st.st_size);
+
+    auto fail = [&](std::string const& msg)
+    {
+        ::close(fd);
+        throw std::runtime_error(msg);
+    };
+
+    // Validate everything and save original bytes before writing anything.
+    std::vector<std::vector<std::uint8_t>> originals;
+    for(auto const& r: runs)
+    {
+        if(r.offset + r.bytes.size() > file_size) {
+            fail("Error: edit at offset "s + std::to_string(r.offset) + " goes beyond end of file");
+        }
+        std::vector<std::uint8_t> orig(r.bytes.size());
+        if(::pread(fd, orig.data(), orig.size(), static_cast<off_t>(r.offset))
+           != static_cast<ssize_t>(orig.size())) {
+            fail("Error: failed to read file: "s + file);
+        }
+        originals.push_back(std::move(orig));
+    }
+
+    auto to_hex = [](std::vector<std::uint8_t> const& bytes)
+    {
+        std::string s;
+        for(auto b: bytes)
+        {
+            if(!s.empty()) { s.push_back(' '); }
+            s.append(tables::hex_pairs[b].data(), 2);
+        }
+        return s;
+    };
+
+    if(!undo_file.empty() && !dry_run)
+    {
+        std::ofstream ofs(undo_file);
+        if(!ofs) { fail("Error: Unable to create file: "s + undo_file); }
+        ofs << "# hextool undo file for: " << file << "\n";
+        for(std::size_t i = 0; i < runs.size(); i++) {
+            ofs << "0x" << std::hex << runs[i].offset << std::dec << " " << to_hex(originals[i]) << "\n";
+        }
+        ofs.flush();
+        if(!ofs) { fail("Error: failed to write file: "s + undo_file); }
+    }
+
+    std::uint64_t written = 0;
+    for(std::size_t i = 0; i < runs.size(); i++)
+    {
+        auto const& r = runs[i];
+        std::cout << " 0x" << std::hex << std::setw(16) << std::setfill('0') << r.offset
+                  << std::dec << std::setfill(' ') << " " << std::setw(8) << r.bytes.size() << " bytes";
+        if(r.bytes.size() <= 16) {
+            std::cout << "  " << to_hex(originals[i]) << " => " << to_hex(r.bytes);
+        }
+        std::cout << "\n";
+
+        if(dry_run) { continue; }
+        if(::pwrite(fd, r.bytes.data(), r.bytes.size(), static_cast<off_t>(r.offset))
+           != static_cast<ssize_t>(r.bytes.size())) {
+            fail("Error: failed to write file: "s + file);
+        }
+        written += r.bytes.size();
+    }
+
+    if(sync && !dry_run && ::fdatasync(fd) < 0) {
+        fail("Error: fdatasync failed: "s + file);
+    }
+    ::close(fd);
+    std::cerr << " [INFO] Edits: " << edits.size() << " ; writes: " << runs.size()
+              << " ; bytes written: " << written << (dry_run ? " (dry run)" : "") << "\n";
+}
+
+//------------------------------------------------------------------//
+//         Interactive viewer                                       //
+//------------------------------------------------------------------//
+
+/** @brief Raw mode terminal on the alternate screen.
+ *
+ *  The previous terminal settings and screen are restored on destruction.
+ */
+class TerminalSession
+{
+    termios m_saved{};
+public:
+
+    TerminalSession()
+    {
+        if(!::isatty(STDIN_FILENO) || !::isatty(STDOUT_FILENO)) {
+            throw std::runtime_error("Error: view requires a terminal");
+        }
+        ::tcgetattr(STDIN_FILENO, &m_saved);
+        termios raw = m_saved;
+        raw.c_iflag &= ~static_cast<tcflag_t>(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+        raw.c_oflag &= ~static_cast<tcflag_t>(OPOST);
+        raw.c_cflag |= CS8;
+        raw.c_lflag &= ~static_cast<tcflag_t>(ECHO | ICANON | IEXTEN | ISIG);
+        raw.c_cc[VMIN]  = 1;
+        raw.c_cc[VTIME] = 0;
+        ::tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+        // No SA_RESTART: a blocked read() returns EINTR on resize and
+        // the viewer redraws with the new size.
+        struct sigaction sa{};
+        sa.sa_handler = [](int){ };
+        ::sigaction(SIGWINCH, &sa, nullptr);
+
+        // Alternate screen and hidden cursor.
+        this->write("\x1b[?1049h\x1b[?25l");
+    }
+
+    ~TerminalSession()
+    {
+        this->write("\x1b[?25h\x1b[?1049l");
+        ::tcsetattr(STDIN_FILENO, TCSAFLUSH, &m_saved);
+        ::signal(SIGWINCH, SIG_DFL);
+    }
+
+    TerminalSession(TerminalSession const&) = delete;
+    TerminalSession& operator=(TerminalSession const&) = delete;
+
+    /// Terminal size as (rows, columns).
+    static auto size() -> std::pair<int, int>
+    {
+        winsize ws{};
+        if(::ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_row == 0) {
+            return {24, 80};
+        }
+        return {ws.ws_row, ws.ws_col};
+    }
+
+    /// True if a key is waiting to be read (timeout in milliseconds).
+    static bool key_pending(int timeout)
+    {
+        pollfd pfd{STDIN_FILENO, POLLIN, 0};
+        return ::poll(&pfd, 1, timeout) > 0;
+    }
+
+    static void write(std::string_view s)
+    {
+        while(!s.empty())
+        {
+            auto n = ::write(STDOUT_FILENO, s.data(), s.size());
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n <= 0) { break; }
+            s.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+};
+
+/// Keys understood by the viewer; other values are plain characters.
+enum view_key: int
+{
+      key_none = -1
+    , key_up = 0x100, key_down, key_left, key_right
+    , key_page_up, key_page_down, key_home, key_end
+    , key_resize
+};
+
+/// Read a key press, decoding the escape sequences of cursor keys.
+int read_key()
+{
+    unsigned char ch;
+    auto n = ::read(STDIN_FILENO, &ch, 1);
+    if(n < 0 && errno == EINTR) { return key_resize; }
+    if(n <= 0) { return 'q'; }
+    if(ch != 0x1b) { return ch; }
+
+    // Lone ESC or escape sequence: "ESC [ A", "ESC [ 5 ~", "ESC O H", ...
+    char seq[4] = {};
+    if(!TerminalSession::key_pending(30) || ::read(STDIN_FILENO, &seq[0], 1) != 1) { return 0x1b; }
+    if(!TerminalSession::key_pending(30) || ::read(STDIN_FILENO, &seq[1], 1) != 1) { return 0x1b; }
+    if(seq[0] != '[' && seq[0] != 'O') { return 0x1b; }
+    if(seq[1] >= '0' && seq[1] <= '9')
+    {
+        if(::read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~') { return key_none; }
+        switch(seq[1])
+        {
+        case '1': case '7': return key_home;
+        case '4': case '8': return key_end;
+        case '5': return key_page_up;
+        case '6': return key_page_down;
+        }
+        return key_none;
+    }
+    switch(seq[1])
+    {
+    case 'A': return key_up;
+    case 'B': return key_down;
+    case 'C': return key_right;
+    case 'D': return key_left;
+    case 'H': return key_home;
+    case 'F': return key_end;
+    }
+    return key_none;
+}
+
+/** @brief Interactive hex viewer of a memory mapped file.
+ *
+ *  Only the visible rows are formatted, so moving to any offset costs
+ *  the same on files of any size: pages are faulted in on demand
+ *  (MADV_RANDOM disables read-ahead of unrelated data). Searches use
+ *  the same kernel as 'find' and run in steps, checking the keyboard
+ *  between steps so that a long search can be cancelled.
+ */
+class HexViewer
+{
+    static constexpr std::uint64_t row_bytes   = 16;
+    static constexpr std::size_t   search_step = 64 << 20;
+
+    std::string                m_file;
+    MappedFile                 m_map;
+    std::uint64_t              m_cursor    = 0;
+    std::uint64_t              m_top       = 0;
+    // Length of the match under the cursor (highlighted).
+    std::size_t                m_match_len = 0;
+    std::optional<BytePattern> m_pattern;
+    std::string                m_message;
+    int                        m_rows      = 24;
+    int                        m_columns   = 80;
+public:
+
+    explicit HexViewer(std::string const& file)
+        : m_file(file), m_map(file)
+    {
+        m_map.advise(MADV_RANDOM);
+    }
+
+    void run(std::uint64_t offset)
+    {
+        TerminalSession term;
+        this->move_to(offset);
+
+        for(;;)
+        {
+            std::tie(m_rows, m_columns) = TerminalSession::size();
+            this->render();
+            int key = read_key();
+            m_message.clear();
+            m_match_len = 0;
+
+            const auto page = static_cast<std::uint64_t>(std::max(1, m_rows - 2)) * row_bytes;
+            switch(key)
+            {
+            case 'q': case 0x03:         return;
+            case 'j': case key_down:     this->move_by(+static_cast<std::int64_t>(row_bytes)); break;
+            case 'k': case key_up:       this->move_by(-static_cast<std::int64_t>(row_bytes)); break;
+            case 'l': case key_right:    this->move_by(+1); break;
+            case 'h': case key_left:     this->move_by(-1); break;
+            case ' ': case 0x06: case key_page_down: this->move_by(+static_cast<std::int64_t>(page)); break;
+            case 'b': case 0x02: case key_page_up:   this->move_by(-static_cast<std::int64_t>(page)); break;
+            case 'g': case key_home:     this->move_to(0); break;
+            case 'G': case key_end:      this->move_to(std::numeric_limits<std::uint64_t>::max()); break;
+            case ':':
+                if(auto text = this->prompt("Offset: ")) {
+                    try { this->move_to(parse_offset(*text)); }
+                    catch(std::runtime_error const& ex) { m_message = ex.what(); }
+                }
+                break;
+            case '/':
+                if(auto text = this->prompt("Hex pattern: ")) {
+                    try {
+                        m_pattern = parse_byte_pattern(*text);
+                        this->search_forward(m_cursor);
+                    } catch(std::runtime_error const& ex) { m_message = ex.what(); }
+                }
+                break;
+            case 'n': this->search_forward(m_cursor + 1); break;
+            case 'N': this->search_backward(m_cursor);    break;
+            }
+        }
+    }
+
+private:
+
+    std::uint64_t visible_rows() const
+    {
+        return static_cast<std::uint64_t>(std::max(1, m_rows - 1));
+    }
+
+    void move_to(std::uint64_t offset)
+    {
+        m_cursor = m_map.size() == 0 ? 0 : std::min<std::uint64_t>(offset, m_map.size() - 1);
+        // Scroll so that the cursor row is visible.
+        std::uint64_t row = m_cursor / row_bytes;
+        if(row < m_top / row_bytes) {
+            m_top = row * row_bytes;
+        } else if(row >= m_top / row_bytes + this->visible_rows()) {
+            m_top = (row - this->visible_rows() + 1) * row_bytes;
+        }
+    }
+
+    void move_by(std::int64_t delta)
+    {
+        if(delta >= 0 || static_cast<std::uint64_t>(-delta) <= m_cursor) {
+            this->move_to(m_cursor + static_cast<std::uint64_t>(delta));
+        } else if(static_cast<std::uint64_t>(-delta) > row_bytes) {
+            // Page up near the start: first row, same column.
+            this->move_to(m_cursor % row_bytes);
+        }
+    }
+
+    void render()
+    {
+        const std::uint8_t* data = m_map.data();
+        const std::uint64_t size = m_map.size();
+        const int width = size > 0xFFFFFFFFULL ? 16 : 8;
+        const std::uint64_t hl_begin = m_cursor;
+        const std::uint64_t hl_end   = m_cursor + std::max<std::size_t>(m_match_len, 1);
+
+        std::string frame = "\x1b[H";
+        char line[512];
+        for(std::uint64_t r = 0; r < this->visible_rows(); r++)
+        {
+            std::uint64_t off = m_top + r * row_bytes;
+            if(off >= size) {
+                frame += "~\x1b[K\r\n";
+                continue;
+            }
+            std::size_t n = static_cast<std::size_t>(std::min(row_bytes, size - off));
+            char* p = format_offset(line, off, width);
+            *p++ = ' ';
+            *p++ = ' ';
+            auto highlight = [&](std::uint64_t pos, bool on)
+            {
+                if(pos >= hl_begin && pos < hl_end) {
+                    std::memcpy(p, on ? "\x1b[7m" : "\x1b[0m", 4);
+                    p += 4;
+                }
+            };
+            for(std::size_t i = 0; i < row_bytes; i++)
+            {
+                if(i == 8) { *p++ = ' '; }
+                if(i < n) {
+                    highlight(off + i, true);
+                    std::memcpy(p, tables::hex_pairs[data[off + i]].data(), 2);
+                    p += 2;
+                    highlight(off + i, false);
+                    *p++ = ' ';
+                } else {
+                    std::memset(p, ' ', 3);
+                    p += 3;
+                }
+            }
+            *p++ = ' ';
+            *p++ = '|';
+            for(std::size_t i = 0; i < n; i++)
+            {
+                highlight(off + i, true);
+                *p++ = tables::ascii[data[off + i]];
+                highlight(off + i, false);
+            }
+            *p++ = '|';
+            frame.append(line, static_cast<std::size_t>(p - line));
+            frame += "\x1b[K\r\n";
+        }
+
+        char status[256];
+        int percent = size == 0 ? 100 : static_cast<int>(m_cursor * 100 / size);
+        std::snprintf(status, sizeof(status), " %s  0x%llx / 0x%llx (%d%%)  %s"
+                      , m_file.c_str()
+                      , static_cast<unsigned long long>(m_cursor)
+                      , static_cast<unsigned long long>(size), percent
+                      , m_message.empty() ? "q quit, : offset, / search, n/N next/previous"
+                                          : m_message.c_str());
+        std::string text(status);
+        text.resize(static_cast<std::size_t>(std::max(m_columns, 1)), ' ');
+        frame += "\x1b[7m" + text + "\x1b[0m";
+        TerminalSession::write(frame);
+    }
+
+    /// Read a line of text on the status line; std::nullopt if cancelled.
+    auto prompt(std::string const& label) -> std::optional<std::string>
+    {
+        std::string text;
+        for(;;)
+        {
+            std::string line = "\x1b[" + std::to_string(m_rows) + ";1H\x1b[K" + label + text;
+            TerminalSession::write(line);
+            int key = read_key();
+            if(key == '\r' || key == '\n') { return text; }
+            if(key == 0x1b || key == 0x03)  { return std::nullopt; }
+            if(key == 127 || key == 0x08) {
+                if(!text.empty()) { text.pop_back(); }
+            } else if(key >= 0x20 && key < 0x7F) {
+                text.push_back(static_cast<char>(key));
+            }
+        }
+    }
+
+    void show_progress(std::uint64_t pos)
+    {
+        char line[96];
+        std::snprintf(line, sizeof(line), "\x1b[%d;1H\x1b[K Searching... 0x%llx (any key cancels)"
+                      , m_rows, static_cast<unsigned long long>(pos));
+        TerminalSession::write(line);
+    }
+
+    bool cancelled(std::uint64_t pos)
+    {
+        if(!TerminalSession::key_pending(0)) { return false; }
+        read_key();
+        char text[64];
+        std::snprintf(text, sizeof(text), "Search cancelled at 0x%llx"
+                      , static_cast<unsigned long long>(pos));
+        m_message = text;
+        return true;
+    }
+
+    void search_forward(std::uint64_t from)
+    {
+        if(!m_pattern) { m_message = "No pattern, use / first"; return; }
+        const std::size_t size = m_map.size();
+        for(std::size_t pos = from; pos < size; pos += search_step)
+        {
+            std::size_t end = std::min<std::size_t>(size, pos + search_step);
+            m_map.advise_range(pos, end - pos + m_pattern->size(), MADV_WILLNEED);
+            auto found = find_first_pattern(*m_pattern, m_map.data(), pos, end, size);
+            if(found) { return this->show_match(*found); }
+            this->show_progress(end);
+            if(this->cancelled(end)) { return; }
+        }
+        m_message = "Pattern not found: " + m_pattern->text;
+    }
+
+    void search_backward(std::uint64_t before)
+    {
+        if(!m_pattern) { m_message = "No pattern, use / first"; return; }
+        for(std::uint64_t end = before; end > 0; )
+        {
+            std::uint64_t begin = end > search_step ? end - search_step : 0;
+            m_map.advise_range(begin, end - begin + m_pattern->size(), MADV_WILLNEED);
+            std::optional<std::size_t> last;
+            scan_pattern(*m_pattern, m_map.data(), begin, end, m_map.size()
+                         , [&](std::size_t p){ last = p; });
+            if(last) { return this->show_match(*last); }
+            this->show_progress(begin);
+            if(this->cancelled(begin)) { return; }
+            end = begin;
+        }
+        m_message = "Pattern not found: " + m_pattern->text;
+    }
+
+    void show_match(std::uint64_t pos)
+    {
+        this->move_to(pos);
+        m_match_len = m_pattern->size();
+        m_message = "Match: " + m_pattern->text;
+    }
+};
+
+// Benchmarks include this file for its functions (see bench/).
+#ifndef CLIBOX_NO_MAIN
+int main(int argc, char** argv)
+{
+    CLI::App app{ "hextool - Tool for analysis of binary files"};
+    //app.footer("\n Creator: Somebody else.");
+    app.footer("\n Use '-' as <FILE> to read the standard input; pipes and devices are read as streams.");
+
+     // Dump printable characters of a binary file
+    auto cmd_strings = app.add_subcommand("dump-strings",
+                                          "Dump all printable strings of a binary file");
+
+    std::string file;
+    cmd_strings->add_option("<FILE>", file)->required();
+
+    auto cmd_dump = app.add_subcommand("dump-bytes"
+                                       , "Read binary file at some offset");
+
+    cmd_dump->add_option("<FILE>", file)->required();
+
+    long offset = -1;
+    cmd_dump->add_option("--offset", offset);
+
+    size_t size = 1;
+
+    cmd_dump->add_option("--size", size, "Number of elements to display, 0 => up to end of file");
+
+    std::string dtype_name = "byte";
+    cmd_dump->add_option("--type", dtype_name,
+                         "Set display type => byte (hexdump), char, i8, i16, i32, i64"
+                         ", u8, u16, u32, u64, f32, f64");
+
+    std::string endian_name = "little";
+    cmd_dump->add_option("--endian", endian_name,
+                         "Byte order of multi-byte values => little, big");
+
+    // Search byte patterns with wildcards
+    auto cmd_find = app.add_subcommand("find"
+                                       , "Search byte patterns such as '4D 5A ?? ?? 50 45'");
+
+    cmd_find->add_option("<FILE>", file)->required();
+
+    std::vector<std::string> find_patterns;
+    cmd_find->add_option("<PATTERN>", find_patterns
+                         , "Hex pattern, ? replaces a nibble and ?? any byte");
+
+    std::string find_pattern_file;
+    cmd_find->add_option("-f,--file", find_pattern_file
+                         , "File containing one pattern per line");
+
+    unsigned jobs = 1;
+    cmd_find->add_option("-j,--jobs", jobs, "Number of threads, 0 => all cores");
+
+    // Carve embedded files
+    auto cmd_carve = app.add_subcommand("carve"
+                                        , "Extract embedded files (JPEG, PNG, ZIP, PDF, ELF ...)");
+
+    cmd_carve->add_option("<FILE>", file)->required();
+
+    std::string carve_table_file;
+    cmd_carve->add_option("-t,--table", carve_table_file
+                          , "Signature table: <name> <ext> <header> <footer>[+extra] <max-length>");
+
+    std::string carve_outdir = "carved";
+    cmd_carve->add_option("-o,--output", carve_outdir, "Output directory");
+
+    bool carve_list = false;
+    cmd_carve->add_flag("-l,--list", carve_list, "Only list files found, do not write them");
+
+    cmd_carve->add_option("-j,--jobs", jobs, "Number of threads, 0 => all cores");
+
+    // Sliding window entropy
+    auto cmd_entropy = app.add_subcommand("entropy"
+                                          , "Shannon entropy and byte histogram of sliding windows");
+
+    cmd_entropy->add_option("<FILE>", file)->required();
+
+    std::string entropy_window = "4K";
+    cmd_entropy->add_option("-w,--window", entropy_window, "Window size, for instance: 512, 4K, 1M");
+
+    std::string entropy_step = "";
+    cmd_entropy->add_option("-s,--step", entropy_step, "Distance between windows (default: window size)");
+
+    bool entropy_binary = false;
+    cmd_entropy->add_flag("--binary", entropy_binary
+                          , "Write binary records {u64 offset; f32 entropy} instead of CSV");
+
+    bool entropy_histogram = false;
+    cmd_entropy->add_flag("--histogram", entropy_histogram, "Add the 256 byte counts of each window");
+
+    cmd_entropy->add_option("-j,--jobs", jobs, "Number of threads, 0 => all cores");
+
+    // Block hashing
+    auto cmd_hash = app.add_subcommand("hash"
+                                       , "Hash fixed-size blocks and write a manifest with a Merkle root");
+
+    cmd_hash->add_option("<FILE>", file)->required();
+
+    std::string hash_algo = "sha256";
+    cmd_hash->add_option("-a,--algorithm", hash_algo, "Hash algorithm => sha256, xxh3, crc32c");
+
+    std::string hash_block = "1M";
+    cmd_hash->add_option("-b,--block", hash_block, "Block size, for instance: 64K, 1M");
+
+    std::string hash_manifest = "";
+    cmd_hash->add_option("-o,--output", hash_manifest, "Manifest file (default: stdout)");
+
+    cmd_hash->add_option("-j,--jobs", jobs, "Number of threads, 0 => all cores");
+
+    // Verification against a manifest
+    auto cmd_verify = app.add_subcommand("verify"
+                                         , "Check a file against a block manifest and report changed blocks");
+
+    cmd_verify->add_option("<FILE>", file)->required();
+    cmd_verify->add_option("-m,--manifest", hash_manifest, "Manifest written by 'hash'")->required();
+    cmd_verify->add_option("-j,--jobs", jobs, "Number of threads, 0 => all cores");
+
+    // Binary diff
+    auto cmd_diff = app.add_subcommand("diff", "Compare two binary files");
+
+    cmd_diff->add_option("<FILE>", file)->required();
+
+    std::string file2;
+    cmd_diff->add_option("<FILE2>", file2)->required();
+
+    bool diff_summary = false;
+    cmd_diff->add_flag("-s,--summary", diff_summary, "Only show the number of differences");
+
+    size_t diff_context = 16;
+    cmd_diff->add_option("-c,--context", diff_context, "Bytes of context around each range");
+
+    size_t diff_gap = 8;
+    cmd_diff->add_option("-g,--gap", diff_gap, "Merge ranges separated by up to N equal bytes");
+
+    cmd_diff->add_option("-j,--jobs", jobs, "Number of threads, 0 => all cores");
+
+    // Record decoding
+    auto cmd_decode = app.add_subcommand("decode"
+                                         , "Decode fixed-layout records into CSV or binary columns");
+
+    cmd_decode->add_option("<FILE>", file)->required();
+
+    std::string decode_schema;
+    cmd_decode->add_option("--schema", decode_schema
+                           , "Fields <name>:<type>[le|be] or pad<N>, e.g. 'ts:u32,id:i16,value:f64'")
+                           ->required();
+
+    size_t decode_stride = 0;
+    cmd_decode->add_option("--stride", decode_stride, "Distance between records, 0 => record size");
+
+    size_t decode_count = 0;
+    cmd_decode->add_option("--count", decode_count, "Maximum number of records, 0 => all");
+
+    size_t decode_offset = 0;
+    cmd_decode->add_option("--offset", decode_offset, "Offset of the first record");
+
+    cmd_decode->add_option("--endian", endian_name, "Default byte order => little, big");
+
+    bool decode_binary = false;
+    cmd_decode->add_flag("--binary", decode_binary, "Write binary columnar format instead of CSV");
+
+    std::string decode_output;
+    cmd_decode->add_option("-o,--output", decode_output, "Output file of the binary format");
+
+    // In-place patching
+    auto cmd_patch = app.add_subcommand("patch", "Patch bytes of a file in place");
+
+    cmd_patch->add_option("<FILE>", file)->required();
+
+    std::vector<std::string> patch_edits;
+    cmd_patch->add_option("-e,--edit", patch_edits, "Edit OFFSET:HEX, for instance: 0x1F0:90 90");
+
+    std::string patch_edit_file;
+    cmd_patch->add_option("--edits", patch_edit_file, "File with one '<offset> <hex bytes>' edit per line");
+
+    std::string patch_ips_file;
+    cmd_patch->add_option("--ips", patch_ips_file, "IPS patch file");
+
+    std::string patch_undo_file;
+    cmd_patch->add_option("--undo", patch_undo_file, "Save original bytes to this file (edit list format)");
+
+    bool patch_sync = false;
+    cmd_patch->add_flag("--sync", patch_sync, "Call fdatasync() after writing");
+
+    bool patch_dry_run = false;
+    cmd_patch->add_flag("-n,--dry-run", patch_dry_run, "Only show the edits");
+
+    // Interactive viewer
+    auto cmd_view = app.add_subcommand("view", "Interactive hex viewer (memory mapped)");
+
+    cmd_view->add_option("<FILE>", file)->required();
+
+    std::string view_offset = "0";
+    cmd_view->add_option("--offset", view_offset, "Initial offset, decimal or hexadecimal (0x)");
+
+    // Execution statistics (every subcommand but the interactive viewer)
+    stats::Options stats_options;
+    for(auto cmd: {cmd_strings, cmd_dump, cmd_find, cmd_carve, cmd_entropy, cmd_hash
+                  , cmd_verify, cmd_diff, cmd_decode, cmd_patch}) {
+        stats::add_options(cmd, stats_options);
+    }
+
+    // ----- Parse Arguments ---------//
+    try {
+        app.require_subcommand();
+        app.validate_positionals();
+        CLI11_PARSE(app, argc, argv);
+    } catch (std::exception& ex) {
+        std::cout << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    //------ Program Actions ---------//
+
+    stats::Session stats_session(stats_options);
+    // Time not spent reading or writing is spent processing the data.
+    stats::ScopedPhase stats_timer(stats::phase::match);
+
+    if(*cmd_strings)
+    {
+        std::cout << " Selected file: " << file << std::endl;
+        try {
+            command_strings(file);
+        } catch (std::runtime_error& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_dump)
+    {
+        try {
+            dump_binary(file, parse_data_type(dtype_name), size, offset
+                        , parse_byte_order(endian_name));
+        } catch (std::runtime_error& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_find)
+    {
+        try {
+            std::vector<BytePattern> patterns;
+            if(!find_pattern_file.empty()) {
+                patterns = read_pattern_file(find_pattern_file);
+            }
+            for(auto const& text: find_patterns) {
+                patterns.push_back(parse_byte_pattern(text));
+            }
+            if(patterns.empty()) {
+                throw std::runtime_error("Error: no pattern given");
+            }
+            command_find(file, patterns, jobs);
+        } catch (std::runtime_error& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_carve)
+    {
+        try {
+            std::vector<CarveSignature> table;
+            if(carve_table_file.empty()) {
+                std::stringstream ss(default_carve_table);
+                table = parse_carve_table(ss);
+            } else {
+                auto ifs = std::ifstream(carve_table_file);
+                if(!ifs) {
+                    throw std::runtime_error("Error: Unable to open file: " + carve_table_file);
+                }
+                table = parse_carve_table(ifs);
+            }
+            command_carve(file, table, carve_outdir, carve_list, jobs);
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_entropy)
+    {
+        try {
+            auto window = parse_size(entropy_window);
+            auto step   = entropy_step.empty() ? window : parse_size(entropy_step);
+            command_entropy(file, window, step
+                            , entropy_binary ? entropy_format::binary : entropy_format::csv
+                            , entropy_histogram, jobs);
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_hash)
+    {
+        try {
+            command_hash(file, parse_hash_algorithm(hash_algo), parse_size(hash_block)
+                         , hash_manifest, jobs);
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_verify)
+    {
+        try {
+            return command_verify(file, hash_manifest, jobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(*cmd_diff)
+    {
+        try {
+            bool same = command_diff(file, file2, diff_summary, diff_context, diff_gap, jobs);
+            return same ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(*cmd_decode)
+    {
+        try {
+            auto plan = compile_schema(decode_schema, decode_stride, parse_byte_order(endian_name));
+            command_decode(file, plan, decode_count, decode_offset, decode_binary, decode_output);
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_patch)
+    {
+        try {
+            std::vector<ByteEdit> edits;
+            if(!patch_ips_file.empty())  { edits = read_ips_patch(patch_ips_file);  }
+            if(!patch_edit_file.empty())
+            {
+                auto list = read_edit_list(patch_edit_file);
+                edits.insert(edits.end(), list.begin(), list.end());
+            }
+            for(auto const& e: patch_edits) { edits.push_back(parse_edit(e)); }
+            if(edits.empty()) {
+                throw std::runtime_error("Error: no edit given");
+            }
+            command_patch(file, edits, patch_undo_file, patch_sync, patch_dry_run);
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_view)
+    {
+        try {
+            if(is_stream_input(file)) {
+                throw std::runtime_error("Error: view requires a regular file: " + file);
+            }
+            HexViewer(file).run(parse_offset(view_offset));
+        } catch (std::exception& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
         return EXIT_SUCCESS;
     }
 
     return EXIT_SUCCESS;
 }
+#endif // CLIBOX_NO_MAIN
@@ -11,6 +11,21 @@
 #include <cstdlib>
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <array>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <numeric>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <ctime>
+#include <cstdint>
+#include <string_view>
 
 //---- Library Headers -----------------//
 #include <CLI/CLI.hpp>
@@ -23,6 +38,36 @@
 #include <signal.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <poll.h>
+
+#include "stats.hpp"
+#include "posix.hpp"
+
+namespace stats = clibox::stats;
+namespace posix = clibox::posix;
+
+#ifndef SYS_pidfd_open
+  #define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+  #define SYS_pidfd_send_signal 424
+#endif
+#ifndef SYS_pidfd_getfd
+  #define SYS_pidfd_getfd 438
+#endif
+#ifndef P_PIDFD
+  #define P_PIDFD 3
+#endif
 
 bool is_tty_terminal()
 {
@@ -33,14 +78,839 @@ bool is_tty_terminal()
     #endif
 }
 
+/// dup2() for descriptors opened with O_CLOEXEC: when 'fd' already is
+/// 'target' dup2() does nothing, so close-on-exec is cleared instead.
+void redirect_fd(int fd, int target)
+{
+    if(fd == target) { ::fcntl(fd, F_SETFD, 0); }
+    else             { ::dup2(fd, target);      }
+}
+
+/// Parse a duration such as 250ms, 2s, 5m or 1h (plain numbers are seconds).
+std::chrono::milliseconds parse_duration(std::string const& text)
+{
+    using namespace std::string_literals;
+    std::size_t pos = 0;
+    long value = -1;
+    try { value = std::stol(text, &pos); } catch(std::exception const&) { }
+    auto unit = text.substr(pos);
+    if(value < 0) {
+        throw std::runtime_error("Error: invalid duration: "s + text);
+    }
+    if(unit == "ms")               { return std::chrono::milliseconds(value); }
+    if(unit == "s" || unit == "")  { return std::chrono::seconds(value); }
+    if(unit == "m")                { return std::chrono::minutes(value); }
+    if(unit == "h")                { return std::chrono::hours(value); }
+    throw std::runtime_error("Error: invalid duration: "s + text);
+}
+
+/// Settings of a log file fed through a pipe.
+struct LogRotation
+{
+    std::string               file;
+    // Rotate when the file reaches this size (0 => never).
+    std::size_t               max_size   = 0;
+    // Rotate when the file is older than this (0 => never).
+    std::chrono::milliseconds max_age{0};
+    // Number of rotated files kept.
+    unsigned                  keep       = 5;
+    // Prefix every line with the time it was read.
+    bool                      timestamps = false;
+
+    bool enabled() const
+    {
+        return max_size != 0 || max_age.count() != 0 || timestamps;
+    }
+};
+
+/** @brief Copy the output of a process from a pipe to rotated log files.
+ *
+ *  Without timestamps, data is moved from the pipe to the file with
+ *  splice(2) and never goes through user space. With timestamps, data is
+ *  read in large blocks and the time is taken once per block, so that
+ *  there are no per-line system calls.
+ *
+ *  Rotation only renames the current file (to FILE.YYYYmmdd-HHMMSS-N) and
+ *  opens a new one; old files beyond the 'keep' limit are deleted by a
+ *  background thread. The child writing into the pipe is never blocked
+ *  by rotation, the pipe buffer (enlarged to 1 MiB) absorbs the output
+ *  in the meantime.
+ */
+class LogCollector
+{
+    static constexpr std::size_t block_size = 1 << 20;
+
+    LogRotation             m_conf;
+    int                     m_fd      = -1;
+    std::size_t             m_written = 0;
+    unsigned                m_rotations = 0;
+    std::chrono::steady_clock::time_point m_opened;
+
+    // Pruning of old files by a background thread.
+    std::thread             m_pruner;
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    bool                    m_prune_pending = false;
+    bool                    m_done          = false;
+
+public:
+
+    explicit LogCollector(LogRotation conf)
+        : m_conf(std::move(conf))
+    {
+        this->open_file();
+        m_pruner = std::thread([this]{ this->prune_loop(); });
+    }
+
+    ~LogCollector()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = true;
+        }
+        m_cond.notify_one();
+        m_pruner.join();
+        if(m_fd >= 0) { ::close(m_fd); }
+    }
+
+    LogCollector(LogCollector const&) = delete;
+    LogCollector& operator=(LogCollector const&) = delete;
+
+    /// Copy data from fd_in until all writers of the pipe are closed.
+    void run(int fd_in)
+    {
+        ::fcntl(fd_in, F_SETPIPE_SZ, static_cast<int>(block_size));
+        if(m_conf.timestamps)
+            this->run_timestamps(fd_in);
+        else
+            this->run_splice(fd_in);
+    }
+
+private:
+
+    void open_file()
+    {
+        using namespace std::string_literals;
+        // No O_APPEND: splice(2) does not accept it for the output file.
+        m_fd = ::open(m_conf.file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if(m_fd < 0) {
+            throw std::runtime_error("Error: Unable to open log file: "s + m_conf.file);
+        }
+        auto end = ::lseek(m_fd, 0, SEEK_END);
+        m_written = end > 0 ? static_cast<std::size_t>(end) : 0;
+        m_opened  = std::chrono::steady_clock::now();
+    }
+
+    /// Milliseconds until the file must be rotated by age, -1 if never.
+    int rotation_timeout() const
+    {
+        if(m_conf.max_age.count() == 0) { return -1; }
+        auto age  = std::chrono::steady_clock::now() - m_opened;
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(m_conf.max_age - age);
+        return static_cast<int>(std::max<long long>(0, left.count()));
+    }
+
+    bool rotation_due(std::size_t incoming = 0) const
+    {
+        if(m_written == 0) { return false; }
+        if(m_conf.max_size != 0 && (m_written >= m_conf.max_size
+                                    || m_written + incoming > m_conf.max_size)) { return true; }
+        return m_conf.max_age.count() != 0 && this->rotation_timeout() == 0;
+    }
+
+    void rotate()
+    {
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::tm tm{};
+        ::localtime_r(&now, &tm);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        ::close(m_fd);
+        // The counter restarts in every collector: a name already used by a
+        // previous run in the same second is skipped, never overwritten.
+        for(;;)
+        {
+            auto target = m_conf.file + "." + stamp + "-" + std::to_string(m_rotations++);
+            if(::link(m_conf.file.c_str(), target.c_str()) == 0) {
+                ::unlink(m_conf.file.c_str());
+                break;
+            }
+            if(errno == EEXIST) { continue; }
+            // No hard links on this file system.
+            std::error_code ec;
+            if(std::filesystem::exists(target, ec)) { continue; }
+            ::rename(m_conf.file.c_str(), target.c_str());
+            break;
+        }
+        this->open_file();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_prune_pending = true;
+        }
+        m_cond.notify_one();
+    }
+
+    /// Order of a rotated file, from a name 'FILE.YYYYmmdd-HHMMSS-N' written
+    /// by rotate(); nothing for any other name, such as FILE.conf.
+    static std::optional<std::pair<std::string, unsigned long>>
+    rotation_order(std::string const& name, std::string const& prefix)
+    {
+        constexpr std::size_t stamp_size = 15;  // YYYYmmdd-HHMMSS
+        if(name.size() < prefix.size() + stamp_size + 2
+           || name.compare(0, prefix.size(), prefix) != 0) { return std::nullopt; }
+        auto stamp   = name.substr(prefix.size(), stamp_size);
+        auto counter = name.substr(prefix.size() + stamp_size);
+        auto digits  = [](std::string const& text, std::size_t from, std::size_t to) {
+            return std::all_of(text.begin() + from, text.begin() + to
+                               , [](unsigned char c){ return std::isdigit(c); });
+        };
+        if(!digits(stamp, 0, 8) || stamp[8] != '-' || !digits(stamp, 9, stamp_size)
+           || counter[0] != '-' || counter.size() > 10 || !digits(counter, 1, counter.size())) {
+            return std::nullopt;
+        }
+        std::tm tm{};
+        auto end = ::strptime(stamp.c_str(), "%Y%m%d-%H%M%S", &tm);
+        if(end == nullptr || *end != '\0') { return std::nullopt; }
+        return std::make_pair(stamp, std::stoul(counter.substr(1)));
+    }
+
+    /// Delete the oldest rotated files beyond the 'keep' limit.
+    void prune_loop()
+    {
+        namespace fs = std::filesystem;
+        auto path   = fs::path(m_conf.file);
+        auto dir    = path.parent_path().empty() ? fs::path(".") : path.parent_path();
+        auto prefix = path.filename().string() + ".";
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for(;;)
+        {
+            m_cond.wait(lock, [this]{ return m_prune_pending || m_done; });
+            if(!m_prune_pending && m_done) { return; }
+            m_prune_pending = false;
+            lock.unlock();
+
+            // Oldest first: by time stamp, then by counter within a second.
+            std::vector<std::pair<std::pair<std::string, unsigned long>, fs::path>> rotated;
+            std::error_code ec;
+            for(auto const& entry: fs::directory_iterator(dir, ec))
+            {
+                auto order = rotation_order(entry.path().filename().string(), prefix);
+                if(order && entry.is_regular_file(ec)) {
+                    rotated.emplace_back(std::move(*order), entry.path());
+                }
+            }
+            if(rotated.size() > m_conf.keep)
+            {
+                std::sort(rotated.begin(), rotated.end());
+                for(std::size_t i = 0; i < rotated.size() - m_conf.keep; i++) {
+                    fs::remove(rotated[i].second, ec);
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    /// Wait for data; returns false if the pipe was closed by all writers.
+    bool wait_input(int fd_in)
+    {
+        for(;;)
+        {
+            pollfd pfd{fd_in, POLLIN, 0};
+            int rc = ::poll(&pfd, 1, this->rotation_timeout());
+            if(rc < 0 && errno == EINTR) { continue; }
+            if(rc == 0) {
+                // Idle: rotation by age.
+                if(this->rotation_due()) { this->rotate(); }
+                continue;
+            }
+            return (pfd.revents & POLLIN) != 0 || (pfd.revents & POLLHUP) == 0;
+        }
+    }
+
+    void write_block(const char* data, std::size_t size)
+    {
+        while(size > 0)
+        {
+            auto n = ::write(m_fd, data, size);
+            if(n < 0 && errno == EINTR) { continue; }
+            // Disk full or similar: the data is dropped, the child keeps running.
+            if(n <= 0) { return; }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+            m_written += static_cast<std::size_t>(n);
+        }
+    }
+
+    void run_splice(int fd_in)
+    {
+        bool use_splice = true;
+        std::vector<char> buffer;
+        while(this->wait_input(fd_in))
+        {
+            if(this->rotation_due()) { this->rotate(); }
+            std::size_t len = block_size;
+            if(m_conf.max_size != 0 && m_written < m_conf.max_size) {
+                len = std::min(len, m_conf.max_size - m_written);
+            }
+            if(use_splice)
+            {
+                auto n = ::splice(fd_in, nullptr, m_fd, nullptr, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if(n > 0)  { m_written += static_cast<std::size_t>(n); continue; }
+                if(n == 0) { return; }
+                if(errno == EINTR || errno == EAGAIN) { continue; }
+                // File system without splice support.
+                use_splice = false;
+            }
+            buffer.resize(block_size);
+            auto n = ::read(fd_in, buffer.data(), len);
+            if(n < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+            if(n <= 0) { return; }
+            this->write_block(buffer.data(), static_cast<std::size_t>(n));
+        }
+    }
+
+    void run_timestamps(int fd_in)
+    {
+        std::vector<char> input(block_size);
+        std::string output;
+        output.reserve(2 * block_size);
+        bool line_start = true;
+
+        while(this->wait_input(fd_in))
+        {
+            auto n = ::read(fd_in, input.data(), input.size());
+            if(n < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+            if(n <= 0) { break; }
+
+            // One clock read per block of input.
+            char stamp[40];
+            timespec ts{};
+            ::clock_gettime(CLOCK_REALTIME, &ts);
+            std::tm tm{};
+            ::localtime_r(&ts.tv_sec, &tm);
+            auto len = std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+            len += static_cast<std::size_t>(std::snprintf(stamp + len, sizeof(stamp) - len
+                                                          , ".%03ld ", ts.tv_nsec / 1000000));
+
+            const char* p   = input.data();
+            const char* end = p + n;
+            while(p < end)
+            {
+                auto eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+                const char* stop = eol != nullptr ? eol + 1 : end;
+                auto line_size = static_cast<std::size_t>(stop - p) + (line_start ? len : 0);
+                // Files are rotated between lines.
+                if(line_start && this->rotation_due(output.size() + line_size))
+                {
+                    this->write_block(output.data(), output.size());
+                    output.clear();
+                    this->rotate();
+                }
+                if(line_start) { output.append(stamp, len); }
+                output.append(p, static_cast<std::size_t>(stop - p));
+                line_start = eol != nullptr;
+                p = stop;
+            }
+            this->write_block(output.data(), output.size());
+            output.clear();
+        }
+    }
+};
+
+
+   /*==================================================*
+    *     Executable lookup cache                      *
+    *==================================================*/
+
+/** @brief Memory-mapped hash table from command name to executable path.
+ *
+ *  The table is built by scanning the directories of $PATH and stored in
+ *  a cache file (one per $PATH value) that is mapped with mmap(2), so a
+ *  lookup costs no directory scan and no probing exec. Every directory
+ *  keeps its mtime: a lookup only stats the directories up to the one
+ *  the command was found in (an executable added to an earlier directory
+ *  would shadow it). A directory replaced by another one, or with its
+ *  mtime set back, is caught by its inode and ctime which are kept as
+ *  well. When one of them changed, the table is rebuilt and
+ *  only the changed directories are scanned again; the entries of the
+ *  others are copied from the previous table.
+ *
+ *  Relative directories of $PATH depend on the current directory and are
+ *  not cached, they are probed with access(2) at lookup time.
+ *
+ *  File layout: Header | DirRecord[ndirs] | EntryRecord[nentries]
+ *  | uint32 bucket[nbuckets] | strings. Every offset and index of a
+ *  mapped file is checked once by load(), a file which is truncated,
+ *  corrupted or owned by another user is rebuilt.
+ */
+class PathCache
+{
+    static constexpr std::uint32_t empty_bucket = 0xFFFFFFFF;
+
+    struct Header
+    {
+        char          magic[8];
+        std::uint64_t path_hash;
+        std::uint32_t ndirs;
+        std::uint32_t nentries;
+        std::uint32_t nbuckets;
+        std::uint32_t strings_size;
+    };
+    struct DirRecord
+    {
+        std::int64_t  mtime_sec;     // -1 => missing or relative directory
+        std::int64_t  mtime_nsec;
+        std::int64_t  ctime_sec;
+        std::int64_t  ctime_nsec;
+        std::uint64_t inode;
+        std::uint32_t name;          // Offset in the strings
+        std::uint32_t name_len;
+        std::uint32_t first_entry;
+        std::uint32_t count;
+    };
+    struct EntryRecord
+    {
+        std::uint32_t hash;
+        std::uint32_t name;
+        std::uint32_t name_len;
+        std::uint32_t dir;
+        std::uint32_t next;          // Same name in a later directory (shadowed)
+    };
+
+    std::vector<std::string> m_dirs;
+    std::uint64_t            m_path_hash = 0;
+    std::string              m_file;
+    // Table: either the mapped cache file or m_image.
+    void*                    m_map      = MAP_FAILED;
+    std::size_t              m_map_size = 0;
+    std::vector<char>        m_image;
+    const char*              m_data     = nullptr;
+
+public:
+
+    /// Cache of the directories of a $PATH value; file may be empty (no cache file).
+    PathCache(std::string const& path_env, std::string file)
+        : m_file(std::move(file))
+    {
+        std::stringstream ss{ path_env };
+        std::string dir;
+        while(std::getline(ss, dir, ':')) { m_dirs.push_back(dir.empty() ? "." : dir); }
+        m_path_hash = PathCache::fnv1a64(path_env);
+        if(!this->load()) { this->rebuild(); }
+    }
+
+    ~PathCache() { this->unmap(); }
+
+    PathCache(PathCache const&) = delete;
+    PathCache& operator=(PathCache const&) = delete;
+
+    /// Cache of the current $PATH in $XDG_CACHE_HOME/cb-launch (or ~/.cache/cb-launch).
+    static PathCache& instance()
+    {
+        static PathCache cache(PathCache::current_path(), PathCache::default_file());
+        return cache;
+    }
+
+    static std::string current_path()
+    {
+        const char* path = ::getenv("PATH");
+        return path != nullptr ? path : "/usr/bin:/bin";
+    }
+
+    static std::string default_file()
+    {
+        std::string base;
+        if(const char* xdg = ::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0') {
+            base = xdg;
+        } else if(const char* home = ::getenv("HOME"); home != nullptr && *home != '\0') {
+            base = std::string(home) + "/.cache";
+        } else {
+            return "";
+        }
+        char name[40];
+        std::snprintf(name, sizeof(name), "/path-%016llx.cache"
+                      , static_cast<unsigned long long>(PathCache::fnv1a64(PathCache::current_path())));
+        return base + "/cb-launch" + name;
+    }
+
+    /// Path of the executable run for 'name', or an empty string.
+    std::string lookup(std::string const& name)
+    {
+        auto all = this->lookup_impl(name, false);
+        return all.empty() ? "" : all.front();
+    }
+
+    /// All executables named 'name' in $PATH order: the first one shadows the others.
+    std::vector<std::string> lookup_all(std::string const& name)
+    {
+        return this->lookup_impl(name, true);
+    }
+
+    /// Commands found in several directories, with all their paths in $PATH order.
+    std::vector<std::vector<std::string>> shadowed()
+    {
+        this->refresh(m_dirs.size());
+        std::vector<std::vector<std::string>> result;
+        auto const& h = this->header();
+        for(std::uint32_t i = 0; i < h.nentries; i++)
+        {
+            auto const& e = this->entries()[i];
+            // First occurrences only: an entry that is the head of its bucket chain.
+            if(e.next == empty_bucket || this->find(this->string(e.name, e.name_len)) != i) { continue; }
+            std::vector<std::string> paths;
+            for(auto k = i; k != empty_bucket; k = this->entries()[k].next) { paths.push_back(this->path_of(k)); }
+            result.push_back(std::move(paths));
+        }
+        return result;
+    }
+
+    /// Scan the changed directories again and rewrite the cache file.
+    void rebuild(bool full = false)
+    {
+        struct Dir
+        {
+            std::string              name;
+            std::optional<struct stat> st;
+            std::vector<std::string> names;
+        };
+        std::vector<Dir> dirs(m_dirs.size());
+        for(std::size_t i = 0; i < m_dirs.size(); i++)
+        {
+            auto& d = dirs[i];
+            d.name = m_dirs[i];
+            struct stat st;
+            if(d.name[0] != '/' || ::stat(d.name.c_str(), &st) != 0) { continue; }
+            d.st = st;
+            if(!full && this->copy_dir(d.name, st, d.names)) { continue; }
+            PathCache::scan_dir(d.name, d.names);
+        }
+
+        // Strings, records and hash table of the new image.
+        std::string strings;
+        std::vector<DirRecord> dir_records;
+        std::vector<EntryRecord> entry_records;
+        std::map<std::string, std::pair<std::uint32_t, std::uint32_t>> chains; // first, last
+        for(std::size_t i = 0; i < dirs.size(); i++)
+        {
+            auto const& st = dirs[i].st;
+            DirRecord dr{st ? st->st_mtim.tv_sec : -1, st ? st->st_mtim.tv_nsec : 0
+                         , st ? st->st_ctim.tv_sec : -1, st ? st->st_ctim.tv_nsec : 0
+                         , st ? static_cast<std::uint64_t>(st->st_ino) : 0
+                         , static_cast<std::uint32_t>(strings.size())
+                         , static_cast<std::uint32_t>(dirs[i].name.size())
+                         , static_cast<std::uint32_t>(entry_records.size())
+                         , static_cast<std::uint32_t>(dirs[i].names.size())};
+            strings += dirs[i].name;
+            dir_records.push_back(dr);
+            for(auto const& n: dirs[i].names)
+            {
+                auto index = static_cast<std::uint32_t>(entry_records.size());
+                entry_records.push_back({PathCache::fnv1a32(n), static_cast<std::uint32_t>(strings.size())
+                                         , static_cast<std::uint32_t>(n.size())
+                                         , static_cast<std::uint32_t>(i), empty_bucket});
+                strings += n;
+                auto [it, inserted] = chains.try_emplace(n, index, index);
+                if(!inserted) {
+                    entry_records[it->second.second].next = index;
+                    it->second.second = index;
+                }
+            }
+        }
+        std::uint32_t nbuckets = 16;
+        while(nbuckets < 2 * chains.size()) { nbuckets *= 2; }
+        std::vector<std::uint32_t> buckets(nbuckets, empty_bucket);
+        for(auto const& c: chains)
+        {
+            auto b = entry_records[c.second.first].hash & (nbuckets - 1);
+            while(buckets[b] != empty_bucket) { b = (b + 1) & (nbuckets - 1); }
+            buckets[b] = c.second.first;
+        }
+
+        Header h{{'C', 'B', 'P', 'A', 'T', 'H', '2', '\n'}, m_path_hash
+                 , static_cast<std::uint32_t>(dir_records.size())
+                 , static_cast<std::uint32_t>(entry_records.size()), nbuckets
+                 , static_cast<std::uint32_t>(strings.size())};
+        std::vector<char> image;
+        auto append = [&image](const void* data, std::size_t size) {
+            image.insert(image.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+        };
+        append(&h, sizeof(h));
+        append(dir_records.data(), dir_records.size() * sizeof(DirRecord));
+        append(entry_records.data(), entry_records.size() * sizeof(EntryRecord));
+        append(buckets.data(), buckets.size() * sizeof(std::uint32_t));
+        append(strings.data(), strings.size());
+
+        this->unmap();
+        m_image = std::move(image);
+        m_data  = m_image.data();
+        this->save();
+    }
+
+private:
+
+    static std::uint32_t fnv1a32(std::string_view s)
+    {
+        std::uint32_t h = 2166136261u;
+        for(unsigned char c: s) { h = (h ^ c) * 16777619u; }
+        return h;
+    }
+
+    static std::uint64_t fnv1a64(std::string_view s)
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        for(unsigned char c: s) { h = (h ^ c) * 1099511628211ull; }
+        return h;
+    }
+
+    /// Executable files of a directory (directories are skipped by d_type).
+    static void scan_dir(std::string const& dir, std::vector<std::string>& names)
+    {
+        int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* d  = dfd < 0 ? nullptr : ::fdopendir(dfd);
+        if(d == nullptr) {
+            if(dfd >= 0) { ::close(dfd); }
+            return;
+        }
+        while(auto entry = ::readdir(d))
+        {
+            if(entry->d_name[0] == '.' || entry->d_type == DT_DIR) { continue; }
+            if(::faccessat(dfd, entry->d_name, X_OK, 0) == 0) { names.emplace_back(entry->d_name); }
+        }
+        ::closedir(d);
+        std::sort(names.begin(), names.end());
+    }
+
+    Header const& header() const { return *reinterpret_cast<const Header*>(m_data); }
+
+    const DirRecord* dirs() const
+    {
+        return reinterpret_cast<const DirRecord*>(m_data + sizeof(Header));
+    }
+    const EntryRecord* entries() const
+    {
+        return reinterpret_cast<const EntryRecord*>(this->dirs() + this->header().ndirs);
+    }
+    const std::uint32_t* buckets() const
+    {
+        return reinterpret_cast<const std::uint32_t*>(this->entries() + this->header().nentries);
+    }
+    std::string_view string(std::uint32_t offset, std::uint32_t len) const
+    {
+        auto strings = reinterpret_cast<const char*>(this->buckets() + this->header().nbuckets);
+        return std::string_view(strings + offset, len);
+    }
+
+    std::string path_of(std::uint32_t entry) const
+    {
+        auto const& e = this->entries()[entry];
+        auto const& d = this->dirs()[e.dir];
+        return std::string(this->string(d.name, d.name_len)) + "/" + std::string(this->string(e.name, e.name_len));
+    }
+
+    /// Index of the first entry named 'name', empty_bucket if none.
+    std::uint32_t find(std::string_view name) const
+    {
+        auto const& h = this->header();
+        auto b = PathCache::fnv1a32(name) & (h.nbuckets - 1);
+        for(auto index = this->buckets()[b]; index != empty_bucket; index = this->buckets()[b])
+        {
+            auto const& e = this->entries()[index];
+            if(this->string(e.name, e.name_len) == name) { return index; }
+            b = (b + 1) & (h.nbuckets - 1);
+        }
+        return empty_bucket;
+    }
+
+    /// True if the directory ('st', nullptr if missing) is the one recorded, unchanged.
+    static bool unchanged(DirRecord const& d, struct stat const* st)
+    {
+        if(st == nullptr) { return d.mtime_sec == -1; }
+        return st->st_mtim.tv_sec == d.mtime_sec && st->st_mtim.tv_nsec == d.mtime_nsec
+            && st->st_ctim.tv_sec == d.ctime_sec && st->st_ctim.tv_nsec == d.ctime_nsec
+            && static_cast<std::uint64_t>(st->st_ino) == d.inode;
+    }
+
+    /// Check the first 'count' directories, rebuild if one changed.
+    void refresh(std::size_t count)
+    {
+        for(std::size_t i = 0; i < count && i < m_dirs.size(); i++)
+        {
+            auto const& d = this->dirs()[i];
+            if(m_dirs[i][0] != '/') { continue; }
+            struct stat st;
+            bool exists = ::stat(m_dirs[i].c_str(), &st) == 0;
+            if(!PathCache::unchanged(d, exists ? &st : nullptr))
+            {
+                this->rebuild();
+                return;
+            }
+        }
+    }
+
+    std::vector<std::string> lookup_impl(std::string const& name, bool all)
+    {
+        if(name.find('/') != std::string::npos) { return {name}; }
+        auto first = this->find(name);
+        std::size_t last_dir = first == empty_bucket ? m_dirs.size() : this->entries()[first].dir + 1;
+        this->refresh(all ? m_dirs.size() : last_dir);
+        first = this->find(name);
+
+        std::vector<std::string> result;
+        std::size_t next_dir = 0;
+        auto probe_relative = [&](std::size_t until) {
+            for(; next_dir < until; next_dir++)
+            {
+                if(m_dirs[next_dir][0] == '/') { continue; }
+                auto candidate = m_dirs[next_dir] + "/" + name;
+                if(::access(candidate.c_str(), X_OK) == 0) { result.push_back(candidate); }
+            }
+        };
+        for(auto k = first; k != empty_bucket; k = this->entries()[k].next)
+        {
+            probe_relative(this->entries()[k].dir);
+            if(!all && !result.empty()) { return result; }
+            result.push_back(this->path_of(k));
+            next_dir = this->entries()[k].dir + 1;
+            if(!all) { return result; }
+        }
+        probe_relative(m_dirs.size());
+        return result;
+    }
+
+    /// Names of a directory from the current table if it did not change.
+    bool copy_dir(std::string const& dir, struct stat const& st, std::vector<std::string>& names) const
+    {
+        if(m_data == nullptr) { return false; }
+        for(std::uint32_t i = 0; i < this->header().ndirs; i++)
+        {
+            auto const& d = this->dirs()[i];
+            if(this->string(d.name, d.name_len) != dir) { continue; }
+            if(!PathCache::unchanged(d, &st)) { return false; }
+            for(std::uint32_t k = d.first_entry; k < d.first_entry + d.count; k++) {
+                names.emplace_back(this->string(this->entries()[k].name, this->entries()[k].name_len));
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /// Check every offset and index of the mapped table, so that lookups
+    /// never read outside of it and bucket probes and chains terminate.
+    bool validate() const
+    {
+        auto const& h = this->header();
+        auto in_strings = [&](std::uint32_t offset, std::uint32_t len) {
+            return std::uint64_t{offset} + len <= h.strings_size;
+        };
+        for(std::uint32_t i = 0; i < h.ndirs; i++)
+        {
+            auto const& d = this->dirs()[i];
+            if(!in_strings(d.name, d.name_len) || this->string(d.name, d.name_len) != m_dirs[i]
+               || std::uint64_t{d.first_entry} + d.count > h.nentries) { return false; }
+        }
+        for(std::uint32_t i = 0; i < h.nentries; i++)
+        {
+            // Chains only go forward (later directories), so they end.
+            auto const& e = this->entries()[i];
+            if(!in_strings(e.name, e.name_len) || e.dir >= h.ndirs
+               || (e.next != empty_bucket && (e.next <= i || e.next >= h.nentries))) { return false; }
+        }
+        bool has_empty = false;
+        for(std::uint32_t b = 0; b < h.nbuckets; b++)
+        {
+            auto index = this->buckets()[b];
+            if(index == empty_bucket) { has_empty = true; }
+            else if(index >= h.nentries) { return false; }
+        }
+        return has_empty;
+    }
+
+    /// Map the cache file; false if it is missing, corrupted, of another
+    /// $PATH or not owned by the current user.
+    bool load()
+    {
+        if(m_file.empty()) { return false; }
+        int fd = ::open(m_file.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) { return false; }
+        struct stat st;
+        if(::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)
+           || st.st_uid != ::geteuid()) {
+            ::close(fd);
+            return false;
+        }
+        auto size = static_cast<std::size_t>(st.st_size);
+        void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(map == MAP_FAILED) { return false; }
+
+        auto const& h = *static_cast<const Header*>(map);
+        std::size_t expected = sizeof(Header) + std::size_t{h.ndirs} * sizeof(DirRecord)
+                               + std::size_t{h.nentries} * sizeof(EntryRecord)
+                               + std::size_t{h.nbuckets} * sizeof(std::uint32_t) + h.strings_size;
+        if(std::memcmp(h.magic, "CBPATH2\n", 8) != 0 || h.path_hash != m_path_hash
+           || h.ndirs != m_dirs.size() || expected != size
+           || h.nbuckets == 0 || (h.nbuckets & (h.nbuckets - 1)) != 0)
+        {
+            ::munmap(map, size);
+            return false;
+        }
+        m_map      = map;
+        m_map_size = size;
+        m_data     = static_cast<const char*>(map);
+        if(!this->validate())
+        {
+            this->unmap();
+            return false;
+        }
+        return true;
+    }
+
+    /// Write the table atomically (temporary file and rename); errors are ignored.
+    void save() const
+    {
+        if(m_file.empty()) { return; }
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(m_file).parent_path(), ec);
+        auto temp = m_file + ".tmp" + std::to_string(::getpid());
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0) { return; }
+        bool ok = ::write(fd, m_image.data(), m_image.size()) == static_cast<ssize_t>(m_image.size());
+        ::close(fd);
+        if(!ok || ::rename(temp.c_str(), m_file.c_str()) != 0) { ::unlink(temp.c_str()); }
+    }
+
+    void unmap()
+    {
+        if(m_map != MAP_FAILED) { ::munmap(m_map, m_map_size); }
+        m_map  = MAP_FAILED;
+        m_data = nullptr;
+    }
+};
+
+/** @brief Find an executable in the directories of $PATH.
+ *
+ *  Names containing a '/' are returned unchanged. Returns an empty string
+ *  if the program is not found. Lookups go through PathCache.
+ */
+std::string find_in_path(std::string const& program)
+{
+    if(program.find('/') != std::string::npos) { return program; }
+    return PathCache::instance().lookup(program);
+}
+
 
 class AppLauncher
 {
     std::string                m_program;
     std::string                m_cwd      = ".";
     std::optional<std::string> m_logfile  = std::nullopt;
+    LogRotation                m_rotation;
     bool                       m_terminal = false;
     bool                       m_exec     = false;
+    std::optional<std::string> m_argv0    = std::nullopt;
+    std::optional<std::vector<std::string>> m_environment = std::nullopt;
+    std::vector<int>           m_listen_fds;
 
 public:
 
@@ -48,163 +918,1827 @@ public:
         : m_program(std::move(program))
     { }
 
-    /// Set process current directory
-    void set_cwd(std::string cwd)
+    /// Set process current directory
+    void set_cwd(std::string cwd)
+    {
+        this->m_cwd = std::move(cwd);
+    }
+
+    /// Set process log file to which the output (stderr and stdout)
+    /// will be redirected to.
+    void set_logfile(std::string logfile)
+    {
+        this->m_logfile = std::move(logfile);
+    }
+
+    /// Capture the output through a pipe into rotated log files
+    /// (the file name is taken from set_logfile()).
+    void set_log_rotation(LogRotation rotation)
+    {
+        this->m_rotation = std::move(rotation);
+    }
+
+    /// If set to true, the application is launched in a new terminal
+    void set_terminal(bool flag)
+    {
+        this->m_terminal = flag;
+    }
+
+    /// If set to true, the application is launched in current terminal
+    /// replacing current process (not launched as a daemon wich is
+    /// the default behavior).
+    void set_exec(bool flag)
+    {
+        this->m_exec = flag;
+    }
+
+    /// Set argv[0] of the process (the program name by default).
+    void set_argv0(std::string argv0)
+    {
+        this->m_argv0 = std::move(argv0);
+    }
+
+    /// Set the environment of the process ("NAME=VALUE" entries) instead
+    /// of inheriting the environment of the launcher.
+    void set_environment(std::vector<std::string> environment)
+    {
+        this->m_environment = std::move(environment);
+    }
+
+    /// Pass listening sockets to the process as file descriptors 3, 4, ...
+    /// following the LISTEN_FDS/LISTEN_PID protocol of sd_listen_fds(3).
+    /// The descriptors are not closed by the launcher.
+    void set_listen_fds(std::vector<int> fds)
+    {
+        this->m_listen_fds = std::move(fds);
+    }
+
+    std::optional<int>
+    launch(std::vector<std::string> const& args = {})
+    {
+        if(m_exec)
+            return this->exec(m_program, args);
+
+        if(!m_terminal)
+            return this->launch_impl(m_program, args);
+        else
+            return this->launch_impl("xterm", {"-hold", "-e", m_program});
+    }
+
+private:
+
+    /// Wrapper for exec POSIX C API function
+    int exec(std::string program, std::vector<std::string> const& args)
+    {
+        std::vector<const char*> pargs(args.size() + 1);
+        pargs[0] = m_argv0 && program == m_program ? m_argv0->c_str() : program.c_str();
+        std::transform(args.begin(), args.end(), pargs.begin() + 1
+                       , [](auto const& s){ return s.c_str(); });
+        pargs.push_back(nullptr);
+
+        // Executable from the $PATH cache, execvp(3) probes the directories
+        // itself if the cached entry turns out to be stale.
+        auto path = find_in_path(program);
+
+        if(!m_environment && m_listen_fds.empty())
+        {
+            if(!path.empty()) { ::execv(path.c_str(), (char* const*) &pargs[0]); }
+            return ::execvp(program.c_str(), (char* const*) &pargs[0]);
+        }
+
+        // Environment of the process without the LISTEN_* variables of a
+        // previous socket activation.
+        std::vector<std::string> env;
+        if(m_environment) {
+            env = m_environment.value();
+        } else {
+            for(char** e = environ; *e != nullptr; e++) { env.emplace_back(*e); }
+        }
+        env.erase(std::remove_if(env.begin(), env.end(), [](auto const& e){
+                      return e.compare(0, 7, "LISTEN_") == 0;
+                  }), env.end());
+        if(!m_listen_fds.empty())
+        {
+            this->pass_listen_fds();
+            env.push_back("LISTEN_FDS=" + std::to_string(m_listen_fds.size()));
+            env.push_back("LISTEN_PID=" + std::to_string(::getpid()));
+        }
+        std::vector<const char*> penv;
+        for(auto const& e: env) { penv.push_back(e.c_str()); }
+        penv.push_back(nullptr);
+
+        if(!path.empty()) { ::execve(path.c_str(), (char* const*) &pargs[0], (char* const*) &penv[0]); }
+        return ::execvpe(program.c_str(), (char* const*) &pargs[0], (char* const*) &penv[0]);
+    }
+
+    /// Move the listening sockets to the descriptors 3, 4, ... (without FD_CLOEXEC).
+    void pass_listen_fds()
+    {
+        int first = 3; // SD_LISTEN_FDS_START
+        int nfds  = static_cast<int>(m_listen_fds.size());
+        // Copy above the target range first, so that no socket is
+        // overwritten before it was moved.
+        std::vector<int> high;
+        for(int fd: m_listen_fds) { high.push_back(::fcntl(fd, F_DUPFD_CLOEXEC, first + nfds)); }
+        for(int i = 0; i < nfds; i++) {
+            ::dup2(high[i], first + i);
+            ::close(high[i]);
+        }
+    }
+
+    std::optional<int>
+    launch_impl(std::string program, std::vector<std::string> const& args)
+    {
+        // Pipe between the process output and the log collector.
+        int log_pipe[2] = {-1, -1};
+        if(m_logfile && m_rotation.enabled())
+        {
+            if(::pipe2(log_pipe, O_CLOEXEC) < 0) {
+                std::cerr << " [ERROR] Unable to create log pipe: " << std::strerror(errno) << "\n";
+                return std::nullopt;
+            }
+            if(!this->launch_log_collector(log_pipe)) {
+                ::close(log_pipe[0]);
+                ::close(log_pipe[1]);
+                return std::nullopt;
+            }
+        }
+
+        int pid = ::fork();
+
+        // If the PID of the forked process is negative
+        // when the fork operation has fails.
+        if(pid < 0) {
+            std::cerr << " [ERROR] Unable to fork proces and launch " << program << "\n";
+            // Closing the last writer makes the collector exit.
+            if(log_pipe[0] >= 0) {
+                ::close(log_pipe[0]);
+                ::close(log_pipe[1]);
+            }
+            return std::nullopt;
+        }
+
+        // If the PID is greater than zero, the current process
+        // is the original or the parent one. Then the PID is returned
+        // to the caller.
+        if(pid > 0)
+        {
+            // The collector exits when the last writer closes the pipe.
+            if(log_pipe[0] >= 0) {
+                ::close(log_pipe[0]);
+                ::close(log_pipe[1]);
+            }
+            return pid;
+        }
+
+        // ---- Forked process (pid == 0) --- //
+        //------------------------------------//
+        assert(pid == 0 && "PID should be zero");
+        ::setsid();
+        ::umask(0);
+
+        // Set current directory of daemon process
+        ::chdir(m_cwd.c_str());
+
+        // Replace stdin, stdout and stderr to avoid littering the parent
+        // process output: stdin reads from /dev/null, the output goes to
+        // the log pipe, the log file or /dev/null.
+        // Close-on-exec: the program only inherits the copies on 0, 1, 2.
+        int null = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+        int out  = null;
+        if(log_pipe[1] >= 0)
+        {
+            out = log_pipe[1];
+        }
+        else if(this->m_logfile)
+        {
+            out = ::open(m_logfile.value().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if(out < 0){
+                std::cerr << " [ERROR] Failed to open file: " << m_logfile.value()
+                          << ": " << std::strerror(errno) << "\n";
+                out = null;
+            }
+        }
+        redirect_fd(null, STDIN_FILENO);
+        redirect_fd(out,  STDOUT_FILENO);
+        redirect_fd(out,  STDERR_FILENO);
+
+        this->exec(program, args);
+        // Only reached if exec failed, the forked process must not return
+        // into the caller code.
+        ::_exit(127);
+    }
+
+    /// Fork the process which copies the log pipe to the log files.
+    bool launch_log_collector(int log_pipe[2])
+    {
+        int pid = ::fork();
+        if(pid < 0) {
+            std::cerr << " [ERROR] Unable to fork log collector\n";
+            return false;
+        }
+        if(pid > 0) { return true; }
+
+        // ---- Log collector process ---- //
+        ::setsid();
+        ::close(log_pipe[1]);
+        // Relative log paths are relative to the process directory.
+        ::chdir(m_cwd.c_str());
+        int status = EXIT_SUCCESS;
+        try {
+            auto conf = m_rotation;
+            conf.file = m_logfile.value();
+            LogCollector collector(conf);
+            int null = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+            redirect_fd(null, STDIN_FILENO);
+            redirect_fd(null, STDOUT_FILENO);
+            redirect_fd(null, STDERR_FILENO);
+            if(null > STDERR_FILENO) { ::close(null); }
+            collector.run(log_pipe[0]);
+        } catch(std::exception const& ex) {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            status = EXIT_FAILURE;
+        }
+        ::_exit(status);
+    }
+};
+
+
+/** Print directories listed in PATH environment variable.
+ *  Operating Systems.
+ *  Requires: <iostream>, <cstdlib> <sstream>
+ **********************************************************/
+void show_dirs_in_path(std::ostream& os)
+{
+    std::stringstream ss{ ::getenv("PATH") };
+    std::string dirpath;
+
+    while(std::getline(ss, dirpath, ':'))
+        os << "\t" << dirpath << std::endl;
+}
+
+std::optional<std::string>
+get_symlink_realpath(std::string const& path)
+{
+    auto buffer = std::string(PATH_MAX, 0x00);
+    char* result = ::realpath(path.c_str(), buffer.data());
+    if(result){
+        buffer.resize(std::strlen(result));
+        return std::make_optional(buffer);
+    }
+    return std::nullopt;
+}
+
+/// Read a /proc file made of NUL separated strings (cmdline, environ).
+std::vector<std::string> read_proc_strings(std::string const& path)
+{
+    using namespace std::string_literals;
+    std::ifstream ifs(path, std::ios::binary);
+    if(!ifs) {
+        throw std::runtime_error("Error: Unable to read: "s + path);
+    }
+    std::vector<std::string> items;
+    std::string item;
+    while(std::getline(ifs, item, '\0')) { items.push_back(item); }
+    return items;
+}
+
+/** @brief Duplicate the listening sockets of a process with pidfd_getfd(2).
+ *
+ *  Requires Linux 5.6 and the permission to ptrace the process.
+ *  @return the local duplicates, ordered by descriptor number in the process.
+ */
+std::vector<int> take_listening_sockets(int pid, int pidfd)
+{
+    using namespace std::string_literals;
+    namespace fs = std::filesystem;
+
+    std::vector<std::pair<int, int>> sockets;
+    std::error_code ec;
+    for(auto const& entry: fs::directory_iterator("/proc/"s + std::to_string(pid) + "/fd", ec))
+    {
+        auto target = fs::read_symlink(entry.path(), ec);
+        if(ec || target.string().compare(0, 7, "socket:") != 0) { continue; }
+        int fd    = std::stoi(entry.path().filename().string());
+        int local = static_cast<int>(::syscall(SYS_pidfd_getfd, pidfd, fd, 0));
+        if(local < 0)
+        {
+            auto error = std::strerror(errno);
+            for(auto const& s: sockets) { ::close(s.second); }
+            throw std::runtime_error("Error: unable to take the sockets of process <"s
+                                     + std::to_string(pid) + ">: " + error
+                                     + " (use --no-handoff to relaunch without them)");
+        }
+        int listening = 0;
+        socklen_t len = sizeof(listening);
+        if(::getsockopt(local, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == 0 && listening) {
+            sockets.emplace_back(fd, local);
+        } else {
+            ::close(local);
+        }
+    }
+    std::sort(sockets.begin(), sockets.end());
+    std::vector<int> fds;
+    for(auto const& s: sockets) { fds.push_back(s.second); }
+    return fds;
+}
+
+/// Wait until a process exits (through its pidfd if any); false on timeout.
+bool wait_process_exit(int pid, int pidfd, std::chrono::milliseconds timeout)
+{
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + timeout;
+    for(;;)
+    {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+        int wait  = static_cast<int>(std::max<long long>(0, left.count()));
+        if(pidfd < 0)
+        {
+            // Kernels without pidfd_open: polling. A child of this process
+            // (the new instance) stays a zombie until reaped, kill(2) keeps
+            // succeeding on it, so children are polled with waitpid(2).
+            int status = 0;
+            int rc = ::waitpid(pid, &status, WNOHANG);
+            if(rc == pid) { return true; }
+            if(rc < 0 && errno == ECHILD && ::kill(pid, 0) < 0 && errno == ESRCH) { return true; }
+            if(wait == 0) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds(std::min(wait, 20)));
+            continue;
+        }
+        pollfd pfd{pidfd, POLLIN, 0};
+        int rc = ::poll(&pfd, 1, wait);
+        if(rc < 0 && errno == EINTR) { continue; }
+        return rc > 0;
+    }
+}
+
+void send_signal(int pid, int pidfd, int signal)
+{
+    if(pidfd < 0 || ::syscall(SYS_pidfd_send_signal, pidfd, signal, nullptr, 0) < 0) {
+        ::kill(pid, signal);
+    }
+}
+
+/** @brief Replace a running process by a new instance without downtime.
+ *
+ *  The new instance is started first, with the executable, arguments,
+ *  environment and directory of the old one (from /proc/PID). Unless
+ *  'handoff' is false, the listening sockets of the old process are
+ *  duplicated with pidfd_getfd(2) and passed to the new one through the
+ *  LISTEN_FDS protocol, so that no connection is refused in between.
+ *  The old process is then stopped with SIGTERM, and SIGKILL if it is
+ *  still running after 'stop_timeout'. If the new instance exits within
+ *  'startup_check', the old one is left running.
+ */
+void relaunch_app_pid(int pid, bool handoff
+                      , std::chrono::milliseconds startup_check
+                      , std::chrono::milliseconds stop_timeout)
+{
+    using namespace std::string_literals;
+    auto proc = "/proc/"s + std::to_string(pid);
+
+    // The pidfd refers to this process even if the PID is reused.
+    int pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+
+    // Executable path: a binary replaced by an upgrade shows up as
+    // "PATH (deleted)", the new binary at PATH is launched.
+    std::optional<std::string> exe;
+    {
+        std::string buffer(PATH_MAX, 0x00);
+        auto n = ::readlink((proc + "/exe").c_str(), buffer.data(), buffer.size());
+        if(n > 0) {
+            buffer.resize(static_cast<std::size_t>(n));
+            auto pos = buffer.rfind(" (deleted)");
+            if(pos != std::string::npos && pos + 10 == buffer.size()) { buffer.resize(pos); }
+            exe = buffer;
+        }
+    }
+    // Current working directory
+    auto cwd  = get_symlink_realpath(proc + "/cwd");
+
+    if(!exe || !cwd){
+        if(pidfd >= 0) { ::close(pidfd); }
+        throw std::runtime_error("Error: process of pid: <"s
+                                 + std::to_string(pid) + "> not found. ");
+    }
+    auto cmdline     = read_proc_strings(proc + "/cmdline");
+    auto environment = read_proc_strings(proc + "/environ");
+
+    std::vector<int> sockets;
+    if(handoff) { sockets = take_listening_sockets(pid, pidfd); }
+
+    // Start the new instance while the old one keeps serving.
+    AppLauncher app(exe.value());
+    app.set_cwd(cwd.value());
+    if(!cmdline.empty()) { app.set_argv0(cmdline[0]); }
+    app.set_environment(environment);
+    app.set_listen_fds(sockets);
+    auto pid_new = app.launch(cmdline.empty()
+                              ? std::vector<std::string>{}
+                              : std::vector<std::string>(cmdline.begin() + 1, cmdline.end()));
+    for(int fd: sockets) { ::close(fd); }
+    if(!pid_new){
+        if(pidfd >= 0) { ::close(pidfd); }
+        throw std::runtime_error("Error: failed to relaunch process");
+    }
+
+    int new_pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid_new.value(), 0));
+    bool failed   = wait_process_exit(pid_new.value(), new_pidfd, startup_check);
+    if(new_pidfd >= 0) { ::close(new_pidfd); }
+    if(failed)
+    {
+        if(pidfd >= 0) { ::close(pidfd); }
+        throw std::runtime_error("Error: new instance exited during startup,"
+                                 " process <"s + std::to_string(pid) + "> left running");
+    }
+
+    // Stop the old instance.
+    std::string stopped = "SIGTERM";
+    send_signal(pid, pidfd, SIGTERM);
+    if(!wait_process_exit(pid, pidfd, stop_timeout))
+    {
+        stopped = "SIGKILL";
+        send_signal(pid, pidfd, SIGKILL);
+        wait_process_exit(pid, pidfd, stop_timeout);
+    }
+    if(pidfd >= 0) { ::close(pidfd); }
+
+    std::cout << " [INFO] Relaunched application: "
+              << "\n        pid = " << pid_new.value()
+              << "\n executable = " << exe.value()
+              << "\n  directory = " << cwd.value()
+              << "\n    sockets = " << sockets.size()
+              << "\n    stopped = " << pid << " (" << stopped << ")"
+              << "\n";
+}
+
+
+   /*==================================================*
+    *     Process supervisor                           *
+    *==================================================*/
+
+enum class restart_policy
+{
+      never       // Never restart
+    , on_failure  // Restart on non-zero exit status or signal
+    , always      // Restart whenever the process exits
+};
+
+/// Description of a supervised service.
+struct ServiceSpec
+{
+    std::string               name;
+    std::vector<std::string>  command;
+    std::string               directory   = ".";
+    std::string               logfile;
+    restart_policy            restart     = restart_policy::on_failure;
+    // Delay before a restart, doubled after each restart up to the maximum.
+    std::chrono::milliseconds backoff_min = std::chrono::seconds(1);
+    std::chrono::milliseconds backoff_max = std::chrono::seconds(60);
+};
+
+/// Split a command line into words; double quotes group words with blanks.
+std::vector<std::string> split_command_line(std::string const& line)
+{
+    std::vector<std::string> words;
+    std::string word;
+    bool quoted = false, in_word = false;
+    for(char ch: line)
+    {
+        if(ch == '"') {
+            quoted = !quoted;
+            in_word = true;
+        } else if(!quoted && std::isspace(static_cast<unsigned char>(ch))) {
+            if(in_word) { words.push_back(word); }
+            word.clear();
+            in_word = false;
+        } else {
+            word.push_back(ch);
+            in_word = true;
+        }
+    }
+    if(in_word) { words.push_back(word); }
+    return words;
+}
+
+/** @brief Parse a service line.
+ *
+ *  Syntax: NAME [restart=always|on-failure|never] [backoff=MIN:MAX]
+ *               [dir=DIRECTORY] [log=FILE] -- COMMAND [ARGS...]
+ *
+ *  @code
+ *   web  restart=always backoff=1s:30s log=/tmp/web.log -- python3 -m http.server 8000
+ *  @endcode
+ */
+ServiceSpec parse_service_spec(std::string const& line)
+{
+    using namespace std::string_literals;
+
+    auto words = split_command_line(line);
+    auto sep   = std::find(words.begin(), words.end(), "--");
+    if(words.empty() || sep == words.begin() || sep == words.end() || sep + 1 == words.end()) {
+        throw std::runtime_error("Error: invalid service (expected NAME [OPTIONS] -- COMMAND): "s + line);
+    }
+
+    ServiceSpec spec;
+    spec.name = words[0];
+    spec.command.assign(sep + 1, words.end());
+    for(auto it = words.begin() + 1; it != sep; ++it)
+    {
+        auto eq = it->find('=');
+        auto key   = it->substr(0, eq);
+        auto value = eq == std::string::npos ? "" : it->substr(eq + 1);
+        if(key == "restart")
+        {
+            if(value == "always")          { spec.restart = restart_policy::always;     }
+            else if(value == "on-failure") { spec.restart = restart_policy::on_failure; }
+            else if(value == "never")      { spec.restart = restart_policy::never;      }
+            else { throw std::runtime_error("Error: invalid restart policy: "s + value); }
+        }
+        else if(key == "backoff")
+        {
+            auto colon = value.find(':');
+            spec.backoff_min = parse_duration(value.substr(0, colon));
+            spec.backoff_max = colon == std::string::npos
+                             ? spec.backoff_min : parse_duration(value.substr(colon + 1));
+            spec.backoff_max = std::max(spec.backoff_min, spec.backoff_max);
+        }
+        else if(key == "dir") { spec.directory = value; }
+        else if(key == "log") { spec.logfile   = value; }
+        else { throw std::runtime_error("Error: invalid service option: "s + *it); }
+    }
+    return spec;
+}
+
+/// Read services from a file, one per line; '#' starts a comment line.
+std::vector<ServiceSpec> read_service_file(std::string const& file)
+{
+    using namespace std::string_literals;
+    auto ifs = std::ifstream(file);
+    if(!ifs) {
+        throw std::runtime_error("Error: Unable to open file: "s + file);
+    }
+    std::vector<ServiceSpec> specs;
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        auto first = line.find_first_not_of(" \t");
+        if(first == std::string::npos || line[first] == '#') { continue; }
+        specs.push_back(parse_service_spec(line));
+    }
+    return specs;
+}
+
+/// Default path of the supervisor control socket.
+std::string default_control_socket()
+{
+    return posix::runtime_socket("cb.launch");
+}
+
+/** @brief Event driven supervisor of a set of services.
+ *
+ *  Everything runs on a single epoll loop without polling:
+ *   - a pidfd (pidfd_open) per process becomes readable when it exits;
+ *     on kernels without pidfd, SIGCHLD is used to collect exits;
+ *   - a timerfd per service triggers delayed restarts (backoff) and
+ *     the SIGKILL sent when a stopped process outlives its grace period;
+ *   - a signalfd receives SIGTERM/SIGINT (shutdown) and SIGCHLD;
+ *   - a Unix socket accepts control commands (one line per connection):
+ *     status, start NAME, stop NAME, restart NAME, shutdown.
+ */
+class Supervisor
+{
+    using clock = std::chrono::steady_clock;
+
+    enum class state { stopped, running, stopping, backoff, failed };
+
+    struct Service
+    {
+        ServiceSpec               spec;
+        state                     st       = state::stopped;
+        pid_t                     pid      = -1;
+        int                       pidfd    = -1;
+        int                       timerfd  = -1;
+        unsigned                  starts   = 0;
+        std::chrono::milliseconds backoff{0};
+        clock::time_point         started;
+        std::string               last_exit = "-";
+        // Start again once stopped (restart command).
+        bool                      start_after_stop = false;
+    };
+
+    /// Source of an epoll event, stored in the upper half of epoll_data.u64.
+    enum source : std::uint32_t { src_signal, src_control, src_client, src_process, src_timer };
+
+    /// A process running this long resets the backoff delay.
+    static constexpr auto stable_uptime = std::chrono::seconds(10);
+
+    std::vector<Service>       m_services;
+    std::chrono::milliseconds  m_stop_timeout;
+    std::string                m_socket_path;
+    int                        m_epoll    = -1;
+    int                        m_signalfd = -1;
+    int                        m_listen   = -1;
+    std::map<int, std::string> m_clients;
+    bool                       m_shutdown = false;
+    sigset_t                   m_saved_mask{};
+
+public:
+
+    Supervisor(std::vector<ServiceSpec> specs, std::string socket_path
+               , std::chrono::milliseconds stop_timeout)
+        : m_stop_timeout(stop_timeout), m_socket_path(std::move(socket_path))
+    {
+        using namespace std::string_literals;
+
+        for(auto& spec: specs)
+        {
+            for(auto const& s: m_services) {
+                if(s.spec.name == spec.name) {
+                    throw std::runtime_error("Error: duplicate service name: "s + spec.name);
+                }
+            }
+            Service s;
+            s.backoff = spec.backoff_min;
+            s.spec    = std::move(spec);
+            m_services.push_back(std::move(s));
+        }
+
+        m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        if(m_epoll < 0) {
+            throw std::runtime_error("Error: epoll_create1() failed: "s + std::strerror(errno));
+        }
+
+        // Signals are received through the signalfd only.
+        sigset_t mask;
+        ::sigemptyset(&mask);
+        ::sigaddset(&mask, SIGCHLD);
+        ::sigaddset(&mask, SIGTERM);
+        ::sigaddset(&mask, SIGINT);
+        ::sigprocmask(SIG_BLOCK, &mask, &m_saved_mask);
+        ::signal(SIGPIPE, SIG_IGN);
+        m_signalfd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        this->watch(m_signalfd, src_signal, 0);
+
+        for(std::uint32_t i = 0; i < m_services.size(); i++)
+        {
+            auto& s = m_services[i];
+            s.timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if(s.timerfd < 0) {
+                throw std::runtime_error("Error: timerfd_create() failed: "s + std::strerror(errno));
+            }
+            this->watch(s.timerfd, src_timer, i);
+        }
+
+        this->open_control_socket();
+    }
+
+    ~Supervisor()
+    {
+        for(auto const& [fd, _]: m_clients) { ::close(fd); }
+        for(auto& s: m_services)
+        {
+            if(s.pidfd >= 0)   { ::close(s.pidfd);   }
+            if(s.timerfd >= 0) { ::close(s.timerfd); }
+        }
+        if(m_listen >= 0)
+        {
+            ::close(m_listen);
+            ::unlink(m_socket_path.c_str());
+        }
+        if(m_signalfd >= 0) { ::close(m_signalfd); }
+        if(m_epoll >= 0)    { ::close(m_epoll);    }
+        ::sigprocmask(SIG_SETMASK, &m_saved_mask, nullptr);
+    }
+
+    Supervisor(Supervisor const&) = delete;
+    Supervisor& operator=(Supervisor const&) = delete;
+
+    /// Start all services and dispatch events until shutdown.
+    void run()
+    {
+        using namespace std::string_literals;
+
+        std::cout << " [INFO] Supervising " << m_services.size() << " services"
+                  << " ; control socket: " << m_socket_path << std::endl;
+        for(auto& s: m_services) { this->start(s); }
+
+        std::array<epoll_event, 64> events;
+        while(!(m_shutdown && this->all_stopped()))
+        {
+            int n = ::epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), -1);
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n < 0) {
+                throw std::runtime_error("Error: epoll_wait() failed: "s + std::strerror(errno));
+            }
+            for(int k = 0; k < n; k++)
+            {
+                auto src   = static_cast<source>(events[k].data.u64 >> 32);
+                auto index = static_cast<std::uint32_t>(events[k].data.u64);
+                switch(src)
+                {
+                case src_signal:  this->handle_signals();              break;
+                case src_control: this->accept_clients();              break;
+                case src_client:  this->handle_client(static_cast<int>(index)); break;
+                case src_process: this->collect_exit(m_services[index]); break;
+                case src_timer:   this->handle_timer(m_services[index]); break;
+                }
+            }
+        }
+        std::cout << " [INFO] All services stopped" << std::endl;
+    }
+
+private:
+
+    void watch(int fd, source src, std::uint32_t index)
+    {
+        epoll_event ev{};
+        ev.events   = EPOLLIN;
+        ev.data.u64 = (static_cast<std::uint64_t>(src) << 32) | index;
+        ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void log(Service const& s, std::string const& what)
+    {
+        std::cout << " [INFO] " << s.spec.name << ": " << what << std::endl;
+    }
+
+    bool all_stopped() const
+    {
+        return std::none_of(m_services.begin(), m_services.end(), [](Service const& s)
+        {
+            return s.st == state::running || s.st == state::stopping;
+        });
+    }
+
+    void open_control_socket()
+    {
+        using namespace std::string_literals;
+
+        auto addr = posix::make_unix_address(m_socket_path);
+        m_listen = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(m_listen < 0) {
+            throw std::runtime_error("Error: socket() failed: "s + std::strerror(errno));
+        }
+        // A socket file left by a supervisor which is gone can be replaced.
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool alive = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        ::close(probe);
+        if(alive) {
+            ::close(m_listen);
+            m_listen = -1;
+            throw std::runtime_error("Error: a supervisor is already listening on: "s + m_socket_path);
+        }
+        ::unlink(m_socket_path.c_str());
+
+        auto mask = ::umask(0077);
+        int rc = ::bind(m_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        ::umask(mask);
+        if(rc < 0 || ::listen(m_listen, 16) < 0) {
+            ::close(m_listen);
+            m_listen = -1;
+            throw std::runtime_error("Error: unable to listen on: "s + m_socket_path
+                                     + ": " + std::strerror(errno));
+        }
+        this->watch(m_listen, src_control, 0);
+    }
+
+    /// Fork and exec a service in its own process group.
+    void start(Service& s)
+    {
+        std::vector<char*> argv;
+        for(auto& a: s.spec.command) { argv.push_back(a.data()); }
+        argv.push_back(nullptr);
+
+        s.start_after_stop = false;
+        pid_t pid = ::fork();
+        if(pid == 0)
+        {
+            // ---- Child process ---- //
+            ::sigprocmask(SIG_SETMASK, &m_saved_mask, nullptr);
+            ::signal(SIGPIPE, SIG_DFL);
+            ::setpgid(0, 0);
+            if(::chdir(s.spec.directory.c_str()) < 0) { ::_exit(126); }
+            // Close-on-exec: the service only inherits the copies on 0, 1, 2.
+            int null = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+            redirect_fd(null, STDIN_FILENO);
+            int out = s.spec.logfile.empty() ? null
+                    : ::open(s.spec.logfile.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if(out < 0) { out = null; }
+            redirect_fd(out, STDOUT_FILENO);
+            redirect_fd(out, STDERR_FILENO);
+            ::execvp(argv[0], argv.data());
+            ::_exit(127);
+        }
+        if(pid < 0)
+        {
+            this->log(s, std::string("fork() failed: ") + std::strerror(errno));
+            this->schedule_restart(s);
+            return;
+        }
+
+        s.pid     = pid;
+        s.st      = state::running;
+        s.started = clock::now();
+        s.starts++;
+        s.pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+        if(s.pidfd >= 0) {
+            this->watch(s.pidfd, src_process, static_cast<std::uint32_t>(&s - m_services.data()));
+        }
+        this->log(s, "started, pid = " + std::to_string(pid));
+    }
+
+    void stop(Service& s)
+    {
+        s.start_after_stop = false;
+        if(s.st == state::backoff) {
+            this->arm_timer(s, std::chrono::milliseconds(0));
+            s.st = state::stopped;
+        }
+        if(s.st != state::running) { return; }
+        // The whole process group, so that children of the service stop too.
+        if(::kill(-s.pid, SIGTERM) < 0) { ::kill(s.pid, SIGTERM); }
+        s.st = state::stopping;
+        this->arm_timer(s, m_stop_timeout);
+        this->log(s, "stopping");
+    }
+
+    void restart(Service& s)
+    {
+        if(s.st == state::running || s.st == state::stopping)
+        {
+            this->stop(s);
+            s.start_after_stop = true;
+        } else
+        {
+            this->arm_timer(s, std::chrono::milliseconds(0));
+            this->start(s);
+        }
+    }
+
+    /// One-shot timer; a zero delay disarms it.
+    void arm_timer(Service& s, std::chrono::milliseconds delay)
+    {
+        itimerspec its{};
+        its.it_value.tv_sec  = static_cast<time_t>(delay.count() / 1000);
+        its.it_value.tv_nsec = static_cast<long>(delay.count() % 1000) * 1000000;
+        ::timerfd_settime(s.timerfd, 0, &its, nullptr);
+    }
+
+    void schedule_restart(Service& s)
+    {
+        auto delay = s.backoff;
+        s.backoff  = std::min(s.backoff * 2, s.spec.backoff_max);
+        if(delay.count() == 0) {
+            this->start(s);
+            return;
+        }
+        s.st = state::backoff;
+        this->arm_timer(s, delay);
+        this->log(s, "restarting in " + std::to_string(delay.count()) + " ms");
+    }
+
+    void handle_timer(Service& s)
+    {
+        std::uint64_t expirations;
+        if(::read(s.timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) { return; }
+        if(s.st == state::backoff && !m_shutdown) {
+            this->start(s);
+        } else if(s.st == state::stopping) {
+            this->log(s, "grace period expired, sending SIGKILL");
+            if(::kill(-s.pid, SIGKILL) < 0) { ::kill(s.pid, SIGKILL); }
+        }
+    }
+
+    /// Reap the process of a service if it has exited.
+    void collect_exit(Service& s)
+    {
+        if(s.st != state::running && s.st != state::stopping) { return; }
+        siginfo_t info{};
+        int rc = s.pidfd >= 0
+               ? ::waitid(static_cast<idtype_t>(P_PIDFD), static_cast<id_t>(s.pidfd), &info, WEXITED | WNOHANG)
+               : ::waitid(P_PID, static_cast<id_t>(s.pid), &info, WEXITED | WNOHANG);
+        if(rc < 0 || info.si_pid == 0) { return; }
+
+        if(s.pidfd >= 0) {
+            ::close(s.pidfd);
+            s.pidfd = -1;
+        }
+        bool failed = !(info.si_code == CLD_EXITED && info.si_status == 0);
+        s.last_exit = (info.si_code == CLD_EXITED ? "exit " : "signal ") + std::to_string(info.si_status);
+        s.pid = -1;
+        this->log(s, "exited (" + s.last_exit + ")");
+
+        if(clock::now() - s.started >= stable_uptime) {
+            s.backoff = s.spec.backoff_min;
+        }
+        if(s.st == state::stopping || m_shutdown)
+        {
+            this->arm_timer(s, std::chrono::milliseconds(0));
+            s.st = state::stopped;
+            if(s.start_after_stop && !m_shutdown) { this->start(s); }
+            return;
+        }
+
+        bool again = s.spec.restart == restart_policy::always
+                  || (s.spec.restart == restart_policy::on_failure && failed);
+        if(!again) {
+            s.st = failed ? state::failed : state::stopped;
+            return;
+        }
+        this->schedule_restart(s);
+    }
+
+    void handle_signals()
+    {
+        signalfd_siginfo si;
+        bool child = false;
+        while(::read(m_signalfd, &si, sizeof(si)) == sizeof(si))
+        {
+            if(si.ssi_signo == SIGCHLD) {
+                child = true;
+                continue;
+            }
+            if(!m_shutdown) {
+                std::cout << " [INFO] Signal " << si.ssi_signo << " received, stopping services" << std::endl;
+            }
+            this->shutdown();
+        }
+        // Exits of processes without a pidfd (kernels before 5.3).
+        if(child) {
+            for(auto& s: m_services) {
+                if(s.pidfd < 0) { this->collect_exit(s); }
+            }
+        }
+    }
+
+    void shutdown()
+    {
+        m_shutdown = true;
+        for(auto& s: m_services) { this->stop(s); }
+    }
+
+    void accept_clients()
+    {
+        for(;;)
+        {
+            int fd = ::accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0) { return; }
+            m_clients[fd];
+            this->watch(fd, src_client, static_cast<std::uint32_t>(fd));
+        }
+    }
+
+    /// Read a command line from a client, reply and close the connection.
+    void handle_client(int fd)
+    {
+        auto& buffer = m_clients[fd];
+        char chunk[512];
+        ssize_t n;
+        while((n = ::read(fd, chunk, sizeof(chunk))) > 0) { buffer.append(chunk, static_cast<std::size_t>(n)); }
+        auto eol = buffer.find('\n');
+        bool closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+        if(eol == std::string::npos && !closed && buffer.size() < 4096) { return; }
+
+        std::string reply = this->execute(buffer.substr(0, eol));
+        // Replies are small: send them with a blocking write (bounded by a timeout).
+        int flags = ::fcntl(fd, F_GETFL);
+        ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+        timeval tv{1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        ::send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+        m_clients.erase(fd);
+        ::close(fd);
+    }
+
+    std::string execute(std::string const& line)
+    {
+        std::stringstream ss(line);
+        std::string command, name;
+        ss >> command >> name;
+
+        if(command == "status")   { return this->status(); }
+        if(command == "shutdown") { this->shutdown(); return "ok\n"; }
+        if(command != "start" && command != "stop" && command != "restart") {
+            return "error: unknown command '" + command + "' (status, start, stop, restart, shutdown)\n";
+        }
+        if(m_shutdown) { return "error: shutting down\n"; }
+
+        std::size_t count = 0;
+        for(auto& s: m_services)
+        {
+            if(name != "all" && s.spec.name != name) { continue; }
+            count++;
+            if(command == "stop") { this->stop(s); continue; }
+            if(command == "restart") { s.backoff = s.spec.backoff_min; this->restart(s); continue; }
+            if(s.st != state::running && s.st != state::stopping)
+            {
+                s.backoff = s.spec.backoff_min;
+                this->arm_timer(s, std::chrono::milliseconds(0));
+                this->start(s);
+            }
+        }
+        if(count == 0) { return "error: unknown service '" + name + "'\n"; }
+        return "ok\n";
+    }
+
+    std::string status() const
+    {
+        static const char* names[] = { "stopped", "running", "stopping", "backoff", "failed" };
+        std::stringstream ss;
+        ss << std::left << std::setw(20) << "NAME" << std::setw(10) << "STATE"
+           << std::setw(8) << "PID" << std::setw(8) << "STARTS"
+           << std::setw(12) << "UPTIME" << "LAST-EXIT\n";
+        for(auto const& s: m_services)
+        {
+            bool up = s.st == state::running || s.st == state::stopping;
+            auto uptime = std::chrono::duration_cast<std::chrono::seconds>(clock::now() - s.started);
+            ss << std::setw(20) << s.spec.name
+               << std::setw(10) << names[static_cast<int>(s.st)]
+               << std::setw(8)  << (up ? std::to_string(s.pid) : "-")
+               << std::setw(8)  << s.starts
+               << std::setw(12) << (up ? std::to_string(uptime.count()) + "s" : "-")
+               << s.last_exit << "\n";
+        }
+        return ss.str();
+    }
+};
+
+/// Send a command to a running supervisor and print its reply.
+bool supervisor_control(std::string const& socket_path, std::vector<std::string> const& words)
+{
+    using namespace std::string_literals;
+
+    auto addr = posix::make_unix_address(socket_path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        if(fd >= 0) { ::close(fd); }
+        throw std::runtime_error("Error: no supervisor listening on: "s + socket_path);
+    }
+    std::string line;
+    for(auto const& w: words) { line += (line.empty() ? "" : " ") + w; }
+    line += "\n";
+    ::send(fd, line.data(), line.size(), MSG_NOSIGNAL);
+    ::shutdown(fd, SHUT_WR);
+
+    std::string reply;
+    char chunk[4096];
+    ssize_t n;
+    while((n = ::read(fd, chunk, sizeof(chunk))) > 0) { reply.append(chunk, static_cast<std::size_t>(n)); }
+    ::close(fd);
+    std::cout << reply;
+    return reply.compare(0, 6, "error:") != 0;
+}
+
+
+   /*==================================================*
+    *     Batch launcher                               *
+    *==================================================*/
+
+/// A command of a batch file.
+struct BatchJob
+{
+    std::vector<std::string> command;
+    std::string              directory;
+    std::string              logfile;
+};
+
+/** @brief Parse a line of a batch file.
+ *
+ *  Syntax: COMMAND [ARGS...]  or  [dir=DIRECTORY] [log=FILE] -- COMMAND [ARGS...]
+ */
+BatchJob parse_batch_job(std::string const& line)
+{
+    using namespace std::string_literals;
+
+    auto words = split_command_line(line);
+    auto sep   = std::find(words.begin(), words.end(), "--");
+    BatchJob job;
+    if(sep == words.end()) {
+        job.command = std::move(words);
+        return job;
+    }
+    job.command.assign(sep + 1, words.end());
+    if(job.command.empty()) {
+        throw std::runtime_error("Error: missing command: "s + line);
+    }
+    for(auto it = words.begin(); it != sep; ++it)
+    {
+        if(it->compare(0, 4, "dir=") == 0)      { job.directory = it->substr(4); }
+        else if(it->compare(0, 4, "log=") == 0) { job.logfile   = it->substr(4); }
+        else { throw std::runtime_error("Error: invalid job option: "s + *it); }
+    }
+    return job;
+}
+
+/// Read jobs from a file ('-' for stdin); blank lines and '#' comments are skipped.
+std::vector<BatchJob> read_batch_file(std::string const& file)
+{
+    using namespace std::string_literals;
+
+    std::ifstream ifs;
+    if(file != "-")
+    {
+        ifs.open(file);
+        if(!ifs) {
+            throw std::runtime_error("Error: Unable to open file: "s + file);
+        }
+    }
+    std::istream& is = file == "-" ? std::cin : ifs;
+    std::vector<BatchJob> jobs;
+    std::string line;
+    while(std::getline(is, line))
+    {
+        auto first = line.find_first_not_of(" \t");
+        if(first == std::string::npos || line[first] == '#') { continue; }
+        jobs.push_back(parse_batch_job(line));
+    }
+    return jobs;
+}
+
+/** @brief Run the jobs of a batch with at most 'parallel' processes at once.
+ *
+ *  Processes are created with posix_spawn(3), which glibc implements with
+ *  clone(CLONE_VM | CLONE_VFORK): the address space of the launcher is not
+ *  copied. Executables are looked up in $PATH once per distinct program
+ *  name. Exits are collected through one pidfd per process on an epoll
+ *  loop (SIGCHLD through a signalfd on kernels without pidfd_open).
+ *
+ *  @return true if all jobs exited with status 0.
+ */
+bool run_batch(std::vector<BatchJob> const& jobs, unsigned parallel, bool quiet)
+{
+    using namespace std::string_literals;
+    using clock = std::chrono::steady_clock;
+
+    struct JobResult
+    {
+        pid_t             pid   = -1;
+        int               pidfd = -1;
+        clock::time_point start;
+        double            millis = 0;
+        std::string       status = "-";
+        bool              ok     = false;
+    };
+    std::vector<JobResult> results(jobs.size());
+    parallel = std::max(parallel, 1u);
+
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    sigset_t mask, saved_mask;
+    ::sigemptyset(&mask);
+    ::sigaddset(&mask, SIGCHLD);
+    ::sigprocmask(SIG_BLOCK, &mask, &saved_mask);
+    int sigfd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_event ev{};
+    ev.events   = EPOLLIN;
+    ev.data.u64 = std::numeric_limits<std::uint64_t>::max();
+    ::epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+
+    posix_spawnattr_t attr;
+    ::posix_spawnattr_init(&attr);
+    // Children start with the signal mask of the launcher before SIGCHLD was blocked.
+    ::posix_spawnattr_setsigmask(&attr, &saved_mask);
+    ::posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    std::map<std::string, std::string> resolved;
+    std::size_t next = 0, running = 0, failures = 0;
+    std::vector<std::size_t> no_pidfd;
+    auto batch_start = clock::now();
+
+    auto finish = [&](std::size_t i, siginfo_t const& info)
+    {
+        auto& r = results[i];
+        r.millis = std::chrono::duration<double, std::milli>(clock::now() - r.start).count();
+        r.ok     = info.si_code == CLD_EXITED && info.si_status == 0;
+        r.status = (info.si_code == CLD_EXITED ? "exit " : "signal ") + std::to_string(info.si_status);
+        if(r.pidfd >= 0) { ::close(r.pidfd); }
+        r.pidfd = -1;
+        running--;
+        if(!r.ok) { failures++; }
+    };
+
+    auto spawn = [&](std::size_t i)
+    {
+        stats::ScopedPhase timer(stats::phase::spawn);
+        auto const& job = jobs[i];
+        auto& r = results[i];
+        r.start = clock::now();
+
+        auto it = resolved.find(job.command[0]);
+        if(it == resolved.end()) {
+            it = resolved.emplace(job.command[0], find_in_path(job.command[0])).first;
+        }
+        std::vector<char*> argv;
+        for(auto const& a: job.command) { argv.push_back(const_cast<char*>(a.c_str())); }
+        argv.push_back(nullptr);
+
+        posix_spawn_file_actions_t actions;
+        ::posix_spawn_file_actions_init(&actions);
+        ::posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        if(!job.logfile.empty())
+        {
+            ::posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, job.logfile.c_str()
+                                               , O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            ::posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+        }
+        int rc = ENOENT;
+        if(!job.directory.empty())
+        {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+            ::posix_spawn_file_actions_addchdir_np(&actions, job.directory.c_str());
+#else
+            rc = ENOTSUP;
+#endif
+        }
+        const std::string& exe = it->second;
+        if(!exe.empty() && rc != ENOTSUP) {
+            rc = ::posix_spawn(&r.pid, exe.c_str(), &actions, &attr, argv.data(), environ);
+            stats::add(stats::counter::syscalls);
+        }
+        ::posix_spawn_file_actions_destroy(&actions);
+
+        if(rc != 0)
+        {
+            r.status = "error: "s + std::strerror(rc);
+            failures++;
+            return;
+        }
+        running++;
+        stats::add(stats::counter::processes);
+        stats::add(stats::counter::syscalls, 2);
+        r.pidfd = static_cast<int>(::syscall(SYS_pidfd_open, r.pid, 0));
+        if(r.pidfd < 0) {
+            no_pidfd.push_back(i);
+            return;
+        }
+        epoll_event pev{};
+        pev.events   = EPOLLIN;
+        pev.data.u64 = i;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, r.pidfd, &pev);
+    };
+
+    std::array<epoll_event, 256> events;
+    while(next < jobs.size() || running > 0)
+    {
+        while(running < parallel && next < jobs.size()) { spawn(next++); }
+        if(running == 0) { continue; }
+
+        stats::ScopedPhase timer(stats::phase::wait);
+        int n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()), -1);
+        stats::add(stats::counter::syscalls);
+        for(int k = 0; k < n; k++)
+        {
+            auto i = events[k].data.u64;
+            stats::add(stats::counter::syscalls);
+            siginfo_t info{};
+            if(i != std::numeric_limits<std::uint64_t>::max())
+            {
+                if(::waitid(static_cast<idtype_t>(P_PIDFD), static_cast<id_t>(results[i].pidfd)
+                            , &info, WEXITED | WNOHANG) == 0 && info.si_pid != 0) {
+                    finish(i, info);
+                }
+                continue;
+            }
+            // SIGCHLD: exits of processes without a pidfd.
+            signalfd_siginfo si;
+            while(::read(sigfd, &si, sizeof(si)) == sizeof(si)) { }
+            for(std::size_t j = 0; j < no_pidfd.size(); )
+            {
+                std::size_t idx = no_pidfd[j];
+                info = siginfo_t{};
+                if(::waitid(P_PID, static_cast<id_t>(results[idx].pid), &info, WEXITED | WNOHANG) == 0
+                   && info.si_pid != 0)
+                {
+                    finish(idx, info);
+                    no_pidfd[j] = no_pidfd.back();
+                    no_pidfd.pop_back();
+                    continue;
+                }
+                j++;
+            }
+        }
+    }
+    double total_ms = std::chrono::duration<double, std::milli>(clock::now() - batch_start).count();
+
+    ::posix_spawnattr_destroy(&attr);
+    ::close(sigfd);
+    ::close(epfd);
+    ::sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+
+    if(!quiet)
+    {
+        std::cout << std::left << std::setw(8) << "JOB" << std::setw(12) << "STATUS"
+                  << std::right << std::setw(12) << "TIME(ms)" << "  COMMAND\n";
+        for(std::size_t i = 0; i < jobs.size(); i++)
+        {
+            std::string cmd;
+            for(auto const& a: jobs[i].command) { cmd += (cmd.empty() ? "" : " ") + a; }
+            std::cout << std::left << std::setw(8) << i << std::setw(12) << results[i].status
+                      << std::right << std::setw(12) << std::fixed << std::setprecision(2)
+                      << results[i].millis << "  " << cmd << "\n";
+        }
+    }
+
+    std::vector<double> times;
+    for(auto const& r: results) { times.push_back(r.millis); }
+    std::sort(times.begin(), times.end());
+    auto percentile = [&](double p) {
+        return times.empty() ? 0.0 : times[static_cast<std::size_t>(p * (times.size() - 1))];
+    };
+    double sum = std::accumulate(times.begin(), times.end(), 0.0);
+    std::cout << std::fixed << std::setprecision(2)
+              << " [INFO] Jobs: " << jobs.size() << " ; failed: " << failures
+              << " ; parallel: " << parallel
+              << " ; wall time: " << total_ms << " ms"
+              << " ; throughput: " << (total_ms > 0 ? jobs.size() * 1000.0 / total_ms : 0.0) << " jobs/s\n"
+              << " [INFO] Job time (ms): min " << (times.empty() ? 0.0 : times.front())
+              << " ; mean " << (times.empty() ? 0.0 : sum / times.size())
+              << " ; p50 " << percentile(0.5) << " ; p95 " << percentile(0.95)
+              << " ; max " << (times.empty() ? 0.0 : times.back()) << "\n";
+    return failures == 0;
+}
+
+   /*==================================================*
+    *     Process resource sampler                     *
+    *==================================================*/
+
+/// Counters of a process read from procfs.
+struct ProcSample
+{
+    std::uint64_t utime       = 0;   // Clock ticks in user mode
+    std::uint64_t stime       = 0;   // Clock ticks in kernel mode
+    std::uint64_t vsize       = 0;   // Bytes
+    std::uint64_t rss         = 0;   // Bytes
+    std::uint64_t rchar       = 0;   // Bytes read by system calls
+    std::uint64_t wchar       = 0;   // Bytes written by system calls
+    std::uint64_t read_bytes  = 0;   // Bytes read from storage
+    std::uint64_t write_bytes = 0;   // Bytes written to storage
+    std::uint32_t threads     = 0;
+    std::uint32_t fds         = 0;
+    std::int32_t  ppid        = 0;
+    char          comm[16]    = {};
+};
+
+/// Allocation-free parsers of procfs files.
+namespace procfs
+{
+    inline const char* skip_blanks(const char* p, const char* end)
     {
-        this->m_cwd = std::move(cwd);
+        while(p < end && (*p == ' ' || *p == '\n' || *p == '\t')) { p++; }
+        return p;
     }
 
-    /// Set process log file to which the output (stderr and stdout)
-    /// will be redirected to.
-    void set_logfile(std::string logfile)
+    inline const char* skip_field(const char* p, const char* end)
     {
-        this->m_logfile = std::move(logfile);
+        p = skip_blanks(p, end);
+        while(p < end && *p != ' ' && *p != '\n') { p++; }
+        return p;
     }
 
-    /// If set to true, the application is launched in a new terminal
-    void set_terminal(bool flag)
+    inline const char* parse_u64(const char* p, const char* end, std::uint64_t& value)
     {
-        this->m_terminal = flag;
+        p = skip_blanks(p, end);
+        value = 0;
+        while(p < end && *p >= '0' && *p <= '9') { value = value * 10 + static_cast<unsigned>(*p++ - '0'); }
+        return p;
     }
 
-    /// If set to true, the application is launched in current terminal
-    /// replacing current process (not launched as a daemon wich is
-    /// the default behavior).
-    void set_exec(bool flag)
+    /// Parse /proc/PID/stat: comm, ppid, utime, stime, num_threads and vsize.
+    inline bool parse_stat(const char* buf, std::size_t size, ProcSample& s)
     {
-        this->m_exec = flag;
+        const char* end   = buf + size;
+        const char* open  = static_cast<const char*>(std::memchr(buf, '(', size));
+        // The command name may contain ')', the last one closes it.
+        const char* close = end;
+        while(close > buf && *(close - 1) != ')') { close--; }
+        if(open == nullptr || close == buf || close - 1 < open) { return false; }
+        std::size_t len = std::min<std::size_t>(static_cast<std::size_t>(close - 1 - (open + 1))
+                                                , sizeof(s.comm) - 1);
+        std::memcpy(s.comm, open + 1, len);
+        s.comm[len] = '\0';
+
+        std::uint64_t value = 0;
+        const char* p = skip_field(close, end);                  // 3  state
+        p = parse_u64(p, end, value);                            // 4  ppid
+        s.ppid = static_cast<std::int32_t>(value);
+        for(int field = 5; field < 14; field++) { p = skip_field(p, end); }
+        p = parse_u64(p, end, s.utime);                          // 14 utime
+        p = parse_u64(p, end, s.stime);                          // 15 stime
+        for(int field = 16; field < 20; field++) { p = skip_field(p, end); }
+        p = parse_u64(p, end, value);                            // 20 num_threads
+        s.threads = static_cast<std::uint32_t>(value);
+        p = skip_field(p, end);                                  // 21 itrealvalue
+        p = skip_field(p, end);                                  // 22 starttime
+        parse_u64(p, end, s.vsize);                              // 23 vsize
+        return true;
     }
 
-    std::optional<int>
-    launch(std::vector<std::string> const& args = {})
+    /// Parse /proc/PID/statm: the second field is the resident set in pages.
+    inline void parse_statm(const char* buf, std::size_t size, std::uint64_t page_size, ProcSample& s)
     {
-        if(m_exec)
-            return this->exec(m_program, args);
+        std::uint64_t pages = 0;
+        parse_u64(skip_field(buf, buf + size), buf + size, pages);
+        s.rss = pages * page_size;
+    }
 
-        if(!m_terminal)
-            return this->launch_impl(m_program, args);
-        else
-            return this->launch_impl("xterm", {"-hold", "-e", m_program});
+    /// Parse the "key: value" lines of /proc/PID/io.
+    inline void parse_io(const char* buf, std::size_t size, ProcSample& s)
+    {
+        const char* end = buf + size;
+        const char* p   = buf;
+        auto key = [&](const char* name, std::size_t len) {
+            return static_cast<std::size_t>(end - p) > len && std::memcmp(p, name, len) == 0;
+        };
+        while(p < end)
+        {
+            const char* colon = static_cast<const char*>(std::memchr(p, ':', static_cast<std::size_t>(end - p)));
+            if(colon == nullptr) { break; }
+            std::uint64_t* target = key("rchar", 5)       ? &s.rchar
+                                  : key("wchar", 5)       ? &s.wchar
+                                  : key("read_bytes", 10) ? &s.read_bytes
+                                  : key("write_bytes", 11)? &s.write_bytes
+                                  : nullptr;
+            std::uint64_t value = 0;
+            p = parse_u64(colon + 1, end, value);
+            if(target != nullptr) { *target = value; }
+            while(p < end && *p != '\n') { p++; }
+            p++;
+        }
     }
+}
 
-private:
+/** @brief Open procfs files of a process, re-read with pread(2) at each sample.
+ *
+ *  The files stay bound to the process they were opened for: once it
+ *  exits, reads fail with ESRCH even if the PID is reused. /proc/PID/io
+ *  needs the permission to ptrace the process, its counters stay at zero
+ *  otherwise.
+ */
+class ProcHandle
+{
+    int m_stat   = -1;
+    int m_statm  = -1;
+    int m_io     = -1;
+    int m_fd_dir = -1;
 
-    /// Wrapper for exec POSIX C API function
-    int exec(std::string program, std::vector<std::string> const& args)
-    {
-        std::vector<const char*> pargs(args.size() + 1);
-        pargs[0] = program.c_str();
-        std::transform(args.begin(), args.end(), pargs.begin() + 1
-                       , [](auto const& s){ return s.c_str(); });
-        pargs.push_back(nullptr);
+public:
 
-        // Dummy return
-        return ::execvp(program.c_str(), (char* const*) &pargs[0]);
+    explicit ProcHandle(int pid)
+    {
+        auto dir = "/proc/" + std::to_string(pid);
+        m_stat   = ::open((dir + "/stat").c_str(),  O_RDONLY | O_CLOEXEC);
+        m_statm  = ::open((dir + "/statm").c_str(), O_RDONLY | O_CLOEXEC);
+        m_io     = ::open((dir + "/io").c_str(),    O_RDONLY | O_CLOEXEC);
+        m_fd_dir = ::open((dir + "/fd").c_str(),    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
     }
 
-    std::optional<int>
-    launch_impl(std::string program, std::vector<std::string> const& args)
+    ~ProcHandle()
     {
-        int pid = ::fork();
-
-        // If the PID of the forked process is negative
-        // when the fork operation has fails.
-        if(pid < 0) {
-            std::cerr << " [ERROR] Unable to fork proces and launch " << program << "\n";
-            return std::nullopt;
+        for(int fd: {m_stat, m_statm, m_io, m_fd_dir}) {
+            if(fd >= 0) { ::close(fd); }
         }
+    }
 
-        // If the PID is greater than zero, the current process
-        // is the original or the parent one. Then the PID is returned
-        // to the caller.
-        if(pid > 0) { return pid; }
+    ProcHandle(ProcHandle const&) = delete;
+    ProcHandle& operator=(ProcHandle const&) = delete;
 
-        // ---- Forked process (pid == 0) --- //
-        //------------------------------------//
-        assert(pid == 0 && "PID should be zero");
-        ::setsid();
-        ::umask(0);
+    /// Read the counters; false if the process is gone.
+    bool sample(ProcSample& s)
+    {
+        static const std::uint64_t page_size = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        char buffer[1024];
+
+        stats::ScopedPhase timer(stats::phase::read);
+        stats::add(stats::counter::processes);
+        stats::add(stats::counter::syscalls, 3);
+        s = ProcSample{};
+        auto n = m_stat < 0 ? -1 : ::pread(m_stat, buffer, sizeof(buffer), 0);
+        if(n <= 0 || !procfs::parse_stat(buffer, static_cast<std::size_t>(n), s)) { return false; }
+        n = m_statm < 0 ? -1 : ::pread(m_statm, buffer, sizeof(buffer), 0);
+        if(n > 0) { procfs::parse_statm(buffer, static_cast<std::size_t>(n), page_size, s); }
+        n = m_io < 0 ? -1 : ::pread(m_io, buffer, sizeof(buffer), 0);
+        if(n > 0) { procfs::parse_io(buffer, static_cast<std::size_t>(n), s); }
+        s.fds = this->count_fds();
+        return true;
+    }
 
-        // Set current directory of daemon process
-        ::chdir(m_cwd.c_str());
+private:
 
-        // Close stdin, stdout and stderr file descriptors to avoid
-        // littering the parent process output.
-        ::close(STDIN_FILENO);
-        ::close(STDOUT_FILENO);
-        ::close(STDERR_FILENO);
-
-        // If the flag is true, redirect the process output
-        // to a log file.
-        if(this->m_logfile)
-        {
-            FILE* fp = ::fopen(m_logfile.value().c_str(), "w");
-            int fd = ::fileno(fp);
-            //int fd = open(logfile.value().c_str(), O_WRONLY);
-            if(fd == -1){
-                std::cerr << " [ERROR] Failed to open file: " << m_logfile.value() << "\n";
-            } else
+    /// Count the entries of /proc/PID/fd with getdents64(2).
+    std::uint32_t count_fds()
+    {
+        if(m_fd_dir < 0) { return 0; }
+        alignas(8) char buffer[8192];
+        std::uint32_t count = 0;
+        ::lseek(m_fd_dir, 0, SEEK_SET);
+        for(;;)
+        {
+            auto n = ::syscall(SYS_getdents64, m_fd_dir, buffer, sizeof(buffer));
+            stats::add(stats::counter::syscalls);
+            if(n <= 0) { break; }
+            for(long pos = 0; pos < n; )
             {
-                ::dup2(fd, ::fileno(stdout));
-                ::dup2(fd, ::fileno(stderr));
-                ::dup2(fd, ::fileno(stdin));
+                // struct linux_dirent64: d_ino, d_off, d_reclen, d_type, d_name
+                unsigned short reclen;
+                std::memcpy(&reclen, buffer + pos + 16, sizeof(reclen));
+                if(buffer[pos + 19] != '.') { count++; }
+                pos += reclen;
             }
         }
-        return this->exec(program, args);
+        return count;
     }
 };
 
+/** @brief Processes of the trees rooted at 'roots' (roots included).
+ *
+ *  Uses /proc/PID/task/TID/children when the kernel provides it
+ *  (CONFIG_PROC_CHILDREN), otherwise the parent PIDs of all processes.
+ */
+std::vector<int> process_tree(std::vector<int> const& roots)
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<int> result;
+    bool has_children = fs::exists("/proc/self/task/" + std::to_string(::getpid()) + "/children", ec);
 
-/** Print directories listed in PATH environment variable.
- *  Operating Systems.
- *  Requires: <iostream>, <cstdlib> <sstream>
- **********************************************************/
-void show_dirs_in_path(std::ostream& os)
+    std::multimap<int, int> children_of;
+    if(!has_children)
+    {
+        char buffer[1024];
+        for(auto const& entry: fs::directory_iterator("/proc", ec))
+        {
+            auto name = entry.path().filename().string();
+            if(name.empty() || !std::isdigit(static_cast<unsigned char>(name[0]))) { continue; }
+            int fd = ::open((entry.path() / "stat").c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0) { continue; }
+            auto n = ::read(fd, buffer, sizeof(buffer));
+            ::close(fd);
+            ProcSample s;
+            if(n > 0 && procfs::parse_stat(buffer, static_cast<std::size_t>(n), s)) {
+                children_of.emplace(s.ppid, std::stoi(name));
+            }
+        }
+    }
+
+    std::vector<int> pending(roots.begin(), roots.end());
+    while(!pending.empty())
+    {
+        int pid = pending.back();
+        pending.pop_back();
+        if(std::find(result.begin(), result.end(), pid) != result.end()) { continue; }
+        result.push_back(pid);
+        if(!has_children)
+        {
+            auto range = children_of.equal_range(pid);
+            for(auto it = range.first; it != range.second; ++it) { pending.push_back(it->second); }
+            continue;
+        }
+        auto task_dir = "/proc/" + std::to_string(pid) + "/task";
+        for(auto const& task: fs::directory_iterator(task_dir, ec))
+        {
+            std::ifstream ifs(task.path() / "children");
+            int child;
+            while(ifs >> child) { pending.push_back(child); }
+        }
+    }
+    return result;
+}
+
+/// Header and records of the binary time series of 'top --output'
+/// (host byte order, counters are cumulative).
+struct StatFileHeader
 {
-    std::stringstream ss{ ::getenv("PATH") };
-    std::string dirpath;
+    char          magic[8]         = {'C', 'B', 'S', 'T', 'A', 'T', '1', '\n'};
+    std::uint32_t record_size      = 0;
+    std::uint32_t ticks_per_second = 0;
+};
 
-    while(std::getline(ss, dirpath, ':'))
-        os << "\t" << dirpath << std::endl;
+struct StatRecord
+{
+    std::uint64_t time_ns;           // CLOCK_REALTIME
+    std::int32_t  pid;
+    std::int32_t  ppid;
+    std::uint64_t utime;
+    std::uint64_t stime;
+    std::uint64_t vsize;
+    std::uint64_t rss;
+    std::uint64_t rchar;
+    std::uint64_t wchar;
+    std::uint64_t read_bytes;
+    std::uint64_t write_bytes;
+    std::uint32_t threads;
+    std::uint32_t fds;
+    char          comm[16];
+};
+static_assert(sizeof(StatRecord) == 104, "StatRecord layout is part of the file format");
+
+/// Per-interval rates of a process.
+struct ProcRates
+{
+    double cpu_percent = 0;
+    double read_kib_s  = 0;
+    double write_kib_s = 0;
+};
+
+ProcRates compute_rates(ProcSample const& prev, ProcSample const& cur
+                        , double seconds, double ticks_per_second)
+{
+    auto delta = [](std::uint64_t a, std::uint64_t b) {
+        return b >= a ? static_cast<double>(b - a) : 0.0;
+    };
+    ProcRates r;
+    if(seconds <= 0) { return r; }
+    r.cpu_percent = 100.0 * (delta(prev.utime, cur.utime) + delta(prev.stime, cur.stime))
+                    / ticks_per_second / seconds;
+    r.read_kib_s  = delta(prev.rchar, cur.rchar) / 1024.0 / seconds;
+    r.write_kib_s = delta(prev.wchar, cur.wchar) / 1024.0 / seconds;
+    return r;
 }
 
-std::optional<std::string>
-get_symlink_realpath(std::string const& path)
+void print_top_header(std::ostream& os)
 {
-    auto buffer = std::string(PATH_MAX, 0x00);
-    char* result = ::realpath(path.c_str(), buffer.data());
-    if(result){ return std::make_optional(buffer); }
-    return std::nullopt;
+    os << std::right << std::setw(8) << "PID" << std::setw(8) << "CPU%"
+       << std::setw(12) << "RSS(KiB)" << std::setw(6) << "THR" << std::setw(7) << "FDS"
+       << std::setw(12) << "READ(KiB/s)" << std::setw(13) << "WRITE(KiB/s)" << "  COMMAND\n";
+}
+
+void print_top_row(std::ostream& os, int pid, ProcSample const& s, ProcRates const& r)
+{
+    os << std::right << std::fixed << std::setprecision(1)
+       << std::setw(8) << pid << std::setw(8) << r.cpu_percent
+       << std::setw(12) << s.rss / 1024 << std::setw(6) << s.threads << std::setw(7) << s.fds
+       << std::setw(12) << r.read_kib_s << std::setw(13) << r.write_kib_s
+       << "  " << s.comm << "\n";
 }
 
-void relaunch_app_pid(int pid)
+/** @brief Sample CPU, memory, I/O and descriptors of processes at a fixed interval.
+ *
+ *  The procfs files of each process are opened once and re-read with
+ *  pread(2) into stack buffers, no process is spawned and nothing is
+ *  allocated per sample. With 'tree', descendants are looked up again
+ *  at every interval. Samples can be appended to a binary time series
+ *  ('output'), which 'replay_stats' turns back into a table.
+ *
+ *  @param count Number of intervals (0 => until all processes exit).
+ */
+void run_top(std::vector<int> const& pids, bool tree, std::chrono::milliseconds interval
+             , unsigned count, std::string const& output, bool quiet)
 {
     using namespace std::string_literals;
+    using clock = std::chrono::steady_clock;
 
-    // Executable path
-    auto exe = get_symlink_realpath("/proc/"s + std::to_string(pid) + "/exe");
-    // Current working directory
-    auto cwd  = get_symlink_realpath("/proc/"s + std::to_string(pid) + "/cwd");
+    struct Tracked
+    {
+        ProcHandle handle;
+        ProcSample current;
+        ProcSample previous;
+        bool       has_previous = false;
+        explicit Tracked(int pid): handle(pid) { }
+    };
+    std::map<int, Tracked> tracked;
+    double ticks_per_second = static_cast<double>(::sysconf(_SC_CLK_TCK));
+
+    std::FILE* out = nullptr;
+    if(!output.empty())
+    {
+        out = std::fopen(output.c_str(), "ab");
+        if(out == nullptr) {
+            throw std::runtime_error("Error: Unable to open file: "s + output);
+        }
+        if(std::ftell(out) == 0)
+        {
+            StatFileHeader header;
+            header.record_size      = sizeof(StatRecord);
+            header.ticks_per_second = static_cast<std::uint32_t>(ticks_per_second);
+            std::fwrite(&header, sizeof(header), 1, out);
+        }
+    }
 
-    if(!exe || !cwd){
-        throw std::runtime_error("Error: process of pid: <"s
-                                 + std::to_string(pid) + "> not found. ");
+    timespec deadline{};
+    ::clock_gettime(CLOCK_MONOTONIC, &deadline);
+    auto last = clock::now();
+    for(unsigned iteration = 0; count == 0 || iteration <= count; iteration++)
+    {
+        auto members = tree ? process_tree(pids) : pids;
+        for(int pid: members) { tracked.try_emplace(pid, pid); }
+        for(auto it = tracked.begin(); it != tracked.end(); )
+        {
+            bool member = std::find(members.begin(), members.end(), it->first) != members.end();
+            it = member ? std::next(it) : tracked.erase(it);
+        }
+
+        auto now     = clock::now();
+        double secs  = std::chrono::duration<double>(now - last).count();
+        last = now;
+        timespec wall{};
+        ::clock_gettime(CLOCK_REALTIME, &wall);
+
+        for(auto it = tracked.begin(); it != tracked.end(); )
+        {
+            it = it->second.handle.sample(it->second.current) ? std::next(it) : tracked.erase(it);
+        }
+
+        if(!quiet && iteration > 0 && !tracked.empty())
+        {
+            char stamp[16];
+            std::tm tm{};
+            ::localtime_r(&wall.tv_sec, &tm);
+            std::strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+            std::cout << " [" << stamp << "] processes: " << tracked.size() << "\n";
+            print_top_header(std::cout);
+        }
+        for(auto& [pid, t]: tracked)
+        {
+            auto const& s = t.current;
+            if(!quiet && t.has_previous) {
+                print_top_row(std::cout, pid, s, compute_rates(t.previous, s, secs, ticks_per_second));
+            }
+            if(out != nullptr)
+            {
+                StatRecord rec{};
+                rec.time_ns     = static_cast<std::uint64_t>(wall.tv_sec) * 1000000000ull
+                                  + static_cast<std::uint64_t>(wall.tv_nsec);
+                rec.pid         = pid;
+                rec.ppid        = s.ppid;
+                rec.utime       = s.utime;
+                rec.stime       = s.stime;
+                rec.vsize       = s.vsize;
+                rec.rss         = s.rss;
+                rec.rchar       = s.rchar;
+                rec.wchar       = s.wchar;
+                rec.read_bytes  = s.read_bytes;
+                rec.write_bytes = s.write_bytes;
+                rec.threads     = s.threads;
+                rec.fds         = s.fds;
+                std::memcpy(rec.comm, s.comm, sizeof(rec.comm));
+                std::fwrite(&rec, sizeof(rec), 1, out);
+            }
+            t.previous     = s;
+            t.has_previous = true;
+        }
+        if(out != nullptr) { std::fflush(out); }
+        std::cout.flush();
+
+        if(tracked.empty())
+        {
+            std::cerr << " [INFO] No process left to sample\n";
+            break;
+        }
+        // Absolute deadlines: the interval does not drift with the sampling time.
+        auto ns = deadline.tv_nsec + std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+        deadline.tv_sec  += static_cast<time_t>(ns / 1000000000);
+        deadline.tv_nsec  = static_cast<long>(ns % 1000000000);
+        while(::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) { }
     }
+    if(out != nullptr) { std::fclose(out); }
+}
 
-    // Kill process
-    ::kill(pid, 9);
-    // Restart process
-    AppLauncher app(exe.value());
-    app.set_cwd(cwd.value());
-    auto pid_new = app.launch();
-    if(!pid_new){
-        throw std::runtime_error("Error: failed to relaunch process");
+/// Print the samples of a binary time series written by 'top --output' as CSV.
+void replay_stats(std::string const& file, std::ostream& os)
+{
+    using namespace std::string_literals;
+
+    std::ifstream ifs(file, std::ios::binary);
+    StatFileHeader header, expected;
+    if(!ifs || !ifs.read(reinterpret_cast<char*>(&header), sizeof(header))
+       || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+       || header.record_size != sizeof(StatRecord))
+    {
+        throw std::runtime_error("Error: not a statistics file: "s + file);
+    }
+    os << "time,pid,ppid,command,cpu_percent,rss_kib,vsize_kib,threads,fds"
+          ",read_kib_s,write_kib_s,disk_read_bytes,disk_write_bytes\n";
+
+    std::map<int, StatRecord> previous;
+    StatRecord rec;
+    while(ifs.read(reinterpret_cast<char*>(&rec), sizeof(rec)))
+    {
+        ProcSample cur;
+        cur.utime = rec.utime;  cur.stime = rec.stime;
+        cur.rchar = rec.rchar;  cur.wchar = rec.wchar;
+        ProcRates rates;
+        auto it = previous.find(rec.pid);
+        if(it != previous.end())
+        {
+            ProcSample prev;
+            prev.utime = it->second.utime;  prev.stime = it->second.stime;
+            prev.rchar = it->second.rchar;  prev.wchar = it->second.wchar;
+            rates = compute_rates(prev, cur, (rec.time_ns - it->second.time_ns) / 1e9
+                                  , header.ticks_per_second);
+        }
+        previous[rec.pid] = rec;
+
+        char comm[sizeof(rec.comm) + 1] = {};
+        std::memcpy(comm, rec.comm, sizeof(rec.comm));
+        os << std::fixed << std::setprecision(3) << rec.time_ns / 1e9
+           << "," << rec.pid << "," << rec.ppid << "," << comm
+           << std::setprecision(1) << "," << rates.cpu_percent
+           << "," << rec.rss / 1024 << "," << rec.vsize / 1024
+           << "," << rec.threads << "," << rec.fds
+           << "," << rates.read_kib_s << "," << rates.write_kib_s
+           << "," << rec.read_bytes << "," << rec.write_bytes << "\n";
     }
-    std::cout << " [INFO] Relaunched application: "
-              << "\n        pid = " << pid_new.value()
-              << "\n executable = " << exe.value()
-              << "\n  directory = " << cwd.value()
-              << "\n";
 }
 
 
@@ -246,6 +2780,21 @@ int main(int argc, char** argv)
     cmd_run->add_option("--logfile", logfile
                         , "Log file to which the process output will be redirected to.");
 
+    std::string log_rotate_size = "0";
+    cmd_run->add_option("--log-rotate-size", log_rotate_size
+                        , "Rotate the log file when it reaches this size, for instance: 100M");
+
+    std::string log_rotate_time = "0";
+    cmd_run->add_option("--log-rotate-time", log_rotate_time
+                        , "Rotate the log file after this time, for instance: 1h");
+
+    unsigned log_keep = 5;
+    cmd_run->add_option("--log-keep", log_keep, "Number of rotated log files kept");
+
+    bool log_timestamps = false;
+    cmd_run->add_flag("--log-timestamps", log_timestamps
+                      , "Prefix each line of the log with the time it was written");
+
 
     //----- Path command settings -----------------//
 
@@ -254,6 +2803,26 @@ int main(int argc, char** argv)
         ,"Show content of $PATH environment variable"
         );
 
+    bool path_shadowed = false;
+    cmd_path->add_flag("--shadowed", path_shadowed
+                       , "Show the commands found in several directories of $PATH");
+
+    //----- Which command settings -----------------//
+
+    CLI::App* cmd_which = app.add_subcommand(
+         "which"
+        ,"Show the executables run for commands (cached $PATH lookup)"
+        );
+
+    std::vector<std::string> which_names;
+    cmd_which->add_option("<NAME>", which_names, "Command names");
+
+    bool which_all = false;
+    cmd_which->add_flag("-a,--all", which_all, "Show all matches, including shadowed ones");
+
+    bool which_rebuild = false;
+    cmd_which->add_flag("--rebuild", which_rebuild, "Scan all directories of $PATH again");
+
     //----- Relaunch command settings -----------------//
 
     CLI::App* cmd_relaunch = app.add_subcommand(
@@ -264,6 +2833,102 @@ int main(int argc, char** argv)
     cmd_relaunch->add_option("<PID>", pid_to_relaunch
                              , "PID of application to be relaunched")->required();
 
+    bool relaunch_no_handoff = false;
+    cmd_relaunch->add_flag("--no-handoff", relaunch_no_handoff
+                           , "Do not pass the listening sockets to the new instance");
+
+    std::string relaunch_startup_check = "1s";
+    cmd_relaunch->add_option("--startup-check", relaunch_startup_check
+                             , "Time the new instance must run before the old one is stopped");
+
+    std::string relaunch_stop_timeout = "5s";
+    cmd_relaunch->add_option("--stop-timeout", relaunch_stop_timeout
+                             , "Time between SIGTERM and SIGKILL of the old instance");
+
+    //----- Supervise command settings -----------------//
+
+    CLI::App* cmd_supervise = app.add_subcommand(
+         "supervise"
+        ,"Launch services and restart them according to their restart policy"
+        );
+    cmd_supervise->footer("\n Service syntax: NAME [restart=always|on-failure|never] [backoff=MIN:MAX]"
+                          "\n                [dir=DIRECTORY] [log=FILE] -- COMMAND [ARGS...]");
+
+    std::string services_file;
+    cmd_supervise->add_option("<FILE>", services_file
+                              , "Services file, one service per line");
+
+    std::vector<std::string> service_lines;
+    cmd_supervise->add_option("-s,--service", service_lines
+                              , "Service line, for instance: 'web restart=always -- python3 -m http.server'");
+
+    std::string control_socket = default_control_socket();
+    cmd_supervise->add_option("--socket", control_socket, "Control socket path");
+
+    std::string stop_timeout = "5s";
+    cmd_supervise->add_option("--stop-timeout", stop_timeout
+                              , "Delay between SIGTERM and SIGKILL when stopping a service");
+
+    //----- Control command settings -----------------//
+
+    CLI::App* cmd_ctl = app.add_subcommand(
+         "ctl"
+        ,"Send a command to a running supervisor: status, start|stop|restart NAME|all, shutdown"
+        );
+    std::vector<std::string> ctl_command;
+    cmd_ctl->add_option("<COMMAND>", ctl_command, "Command and service name")->required();
+    cmd_ctl->add_option("--socket", control_socket, "Control socket path");
+
+    //----- Batch command settings -----------------//
+
+    CLI::App* cmd_batch = app.add_subcommand(
+         "batch"
+        ,"Run the commands of a job file in parallel"
+        );
+    cmd_batch->footer("\n Job syntax: COMMAND [ARGS...] or [dir=DIRECTORY] [log=FILE] -- COMMAND [ARGS...]");
+
+    std::string batch_file;
+    cmd_batch->add_option("<FILE>", batch_file, "Job file, one command per line ('-' for stdin)")->required();
+
+    unsigned batch_jobs = std::max(1u, std::thread::hardware_concurrency());
+    cmd_batch->add_option("-j,--jobs", batch_jobs, "Maximum number of running jobs");
+
+    bool batch_quiet = false;
+    cmd_batch->add_flag("-q,--quiet", batch_quiet, "Only print the summary, not the per-job table");
+
+    //----- Top command settings -----------------//
+
+    CLI::App* cmd_top = app.add_subcommand(
+         "top"
+        ,"Sample CPU, memory, I/O and file descriptors of processes"
+        );
+
+    std::vector<int> top_pids;
+    cmd_top->add_option("<PID>", top_pids, "Processes to be sampled");
+
+    bool top_tree = false;
+    cmd_top->add_flag("-T,--tree", top_tree, "Also sample the descendants of the processes");
+
+    std::string top_interval = "1s";
+    cmd_top->add_option("-i,--interval", top_interval, "Sampling interval, for instance: 500ms");
+
+    unsigned top_count = 0;
+    cmd_top->add_option("-n,--count", top_count, "Number of intervals (0 => until the processes exit)");
+
+    std::string top_output;
+    cmd_top->add_option("-o,--output", top_output, "Append the samples to a binary time series file");
+
+    bool top_quiet = false;
+    cmd_top->add_flag("-q,--quiet", top_quiet, "Do not print the samples");
+
+    std::string top_replay;
+    cmd_top->add_option("--replay", top_replay, "Print a binary time series file as CSV");
+
+    // Execution statistics of the launcher itself
+    stats::Options stats_options;
+    stats::add_options(cmd_batch, stats_options);
+    stats::add_options(cmd_top, stats_options);
+
     // ----------- Parse Arguments ---------------//
     app.require_subcommand();
 
@@ -298,6 +2963,8 @@ int main(int argc, char** argv)
 
     //------------ Program Actions --------------------//
 
+    stats::Session stats_session(stats_options);
+
     // Command: run => Launch a process
     if(*cmd_run){
         // auto pid = launch_as_daemon(application, {}, cwd);
@@ -306,6 +2973,21 @@ int main(int argc, char** argv)
         app.set_terminal(flag_terminal);
         app.set_exec(flag_exec);
         if(logfile != "") app.set_logfile(logfile);
+        try {
+            LogRotation rotation;
+            rotation.max_size   = posix::parse_size(log_rotate_size);
+            rotation.max_age    = parse_duration(log_rotate_time);
+            rotation.keep       = log_keep;
+            rotation.timestamps = log_timestamps;
+            if(rotation.enabled() && logfile == "") {
+                throw std::runtime_error("Error: log rotation requires --logfile");
+            }
+            app.set_log_rotation(rotation);
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
         auto pid = app.launch(rest_args);
 
         if(pid) {
@@ -318,21 +3000,119 @@ int main(int argc, char** argv)
     // Command: path show directories in PATH environment variable
     if(*cmd_path)
     {
-        show_dirs_in_path(std::cout);
+        if(!path_shadowed)
+        {
+            show_dirs_in_path(std::cout);
+            return  EXIT_SUCCESS;
+        }
+        for(auto const& paths: PathCache::instance().shadowed())
+        {
+            std::cout << paths.front() << "\n";
+            for(std::size_t i = 1; i < paths.size(); i++) {
+                std::cout << "\tshadows " << paths[i] << "\n";
+            }
+        }
         return  EXIT_SUCCESS;
     }
 
+    // Command: which shows the executables found through the $PATH cache
+    if(*cmd_which)
+    {
+        auto& cache = PathCache::instance();
+        if(which_rebuild) { cache.rebuild(true); }
+        bool found_all = true;
+        for(auto const& name: which_names)
+        {
+            auto paths = which_all ? cache.lookup_all(name) : std::vector<std::string>{ cache.lookup(name) };
+            if(paths.empty() || paths.front().empty())
+            {
+                std::cerr << " [ERROR] " << name << " not found\n";
+                found_all = false;
+                continue;
+            }
+            for(auto const& p: paths) { std::cout << p << "\n"; }
+        }
+        return found_all ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     if(*cmd_relaunch)
     {
         try {
-            relaunch_app_pid(pid_to_relaunch);
+            relaunch_app_pid(pid_to_relaunch, !relaunch_no_handoff
+                             , parse_duration(relaunch_startup_check)
+                             , parse_duration(relaunch_stop_timeout));
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_supervise)
+    {
+        try {
+            std::vector<ServiceSpec> specs;
+            if(!services_file.empty()) { specs = read_service_file(services_file); }
+            for(auto const& line: service_lines) { specs.push_back(parse_service_spec(line)); }
+            if(specs.empty()) {
+                throw std::runtime_error("Error: no service given");
+            }
+            Supervisor(std::move(specs), control_socket, parse_duration(stop_timeout)).run();
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_batch)
+    {
+        try {
+            auto jobs = read_batch_file(batch_file);
+            return run_batch(jobs, batch_jobs, batch_quiet) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(*cmd_top)
+    {
+        try {
+            if(!top_replay.empty()) {
+                replay_stats(top_replay, std::cout);
+                return EXIT_SUCCESS;
+            }
+            if(top_pids.empty()) {
+                throw std::runtime_error("Error: no process given");
+            }
+            auto interval = parse_duration(top_interval);
+            if(interval.count() == 0) {
+                throw std::runtime_error("Error: invalid interval: " + top_interval);
+            }
+            run_top(top_pids, top_tree, interval, top_count, top_output, top_quiet);
         } catch(std::runtime_error& ex)
         {
             std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
         }
         return EXIT_SUCCESS;
     }
 
+    if(*cmd_ctl)
+    {
+        try {
+            return supervisor_control(control_socket, ctl_command) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     return EXIT_SUCCESS;
 } // * ------ End of main() Function -------------- * //
 
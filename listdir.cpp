@@ -6,7 +6,12 @@
 
 #include <CLI/CLI.hpp>
 
+#include "stats.hpp"
+#include "selector.hpp"
+
 namespace fs = std::filesystem;
+namespace stats = clibox::stats;
+namespace selector = clibox::selector;
 
 
 class DirectoryNavigator
@@ -17,6 +22,7 @@ class DirectoryNavigator
     bool m_recursive      = false;
     bool m_lastmodified   = false;
     bool m_permission     = false;
+    selector::FileSelector m_selector;
 public:
     DirectoryNavigator(){}
     void directory_only(bool flag) {  m_directory_only = flag;  }
@@ -25,6 +31,7 @@ public:
     void recursive(bool flag)      {  m_recursive = flag;       }
     void lastmodified(bool flag)   {  m_lastmodified = flag;    }
     void permission(bool flag)     {  m_permission = flag; }
+    void selection(selector::FileSelector files) {  m_selector = std::move(files); }
 
     void listdir(std::string path)
     {
@@ -54,7 +61,15 @@ public:
         if(!self.m_directory_only && !self.m_file_only)
             predicate = [](fs::path const& ) -> bool { return true;  };
 
+        // --glob, --exclude and --extension, on the names as listed.
+        if(!self.m_selector.empty())
+            predicate = [this, path, type = predicate](fs::path const& p)
+            {
+                return type(p) && m_selector.selects_entry(p.native(), path);
+            };
+
         action = [this](fs::path const& p){
+            stats::ScopedPhase output(stats::phase::output);
             if(m_permission)
             {
                 auto pm = fs::status(p).permissions();
@@ -89,6 +104,7 @@ public:
                 std::cout << p.string() << std::endl;
         };
 
+        stats::ScopedPhase walk(stats::phase::walk);
         if(!m_recursive)
             self.iterate_dirlist(path, predicate, action);
         else
@@ -98,10 +114,19 @@ public:
 
 private:
 
+    static void count_entry(fs::directory_entry const& entry)
+    {
+        if(!stats::enabled()) { return; }
+        std::error_code ec;
+        stats::add(entry.is_directory(ec) ? stats::counter::directories : stats::counter::files);
+    }
+
     template<typename Predicate, typename Action>
     void iterate_dirlist(std::string path, Predicate&& pred, Action&& act)
     {
         for(auto& p: fs::directory_iterator(path))
+        {
+            count_entry(p);
             if(pred(p)) {
                 try { act(p); }
                 catch(fs::filesystem_error& ex)
@@ -109,12 +134,23 @@ private:
                     std::cerr << ex.what() << "\n";
                 }
             }
+        }
     }
 
+    /// Directories excluded by the selection are not descended into.
     template<typename Predicate, typename Action>
     void iterate_recursive_dirlist(std::string path, Predicate&& pred, Action&& act)
     {
-        for(auto& p: fs::recursive_directory_iterator(path))
+        std::error_code ec;
+        for(auto it = fs::recursive_directory_iterator(path); it != fs::recursive_directory_iterator(); ++it)
+        {
+            auto const& p = *it;
+            count_entry(p);
+            if(p.is_directory(ec) && m_selector.prunes_entry(p.path().native(), path))
+            {
+                it.disable_recursion_pending();
+                continue;
+            }
             if(pred(p)) {
                 try { act(p); }
                 catch(fs::filesystem_error& ex)
@@ -122,6 +158,7 @@ private:
                     std::cerr << ex.what() << "\n";
                 }
             }
+        }
     }
 
 
@@ -157,6 +194,12 @@ int main(int argc, char** argv)
     int recursive = 0;
     app.add_flag("-r,--recursive", recursive, "List directory in a recursive way.");
 
+    selector::Options select_options;
+    selector::add_options(&app, select_options);
+
+    stats::Options stats_options;
+    stats::add_options(&app, stats_options);
+
     // ----- Parse Arguments ---------//
     try {
         app.validate_positionals();
@@ -168,6 +211,9 @@ int main(int argc, char** argv)
 
     //------ Program Actions ---------//
 
+    // Statistics are reported when main() returns.
+    stats::Session stats_session(stats_options);
+
     DirectoryNavigator dnav;
     dnav.directory_only(flag_list_dir);
     dnav.file_only(flag_list_file);
@@ -177,10 +223,14 @@ int main(int argc, char** argv)
     dnav.permission(permission);
 
     try {
+        dnav.selection(selector::FileSelector(select_options));
         dnav.listdir(dirpath);
     } catch (fs::filesystem_error& ex) {
         std::cerr << " [ERROR] " << ex.what() << std::endl;
         return EXIT_FAILURE;
+    } catch (std::runtime_error& ex) {
+        std::cerr << " [ERROR] " << ex.what() << std::endl;
+        return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
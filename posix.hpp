@@ -0,0 +1,66 @@
+// POSIX helpers shared by the clibox tools: sizes given on the command line
+// and the UNIX domain sockets of the long-running commands (the supervisor
+// of launch, the search server of text-search).
+#ifndef CLIBOX_POSIX_HPP
+#define CLIBOX_POSIX_HPP
+
+#include <string>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace clibox::posix
+{
+
+/// Parse a size such as 4096, 512K, 100M or 2G (powers of 1024).
+inline std::size_t parse_size(std::string const& text)
+{
+    using namespace std::string_literals;
+    std::size_t pos = 0;
+    unsigned long long value = 0;
+    try { value = std::stoull(text, &pos); } catch(std::exception const&) { pos = 0; }
+    auto unit = text.substr(pos);
+    if(pos == 0 || unit.size() > 1) {
+        throw std::runtime_error("Error: invalid size: "s + text);
+    }
+    switch(unit.empty() ? ' ' : std::toupper(static_cast<unsigned char>(unit[0])))
+    {
+    case ' ': return value;
+    case 'K': return value << 10;
+    case 'M': return value << 20;
+    case 'G': return value << 30;
+    }
+    throw std::runtime_error("Error: invalid size: "s + text);
+}
+
+/// Default path of the socket of a program: $XDG_RUNTIME_DIR/NAME.sock,
+/// or /tmp/NAME-UID.sock without a runtime directory.
+inline std::string runtime_socket(std::string const& name)
+{
+    const char* dir = ::getenv("XDG_RUNTIME_DIR");
+    if(dir != nullptr && *dir != '\0') {
+        return std::string(dir) + "/" + name + ".sock";
+    }
+    return "/tmp/" + name + "-" + std::to_string(::getuid()) + ".sock";
+}
+
+inline auto make_unix_address(std::string const& path) -> sockaddr_un
+{
+    using namespace std::string_literals;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Error: socket path too long: "s + path);
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+    return addr;
+}
+
+} // namespace clibox::posix
+
+#endif // CLIBOX_POSIX_HPP
@@ -9,7 +9,12 @@
 //---- Library Headers -----------------//
 #include <CLI/CLI.hpp>
 
+#include "stats.hpp"
+#include "selector.hpp"
+
 namespace fs = std::filesystem;
+namespace stats = clibox::stats;
+namespace selector = clibox::selector;
 
 template<typename Predicate, typename Action>
 void iterate_dirlist(std::string path, Predicate&& pred, Action&& act)
@@ -24,10 +29,19 @@ void iterate_dirlist(std::string path, Predicate&& pred, Action&& act)
         }
 }
 
-template<typename Predicate, typename Action>
-void iterate_recursive_dirlist(std::string path, Predicate&& pred, Action&& act)
+/// Directories for which prune returns true are not descended into.
+template<typename Predicate, typename Action, typename Prune>
+void iterate_recursive_dirlist(std::string path, Predicate&& pred, Action&& act, Prune&& prune)
 {
-    for(auto& p: fs::recursive_directory_iterator(path))
+    std::error_code ec;
+    for(auto it = fs::recursive_directory_iterator(path); it != fs::recursive_directory_iterator(); ++it)
+    {
+        auto const& p = *it;
+        if(p.is_directory(ec) && prune(p))
+        {
+            it.disable_recursion_pending();
+            continue;
+        }
         if(pred(p)) {
             try { act(p); }
             catch(fs::filesystem_error& ex)
@@ -35,6 +49,7 @@ void iterate_recursive_dirlist(std::string path, Predicate&& pred, Action&& act)
                 std::cerr << ex.what() << "\n";
             }
         }
+    }
 }
 
 std::string
@@ -67,15 +82,23 @@ repladce_string_list(
     return str;
 }
 
-void rename_files_fix(std::string path, bool commit, bool silent, bool recursive)
+void rename_files_fix(std::string path, bool commit, bool silent, bool recursive
+                      , selector::FileSelector const& files = {})
 {
-    auto predicate = [](fs::path const& p)
+    auto predicate = [&](fs::directory_entry const& p)
+    {
+        std::error_code ec;
+        return p.is_regular_file(ec) && files.selects_entry(p.path().native(), path);
+    };
+    auto prune = [&](fs::directory_entry const& p)
     {
-        return fs::is_regular_file(p);
+        return files.prunes_entry(p.path().native(), path);
     };
 
     auto action = [=](fs::path const& p)
     {
+        stats::add(stats::counter::files);
+        stats::ScopedPhase match(stats::phase::match);
         auto txt = repladce_string_list( p.filename().string()
                                             , {   {" ",   "_"}
                                          , {",",   "-"}
@@ -93,7 +116,9 @@ void rename_files_fix(std::string path, bool commit, bool silent, bool recursive
                                         });
 
         auto path2 = p.parent_path() / txt;
+        if(txt != p.filename().string()) { stats::add(stats::counter::matches); }
 
+        stats::ScopedPhase output(stats::phase::output);
         if(!silent){
             std::cout << p.filename().string()
                       << " =>> " << path2.filename().string() << "\n\n";
@@ -104,13 +129,16 @@ void rename_files_fix(std::string path, bool commit, bool silent, bool recursive
         fs::rename(p, path2);
     };
 
+    stats::ScopedPhase walk(stats::phase::walk);
     if(!recursive)
         iterate_dirlist(path, predicate, action);
     else
-        iterate_recursive_dirlist(path, predicate, action);
+        iterate_recursive_dirlist(path, predicate, action, prune);
 
 }
 
+// Benchmarks include this file for its functions (see bench/).
+#ifndef CLIBOX_NO_MAIN
 int main(int argc, char** argv)
 {
     CLI::App app("rename files and fix file names");
@@ -131,6 +159,12 @@ int main(int argc, char** argv)
     app.add_flag("--silent", flag_silent,
                  "Suppress log messages.");
 
+    selector::Options select_options;
+    selector::add_options(&app, select_options);
+
+    stats::Options stats_options;
+    stats::add_options(&app, stats_options);
+
     // ----------- Parse Arguments ---------------//
 
     // app.require_subcommand();
@@ -150,7 +184,18 @@ int main(int argc, char** argv)
 
     // ---- Program Actions ------------------//
 
-    rename_files_fix(path, flag_commit, flag_silent, flag_recursive);
+    // Statistics are reported when main() returns.
+    stats::Session stats_session(stats_options);
+
+    try {
+        rename_files_fix(path, flag_commit, flag_silent, flag_recursive
+                         , selector::FileSelector(select_options));
+    } catch(std::runtime_error& ex)
+    {
+        std::cerr << " [ERROR] " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 
     return 0;
 }
+#endif // CLIBOX_NO_MAIN
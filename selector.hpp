@@ -0,0 +1,466 @@
+// File selection shared by the clibox tools (--glob, --exclude, --extension).
+//
+// The rules are compiled once into a FileSelector, then matched against the
+// name of a directory entry (its d_name bytes) and its path relative to the
+// root of the walk, both as string_views into the entry: no allocation per
+// file.
+//
+//   - Suffixes ("-e .cpp", or a glob such as "*.cpp") are hash lookups of the
+//     last bytes of the name, one lookup per distinct suffix length.
+//   - Globs without metacharacters are hash lookups of the whole name.
+//   - The other globs are merged into one automaton (a bit-parallel NFA, one
+//     bit per glob position) run once over the name; the globs with a '/'
+//     go into a second automaton run over the relative path.
+//
+// A file is selected if it matches an include rule (or if there is none)
+// and no exclude rule ("!GLOB" or --exclude). Directories matching an
+// exclude rule are not descended into.
+//
+// Glob syntax: '*' (any characters but '/'), '?', '[abc]', '[a-z]', '[!a-z]',
+// '**' (any characters, '/' included; "a/**/b" also matches "a/b"), and '\'
+// to escape a metacharacter. A leading '/' anchors the glob at the root.
+#ifndef CLIBOX_SELECTOR_HPP
+#define CLIBOX_SELECTOR_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <bitset>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+
+namespace clibox::selector
+{
+
+/// Set of strings, looked up by string_view without allocating.
+class StringSet
+{
+    std::vector<std::string>   m_keys;
+    std::vector<std::uint32_t> m_slots;   // Index in m_keys + 1 (0: free), power of 2 size
+
+    static std::size_t hash(std::string_view s) { return std::hash<std::string_view>{}(s); }
+
+    std::size_t find_slot(std::string_view s) const
+    {
+        std::size_t mask = m_slots.size() - 1;
+        for(std::size_t i = hash(s) & mask; ; i = (i + 1) & mask)
+        {
+            if(m_slots[i] == 0 || m_keys[m_slots[i] - 1] == s) { return i; }
+        }
+    }
+
+public:
+
+    bool empty() const { return m_keys.empty(); }
+
+    bool contains(std::string_view s) const
+    {
+        return !m_slots.empty() && m_slots[find_slot(s)] != 0;
+    }
+
+    void insert(std::string_view s)
+    {
+        if(this->contains(s)) { return; }
+        m_keys.emplace_back(s);
+        // At most half full.
+        if(m_slots.size() < 2 * m_keys.size())
+        {
+            std::size_t size = 16;
+            while(size < 4 * m_keys.size()) { size *= 2; }
+            m_slots.assign(size, 0);
+            for(std::size_t k = 0; k < m_keys.size(); k++) {
+                m_slots[this->find_slot(m_keys[k])] = static_cast<std::uint32_t>(k + 1);
+            }
+            return;
+        }
+        m_slots[this->find_slot(s)] = static_cast<std::uint32_t>(m_keys.size());
+    }
+};
+
+/// Suffixes of names, a set per suffix length.
+class SuffixSet
+{
+    std::vector<std::pair<std::size_t, StringSet>> m_by_length;
+
+public:
+
+    bool empty() const { return m_by_length.empty(); }
+
+    void insert(std::string_view suffix)
+    {
+        for(auto& [length, set]: m_by_length)
+        {
+            if(length == suffix.size()) {
+                set.insert(suffix);
+                return;
+            }
+        }
+        m_by_length.emplace_back(suffix.size(), StringSet{});
+        m_by_length.back().second.insert(suffix);
+    }
+
+    bool matches(std::string_view name) const
+    {
+        for(auto const& [length, set]: m_by_length)
+        {
+            if(length <= name.size() && set.contains(name.substr(name.size() - length))) { return true; }
+        }
+        return false;
+    }
+};
+
+/** @brief Globs merged into a single automaton.
+ *
+ *  Every glob is a sequence of tokens; bit 'start + k' of the state means
+ *  "the first k tokens of the glob are matched". A byte advances all the
+ *  globs at once: state = ((state << 1) & consume[byte]) | (state & loop[byte]),
+ *  where consume has the bits of the tokens accepting the byte and loop
+ *  the bits of the stars, which can then match more bytes. Stars also
+ *  match the empty string, which is the closure of the state over them.
+ *  The start bit of a glob is never in consume, so nothing is shifted
+ *  from a glob into the next one. Texts whose last byte cannot end any
+ *  glob (a name "x.cpp" for globs "*_[0-9].o") are rejected first.
+ */
+class GlobSet
+{
+    using Bytes = std::bitset<256>;
+
+    struct Token
+    {
+        Bytes bytes;         // Bytes consumed by the token
+        bool  star = false;  // Repeated zero or more times
+    };
+
+    std::vector<std::vector<Token>> m_globs;
+    std::size_t                     m_words     = 0;
+    std::size_t                     m_star_run  = 0;   // Longest run of stars
+    std::vector<std::uint64_t>      m_start;
+    std::vector<std::uint64_t>      m_accept;
+    std::vector<std::uint64_t>      m_stars;
+    std::vector<std::uint64_t>      m_consume;         // 256 rows of m_words
+    std::vector<std::uint64_t>      m_loop;            // 256 rows of m_words
+    // Prefilter: last bytes of the texts which can match (if no glob ends with a star).
+    Bytes                           m_last;
+    bool                            m_any_last  = false;
+
+    static Bytes all_but_slash()
+    {
+        Bytes b;
+        b.set();
+        b.reset('/');
+        return b;
+    }
+
+    /// Tokens of a glob; throws std::runtime_error if it is malformed.
+    static std::vector<Token> parse(std::string_view glob)
+    {
+        std::vector<Token> tokens;
+        for(std::size_t i = 0; i < glob.size(); )
+        {
+            Token t;
+            char c = glob[i];
+            if(c == '*')
+            {
+                bool globstar = i + 1 < glob.size() && glob[i + 1] == '*';
+                t.star  = true;
+                t.bytes = globstar ? Bytes{}.set() : all_but_slash();
+                i += globstar ? 2 : 1;
+                // A star following a star adds nothing.
+                if(!tokens.empty() && tokens.back().star)
+                {
+                    tokens.back().bytes |= t.bytes;
+                    continue;
+                }
+            }
+            else if(c == '?')
+            {
+                t.bytes = all_but_slash();
+                i++;
+            }
+            else if(c == '[')
+            {
+                std::size_t j = i + 1;
+                bool negate = j < glob.size() && (glob[j] == '!' || glob[j] == '^');
+                if(negate) { j++; }
+                // A ']' first is a member of the class.
+                for(bool first = true; j < glob.size() && (first || glob[j] != ']'); first = false)
+                {
+                    auto lo = static_cast<unsigned char>(glob[j]);
+                    if(j + 2 < glob.size() && glob[j + 1] == '-' && glob[j + 2] != ']')
+                    {
+                        auto hi = static_cast<unsigned char>(glob[j + 2]);
+                        for(unsigned b = lo; b <= hi; b++) { t.bytes.set(b); }
+                        j += 3;
+                        continue;
+                    }
+                    t.bytes.set(lo);
+                    j++;
+                }
+                if(j >= glob.size()) {
+                    throw std::runtime_error("Error: unterminated '[' in glob: " + std::string(glob));
+                }
+                if(negate) { t.bytes.flip(); }
+                t.bytes.reset('/');
+                i = j + 1;
+            }
+            else
+            {
+                if(c == '\\' && i + 1 < glob.size()) { c = glob[++i]; }
+                t.bytes.set(static_cast<unsigned char>(c));
+                i++;
+            }
+            tokens.push_back(t);
+        }
+        return tokens;
+    }
+
+    void set_bit(std::vector<std::uint64_t>& v, std::size_t row, std::size_t bit) const
+    {
+        v[row * m_words + bit / 64] |= std::uint64_t{1} << (bit % 64);
+    }
+
+    void build()
+    {
+        std::size_t bits = 0;
+        for(auto const& g: m_globs) { bits += g.size() + 1; }
+        m_words = (bits + 63) / 64;
+        m_start.assign(m_words, 0);
+        m_accept.assign(m_words, 0);
+        m_stars.assign(m_words, 0);
+        m_consume.assign(256 * m_words, 0);
+        m_loop.assign(256 * m_words, 0);
+        m_star_run = 0;
+        m_last.reset();
+        m_any_last = false;
+
+        std::size_t start = 0;
+        for(auto const& g: m_globs)
+        {
+            set_bit(m_start, 0, start);
+            set_bit(m_accept, 0, start + g.size());
+            if(g.empty() || g.back().star) { m_any_last = true; }
+            else                           { m_last |= g.back().bytes; }
+            std::size_t run = 0;
+            for(std::size_t k = 0; k < g.size(); k++)
+            {
+                auto bit = start + k + 1;
+                run = g[k].star ? run + 1 : 0;
+                m_star_run = std::max(m_star_run, run);
+                if(g[k].star) { set_bit(m_stars, 0, bit); }
+                for(std::size_t b = 0; b < 256; b++)
+                {
+                    if(!g[k].bytes.test(b)) { continue; }
+                    set_bit(m_consume, b, bit);
+                    if(g[k].star) { set_bit(m_loop, b, bit); }
+                }
+            }
+            start += g.size() + 1;
+        }
+    }
+
+    /// Epsilon moves: a star can match nothing.
+    void closure(std::uint64_t* state) const
+    {
+        for(std::size_t r = 0; r < m_star_run; r++)
+        {
+            std::uint64_t carry = 0;
+            for(std::size_t w = 0; w < m_words; w++)
+            {
+                std::uint64_t shifted = (state[w] << 1) | carry;
+                carry = state[w] >> 63;
+                state[w] |= shifted & m_stars[w];
+            }
+        }
+    }
+
+public:
+
+    bool empty() const { return m_globs.empty(); }
+
+    /// Add a glob; "a/**/b" and "**/b" are added with their variants without "**/".
+    void insert(std::string_view glob)
+    {
+        for(std::size_t pos = 0; (pos = glob.find("**/", pos)) != std::string_view::npos; pos++)
+        {
+            if(pos == 0 || glob[pos - 1] == '/') {
+                this->insert(std::string(glob.substr(0, pos)) + std::string(glob.substr(pos + 3)));
+            }
+        }
+        m_globs.push_back(GlobSet::parse(glob));
+        this->build();
+    }
+
+    bool matches(std::string_view text) const
+    {
+        if(m_globs.empty()) { return false; }
+        if(!m_any_last && (text.empty() || !m_last.test(static_cast<unsigned char>(text.back())))) { return false; }
+        thread_local std::vector<std::uint64_t> buffer;
+        buffer.assign(m_start.begin(), m_start.end());
+        std::uint64_t* state = buffer.data();
+        this->closure(state);
+        for(char ch: text)
+        {
+            auto b = static_cast<unsigned char>(ch);
+            const std::uint64_t* consume = &m_consume[b * m_words];
+            const std::uint64_t* loop    = &m_loop[b * m_words];
+            std::uint64_t carry = 0;
+            std::uint64_t alive = 0;
+            for(std::size_t w = 0; w < m_words; w++)
+            {
+                std::uint64_t shifted = (state[w] << 1) | carry;
+                carry = state[w] >> 63;
+                state[w] = (shifted & consume[w]) | (state[w] & loop[w]);
+                alive |= state[w];
+            }
+            if(alive == 0) { return false; }
+            this->closure(state);
+        }
+        for(std::size_t w = 0; w < m_words; w++) {
+            if(state[w] & m_accept[w]) { return true; }
+        }
+        return false;
+    }
+};
+
+/// Command line options of the selection (see add_options()).
+struct Options
+{
+    std::vector<std::string> globs;       // -g,--glob GLOB ('!GLOB' excludes)
+    std::vector<std::string> excludes;    // --exclude GLOB
+    std::vector<std::string> extensions;  // -e,--extension SUFFIX
+};
+
+template<typename App>
+void add_options(App* app, Options& options)
+{
+    app->add_option("-g,--glob", options.globs
+                    , "Only select files matching GLOB; '!GLOB' excludes them (and directories)");
+    app->add_option("--exclude", options.excludes, "Exclude files and directories matching GLOB");
+    app->add_option("-e,--extension", options.extensions, "Only select files with this extension (suffix)");
+}
+
+class FileSelector
+{
+    struct Rules
+    {
+        StringSet names;
+        SuffixSet suffixes;
+        GlobSet   name_globs;
+        GlobSet   path_globs;
+
+        bool empty() const
+        {
+            return names.empty() && suffixes.empty() && name_globs.empty() && path_globs.empty();
+        }
+
+        bool matches(std::string_view name, std::string_view path) const
+        {
+            return names.contains(name) || suffixes.matches(name)
+                || name_globs.matches(name) || path_globs.matches(path);
+        }
+
+        void insert(std::string_view glob)
+        {
+            if(glob.find('/') != std::string_view::npos)
+            {
+                if(glob.front() == '/') { glob.remove_prefix(1); }
+                path_globs.insert(glob);
+                return;
+            }
+            auto meta = glob.find_first_of("*?[\\");
+            if(meta == std::string_view::npos) {
+                names.insert(glob);
+            } else if(glob.front() == '*' && glob.size() > 1 && glob.find_first_of("*?[\\", 1) == std::string_view::npos) {
+                suffixes.insert(glob.substr(1));
+            } else {
+                name_globs.insert(glob);
+            }
+        }
+    };
+
+    Rules m_include;
+    Rules m_exclude;
+
+public:
+
+    FileSelector() = default;
+
+    /// Throws std::runtime_error if a glob is malformed.
+    explicit FileSelector(Options const& options)
+    {
+        for(auto const& g: options.globs)      { this->add_glob(g); }
+        for(auto const& g: options.excludes)   { this->add_glob(g, true); }
+        for(auto const& e: options.extensions) { this->add_extension(e); }
+    }
+
+    /// Glob rule; a leading '!' (or exclude) makes it an exclusion.
+    void add_glob(std::string_view glob, bool exclude = false)
+    {
+        if(!glob.empty() && glob.front() == '!')
+        {
+            glob.remove_prefix(1);
+            exclude = !exclude;
+        }
+        if(glob.empty() || glob == "/") {
+            throw std::runtime_error("Error: empty glob");
+        }
+        (exclude ? m_exclude : m_include).insert(glob);
+    }
+
+    /// Name suffix, such as ".cpp" (also matches "a.tar.gz" with ".tar.gz").
+    void add_extension(std::string_view suffix, bool exclude = false)
+    {
+        if(suffix.empty()) { return; }
+        (exclude ? m_exclude : m_include).suffixes.insert(suffix);
+    }
+
+    /// True if no rule is set (every file is selected).
+    bool empty() const { return m_include.empty() && m_exclude.empty(); }
+
+    /// name: the d_name of the entry; path: relative to the root of the walk.
+    bool selects(std::string_view name, std::string_view path) const
+    {
+        return (m_include.empty() || m_include.matches(name, path)) && !m_exclude.matches(name, path);
+    }
+
+    /// True if a directory is excluded: it is not descended into.
+    bool prunes(std::string_view name, std::string_view path) const
+    {
+        return !m_exclude.empty() && m_exclude.matches(name, path);
+    }
+
+    /// Name and path relative to root of an entry of a walk of root, as
+    /// views into the path of the entry.
+    static std::pair<std::string_view, std::string_view>
+    split(std::string_view entry, std::string_view root)
+    {
+        auto slash = entry.rfind('/');
+        auto name  = slash == std::string_view::npos ? entry : entry.substr(slash + 1);
+        if(entry.compare(0, root.size(), root) == 0) { entry.remove_prefix(root.size()); }
+        while(!entry.empty() && entry.front() == '/') { entry.remove_prefix(1); }
+        return {name, entry};
+    }
+
+    /// selects() for the path of an entry of a walk of root.
+    bool selects_entry(std::string_view entry, std::string_view root) const
+    {
+        if(this->empty()) { return true; }
+        auto [name, path] = FileSelector::split(entry, root);
+        return this->selects(name, path);
+    }
+
+    /// prunes() for the path of a directory of a walk of root.
+    bool prunes_entry(std::string_view entry, std::string_view root) const
+    {
+        if(m_exclude.empty()) { return false; }
+        auto [name, path] = FileSelector::split(entry, root);
+        return this->prunes(name, path);
+    }
+};
+
+} // namespace clibox::selector
+
+#endif // CLIBOX_SELECTOR_HPP
@@ -0,0 +1,437 @@
+// Instrumentation shared by the clibox tools (--stats and --stats-json).
+//
+// Counters and phase timers are process-wide. When statistics are not
+// requested, add() and ScopedPhase cost one predictable branch on a plain
+// bool; when enabled, counters are relaxed atomics on separate cache lines.
+// Defining CLIBOX_NO_STATS removes the instrumentation at compile time.
+//
+// Phase times are exclusive: a phase started inside another one pauses
+// it, so that the time spent writing output inside a search is only
+// accounted as output. Times of several threads are summed.
+//
+// Hardware counters (cycles, instructions, cache misses), page faults,
+// context switches and the kernel count of system calls are read with
+// perf_event_open(2) when the kernel and perf_event_paranoid allow it;
+// otherwise they are reported as not available.
+#ifndef CLIBOX_STATS_HPP
+#define CLIBOX_STATS_HPP
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace clibox::stats
+{
+
+enum class counter : unsigned
+{
+      files
+    , directories
+    , bytes_read
+    , bytes_written
+    , syscalls        // System calls issued directly by the tool
+    , matches
+    , processes
+    , count_
+};
+
+enum class phase : unsigned
+{
+      setup
+    , walk            // Directory traversal
+    , read
+    , match
+    , output
+    , spawn
+    , wait
+    , count_
+};
+
+inline const char* name(counter c)
+{
+    static const char* names[] = {
+        "files", "directories", "bytes_read", "bytes_written", "syscalls", "matches", "processes"
+    };
+    return names[static_cast<unsigned>(c)];
+}
+
+inline const char* name(phase p)
+{
+    static const char* names[] = { "setup", "walk", "read", "match", "output", "spawn", "wait" };
+    return names[static_cast<unsigned>(p)];
+}
+
+/// Command line settings, bound to the options of each tool.
+struct Options
+{
+    bool        text = false;   // --stats: summary on stderr
+    std::string json;           // --stats-json FILE ('-' => stderr)
+
+    bool requested() const { return text || !json.empty(); }
+};
+
+/// Add the --stats and --stats-json options to a CLI11 application or subcommand.
+template<typename App>
+void add_options(App* app, Options& options)
+{
+    app->add_flag("--stats", options.text, "Print counters, phase times and hardware counters on stderr");
+    app->add_option("--stats-json", options.json, "Write the statistics as JSON to a file ('-' for stderr)");
+}
+
+namespace detail
+{
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    inline bool g_enabled = false;
+    inline std::array<Slot, static_cast<std::size_t>(counter::count_)> g_counters;
+    inline std::array<Slot, static_cast<std::size_t>(phase::count_)>   g_phases;
+
+    inline std::uint64_t now_ns()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+inline bool enabled()
+{
+#ifdef CLIBOX_NO_STATS
+    return false;
+#else
+    return detail::g_enabled;
+#endif
+}
+
+inline void add(counter c, std::uint64_t n = 1)
+{
+#ifndef CLIBOX_NO_STATS
+    if(detail::g_enabled) {
+        detail::g_counters[static_cast<unsigned>(c)].value.fetch_add(n, std::memory_order_relaxed);
+    }
+#else
+    (void) c; (void) n;
+#endif
+}
+
+inline std::uint64_t get(counter c)
+{
+    return detail::g_counters[static_cast<unsigned>(c)].value.load(std::memory_order_relaxed);
+}
+
+/// Time spent in a phase until the end of the scope (exclusive of nested phases).
+class ScopedPhase
+{
+#ifndef CLIBOX_NO_STATS
+    static ScopedPhase*& current()
+    {
+        static thread_local ScopedPhase* top = nullptr;
+        return top;
+    }
+
+    phase         m_phase;
+    std::uint64_t m_start  = 0;
+    ScopedPhase*  m_parent = nullptr;
+    bool          m_active = false;
+
+    void account(std::uint64_t now)
+    {
+        detail::g_phases[static_cast<unsigned>(m_phase)].value.fetch_add(now - m_start, std::memory_order_relaxed);
+        m_start = now;
+    }
+#endif
+
+public:
+
+    explicit ScopedPhase(phase p)
+#ifndef CLIBOX_NO_STATS
+        : m_phase(p), m_active(detail::g_enabled)
+    {
+        if(!m_active) { return; }
+        m_start  = detail::now_ns();
+        m_parent = current();
+        if(m_parent != nullptr) { m_parent->account(m_start); }
+        // The destructor pops the entry: it never outlives the scope.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+        current() = this;
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+  #pragma GCC diagnostic pop
+#endif
+    }
+#else
+    { (void) p; }
+#endif
+
+    ~ScopedPhase()
+    {
+#ifndef CLIBOX_NO_STATS
+        if(!m_active) { return; }
+        auto now = detail::now_ns();
+        this->account(now);
+        if(m_parent != nullptr) { m_parent->m_start = now; }
+        current() = m_parent;
+#endif
+    }
+
+    ScopedPhase(ScopedPhase const&) = delete;
+    ScopedPhase& operator=(ScopedPhase const&) = delete;
+};
+
+/// Counters of perf_event_open(2) for this process and the threads it creates.
+class PerfCounters
+{
+public:
+    enum event : unsigned { cycles, instructions, cache_references, cache_misses
+                          , page_faults, context_switches, kernel_syscalls, count_ };
+
+private:
+    std::array<int, count_> m_fds;
+    std::string             m_error;
+
+    static const char* event_name(unsigned e)
+    {
+        static const char* names[] = { "cycles", "instructions", "cache_references", "cache_misses"
+                                     , "page_faults", "context_switches", "kernel_syscalls" };
+        return names[e];
+    }
+
+    /// Id of the raw_syscalls:sys_enter tracepoint, 0 if tracefs is not readable.
+    static std::uint64_t syscall_tracepoint()
+    {
+        for(const char* dir: {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"})
+        {
+            std::ifstream ifs(std::string(dir) + "/events/raw_syscalls/sys_enter/id");
+            std::uint64_t id = 0;
+            if(ifs >> id) { return id; }
+        }
+        return 0;
+    }
+
+    int open_event(std::uint32_t type, std::uint64_t config, bool user_only)
+    {
+        perf_event_attr attr{};
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.inherit        = 1;
+        attr.exclude_kernel = user_only ? 1 : 0;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        if(fd < 0 && m_error.empty()) { m_error = std::strerror(errno); }
+        return fd;
+    }
+
+public:
+
+    PerfCounters()
+    {
+        m_fds.fill(-1);
+        m_fds[cycles]           = this->open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true);
+        m_fds[instructions]     = this->open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, true);
+        m_fds[cache_references] = this->open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, true);
+        m_fds[cache_misses]     = this->open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, true);
+        m_fds[page_faults]      = this->open_event(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, false);
+        m_fds[context_switches] = this->open_event(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, false);
+        if(auto id = PerfCounters::syscall_tracepoint(); id != 0) {
+            m_fds[kernel_syscalls] = this->open_event(PERF_TYPE_TRACEPOINT, id, false);
+        }
+        for(int fd: m_fds) {
+            if(fd >= 0) { ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); }
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for(int fd: m_fds) {
+            if(fd >= 0) { ::close(fd); }
+        }
+    }
+
+    PerfCounters(PerfCounters const&) = delete;
+    PerfCounters& operator=(PerfCounters const&) = delete;
+
+    /// Reason of the first counter that could not be opened (empty if none).
+    std::string const& error() const { return m_error; }
+
+    /// Value of an event scaled for multiplexing; -1 if not available.
+    double read(unsigned e) const
+    {
+        std::uint64_t values[3] = {0, 0, 0};
+        if(m_fds[e] < 0 || ::read(m_fds[e], values, sizeof(values)) != sizeof(values)) { return -1; }
+        if(values[2] == 0) { return 0; }
+        return static_cast<double>(values[0]) * static_cast<double>(values[1]) / static_cast<double>(values[2]);
+    }
+
+    static constexpr unsigned size() { return count_; }
+    static const char* name(unsigned e) { return PerfCounters::event_name(e); }
+};
+
+/** @brief Enable the statistics for the lifetime of the session and report
+ *  them when it ends.
+ *
+ *  Create it right after the command line was parsed, before the threads
+ *  of the tool are started.
+ */
+class Session
+{
+    Options       m_options;
+    std::uint64_t m_start = 0;
+    PerfCounters* m_perf  = nullptr;
+
+public:
+
+    explicit Session(Options options)
+        : m_options(std::move(options))
+    {
+        if(!m_options.requested()) { return; }
+        detail::g_enabled = true;
+        m_start = detail::now_ns();
+        m_perf  = new PerfCounters();
+    }
+
+    ~Session()
+    {
+        if(!m_options.requested()) { return; }
+        try { this->report(); } catch(...) { }
+        delete m_perf;
+    }
+
+    Session(Session const&) = delete;
+    Session& operator=(Session const&) = delete;
+
+private:
+
+    static std::string human_bytes(double n)
+    {
+        static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+        int u = 0;
+        while(n >= 1024 && u < 4) { n /= 1024; u++; }
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(u == 0 ? 0 : 2) << n << " " << units[u];
+        return os.str();
+    }
+
+    void report() const
+    {
+        double wall = static_cast<double>(detail::now_ns() - m_start) / 1e9;
+        rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        double user = static_cast<double>(usage.ru_utime.tv_sec) + usage.ru_utime.tv_usec / 1e6;
+        double sys  = static_cast<double>(usage.ru_stime.tv_sec) + usage.ru_stime.tv_usec / 1e6;
+
+        if(m_options.text) { this->report_text(std::cerr, wall, user, sys, usage.ru_maxrss); }
+        if(m_options.json.empty()) { return; }
+        if(m_options.json == "-") {
+            this->report_json(std::cerr, wall, user, sys, usage.ru_maxrss);
+            return;
+        }
+        std::ofstream ofs(m_options.json);
+        if(!ofs) {
+            std::cerr << " [ERROR] Unable to open file: " << m_options.json << "\n";
+            return;
+        }
+        this->report_json(ofs, wall, user, sys, usage.ru_maxrss);
+    }
+
+    void report_text(std::ostream& os, double wall, double user, double sys, long maxrss_kib) const
+    {
+        os << std::fixed << std::setprecision(3)
+           << "\n [STATS] wall " << wall << " s ; user " << user << " s ; sys " << sys
+           << " s ; max rss " << Session::human_bytes(static_cast<double>(maxrss_kib) * 1024) << "\n";
+
+        os << " [STATS]";
+        bool any = false;
+        for(unsigned i = 0; i < static_cast<unsigned>(counter::count_); i++)
+        {
+            auto c = static_cast<counter>(i);
+            auto v = get(c);
+            if(v == 0) { continue; }
+            bool bytes = c == counter::bytes_read || c == counter::bytes_written;
+            os << (any ? " ; " : " ") << name(c) << " "
+               << (bytes ? Session::human_bytes(static_cast<double>(v)) : std::to_string(v));
+            any = true;
+        }
+        os << (any ? "\n" : " no counters\n");
+
+        std::uint64_t total = 0;
+        for(auto const& p: detail::g_phases) { total += p.value.load(std::memory_order_relaxed); }
+        if(total > 0)
+        {
+            os << " [STATS] phases:";
+            for(unsigned i = 0; i < static_cast<unsigned>(phase::count_); i++)
+            {
+                auto ns = detail::g_phases[i].value.load(std::memory_order_relaxed);
+                if(ns == 0) { continue; }
+                os << " " << name(static_cast<phase>(i)) << " " << std::setprecision(3) << ns / 1e9
+                   << " s (" << std::setprecision(1) << 100.0 * static_cast<double>(ns) / static_cast<double>(total) << "%)";
+            }
+            os << "\n";
+        }
+
+        os << " [STATS] perf:";
+        bool available = false;
+        for(unsigned e = 0; e < PerfCounters::size(); e++)
+        {
+            double v = m_perf->read(e);
+            if(v < 0) { continue; }
+            os << " " << PerfCounters::name(e) << " " << std::setprecision(0) << v;
+            available = true;
+        }
+        double cycles = m_perf->read(PerfCounters::cycles);
+        double instructions = m_perf->read(PerfCounters::instructions);
+        if(cycles > 0 && instructions >= 0) {
+            os << " ; IPC " << std::setprecision(2) << instructions / cycles;
+        }
+        if(!m_perf->error().empty()) {
+            os << (available ? " ; " : " ") << "(some counters not available: " << m_perf->error() << ")";
+        }
+        os << "\n";
+    }
+
+    void report_json(std::ostream& os, double wall, double user, double sys, long maxrss_kib) const
+    {
+        os << std::fixed << std::setprecision(6)
+           << "{\n  \"wall_s\": " << wall << ", \"user_s\": " << user << ", \"sys_s\": " << sys
+           << ", \"max_rss_kib\": " << maxrss_kib << ",\n  \"counters\": {";
+        for(unsigned i = 0; i < static_cast<unsigned>(counter::count_); i++) {
+            os << (i ? ", " : " ") << "\"" << name(static_cast<counter>(i)) << "\": " << get(static_cast<counter>(i));
+        }
+        os << " },\n  \"phases_s\": {";
+        for(unsigned i = 0; i < static_cast<unsigned>(phase::count_); i++) {
+            os << (i ? ", " : " ") << "\"" << name(static_cast<phase>(i)) << "\": "
+               << detail::g_phases[i].value.load(std::memory_order_relaxed) / 1e9;
+        }
+        os << " },\n  \"perf\": {";
+        for(unsigned e = 0; e < PerfCounters::size(); e++)
+        {
+            double v = m_perf->read(e);
+            os << (e ? ", " : " ") << "\"" << PerfCounters::name(e) << "\": ";
+            if(v < 0) { os << "null"; } else { os << std::setprecision(0) << v; }
+        }
+        os << " }\n}\n";
+    }
+};
+
+} // namespace clibox::stats
+
+#endif // CLIBOX_STATS_HPP
@@ -4,206 +4,2279 @@
 #include <filesystem>
 #include <bitset>
 #include <cstring> // strtok
+#include <cstdint>
 #include <regex>
 #include <algorithm>
+#include <optional>
+#include <array>
+#include <string_view>
+#include <memory>
+#include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
 
 #include <CLI/CLI.hpp>
 
+//---- Linux/POSIX specific Headers ---//
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#endif
+
+//---- Optional decompression libraries (see CMakeLists.txt) ---//
+#if defined(CLIBOX_HAVE_ZLIB)
+  #include <zlib.h>
+#endif
+#if defined(CLIBOX_HAVE_LZMA)
+  #include <lzma.h>
+#endif
+#if defined(CLIBOX_HAVE_ZSTD)
+  #include <zstd.h>
+#endif
+
+#include "stats.hpp"
+#include "selector.hpp"
+#include "posix.hpp"
+
 namespace fs = std::filesystem;
+namespace stats = clibox::stats;
+namespace selector = clibox::selector;
+namespace posix = clibox::posix;
+
+/// Case folding of UTF-8 text, with a vectorised path for ASCII.
+namespace casefold
+{
+    /// Codepoints first, first + stride, ... up to last fold to codepoint + delta.
+    struct Range
+    {
+        std::uint32_t first;
+        std::uint32_t last;
+        std::int32_t  delta;
+        std::uint32_t stride;
+    };
+
+    /** Simple case folding of the non-ASCII codepoints (CaseFolding.txt,
+     *  status C and S, Unicode 14.0), restricted to the mappings which keep
+     *  the length of the UTF-8 sequence: a folded text has the byte offsets
+     *  of the original one, which the matchers rely on. The few mappings
+     *  left out fold to ASCII (U+017F LONG S, U+212A KELVIN SIGN...) or
+     *  between sequences of 2 and 3 bytes (U+1E9E, U+2126...).
+     */
+    constexpr Range ranges[] = {
+          {0x000B5, 0x000B5,    775, 1}, {0x000C0, 0x000D6,     32, 1}, {0x000D8, 0x000DE,     32, 1}
+        , {0x00100, 0x0012E,      1, 2}, {0x00132, 0x00136,      1, 2}, {0x00139, 0x00147,      1, 2}
+        , {0x0014A, 0x00176,      1, 2}, {0x00178, 0x00178,   -121, 1}, {0x00179, 0x0017D,      1, 2}
+        , {0x00181, 0x00181,    210, 1}, {0x00182, 0x00184,      1, 2}, {0x00186, 0x00186,    206, 1}
+        , {0x00187, 0x00187,      1, 1}, {0x00189, 0x0018A,    205, 1}, {0x0018B, 0x0018B,      1, 1}
+        , {0x0018E, 0x0018E,     79, 1}, {0x0018F, 0x0018F,    202, 1}, {0x00190, 0x00190,    203, 1}
+        , {0x00191, 0x00191,      1, 1}, {0x00193, 0x00193,    205, 1}, {0x00194, 0x00194,    207, 1}
+        , {0x00196, 0x00196,    211, 1}, {0x00197, 0x00197,    209, 1}, {0x00198, 0x00198,      1, 1}
+        , {0x0019C, 0x0019C,    211, 1}, {0x0019D, 0x0019D,    213, 1}, {0x0019F, 0x0019F,    214, 1}
+        , {0x001A0, 0x001A4,      1, 2}, {0x001A6, 0x001A6,    218, 1}, {0x001A7, 0x001A7,      1, 1}
+        , {0x001A9, 0x001A9,    218, 1}, {0x001AC, 0x001AC,      1, 1}, {0x001AE, 0x001AE,    218, 1}
+        , {0x001AF, 0x001AF,      1, 1}, {0x001B1, 0x001B2,    217, 1}, {0x001B3, 0x001B5,      1, 2}
+        , {0x001B7, 0x001B7,    219, 1}, {0x001B8, 0x001B8,      1, 1}, {0x001BC, 0x001BC,      1, 1}
+        , {0x001C4, 0x001C4,      2, 1}, {0x001C5, 0x001C5,      1, 1}, {0x001C7, 0x001C7,      2, 1}
+        , {0x001C8, 0x001C8,      1, 1}, {0x001CA, 0x001CA,      2, 1}, {0x001CB, 0x001DB,      1, 2}
+        , {0x001DE, 0x001EE,      1, 2}, {0x001F1, 0x001F1,      2, 1}, {0x001F2, 0x001F4,      1, 2}
+        , {0x001F6, 0x001F6,    -97, 1}, {0x001F7, 0x001F7,    -56, 1}, {0x001F8, 0x0021E,      1, 2}
+        , {0x00220, 0x00220,   -130, 1}, {0x00222, 0x00232,      1, 2}, {0x0023B, 0x0023B,      1, 1}
+        , {0x0023D, 0x0023D,   -163, 1}, {0x00241, 0x00241,      1, 1}, {0x00243, 0x00243,   -195, 1}
+        , {0x00244, 0x00244,     69, 1}, {0x00245, 0x00245,     71, 1}, {0x00246, 0x0024E,      1, 2}
+        , {0x00345, 0x00345,    116, 1}, {0x00370, 0x00372,      1, 2}, {0x00376, 0x00376,      1, 1}
+        , {0x0037F, 0x0037F,    116, 1}, {0x00386, 0x00386,     38, 1}, {0x00388, 0x0038A,     37, 1}
+        , {0x0038C, 0x0038C,     64, 1}, {0x0038E, 0x0038F,     63, 1}, {0x00391, 0x003A1,     32, 1}
+        , {0x003A3, 0x003AB,     32, 1}, {0x003C2, 0x003C2,      1, 1}, {0x003CF, 0x003CF,      8, 1}
+        , {0x003D0, 0x003D0,    -30, 1}, {0x003D1, 0x003D1,    -25, 1}, {0x003D5, 0x003D5,    -15, 1}
+        , {0x003D6, 0x003D6,    -22, 1}, {0x003D8, 0x003EE,      1, 2}, {0x003F0, 0x003F0,    -54, 1}
+        , {0x003F1, 0x003F1,    -48, 1}, {0x003F4, 0x003F4,    -60, 1}, {0x003F5, 0x003F5,    -64, 1}
+        , {0x003F7, 0x003F7,      1, 1}, {0x003F9, 0x003F9,     -7, 1}, {0x003FA, 0x003FA,      1, 1}
+        , {0x003FD, 0x003FF,   -130, 1}, {0x00400, 0x0040F,     80, 1}, {0x00410, 0x0042F,     32, 1}
+        , {0x00460, 0x00480,      1, 2}, {0x0048A, 0x004BE,      1, 2}, {0x004C0, 0x004C0,     15, 1}
+        , {0x004C1, 0x004CD,      1, 2}, {0x004D0, 0x0052E,      1, 2}, {0x00531, 0x00556,     48, 1}
+        , {0x010A0, 0x010C5,   7264, 1}, {0x010C7, 0x010C7,   7264, 1}, {0x010CD, 0x010CD,   7264, 1}
+        , {0x013F8, 0x013FD,     -8, 1}, {0x01C88, 0x01C88,  35267, 1}, {0x01C90, 0x01CBA,  -3008, 1}
+        , {0x01CBD, 0x01CBF,  -3008, 1}, {0x01E00, 0x01E94,      1, 2}, {0x01E9B, 0x01E9B,    -58, 1}
+        , {0x01EA0, 0x01EFE,      1, 2}, {0x01F08, 0x01F0F,     -8, 1}, {0x01F18, 0x01F1D,     -8, 1}
+        , {0x01F28, 0x01F2F,     -8, 1}, {0x01F38, 0x01F3F,     -8, 1}, {0x01F48, 0x01F4D,     -8, 1}
+        , {0x01F59, 0x01F5F,     -8, 2}, {0x01F68, 0x01F6F,     -8, 1}, {0x01F88, 0x01F8F,     -8, 1}
+        , {0x01F98, 0x01F9F,     -8, 1}, {0x01FA8, 0x01FAF,     -8, 1}, {0x01FB8, 0x01FB9,     -8, 1}
+        , {0x01FBA, 0x01FBB,    -74, 1}, {0x01FBC, 0x01FBC,     -9, 1}, {0x01FC8, 0x01FCB,    -86, 1}
+        , {0x01FCC, 0x01FCC,     -9, 1}, {0x01FD8, 0x01FD9,     -8, 1}, {0x01FDA, 0x01FDB,   -100, 1}
+        , {0x01FE8, 0x01FE9,     -8, 1}, {0x01FEA, 0x01FEB,   -112, 1}, {0x01FEC, 0x01FEC,     -7, 1}
+        , {0x01FF8, 0x01FF9,   -128, 1}, {0x01FFA, 0x01FFB,   -126, 1}, {0x01FFC, 0x01FFC,     -9, 1}
+        , {0x02132, 0x02132,     28, 1}, {0x02160, 0x0216F,     16, 1}, {0x02183, 0x02183,      1, 1}
+        , {0x024B6, 0x024CF,     26, 1}, {0x02C00, 0x02C2F,     48, 1}, {0x02C60, 0x02C60,      1, 1}
+        , {0x02C63, 0x02C63,  -3814, 1}, {0x02C67, 0x02C6B,      1, 2}, {0x02C72, 0x02C72,      1, 1}
+        , {0x02C75, 0x02C75,      1, 1}, {0x02C80, 0x02CE2,      1, 2}, {0x02CEB, 0x02CED,      1, 2}
+        , {0x02CF2, 0x02CF2,      1, 1}, {0x0A640, 0x0A66C,      1, 2}, {0x0A680, 0x0A69A,      1, 2}
+        , {0x0A722, 0x0A72E,      1, 2}, {0x0A732, 0x0A76E,      1, 2}, {0x0A779, 0x0A77B,      1, 2}
+        , {0x0A77D, 0x0A77D, -35332, 1}, {0x0A77E, 0x0A786,      1, 2}, {0x0A78B, 0x0A78B,      1, 1}
+        , {0x0A790, 0x0A792,      1, 2}, {0x0A796, 0x0A7A8,      1, 2}, {0x0A7B3, 0x0A7B3,    928, 1}
+        , {0x0A7B4, 0x0A7C2,      1, 2}, {0x0A7C4, 0x0A7C4,    -48, 1}, {0x0A7C6, 0x0A7C6, -35384, 1}
+        , {0x0A7C7, 0x0A7C9,      1, 2}, {0x0A7D0, 0x0A7D0,      1, 1}, {0x0A7D6, 0x0A7D8,      1, 2}
+        , {0x0A7F5, 0x0A7F5,      1, 1}, {0x0AB70, 0x0ABBF, -38864, 1}, {0x0FF21, 0x0FF3A,     32, 1}
+        , {0x10400, 0x10427,     40, 1}, {0x104B0, 0x104D3,     40, 1}, {0x10570, 0x1057A,     39, 1}
+        , {0x1057C, 0x1058A,     39, 1}, {0x1058C, 0x10592,     39, 1}, {0x10594, 0x10595,     39, 1}
+        , {0x10C80, 0x10CB2,     64, 1}, {0x118A0, 0x118BF,     32, 1}, {0x16E40, 0x16E5F,     32, 1}
+        , {0x1E900, 0x1E921,     34, 1}
+    };
+
+    /// Codepoints below 'small' (two-byte sequences: Latin, Greek, Cyrillic...)
+    /// are folded by a table; the others are searched in ranges only if
+    /// their lead byte and their block of 64 codepoints have mappings, so
+    /// that CJK text, for instance, is just copied.
+    struct Tables
+    {
+        static constexpr std::uint32_t small = 0x800;
+        std::array<std::uint16_t, small>  folded{};
+        std::bitset<(0x110000 >> 6)>      blocks;
+        std::bitset<256>                  leads;
+    };
+
+    inline Tables const& tables()
+    {
+        static const Tables tables = []
+        {
+            Tables t;
+            for(std::uint32_t c = 0; c < Tables::small; c++) { t.folded[c] = static_cast<std::uint16_t>(c); }
+            for(auto const& r: ranges)
+            {
+                for(std::uint32_t c = r.first; c <= r.last; c += r.stride)
+                {
+                    if(c < Tables::small) { t.folded[c] = static_cast<std::uint16_t>(static_cast<std::int32_t>(c) + r.delta); }
+                    t.blocks.set(c >> 6);
+                    t.leads.set(c < 0x10000 ? 0xE0 | (c >> 12) : 0xF0 | (c >> 18));
+                }
+            }
+            return t;
+        }();
+        return tables;
+    }
+
+    /// Folded codepoint (cp if it has no mapping).
+    inline std::uint32_t fold_codepoint(std::uint32_t cp)
+    {
+        auto const& t = tables();
+        if(cp < Tables::small)                         { return t.folded[cp]; }
+        if(cp >= 0x110000 || !t.blocks.test(cp >> 6)) { return cp; }
+
+        auto it = std::upper_bound(std::begin(ranges), std::end(ranges), cp
+                                   , [](std::uint32_t c, Range const& r){ return c < r.first; });
+        if(it == std::begin(ranges)) { return cp; }
+        --it;
+        if(cp > it->last || (cp - it->first) % it->stride != 0) { return cp; }
+        return static_cast<std::uint32_t>(static_cast<std::int32_t>(cp) + it->delta);
+    }
+
+    /// Fold the UTF-8 sequence starting at in[0] (not ASCII), at most n bytes;
+    /// returns its length. Invalid sequences are copied byte by byte.
+    inline std::size_t fold_sequence(const unsigned char* in, std::size_t n, char* out)
+    {
+        const unsigned char lead = in[0];
+        const std::size_t len = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        if(len == 1 || lead >= 0xF8 || len > n)
+        {
+            out[0] = static_cast<char>(lead);
+            return 1;
+        }
+        const unsigned mask = 0x7Fu >> len;  // Payload bits of the lead byte
+        std::uint32_t cp = lead & mask;
+        for(std::size_t k = 1; k < len; k++)
+        {
+            if((in[k] & 0xC0) != 0x80)
+            {
+                out[0] = static_cast<char>(lead);
+                return 1;
+            }
+            cp = (cp << 6) | (in[k] & 0x3Fu);
+        }
+        auto folded = fold_codepoint(cp);
+        for(std::size_t k = len - 1; k > 0; k--)
+        {
+            out[k] = static_cast<char>(0x80u | (folded & 0x3Fu));
+            folded >>= 6;
+        }
+        out[0] = static_cast<char>((lead & ~mask) | (folded & mask));
+        return len;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    inline bool has_avx2()
+    {
+        static const bool flag = __builtin_cpu_supports("avx2");
+        return flag;
+    }
+
+    /// Fold the blocks of 16 ASCII bytes from pos; returns the position of
+    /// the first block with a non-ASCII byte (or of the last partial block).
+    inline std::size_t fold_ascii_sse2(const char* in, char* out, std::size_t pos, std::size_t n)
+    {
+        const __m128i before_a = _mm_set1_epi8('A' - 1);
+        const __m128i after_z  = _mm_set1_epi8('Z' + 1);
+        const __m128i bit      = _mm_set1_epi8(0x20);
+        for(; pos + 16 <= n; pos += 16)
+        {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+            if(_mm_movemask_epi8(c) != 0) { break; }
+            __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, before_a), _mm_cmplt_epi8(c, after_z));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + pos), _mm_or_si128(c, _mm_and_si128(upper, bit)));
+        }
+        return pos;
+    }
+
+    /// Same as fold_ascii_sse2(), 32 bytes per step.
+    __attribute__((target("avx2")))
+    inline std::size_t fold_ascii_avx2(const char* in, char* out, std::size_t pos, std::size_t n)
+    {
+        const __m256i before_a = _mm256_set1_epi8('A' - 1);
+        const __m256i after_z  = _mm256_set1_epi8('Z' + 1);
+        const __m256i bit      = _mm256_set1_epi8(0x20);
+        for(; pos + 32 <= n; pos += 32)
+        {
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + pos));
+            if(_mm256_movemask_epi8(c) != 0) { break; }
+            __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, before_a), _mm256_cmpgt_epi8(after_z, c));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + pos), _mm256_or_si256(c, _mm256_and_si256(upper, bit)));
+        }
+        return pos;
+    }
+#endif
+
+    /** @brief Folded copy of UTF-8 text, of the same length: ASCII letters
+     *  and the codepoints of ranges are lowercased.
+     *
+     *  Pure ASCII blocks are folded with SSE2 or AVX2; only the blocks with
+     *  non-ASCII bytes are decoded. Invalid UTF-8 is copied as is.
+     */
+    inline void fold(std::string_view in, std::string& out)
+    {
+        constexpr std::size_t block = 32;
+        out.resize(in.size());
+        auto src = reinterpret_cast<const unsigned char*>(in.data());
+        char* dst = out.data();
+        const std::size_t n = in.size();
+        auto const& t = tables();
+        for(std::size_t pos = 0; pos < n; )
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            pos = has_avx2() ? fold_ascii_avx2(in.data(), dst, pos, n)
+                             : fold_ascii_sse2(in.data(), dst, pos, n);
+#endif
+            // A block with non-ASCII bytes, or the end of the text.
+            for(auto end = std::min(pos + block, n); pos < end; )
+            {
+                unsigned char c = src[pos];
+                if(c < 0x80)
+                {
+                    dst[pos++] = static_cast<char>((c >= 'A' && c <= 'Z') ? c + 32 : c);
+                    continue;
+                }
+                // Two-byte sequences without a call (most non-ASCII text).
+                if(c >= 0xC2 && c < 0xE0 && pos + 1 < n && (src[pos + 1] & 0xC0) == 0x80)
+                {
+                    auto folded = t.folded[((c & 0x1Fu) << 6) | (src[pos + 1] & 0x3Fu)];
+                    dst[pos]     = static_cast<char>(0xC0u | (folded >> 6));
+                    dst[pos + 1] = static_cast<char>(0x80u | (folded & 0x3Fu));
+                    pos += 2;
+                    continue;
+                }
+                if(t.leads.test(c))
+                {
+                    pos += fold_sequence(src + pos, n - pos, dst + pos);
+                    continue;
+                }
+                // Continuation bytes and sequences without mappings.
+                dst[pos++] = static_cast<char>(c);
+            }
+        }
+    }
+
+    inline std::string fold(std::string_view in)
+    {
+        std::string out;
+        fold(in, out);
+        return out;
+    }
+
+} // * --- End of namespace casefold --- * //
+
+/// Approximate matching: lines with a substring within K edits of a pattern.
+namespace fuzzy
+{
+    /** @brief Pattern of at most 64 bytes compiled for Myers' bit-vector
+     *  algorithm (G. Myers, "A fast bit-vector algorithm for approximate
+     *  string matching based on dynamic programming", 1999).
+     *
+     *  The column of the edit distance matrix is encoded in two words of
+     *  vertical deltas, so a byte of text costs a few word operations
+     *  whatever K. By the pigeonhole principle, a match within K edits
+     *  contains one of K + 1 disjoint pieces of the pattern exactly: the
+     *  pieces are searched first, and only the lines containing one are
+     *  verified, four at a time with AVX2 (one line per 64-bit lane).
+     */
+    struct Pattern
+    {
+        static constexpr std::size_t max_length = 64;
+
+        std::array<std::uint64_t, 256> peq{};    // Positions of every byte in the pattern
+        std::size_t                    length    = 0;
+        std::uint64_t                  max_edits = 0;
+        std::vector<std::string>       pieces;   // K + 1 pieces (none if length <= K)
+
+        /// Throws std::runtime_error if the pattern is too long.
+        Pattern(std::string_view pattern, unsigned edits)
+            : length(pattern.size()), max_edits(edits)
+        {
+            using namespace std::string_literals;
+            if(pattern.size() > max_length) {
+                throw std::runtime_error("Error: fuzzy patterns are limited to "s
+                                         + std::to_string(max_length) + " bytes");
+            }
+            for(std::size_t i = 0; i < pattern.size(); i++) {
+                peq[static_cast<unsigned char>(pattern[i])] |= std::uint64_t{1} << i;
+            }
+            // Any line matches if the whole pattern can be deleted.
+            if(length <= max_edits) { return; }
+            for(std::size_t k = 0; k <= max_edits; k++)
+            {
+                auto first = k * length / (max_edits + 1);
+                auto last  = (k + 1) * length / (max_edits + 1);
+                pieces.emplace_back(pattern.substr(first, last - first));
+            }
+        }
+
+        /// True if every line matches.
+        bool matches_all() const { return length <= max_edits; }
+    };
+
+    /// True if text has a substring within max_edits edits of the pattern.
+    inline bool matches(Pattern const& p, std::string_view text)
+    {
+        if(p.matches_all()) { return true; }
+        const std::uint64_t high = std::uint64_t{1} << (p.length - 1);
+        std::uint64_t pv = ~std::uint64_t{0};
+        std::uint64_t mv = 0;
+        std::uint64_t score = p.length;
+        for(char c: text)
+        {
+            std::uint64_t eq = p.peq[static_cast<unsigned char>(c)];
+            std::uint64_t xv = eq | mv;
+            std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t ph = mv | ~(xh | pv);
+            std::uint64_t mh = pv & xh;
+            if(ph & high)      { score++; }
+            else if(mh & high) { score--; }
+            if(score <= p.max_edits) { return true; }
+            // A match may start anywhere: no carry into the first row.
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return false;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    inline bool has_avx2()
+    {
+        static const bool flag = __builtin_cpu_supports("avx2");
+        return flag;
+    }
+
+    /// Same as matches() for four texts at once, a 64-bit lane each.
+    __attribute__((target("avx2")))
+    inline void matches_avx2(Pattern const& p, std::string_view const* texts, bool* out)
+    {
+        const __m256i high  = _mm256_set1_epi64x(static_cast<long long>(std::uint64_t{1} << (p.length - 1)));
+        const __m256i ones  = _mm256_set1_epi64x(-1);
+        const __m256i one   = _mm256_set1_epi64x(1);
+        const __m256i limit = _mm256_set1_epi64x(static_cast<long long>(p.max_edits + 1));
+        const int     shift = static_cast<int>(p.length - 1);
+        __m256i pv    = ones;
+        __m256i mv    = _mm256_setzero_si256();
+        __m256i score = _mm256_set1_epi64x(static_cast<long long>(p.length));
+        __m256i found = _mm256_setzero_si256();
+
+        std::size_t longest = 0;
+        for(int l = 0; l < 4; l++) { longest = std::max(longest, texts[l].size()); }
+        auto eq_of = [&](int l, std::size_t i) -> long long
+        {
+            return i < texts[l].size() ? static_cast<long long>(p.peq[static_cast<unsigned char>(texts[l][i])]) : 0;
+        };
+        auto active_of = [&](int l, std::size_t i) -> long long { return i < texts[l].size() ? -1 : 0; };
+        for(std::size_t i = 0; i < longest; i++)
+        {
+            __m256i eq = _mm256_set_epi64x(eq_of(3, i), eq_of(2, i), eq_of(1, i), eq_of(0, i));
+            __m256i xv = _mm256_or_si256(eq, mv);
+            __m256i xh = _mm256_or_si256(_mm256_xor_si256(_mm256_add_epi64(_mm256_and_si256(eq, pv), pv), pv), eq);
+            __m256i ph = _mm256_or_si256(mv, _mm256_xor_si256(_mm256_or_si256(xh, pv), ones));
+            __m256i mh = _mm256_and_si256(pv, xh);
+            score = _mm256_add_epi64(score, _mm256_and_si256(_mm256_srli_epi64(_mm256_and_si256(ph, high), shift), one));
+            score = _mm256_sub_epi64(score, _mm256_and_si256(_mm256_srli_epi64(_mm256_and_si256(mh, high), shift), one));
+            __m256i active = _mm256_set_epi64x(active_of(3, i), active_of(2, i), active_of(1, i), active_of(0, i));
+            found = _mm256_or_si256(found, _mm256_and_si256(active, _mm256_cmpgt_epi64(limit, score)));
+            if(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(found, _mm256_xor_si256(active, ones)))) == 0xF) {
+                break;
+            }
+            ph = _mm256_slli_epi64(ph, 1);
+            mh = _mm256_slli_epi64(mh, 1);
+            pv = _mm256_or_si256(mh, _mm256_xor_si256(_mm256_or_si256(xv, ph), ones));
+            mv = _mm256_and_si256(ph, xv);
+        }
+        auto mask = _mm256_movemask_pd(_mm256_castsi256_pd(found));
+        for(int l = 0; l < 4; l++) { out[l] = (mask >> l) & 1; }
+    }
+#endif
+
+    /// matches() of count texts into out.
+    inline void matches(Pattern const& p, std::string_view const* texts, std::size_t count, bool* out)
+    {
+        std::size_t i = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if(!p.matches_all() && has_avx2())
+        {
+            for(; i + 4 <= count; i += 4) { matches_avx2(p, texts + i, out + i); }
+        }
+#endif
+        for(; i < count; i++) { out[i] = matches(p, texts[i]); }
+    }
+
+} // * --- End of namespace fuzzy --- * //
+
+/// String utilties
+namespace strutils
+{
+    bool contains_string2(std::string const& s, const std::string& cont)
+    {
+        return cont.end() != std::search( cont.begin()
+                                        , cont.end()
+                                        , std::boyer_moore_searcher(s.begin(), s.end()));
+    }
+
+    bool ends_with(std::string const & value, std::string const & ending)
+    {
+        if (ending.size() > value.size()) return false;
+        return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+    }
+
+   /// Case folded copy of UTF-8 text (see casefold::fold()).
+   std::string
+   to_lowercase(std::string const& text)
+   {
+       return casefold::fold(text);
+   }
+
+   std::string
+   right_trim(const std::string& s)
+   {
+       size_t end = s.find_last_not_of(" \n\r\t\f\v");
+       return (end == std::string::npos) ? "" : s.substr(0, end + 1);
+   }
+} // * ---- End of namespace strtutils --- * //
+
+/// Transparent decompression of gzip, zstd and xz inputs.
+namespace compression
+{
+    using namespace std::string_literals;
+
+    enum class format { none, gzip, zstd, xz };
+
+    const char* name(format f)
+    {
+        switch(f)
+        {
+            case format::gzip: return "gzip";
+            case format::zstd: return "zstd";
+            case format::xz:   return "xz";
+            default:           return "none";
+        }
+    }
+
+    /// Format identified by the first bytes of a file (at least 6 bytes to tell them all).
+    format detect(std::string_view magic)
+    {
+        auto starts_with = [&](std::string_view m){ return magic.substr(0, m.size()) == m; };
+        if(starts_with("\x1f\x8b"))                 { return format::gzip; }
+        if(starts_with("\x28\xb5\x2f\xfd"))         { return format::zstd; }
+        if(starts_with({"\xfd\x37\x7a\x58\x5a\x00", 6})) { return format::xz; }
+        return format::none;
+    }
+
+    /// Receives the decompressed data; returns false to stop the decompression.
+    using Sink = std::function<bool (const char* data, std::size_t size)>;
+
+    constexpr std::size_t chunk_size = 64 * 1024;
+
+#if defined(CLIBOX_HAVE_ZLIB)
+    void decompress_gzip(std::istream& in, Sink const& sink)
+    {
+        z_stream zs{};
+        if(::inflateInit2(&zs, 15 + 32) != Z_OK) {
+            throw std::runtime_error("Error: inflateInit2() failed");
+        }
+        std::unique_ptr<z_stream, int (*)(z_streamp)> guard(&zs, ::inflateEnd);
+        std::vector<char> input(chunk_size), output(chunk_size);
+        int rc = Z_OK;
+        for(;;)
+        {
+            if(zs.avail_in == 0)
+            {
+                in.read(input.data(), static_cast<std::streamsize>(input.size()));
+                zs.next_in  = reinterpret_cast<Bytef*>(input.data());
+                zs.avail_in = static_cast<uInt>(in.gcount());
+                if(zs.avail_in == 0) { break; }
+            }
+            zs.next_out  = reinterpret_cast<Bytef*>(output.data());
+            zs.avail_out = static_cast<uInt>(output.size());
+            rc = ::inflate(&zs, Z_NO_FLUSH);
+            if(rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+                throw std::runtime_error("Error: corrupted gzip data: "s + (zs.msg ? zs.msg : "unknown error"));
+            }
+            auto produced = output.size() - zs.avail_out;
+            if(produced > 0 && !sink(output.data(), produced)) { return; }
+            // Concatenated members (gzip a >> b.gz)
+            if(rc == Z_STREAM_END) { ::inflateReset(&zs); }
+        }
+        if(rc != Z_STREAM_END) {
+            throw std::runtime_error("Error: truncated gzip data");
+        }
+    }
+#endif
+
+#if defined(CLIBOX_HAVE_LZMA)
+    void decompress_xz(std::istream& in, Sink const& sink)
+    {
+        lzma_stream zs = LZMA_STREAM_INIT;
+        if(::lzma_stream_decoder(&zs, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+            throw std::runtime_error("Error: lzma_stream_decoder() failed");
+        }
+        std::unique_ptr<lzma_stream, void (*)(lzma_stream*)> guard(&zs, ::lzma_end);
+        std::vector<char> input(chunk_size), output(chunk_size);
+        lzma_action action = LZMA_RUN;
+        for(;;)
+        {
+            if(zs.avail_in == 0 && action == LZMA_RUN)
+            {
+                in.read(input.data(), static_cast<std::streamsize>(input.size()));
+                zs.next_in  = reinterpret_cast<const std::uint8_t*>(input.data());
+                zs.avail_in = static_cast<std::size_t>(in.gcount());
+                if(zs.avail_in == 0) { action = LZMA_FINISH; }
+            }
+            zs.next_out  = reinterpret_cast<std::uint8_t*>(output.data());
+            zs.avail_out = output.size();
+            auto rc = ::lzma_code(&zs, action);
+            auto produced = output.size() - zs.avail_out;
+            if(produced > 0 && !sink(output.data(), produced)) { return; }
+            if(rc == LZMA_STREAM_END) { return; }
+            if(rc == LZMA_BUF_ERROR) {
+                throw std::runtime_error("Error: truncated xz data");
+            }
+            if(rc != LZMA_OK) {
+                throw std::runtime_error("Error: corrupted xz data (lzma error " + std::to_string(rc) + ")");
+            }
+        }
+    }
+#endif
+
+#if defined(CLIBOX_HAVE_ZSTD)
+    void decompress_zstd(std::istream& in, Sink const& sink)
+    {
+        std::unique_ptr<ZSTD_DStream, std::size_t (*)(ZSTD_DStream*)> ds(::ZSTD_createDStream(), ::ZSTD_freeDStream);
+        if(ds == nullptr) {
+            throw std::runtime_error("Error: ZSTD_createDStream() failed");
+        }
+        ::ZSTD_initDStream(ds.get());
+        std::vector<char> input(::ZSTD_DStreamInSize()), output(::ZSTD_DStreamOutSize());
+        std::size_t last = 0;
+        for(;;)
+        {
+            in.read(input.data(), static_cast<std::streamsize>(input.size()));
+            ZSTD_inBuffer ib{input.data(), static_cast<std::size_t>(in.gcount()), 0};
+            if(ib.size == 0) { break; }
+            ZSTD_outBuffer ob{output.data(), output.size(), 0};
+            // Until the input is consumed and the decoder has nothing buffered
+            // (0 means the end of a frame: calling again would start a new one).
+            do {
+                ob.pos = 0;
+                last = ::ZSTD_decompressStream(ds.get(), &ob, &ib);
+                if(::ZSTD_isError(last)) {
+                    throw std::runtime_error("Error: corrupted zstd data: "s + ::ZSTD_getErrorName(last));
+                }
+                if(ob.pos > 0 && !sink(output.data(), ob.pos)) { return; }
+            } while(ib.pos < ib.size || (ob.pos == ob.size && last != 0));
+        }
+        if(last != 0) {
+            throw std::runtime_error("Error: truncated zstd data");
+        }
+    }
+#endif
+
+    /// Decompress the whole input (positioned at its start) into sink.
+    void decompress(format f, std::istream& in, Sink const& sink)
+    {
+        switch(f)
+        {
+#if defined(CLIBOX_HAVE_ZLIB)
+            case format::gzip: decompress_gzip(in, sink); return;
+#endif
+#if defined(CLIBOX_HAVE_LZMA)
+            case format::xz:   decompress_xz(in, sink); return;
+#endif
+#if defined(CLIBOX_HAVE_ZSTD)
+            case format::zstd: decompress_zstd(in, sink); return;
+#endif
+            default:
+                (void) in;
+                (void) sink;
+                throw std::runtime_error("Error: "s + name(f) + " support not compiled in");
+        }
+    }
+
+    /// FIFO of bounded capacity between two threads; close() wakes up both sides.
+    template<typename T>
+    class BoundedQueue
+    {
+        std::mutex              m_mutex;
+        std::condition_variable m_not_empty;
+        std::condition_variable m_not_full;
+        std::deque<T>           m_items;
+        std::size_t             m_capacity;
+        bool                    m_closed = false;
+    public:
+        explicit BoundedQueue(std::size_t capacity): m_capacity(capacity) { }
+
+        /// Wait for room; false if the queue was closed.
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_full.wait(lock, [this]{ return m_closed || m_items.size() < m_capacity; });
+            if(m_closed) { return false; }
+            m_items.push_back(std::move(item));
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        /// Wait for an item; empty once the queue is closed and drained.
+        std::optional<T> pop()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [this]{ return m_closed || !m_items.empty(); });
+            if(m_items.empty()) { return std::nullopt; }
+            T item = std::move(m_items.front());
+            m_items.pop_front();
+            m_not_full.notify_one();
+            return item;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_not_empty.notify_all();
+            m_not_full.notify_all();
+        }
+    };
+
+    /** @brief Call on_line(line) for every line of a compressed input, like
+     *  std::getline() on the decompressed data, until it returns false.
+     *
+     *  Decompression runs on its own thread, one block ahead or more of the
+     *  matching: a few fixed size blocks circulate between the two threads,
+     *  so memory stays bounded whatever the size of the file.
+     */
+    template<typename Action>
+    void for_each_line(format f, std::istream& in, Action&& on_line)
+    {
+        constexpr std::size_t block_size = 256 * 1024;
+        constexpr std::size_t blocks     = 4;
+
+        BoundedQueue<std::string> filled(blocks), empty(blocks);
+        for(std::size_t k = 0; k < blocks; k++)
+        {
+            std::string b;
+            b.reserve(block_size);
+            empty.push(std::move(b));
+        }
+
+        std::exception_ptr error;
+        std::thread producer([&]
+        {
+            std::optional<std::string> block;
+            try {
+                stats::ScopedPhase read(stats::phase::read);
+                block = empty.pop();
+                decompress(f, in, [&](const char* data, std::size_t size)
+                {
+                    while(size > 0)
+                    {
+                        auto n = std::min(size, block_size - block->size());
+                        block->append(data, n);
+                        data += n;
+                        size -= n;
+                        if(block->size() < block_size) { break; }
+                        if(!filled.push(std::move(*block)) || !(block = empty.pop())) { return false; }
+                        block->clear();
+                    }
+                    return true;
+                });
+            } catch(...)
+            {
+                error = std::current_exception();
+            }
+            // Also on error: the lines decoded before it are still searched.
+            if(block && !block->empty()) { filled.push(std::move(*block)); }
+            filled.close();
+        });
+
+        auto stop = [&]
+        {
+            filled.close();
+            empty.close();
+            producer.join();
+        };
+        try
+        {
+            std::string line, pending;
+            bool more = true;
+            while(more)
+            {
+                auto block = filled.pop();
+                if(!block) { break; }
+                std::string_view data = *block;
+                for(std::size_t pos = 0; more && pos < data.size(); )
+                {
+                    auto eol = data.find('\n', pos);
+                    if(eol == std::string_view::npos)
+                    {
+                        pending.append(data.substr(pos));
+                        break;
+                    }
+                    if(pending.empty()) { line.assign(data.substr(pos, eol - pos)); }
+                    else
+                    {
+                        pending.append(data.substr(pos, eol - pos));
+                        line.swap(pending);
+                        pending.clear();
+                    }
+                    pos  = eol + 1;
+                    more = on_line(line);
+                }
+                empty.push(std::move(*block));
+            }
+            if(more && !pending.empty()) { on_line(pending); }
+        } catch(...)
+        {
+            stop();
+            throw;
+        }
+        stop();
+        if(error) { std::rethrow_exception(error); }
+    }
+
+} // * --- End of namespace compression --- * //
+
+namespace fileutils
+{
+     using namespace strutils;
+
+     /// Default of iterate_dirlist(): every directory is descended into.
+     struct no_prune
+     {
+         bool operator()(fs::directory_entry const&) const { return false; }
+     };
+
+     /// pred and act are called with the entries (fs::directory_entry, whose
+     /// file type is cached); directories for which prune returns true are
+     /// not descended into.
+     template<typename Predicate, typename Action, typename Prune = no_prune>
+     void iterate_dirlist(  std::string path
+                          , bool recursive
+                          , Predicate&& pred
+                          , Action&& act
+                          , Prune&& prune = Prune{}
+                          )
+     {
+         stats::ScopedPhase walk(stats::phase::walk);
+         if(!recursive)
+         {
+             for(auto& p: fs::directory_iterator(path))
+                 if(pred(p)) {
+                     try { act(p); }
+                     catch(fs::filesystem_error& ex)
+                     {
+                         std::cerr << ex.what() << "\n";
+                     }
+                     catch(std::logic_error& ex)
+                     {
+                         std::cerr << " [ERROR / FILE] " << ex.what() << "\n";
+                     }
+                 }
+             return;
+         }
+
+         std::error_code ec;
+         for(auto it = fs::recursive_directory_iterator(path); it != fs::recursive_directory_iterator(); ++it)
+         {
+             auto const& p = *it;
+             if(p.is_directory(ec))
+             {
+                 stats::add(stats::counter::directories);
+                 if(prune(p))
+                 {
+                     it.disable_recursion_pending();
+                     continue;
+                 }
+             }
+             if(pred(p)) {
+                 try { act(p); }
+                 catch(fs::filesystem_error& ex)
+                 {
+                     std::cerr << ex.what() << "\n";
+                 }
+                 catch(std::logic_error& ex)
+                 {
+                     std::cerr << " [ERROR / FILE] " << ex.what() << "\n";
+                 }
+             }
+         }
+     }
+
+     /** @brief Pattern compiled once and searched in whole in-memory buffers.
+      *
+      *  Text patterns are case insensitive by default (UTF-8 folding, see
+      *  casefold::fold()), but the buffer is folded once and scanned with
+      *  memmem(3) (about twice as fast as std::boyer_moore_horspool_searcher
+      *  here) instead of copying and folding every line. Regular expressions are applied line by line.
+      */
+     class BufferMatcher
+     {
+         std::string                    m_folded;
+         std::optional<std::regex>      m_regex;
+         std::optional<fuzzy::Pattern>  m_fuzzy;
+         bool                           m_ignore_case;
+
+     public:
+
+         /** @brief Throws std::regex_error if the regular expression is invalid,
+          *  std::runtime_error if fuzzy matching can't be used.
+          *
+          *  @param fuzzy - Maximum number of edits of a match (0: exact).
+          */
+         BufferMatcher(std::string const& pattern, bool use_regex, bool ignore_case = true
+                       , unsigned fuzzy = 0)
+             : m_folded(ignore_case ? to_lowercase(pattern) : pattern)
+             , m_ignore_case(ignore_case)
+         {
+             if(use_regex && fuzzy > 0) {
+                 throw std::runtime_error("Error: fuzzy matching does not apply to regular expressions");
+             }
+             if(use_regex) { m_regex.emplace(pattern); }
+             if(fuzzy > 0) { m_fuzzy.emplace(m_folded, fuzzy); }
+         }
+
+         /// True if scan_folded() needs the folded copy of the data.
+         bool folds() const { return !m_regex && m_ignore_case; }
+
+         /// Folded copy of data for scan_folded() (see folds()).
+         static void fold(std::string_view data, std::string& out)
+         {
+             casefold::fold(data, out);
+         }
+
+         /** @brief Call on_match(line_number, line) for every matching line of
+          *  data, line numbers counted from 0 like search_file().
+          *
+          *  The data is folded by windows ending at a newline, so a scan which
+          *  stops early does not read the rest of it (pages of a mapped file).
+          *
+          *  @param scratch  - Buffer reused between calls for the folded copy.
+          *  @param on_match - Returns false to stop the scan.
+          */
+         template<typename Callback>
+         void scan(std::string_view data, std::string& scratch, Callback&& on_match) const
+         {
+             if(!this->folds()) {
+                 this->scan_folded(data, data, std::forward<Callback>(on_match));
+                 return;
+             }
+             constexpr std::size_t window = 64 * 1024;
+             long base = 0;          // Lines before the window
+             bool stop = false;
+             for(std::size_t pos = 0; pos < data.size() && !stop; )
+             {
+                 auto nl  = data.find('\n', std::min(pos + window, data.size()) - 1);
+                 auto end = nl == std::string_view::npos ? data.size() : nl + 1;
+                 auto chunk = data.substr(pos, end - pos);
+                 BufferMatcher::fold(chunk, scratch);
+                 this->scan_folded(chunk, scratch, [&](long number, std::string_view line)
+                 {
+                     stop = !on_match(base + number, line);
+                     return !stop;
+                 });
+                 base += std::count(chunk.begin(), chunk.end(), '\n');
+                 pos = end;
+             }
+         }
+
+         /// True if a single line matches (scratch: reused for the folded copy).
+         bool matches_line(std::string_view line, std::string& scratch) const
+         {
+             if(m_regex) { return std::regex_search(line.begin(), line.end(), *m_regex); }
+             std::string_view folded = line;
+             if(this->folds())
+             {
+                 BufferMatcher::fold(line, scratch);
+                 folded = scratch;
+             }
+             if(m_fuzzy) { return fuzzy::matches(*m_fuzzy, folded); }
+             return ::memmem(folded.data(), folded.size(), m_folded.data(), m_folded.size()) != nullptr;
+         }
+
+         /// Same as scan() with the folded copy of data already made by fold(),
+         /// or data itself if folds() is false.
+         template<typename Callback>
+         void scan_folded(std::string_view data, std::string_view folded, Callback&& on_match) const
+         {
+             auto line_end = [&](std::size_t pos)
+             {
+                 auto end = data.find('\n', pos);
+                 return end == std::string_view::npos ? data.size() : end;
+             };
+
+             if(m_regex)
+             {
+                 long number = 0;
+                 for(std::size_t pos = 0; pos < data.size(); number++)
+                 {
+                     auto end = line_end(pos);
+                     if(std::regex_search(data.begin() + pos, data.begin() + end, *m_regex)
+                        && !on_match(number, data.substr(pos, end - pos))) { return; }
+                     pos = end + 1;
+                 }
+                 return;
+             }
+             if(m_fuzzy)
+             {
+                 this->scan_fuzzy(data, folded, std::forward<Callback>(on_match));
+                 return;
+             }
+
+             long        number  = 0;
+             std::size_t counted = 0;   // Newlines before 'counted' are in 'number'
+             for(std::size_t pos = 0; pos < data.size(); )
+             {
+                 auto it = static_cast<const char*>(::memmem(folded.data() + pos, folded.size() - pos
+                                                             , m_folded.data(), m_folded.size()));
+                 if(it == nullptr) { return; }
+                 auto hit   = static_cast<std::size_t>(it - folded.data());
+                 // 'pos' is always at the start of a line.
+                 auto begin = hit == pos ? std::string_view::npos : data.rfind('\n', hit - 1);
+                 begin = (begin == std::string_view::npos || begin < pos) ? pos : begin + 1;
+                 number += std::count(data.begin() + counted, data.begin() + begin, '\n');
+                 counted = begin;
+                 auto end = line_end(hit);
+                 if(!on_match(number, data.substr(begin, end - begin))) { return; }
+                 pos = end + 1;
+             }
+         }
+
+         /** @brief scan_folded() of a fuzzy pattern: the lines containing one of
+          *  its pieces are verified by batches (see fuzzy::Pattern).
+          */
+         template<typename Callback>
+         void scan_fuzzy(std::string_view data, std::string_view folded, Callback&& on_match) const
+         {
+             constexpr std::size_t batch_size = 64;
+             struct Candidate
+             {
+                 std::size_t begin;
+                 std::size_t end;
+                 long        number;
+             };
+             std::array<Candidate, batch_size>        batch;
+             std::array<std::string_view, batch_size> texts;
+             std::array<bool, batch_size>             found{};
+             std::size_t count = 0;
+
+             auto const& pattern = *m_fuzzy;
+             auto flush = [&]
+             {
+                 fuzzy::matches(pattern, texts.data(), count, found.data());
+                 for(std::size_t k = 0; k < count; k++)
+                 {
+                     auto const& c = batch[k];
+                     if(found[k] && !on_match(c.number, data.substr(c.begin, c.end - c.begin))) { return false; }
+                 }
+                 count = 0;
+                 return true;
+             };
+             auto line_end = [&](std::size_t pos)
+             {
+                 auto end = data.find('\n', pos);
+                 return end == std::string_view::npos ? data.size() : end;
+             };
+             // Next occurrence of every piece from pos (npos: none).
+             auto find = [&](std::string const& piece, std::size_t pos)
+             {
+                 auto it = static_cast<const char*>(::memmem(folded.data() + pos, folded.size() - pos
+                                                             , piece.data(), piece.size()));
+                 return it == nullptr ? std::string_view::npos : static_cast<std::size_t>(it - folded.data());
+             };
+             std::vector<std::size_t> next;
+             for(auto const& piece: pattern.pieces) { next.push_back(find(piece, 0)); }
+
+             long        number  = 0;
+             std::size_t counted = 0;   // Newlines before 'counted' are in 'number'
+             for(std::size_t pos = 0; pos < data.size(); )
+             {
+                 // Without pieces, every line is a candidate.
+                 auto hit = next.empty() ? pos : *std::min_element(next.begin(), next.end());
+                 if(hit == std::string_view::npos) { break; }
+                 auto begin = hit == pos ? std::string_view::npos : data.rfind('\n', hit - 1);
+                 begin = (begin == std::string_view::npos || begin < pos) ? pos : begin + 1;
+                 number += std::count(data.begin() + counted, data.begin() + begin, '\n');
+                 counted = begin;
+                 auto end = line_end(hit);
+                 batch[count] = Candidate{begin, end, number};
+                 texts[count] = folded.substr(begin, end - begin);
+                 if(++count == batch_size && !flush()) { return; }
+                 pos = end + 1;
+                 for(std::size_t k = 0; k < next.size(); k++)
+                 {
+                     if(next[k] < pos) { next[k] = pos < data.size() ? find(pattern.pieces[k], pos) : std::string_view::npos; }
+                 }
+             }
+             flush();
+         }
+
+         /** @brief Append to out a line reported by scan() with all its matches
+          *  replaced; regex replacements may refer to groups ($1, $&...).
+          *
+          *  @param folded_line - Same range of the folded copy (see scan_folded()).
+          *  @return Number of replacements.
+          */
+         std::size_t replace_line(std::string_view line, std::string_view folded_line
+                                  , std::string const& replacement, std::string& out) const
+         {
+             std::size_t count = 0;
+             if(m_regex)
+             {
+                 auto last = line.begin();
+                 for(std::cregex_iterator it(line.begin(), line.end(), *m_regex), end; it != end; ++it)
+                 {
+                     out.append(last, (*it)[0].first);
+                     it->format(std::back_inserter(out), replacement);
+                     last = (*it)[0].second;
+                     count++;
+                 }
+                 out.append(last, line.end());
+                 return count;
+             }
+             std::size_t pos = 0;
+             while(pos < line.size() && !m_folded.empty())
+             {
+                 auto it = static_cast<const char*>(::memmem(folded_line.data() + pos, folded_line.size() - pos
+                                                             , m_folded.data(), m_folded.size()));
+                 if(it == nullptr) { break; }
+                 auto hit = static_cast<std::size_t>(it - folded_line.data());
+                 out.append(line.substr(pos, hit - pos));
+                 out.append(replacement);
+                 pos = hit + m_folded.size();
+                 count++;
+             }
+             out.append(line.substr(pos));
+             return count;
+         }
+     };
+
+     /// Options of search_file(): what is printed and when the scan of a file stops.
+     struct search_mode
+     {
+         bool        files_only          = false; ///< --noline: names of the files with a match
+         bool        files_without_match = false; ///< Names of the files without a match
+         bool        count               = false; ///< Number of matching lines of every file
+         long        max_count           = -1;    ///< Matching lines per file (negative: no limit)
+         std::size_t before              = 0;     ///< Lines of context before a match
+         std::size_t after               = 0;     ///< Lines of context after a match
+         bool        show_abspath        = true;
+
+         /// True if the scan of a file can stop at its first match.
+         bool first_match_only() const
+         {
+             return files_only || files_without_match || max_count == 1;
+         }
+     };
+
+     /** @brief Contents of a plain file, read into a buffer when it is small
+      *  and memory mapped otherwise; compressed files are only identified.
+      *
+      *  Mapped pages are faulted in as the matcher reaches them, so a scan
+      *  which stops early does not read the rest of the file.
+      */
+     class FileBuffer
+     {
+         static constexpr std::size_t map_threshold = 64 * 1024;
+
+         int                  m_fd     = -1;
+         char*                m_map    = nullptr;
+         std::size_t          m_size   = 0;
+         std::string          m_buffer;
+         std::string_view     m_data;
+         compression::format  m_format = compression::format::none;
+
+     public:
+
+         /// sequential: the whole file will be read (enables a larger read-ahead).
+         FileBuffer(std::string const& filename, bool sequential)
+         {
+             using namespace std::string_literals;
+
+             m_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+             struct stat st{};
+             if(m_fd < 0 || ::fstat(m_fd, &st) < 0) {
+                 throw std::logic_error(" Error: failed to open file: "s + filename);
+             }
+             auto read_all = [&](std::size_t offset)
+             {
+                 // Until the end: the size of a pipe or of a /proc file isn't known.
+                 for(ssize_t n = 1; n > 0; )
+                 {
+                     m_buffer.resize(std::max<std::size_t>(offset + 64 * 1024, m_buffer.size()));
+                     n = ::read(m_fd, m_buffer.data() + offset, m_buffer.size() - offset);
+                     if(n < 0 && errno == EINTR) { n = 1; continue; }
+                     if(n > 0) { offset += static_cast<std::size_t>(n); }
+                 }
+                 m_buffer.resize(offset);
+                 m_data = m_buffer;
+             };
+
+             if(!S_ISREG(st.st_mode) || static_cast<std::size_t>(st.st_size) <= map_threshold)
+             {
+                 read_all(0);
+                 m_format = compression::detect(m_data.substr(0, 6));
+                 return;
+             }
+             char magic[6];
+             auto n = ::pread(m_fd, magic, sizeof(magic), 0);
+             m_format = compression::detect({magic, static_cast<std::size_t>(std::max<ssize_t>(n, 0))});
+             if(m_format != compression::format::none) { return; }
+
+             m_size = static_cast<std::size_t>(st.st_size);
+             void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+             if(p == MAP_FAILED)
+             {
+                 m_size = 0;
+                 read_all(0);
+                 return;
+             }
+             ::madvise(p, m_size, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+             m_map  = static_cast<char*>(p);
+             m_data = std::string_view(m_map, m_size);
+         }
+
+         ~FileBuffer()
+         {
+             if(m_map != nullptr) { ::munmap(m_map, m_size); }
+             if(m_fd >= 0)        { ::close(m_fd); }
+         }
+
+         FileBuffer(FileBuffer const&) = delete;
+         FileBuffer& operator=(FileBuffer const&) = delete;
+
+         /// Compressed files have no data(): see compression::for_each_line().
+         compression::format format() const { return m_format; }
+
+         std::string_view data() const { return m_data; }
+     };
+
+     /** @brief Search a file and print the results selected by mode.
+      *
+      *  Plain files are scanned in place: a context line is found by walking
+      *  back or forth from the matching line in the buffer, no line is copied
+      *  and --count only counts. Compressed files are streamed line by line,
+      *  with the lines of the before context kept in a small ring.
+      *  @return true if the file has a match.
+      *  @throw std::runtime_error if compressed data is corrupted or truncated,
+      *         after the results of the lines decoded before the error.
+      */
+     bool search_file(search_mode const& mode, std::string const& filename, BufferMatcher const& matcher)
+     {
+         using namespace std::string_literals;
+         thread_local std::string scratch;
+
+         stats::add(stats::counter::files);
+         std::optional<FileBuffer> file;
+         {
+             stats::ScopedPhase read(stats::phase::read);
+             file.emplace(filename, !mode.first_match_only() && mode.max_count < 0);
+         }
+
+         long        matches = 0;
+         bool        printed = false;   // Something was printed for this file
+         std::string error;             // Corrupted or truncated compressed data
+         auto display_name = [&]
+         {
+             auto p = fs::path(filename);
+             return mode.show_abspath ? fs::absolute(p).string() : p.filename().string();
+         };
+         auto print_line = [&](long number, std::string_view line, char separator)
+         {
+             if(!printed)
+             {
+                 std::cout << "\n\n" << "  => File: "s + display_name() << "\n";
+                 std::cout << "  " << std::string(50, '-') << "\n";
+                 printed = true;
+             }
+             auto end = line.find_last_not_of(" \n\r\t\f\v");
+             std::cout << std::setw(10) << number << separator
+                       << std::setw(10) << line.substr(0, end == std::string_view::npos ? 0 : end + 1)
+                       << "\n";
+         };
+         auto print_gap = [&]{ if(printed) { std::cout << "        --\n"; } };
+         // Only matches are reported line by line.
+         bool list_lines = !mode.files_only && !mode.files_without_match && !mode.count;
+         bool context    = list_lines && (mode.before > 0 || mode.after > 0);
+         auto done = [&]{ return mode.first_match_only() || (mode.max_count >= 0 && matches >= mode.max_count); };
+
+         if(file->format() == compression::format::none)
+         {
+             std::string_view data = file->data();
+             std::size_t scanned     = data.size();
+             std::size_t printed_end = 0;    // Start of the first line not printed yet
+             std::size_t after_from  = 0;    // Start of the next line of after context
+             long        after_line  = 0;
+             std::size_t after_left  = 0;
+
+             auto line_end = [&](std::size_t start)
+             {
+                 auto end = data.find('\n', start);
+                 return end == std::string_view::npos ? data.size() : end;
+             };
+             // Start of the line before the one starting at 'start' (> 0).
+             auto previous_line = [&](std::size_t start) -> std::size_t
+             {
+                 if(start < 2) { return 0; }
+                 auto nl = data.rfind('\n', start - 2);
+                 return nl == std::string_view::npos ? 0 : nl + 1;
+             };
+             auto print_after = [&](std::size_t limit)
+             {
+                 for(; after_left > 0 && after_from < limit && after_from < data.size(); after_left--)
+                 {
+                     auto end = line_end(after_from);
+                     print_line(after_line++, data.substr(after_from, end - after_from), '-');
+                     after_from = printed_end = end + 1;
+                 }
+             };
+
+             if(mode.max_count != 0)
+             {
+                 stats::ScopedPhase match(stats::phase::match);
+                 matcher.scan(data, scratch, [&](long number, std::string_view line)
+                 {
+                     matches++;
+                     auto begin = static_cast<std::size_t>(line.data() - data.data());
+                     auto end   = begin + line.size();
+                     if(list_lines)
+                     {
+                         stats::ScopedPhase output(stats::phase::output);
+                         print_after(begin);
+                         // Before context: walk back, but not over printed lines.
+                         auto first = begin;
+                         auto first_line = number;
+                         for(std::size_t k = 0; k < mode.before && first > printed_end; k++)
+                         {
+                             first = previous_line(first);
+                             first_line--;
+                         }
+                         if(context && first > printed_end) { print_gap(); }
+                         for(auto pos = first; pos < begin; first_line++)
+                         {
+                             auto e = line_end(pos);
+                             print_line(first_line, data.substr(pos, e - pos), '-');
+                             pos = e + 1;
+                         }
+                         print_line(number, line, ' ');
+                         printed_end = after_from = end + 1;
+                         after_line  = number + 1;
+                         after_left  = mode.after;
+                     }
+                     if(done())
+                     {
+                         scanned = std::min(end + 1, data.size());
+                         return false;
+                     }
+                     return true;
+                 });
+             }
+             if(list_lines)
+             {
+                 stats::ScopedPhase output(stats::phase::output);
+                 print_after(data.size());
+             }
+             stats::add(stats::counter::bytes_read, scanned);
+         }
+         else
+         {
+             // Compressed: line by line; copies of the before context lines.
+             std::deque<std::pair<long, std::string>> ring;
+             long        number     = 0;
+             long        last_print = -1;   // Number of the last printed line
+             std::size_t after_left = 0;
+             bool        stopped    = false; // Limit of matches reached
+             std::ifstream in(filename, std::ios::binary);
+             try
+             {
+                 if(mode.max_count != 0)
+                 {
+                     compression::for_each_line(file->format(), in, [&](std::string const& line)
+                     {
+                         stats::add(stats::counter::bytes_read, line.size() + 1);
+                         bool hit = !stopped && matcher.matches_line(line, scratch);
+                         if(hit) { matches++; }
+                         if(list_lines)
+                         {
+                             stats::ScopedPhase output(stats::phase::output);
+                             if(hit)
+                             {
+                                 long first = ring.empty() ? number : ring.front().first;
+                                 if(context && first > last_print + 1) { print_gap(); }
+                                 for(auto const& [n, text]: ring) { print_line(n, text, '-'); }
+                                 ring.clear();
+                                 print_line(number, line, ' ');
+                                 last_print = number;
+                                 after_left = mode.after;
+                             }
+                             else if(after_left > 0)
+                             {
+                                 print_line(number, line, '-');
+                                 last_print = number;
+                                 after_left--;
+                             }
+                             else if(mode.before > 0)
+                             {
+                                 if(ring.size() == mode.before) { ring.pop_front(); }
+                                 ring.emplace_back(number, line);
+                             }
+                         }
+                         number++;
+                         stopped = stopped || done();
+                         // After the last match, only its trailing context is read.
+                         return !stopped || (list_lines && after_left > 0);
+                     });
+                 }
+             } catch(std::runtime_error& ex)
+             {
+                 // Decoding error: the matches found before it are reported
+                 // first, then the caller reports the error.
+                 error = ex.what() + ": "s + filename;
+             }
+         }
+
+         if(matches > 0) { stats::add(stats::counter::matches, static_cast<std::size_t>(matches)); }
+         stats::ScopedPhase output(stats::phase::output);
+         if(mode.files_only && matches > 0)
+         {
+             // Same output as the search of lines, without the lines.
+             std::cout << "\n\n" << "  => File: "s + display_name() << "\n";
+             std::cout << "  " << std::string(50, '-') << "\n";
+         }
+         if(mode.files_without_match && matches == 0) { std::cout << display_name() << "\n"; }
+         if(mode.count && matches > 0) { std::cout << std::setw(10) << matches << " " << display_name() << "\n"; }
+         if(!error.empty())
+         {
+             std::cout.flush();
+             throw std::runtime_error(error);
+         }
+         return matches > 0;
+     }
+
+     /// @return Number of files which could not be searched (reported).
+     std::size_t search_directory(  std::string pattern
+                           , std::string directory
+                           , bool recursive
+                           , bool use_regex
+                           , unsigned fuzzy
+                           , search_mode const& mode
+                           , selector::FileSelector const& files)
+     {
+         std::puts("\n =========== Seaching files =============");
+
+         BufferMatcher matcher(pattern, use_regex, true, fuzzy);
+         std::size_t errors = 0;
+         iterate_dirlist(directory, recursive
+             ,[&](fs::directory_entry const& p)
+             {
+                 std::error_code ec;
+                 return p.is_regular_file(ec) && files.selects_entry(p.path().native(), directory);
+             }
+             ,[&](fs::directory_entry const& p)
+             {
+                 try { search_file(mode, fs::absolute(p.path()).string(), matcher); }
+                 catch(std::runtime_error& ex)
+                 {
+                     std::cerr << " [ERROR] " << ex.what() << "\n";
+                     errors++;
+                 }
+             }
+             ,[&](fs::directory_entry const& p)
+             {
+                 return files.prunes_entry(p.path().native(), directory);
+             });
+         return errors;
+     }
+
+} // * --- End of namespace fileutils --- * //
+
+   /*==================================================*
+    *     Search server (text-search serve)            *
+    *==================================================*/
+
+/** Resident search server: the tree is walked once, kept up to date with
+ *  inotify(7), and queries are answered over a Unix socket.
+ *
+ *  Protocol, one request per line:
+ *     search ID FLAGS PATTERN  - FLAGS: '-' or a combination of 'r' (regex)
+ *                                and 'l' (names of the files only)
+ *     cancel                   - Cancel the running query
+ *     status                   - Index and cache statistics
+ *
+ *  Results are streamed as 'PATH:LINE:TEXT' (or 'PATH') lines, in no
+ *  particular order, and terminated by 'end ID ...', 'cancelled ID' or
+ *  'error ID MESSAGE'. A new search on a connection cancels the one still
+ *  running on it. Cancellation never crosses connections: the searches
+ *  of other clients (or of earlier 'query' runs, one connection each)
+ *  are left running, until their client closes its connection.
+ */
+namespace server
+{
+    using namespace std::string_literals;
+
+    /// Default path of the server socket.
+    std::string default_socket()
+    {
+        return posix::runtime_socket("cb.text-search");
+    }
+
+    /// Write a whole buffer to a socket; false if the peer went away.
+    bool send_all(int fd, std::string_view data)
+    {
+        while(!data.empty())
+        {
+            auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n <= 0) { return false; }
+            data.remove_prefix(static_cast<std::size_t>(n));
+        }
+        return true;
+    }
+
+    /// Indexed regular file.
+    struct FileEntry
+    {
+        std::string   path;
+        std::uint64_t size  = 0;
+        std::int64_t  mtime = 0;  // Nanoseconds
+    };
+
+    using FileList = std::vector<FileEntry>;
+
+    /** @brief Regular files of a directory tree, kept up to date with inotify(7).
+     *
+     *  Every directory of the tree has a watch. Queries take an immutable
+     *  snapshot of the list, rebuilt only after the tree changed.
+     */
+    class TreeIndex
+    {
+        static constexpr std::uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE
+                                                  | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+        struct Meta
+        {
+            std::uint64_t size  = 0;
+            std::int64_t  mtime = 0;
+        };
+
+        std::string                              m_root;
+        selector::FileSelector                   m_selector;
+        std::function<void(std::string const&)>  m_on_change;
+        int                                      m_inotify = -1;
+        bool                                     m_limit_reported = false;
+        std::unordered_map<int, std::string>     m_watches;   // Watch descriptor => directory
+        // Ordered by path, so that a subtree is a contiguous range.
+        std::map<std::string, Meta>              m_files;
+        mutable std::mutex                       m_mutex;
+        mutable std::shared_ptr<const FileList>  m_snapshot;
+
+    public:
+
+        /// on_change is called with the path of every file modified or removed.
+        TreeIndex(std::string root, selector::FileSelector files
+                  , std::function<void(std::string const&)> on_change)
+            : m_root(fs::absolute(root).lexically_normal().string())
+            , m_selector(std::move(files))
+            , m_on_change(std::move(on_change))
+        {
+            if(m_root.size() > 1 && m_root.back() == '/') { m_root.pop_back(); }
+            if(!fs::is_directory(m_root)) {
+                throw std::runtime_error("Error: not a directory: "s + m_root);
+            }
+            m_inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if(m_inotify < 0) {
+                throw std::runtime_error("Error: inotify_init1() failed: "s + std::strerror(errno));
+            }
+            this->add_directory(m_root);
+        }
+
+        ~TreeIndex() { ::close(m_inotify); }
+
+        TreeIndex(TreeIndex const&) = delete;
+        TreeIndex& operator=(TreeIndex const&) = delete;
+
+        /// File descriptor which becomes readable when the tree changes.
+        int fd() const { return m_inotify; }
+
+        std::string const& root() const { return m_root; }
+
+        std::size_t watches() const { return m_watches.size(); }
+
+        std::size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_files.size();
+        }
+
+        /// Current list of files; it is not affected by later changes of the tree.
+        std::shared_ptr<const FileList> snapshot() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_snapshot == nullptr)
+            {
+                auto list = std::make_shared<FileList>();
+                list->reserve(m_files.size());
+                for(auto const& [path, meta]: m_files) {
+                    list->push_back(FileEntry{path, meta.size, meta.mtime});
+                }
+                m_snapshot = std::move(list);
+            }
+            return m_snapshot;
+        }
+
+        /// Apply the pending inotify events (the descriptor is non-blocking).
+        void process_events()
+        {
+            alignas(inotify_event) char buffer[64 * 1024];
+            for(;;)
+            {
+                auto n = ::read(m_inotify, buffer, sizeof(buffer));
+                if(n < 0 && errno == EINTR) { continue; }
+                if(n <= 0) { return; }
+                for(char* p = buffer; p < buffer + n; )
+                {
+                    auto const* ev = reinterpret_cast<inotify_event const*>(p);
+                    p += sizeof(inotify_event) + ev->len;
+                    this->handle(*ev);
+                }
+            }
+        }
+
+    private:
+
+        bool selected(std::string const& path) const
+        {
+            return m_selector.selects_entry(path, m_root);
+        }
+
+        static bool stat_file(std::string const& path, Meta& meta)
+        {
+            struct stat st{};
+            if(::stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) { return false; }
+            meta.size  = static_cast<std::uint64_t>(st.st_size);
+            meta.mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+            return true;
+        }
+
+        void add_watch(std::string const& dir)
+        {
+            int wd = ::inotify_add_watch(m_inotify, dir.c_str(), watch_mask);
+            if(wd >= 0) {
+                m_watches[wd] = dir;
+                return;
+            }
+            // Usually fs.inotify.max_user_watches: the rest of the tree is
+            // still indexed, but changes there are not seen.
+            if(!m_limit_reported)
+            {
+                m_limit_reported = true;
+                std::cerr << " [WARNING] inotify_add_watch(" << dir << ") failed: "
+                          << std::strerror(errno) << " (changes may be missed)\n";
+            }
+        }
+
+        /// Watch and index a directory and all its subdirectories.
+        void add_directory(std::string const& dir)
+        {
+            std::vector<std::pair<std::string, Meta>> found;
+            this->add_watch(dir);
+            std::error_code ec;
+            auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+            for(; !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+            {
+                auto path = it->path().string();
+                if(it->is_directory(ec) && !it->is_symlink(ec))
+                {
+                    if(m_selector.prunes_entry(path, m_root))
+                    {
+                        it.disable_recursion_pending();
+                        continue;
+                    }
+                    this->add_watch(path);
+                    continue;
+                }
+                Meta meta;
+                if(this->selected(path) && TreeIndex::stat_file(path, meta)) {
+                    found.emplace_back(std::move(path), meta);
+                }
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(auto& [path, meta]: found) { m_files[std::move(path)] = meta; }
+            m_snapshot = nullptr;
+        }
+
+        void update_file(std::string const& path)
+        {
+            Meta meta;
+            bool exists = this->selected(path) && TreeIndex::stat_file(path, meta);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_files.find(path);
+                if(it == m_files.end() && !exists) { return; }
+                if(exists) { m_files[path] = meta; }
+                else       { m_files.erase(it); }
+                m_snapshot = nullptr;
+            }
+            m_on_change(path);
+        }
+
+        /// Forget a removed (or moved away) directory.
+        void remove_directory(std::string const& dir)
+        {
+            auto prefix = dir + "/";
+            for(auto it = m_watches.begin(); it != m_watches.end(); )
+            {
+                if(it->second == dir || it->second.compare(0, prefix.size(), prefix) == 0)
+                {
+                    ::inotify_rm_watch(m_inotify, it->first);
+                    it = m_watches.erase(it);
+                    continue;
+                }
+                ++it;
+            }
+            std::vector<std::string> removed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                // '0' is the character after '/'.
+                auto first = m_files.lower_bound(prefix);
+                auto last  = m_files.lower_bound(dir + "0");
+                for(auto it = first; it != last; ++it) { removed.push_back(it->first); }
+                m_files.erase(first, last);
+                m_snapshot = nullptr;
+            }
+            for(auto const& path: removed) { m_on_change(path); }
+        }
+
+        void handle(inotify_event const& ev)
+        {
+            if(ev.mask & IN_Q_OVERFLOW)
+            {
+                // Events were lost: start again from scratch.
+                for(auto const& w: m_watches) { ::inotify_rm_watch(m_inotify, w.first); }
+                m_watches.clear();
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_files.clear();
+                    m_snapshot = nullptr;
+                }
+                m_on_change("");
+                this->add_directory(m_root);
+                return;
+            }
+            auto it = m_watches.find(ev.wd);
+            if(it == m_watches.end()) { return; }
+            if(ev.mask & IN_IGNORED)
+            {
+                m_watches.erase(it);
+                return;
+            }
+            if(ev.len == 0) { return; }
+
+            auto path = it->second + "/" + ev.name;
+            if(ev.mask & IN_ISDIR)
+            {
+                if(ev.mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    if(!m_selector.prunes_entry(path, m_root)) { this->add_directory(path); }
+                }
+                else if(ev.mask & (IN_DELETE | IN_MOVED_FROM)) { this->remove_directory(path); }
+                return;
+            }
+            this->update_file(path);
+        }
+    };
+
+    /// Contents of a file and its folded copy (see BufferMatcher::fold()).
+    struct Content
+    {
+        std::string text;
+        std::string folded;
+
+        std::size_t bytes() const { return text.size() + folded.size(); }
+    };
+
+    /** @brief File contents kept in memory within a budget, the least
+     *  recently used are evicted first.
+     *
+     *  The folded copy is kept too, so that a case insensitive search of
+     *  cached files is a single pass over memory. An entry is valid while
+     *  the size and modification time of the file are those of the index.
+     *  Plain files larger than an eighth of the budget and compressed files
+     *  are not cached, they are scanned without a copy at every query.
+     */
+    class ContentCache
+    {
+        struct Item
+        {
+            std::shared_ptr<const Content>      data;
+            std::uint64_t                       size  = 0;
+            std::int64_t                        mtime = 0;
+            std::list<std::string>::iterator    lru;
+        };
+
+        std::size_t                           m_budget;
+        std::size_t                           m_used = 0;
+        std::list<std::string>                m_lru;    // Most recently used first
+        std::unordered_map<std::string, Item> m_items;
+        std::mutex                            m_mutex;
+        std::atomic<std::uint64_t>            m_hits{0};
+        std::atomic<std::uint64_t>            m_misses{0};
+
+        void erase(std::unordered_map<std::string, Item>::iterator it)
+        {
+            m_used -= it->second.data->bytes();
+            m_lru.erase(it->second.lru);
+            m_items.erase(it);
+        }
+
+        /// Cached contents of a file if they are still valid, else nullptr.
+        std::shared_ptr<const Content> find(FileEntry const& file)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_items.find(file.path);
+            if(it == m_items.end()) { return nullptr; }
+            if(it->second.size == file.size && it->second.mtime == file.mtime)
+            {
+                m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+                return it->second.data;
+            }
+            this->erase(it);
+            return nullptr;
+        }
+
+        void insert(FileEntry const& file, std::shared_ptr<const Content> data)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(m_items.count(file.path) != 0) { return; }
+            m_lru.push_front(file.path);
+            m_used += data->bytes();
+            m_items.emplace(file.path, Item{std::move(data), file.size, file.mtime, m_lru.begin()});
+            while(m_used > m_budget) { this->erase(m_items.find(m_lru.back())); }
+        }
+
+    public:
+
+        explicit ContentCache(std::size_t budget): m_budget(budget) { }
+
+        /** @brief Call on_match(line_number, line) for the matching lines of a
+         *  file (see BufferMatcher::scan()); unreadable files have no match.
+         *
+         *  Only plain files small enough for the cache are copied into memory.
+         *  Larger ones are scanned in place (mapped by FileBuffer) and
+         *  compressed ones are decompressed line by line, so that the memory
+         *  used by a query does not depend on the size of the files.
+         */
+        template<typename Callback>
+        void scan(FileEntry const& file, fileutils::BufferMatcher const& matcher, Callback&& on_match)
+        {
+            thread_local std::string scratch;
+            if(auto data = this->find(file))
+            {
+                m_hits++;
+                matcher.scan_folded(data->text, data->folded, on_match);
+                return;
+            }
+            m_misses++;
 
-/// String utilties
-namespace strutils
-{
-    bool contains_string2(std::string const& s, const std::string& cont)
+            struct stat st{};
+            std::optional<fileutils::FileBuffer> buffer;
+            try {
+                if(::stat(file.path.c_str(), &st) < 0) { return; }
+                buffer.emplace(file.path, true);
+            } catch(std::logic_error&) { return; }
+
+            if(buffer->format() != compression::format::none)
+            {
+                std::ifstream in(file.path, std::ios::binary);
+                long number = 0;
+                try {
+                    compression::for_each_line(buffer->format(), in, [&](std::string const& line)
+                    {
+                        bool more = !matcher.matches_line(line, scratch) || on_match(number, line);
+                        number++;
+                        return more;
+                    });
+                } catch(std::runtime_error&) { }
+                return;
+            }
+
+            auto text = buffer->data();
+            std::int64_t mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+            bool unchanged = text.size() == file.size && mtime == file.mtime;
+            // The text and its folded copy.
+            if(!unchanged || 2 * text.size() > m_budget / 8)
+            {
+                matcher.scan(text, scratch, on_match);
+                return;
+            }
+            auto data = std::make_shared<Content>();
+            data->text.assign(text);
+            fileutils::BufferMatcher::fold(data->text, data->folded);
+            buffer.reset();
+            this->insert(file, data);
+            matcher.scan_folded(data->text, data->folded, on_match);
+        }
+
+        /// Drop a file from the cache (all of them if path is empty).
+        void invalidate(std::string const& path)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(path.empty())
+            {
+                m_items.clear();
+                m_lru.clear();
+                m_used = 0;
+                return;
+            }
+            if(auto it = m_items.find(path); it != m_items.end()) { this->erase(it); }
+        }
+
+        std::string status()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return "cached=" + std::to_string(m_items.size()) + " cached_bytes=" + std::to_string(m_used)
+                 + " budget=" + std::to_string(m_budget) + " hits=" + std::to_string(m_hits.load())
+                 + " misses=" + std::to_string(m_misses.load());
+        }
+    };
+
+    /// Search request of a client.
+    struct Query
     {
-        return cont.end() != std::search( cont.begin()
-                                        , cont.end()
-                                        , std::boyer_moore_searcher(s.begin(), s.end()));
-    }
+        std::string id;
+        std::string pattern;
+        bool        use_regex  = false;
+        bool        files_only = false;
+    };
 
-    bool ends_with(std::string const & value, std::string const & ending)
+    /// Parse 'search ID FLAGS PATTERN' (the pattern is the rest of the line).
+    Query parse_query(std::string const& line)
     {
-        if (ending.size() > value.size()) return false;
-        return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+        Query q;
+        auto p1 = line.find(' ');
+        auto p2 = p1 == std::string::npos ? p1 : line.find(' ', p1 + 1);
+        auto p3 = p2 == std::string::npos ? p2 : line.find(' ', p2 + 1);
+        if(p3 == std::string::npos) {
+            throw std::runtime_error("Error: expected: search ID FLAGS PATTERN");
+        }
+        q.id      = line.substr(p1 + 1, p2 - p1 - 1);
+        q.pattern = line.substr(p3 + 1);
+        for(char f: line.substr(p2 + 1, p3 - p2 - 1))
+        {
+            if(f == 'r')      { q.use_regex  = true; }
+            else if(f == 'l') { q.files_only = true; }
+            else if(f != '-') {
+                throw std::runtime_error("Error: invalid flag: "s + f);
+            }
+        }
+        return q;
     }
 
-   std::string
-   to_lowercase(std::string const& text)
-   {
-       std::string t = text;
-       std::transform( t.begin(),
-                      t.end(),
-                      t.begin(),
-                      [](char x){ return std::toupper(x); }
-                      );
-       return t;
-   }
+    class Server
+    {
+        ContentCache             m_cache;
+        TreeIndex                m_index;
+        std::string              m_socket_path;
+        unsigned                 m_jobs;
+        int                      m_listen = -1;
+        std::atomic<std::uint64_t> m_queries{0};
+        std::mutex               m_clients_mutex;
+        std::condition_variable  m_clients_done;
+        std::set<int>            m_clients;
 
-   std::string
-   right_trim(const std::string& s)
-   {
-       size_t end = s.find_last_not_of(" \n\r\t\f\v");
-       return (end == std::string::npos) ? "" : s.substr(0, end + 1);
-   }
-} // * ---- End of namespace strtutils --- * //
+    public:
 
-namespace fileutils
-{
-     using namespace strutils;
+        Server(std::string const& root, selector::FileSelector files
+               , std::string socket_path, std::size_t cache_budget, unsigned jobs)
+            : m_cache(cache_budget)
+            , m_index(root, std::move(files), [this](std::string const& path){ m_cache.invalidate(path); })
+            , m_socket_path(std::move(socket_path))
+            , m_jobs(std::max(jobs, 1u))
+        { }
 
-     template<typename Predicate, typename Action>
-     void iterate_dirlist(  std::string path
-                          , bool recursive
-                          , Predicate&& pred
-                          , Action&& act
-                          )
-     {
-         if(!recursive)
-         {
-             for(auto& p: fs::directory_iterator(path))
-                 if(pred(p)) {
-                     try { act(p); }
-                     catch(fs::filesystem_error& ex)
-                     {
-                         std::cerr << ex.what() << "\n";
-                     }
-                 }
-             return;
-         }
+        Server(Server const&) = delete;
+        Server& operator=(Server const&) = delete;
 
-         for(auto& p: fs::recursive_directory_iterator(path))
-             if(pred(p)) {
-                 try { act(p); }
-                 catch(fs::filesystem_error& ex)
-                 {
-                     std::cerr << ex.what() << "\n";
-                 }
-             }
-     }
+        TreeIndex const& index() const { return m_index; }
 
-     /** Higher-order function for reading a file line-by-line */
-     template<typename Action>
-     void process_line(std::string const& filename, Action&& line_processor)
-     {
-         using namespace std::string_literals;
+        /// Serve until SIGINT or SIGTERM.
+        void run()
+        {
+            this->open_socket();
 
-         auto fs = std::ifstream(filename);
-         // Report error to the caller
-         if(!fs) {
-             throw std::logic_error(" Error: failed to open file: "s + filename);
-         }
-         std::string line;
+            sigset_t mask;
+            ::sigemptyset(&mask);
+            ::sigaddset(&mask, SIGINT);
+            ::sigaddset(&mask, SIGTERM);
+            ::pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+            int sigfd = ::signalfd(-1, &mask, SFD_CLOEXEC);
 
-         while(std::getline(fs, line))
-         {
-             if(!line_processor(line)) break;
-         }
-     }
+            int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            for(int fd: {m_listen, m_index.fd(), sigfd})
+            {
+                epoll_event ev{};
+                ev.events  = EPOLLIN;
+                ev.data.fd = fd;
+                ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+            }
 
-     template<typename MATCHER>
-     void search_file(  bool        not_show_lines
-                      , bool        show_abspath
-                      , std::string filename
-                      , MATCHER&&   matcher
-                      )
-     {
-         using namespace std::string_literals;
-         long line_number = 0;
-         bool pattern_found = false;
+            bool running = true;
+            while(running)
+            {
+                epoll_event events[8];
+                int n = ::epoll_wait(epfd, events, 8, -1);
+                for(int k = 0; k < n; k++)
+                {
+                    int fd = events[k].data.fd;
+                    if(fd == sigfd) { running = false; }
+                    else if(fd == m_index.fd()) { m_index.process_events(); }
+                    else { this->accept_clients(); }
+                }
+            }
+
+            ::close(epfd);
+            ::close(sigfd);
+            ::close(m_listen);
+            ::unlink(m_socket_path.c_str());
+            // Wake up the client threads blocked in read().
+            std::unique_lock<std::mutex> lock(m_clients_mutex);
+            for(int fd: m_clients) { ::shutdown(fd, SHUT_RDWR); }
+            m_clients_done.wait(lock, [this]{ return m_clients.empty(); });
+        }
 
-         process_line(filename,
-                      [&](std::string const& line)
-                      {
-                          if(matcher(line))
-                          {
-                              auto p = fs::path(filename);
+    private:
 
-                              if(!pattern_found) {
-                                  pattern_found = true;
+        void open_socket()
+        {
+            auto addr = posix::make_unix_address(m_socket_path);
+            m_listen = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if(m_listen < 0) {
+                throw std::runtime_error("Error: socket() failed: "s + std::strerror(errno));
+            }
+            // A socket file left by a server which is gone can be replaced.
+            int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool alive = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+            ::close(probe);
+            if(alive) {
+                ::close(m_listen);
+                throw std::runtime_error("Error: a server is already listening on: "s + m_socket_path);
+            }
+            ::unlink(m_socket_path.c_str());
 
-                                  auto file_path = show_abspath
-                                                  ? fs::absolute(p).string()
-                                                  : p.filename().string();
+            auto mask = ::umask(0077);
+            int rc = ::bind(m_listen, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            ::umask(mask);
+            if(rc < 0 || ::listen(m_listen, 64) < 0) {
+                ::close(m_listen);
+                throw std::runtime_error("Error: unable to listen on: "s + m_socket_path
+                                         + ": " + std::strerror(errno));
+            }
+        }
 
+        void accept_clients()
+        {
+            for(;;)
+            {
+                int fd = ::accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+                if(fd < 0) { return; }
+                std::lock_guard<std::mutex> lock(m_clients_mutex);
+                m_clients.insert(fd);
+                std::thread(&Server::serve_client, this, fd).detach();
+            }
+        }
 
-                                  std::cout << "\n\n"
-                                            << "  => File: "s + file_path << "\n";
-                                  std::cout << "  " << std::string(50, '-') << "\n";
+        /// Read the requests of a connection; searches run on a worker thread
+        /// so that a newer request can cancel them.
+        void serve_client(int fd)
+        {
+            std::mutex                         write_mutex;
+            std::thread                        worker;
+            std::shared_ptr<std::atomic<bool>> cancel;
 
-                                  // Exit this lambda function
-                                  if(not_show_lines) { return false; }
-                              }
+            auto reply = [&](std::string const& text)
+            {
+                std::lock_guard<std::mutex> lock(write_mutex);
+                send_all(fd, text);
+            };
+            auto stop_worker = [&]
+            {
+                if(!worker.joinable()) { return; }
+                cancel->store(true);
+                worker.join();
+            };
 
-                              std::cout << std::setw(10) << line_number
-                                        << " "
-                                        << std::setw(10) << right_trim(line)
-                                        << "\n";
-                          }
-                          ++line_number;
+            std::string buffer;
+            char chunk[4096];
+            for(;;)
+            {
+                auto n = ::read(fd, chunk, sizeof(chunk));
+                if(n < 0 && errno == EINTR) { continue; }
+                if(n <= 0) { break; }
+                buffer.append(chunk, static_cast<std::size_t>(n));
 
-                          return true;
-                      });
-     }
+                std::size_t eol;
+                while((eol = buffer.find('\n')) != std::string::npos)
+                {
+                    auto line = buffer.substr(0, eol);
+                    buffer.erase(0, eol + 1);
+                    if(!line.empty() && line.back() == '\r') { line.pop_back(); }
 
-     void search_file_for_text(std::string pattern, std::string filename, bool not_show_lines)
-     {
-         search_file(not_show_lines, true, filename,
-                     [=](std::string const& line)
-                     {
-                         return contains_string2( to_lowercase(pattern)
-                                                , to_lowercase(line)) ;
-                     });
-     }
+                    if(line.compare(0, 7, "search ") == 0)
+                    {
+                        stop_worker();
+                        try
+                        {
+                            auto query = std::make_shared<Query>(parse_query(line));
+                            cancel = std::make_shared<std::atomic<bool>>(false);
+                            worker = std::thread([=, &write_mutex]{ this->search(fd, *query, *cancel, write_mutex); });
+                        } catch(std::runtime_error& ex)
+                        {
+                            reply("error - "s + ex.what() + "\n");
+                        }
+                    }
+                    else if(line == "cancel") { stop_worker(); }
+                    else if(line == "status")
+                    {
+                        reply("status root=" + m_index.root() + " files=" + std::to_string(m_index.size())
+                              + " watches=" + std::to_string(m_index.watches()) + " " + m_cache.status()
+                              + " queries=" + std::to_string(m_queries.load()) + "\n");
+                    }
+                    else if(!line.empty()) { reply("error - Error: unknown request: " + line + "\n"); }
+                }
+            }
+            stop_worker();
 
-     void search_file_for_regex( std::string pattern
-                               , std::string filename
-                               , bool not_show_lines)
-     {
-         std::regex reg{pattern};
-         search_file(not_show_lines, true, filename, [=, &reg](std::string const& line)
-                     {
-                         return std::regex_search(line, reg) ;
-                     });
-     }
+            std::lock_guard<std::mutex> lock(m_clients_mutex);
+            m_clients.erase(fd);
+            ::close(fd);
+            m_clients_done.notify_all();
+        }
 
-     void search_directory(  std::string pattern
-                           , std::string directory
-                           , bool recursive
-                           , bool not_show_lines
-                           , bool show_abspath
-                           , std::vector<std::string> const& file_extensions)
-     {
-         std::puts("\n =========== Seaching files =============");
+        /// Search all the files of the index, results are sent as soon as
+        /// the search of a file is done.
+        void search(int fd, Query const& query, std::atomic<bool> const& cancel, std::mutex& write_mutex)
+        {
+            using clock = std::chrono::steady_clock;
+            auto start = clock::now();
+            m_queries++;
 
-         iterate_dirlist(directory, recursive
-             ,[=](fs::path const& p)
-             {
-                 if(!fs::is_regular_file(p)) return false;
+            auto send = [&](std::string const& text)
+            {
+                std::lock_guard<std::mutex> lock(write_mutex);
+                return send_all(fd, text);
+            };
 
-                 auto it = std::find_if( file_extensions.begin()
-                                       , file_extensions.end()
-                                       , [=](std::string const& ext)
-                                        {
-                                            return ends_with(p.filename().string(), ext);
-                                        });
+            std::optional<fileutils::BufferMatcher> matcher;
+            try {
+                matcher.emplace(query.pattern, query.use_regex);
+            } catch(std::regex_error& ex)
+            {
+                send("error " + query.id + " Error: invalid regex: " + ex.what() + "\n");
+                return;
+            }
 
-                 return it != file_extensions.end();
-             }
-             ,[=](fs::path const& p)
-             {
-                // std::cout << " FIle = " << p.filename() << std::endl;
+            auto files = m_index.snapshot();
+            std::atomic<std::size_t> next{0}, matches{0}, matched_files{0};
+            std::atomic<bool>        gone{false};
 
-                 search_file(not_show_lines, show_abspath, fs::absolute(p)
-                           , [=](std::string const& line)
-                             {
-                                 return contains_string2( to_lowercase(pattern)
-                                                        , to_lowercase(line)) ;
-                             });
-             });
-     }
+            auto work = [&]
+            {
+                std::string out;
+                for(;;)
+                {
+                    if(cancel.load(std::memory_order_relaxed) || gone.load(std::memory_order_relaxed)) { return; }
+                    auto i = next.fetch_add(1);
+                    if(i >= files->size()) { return; }
+                    auto const& file = (*files)[i];
+                    out.clear();
+                    std::size_t count = 0;
+                    m_cache.scan(file, *matcher, [&](long number, std::string_view line)
+                    {
+                        count++;
+                        if(query.files_only) { return false; }
+                        auto end = line.find_last_not_of(" \n\r\t\f\v");
+                        out += file.path;
+                        out += ':';
+                        out += std::to_string(number);
+                        out += ':';
+                        out.append(line.substr(0, end == std::string_view::npos ? 0 : end + 1));
+                        out += '\n';
+                        return !cancel.load(std::memory_order_relaxed);
+                    });
+                    if(count == 0) { continue; }
+                    if(query.files_only) { out = file.path + "\n"; }
+                    matches += count;
+                    matched_files++;
+                    if(!send(out)) { gone = true; }
+                }
+            };
+            std::vector<std::thread> threads;
+            for(unsigned k = 1; k < m_jobs; k++) { threads.emplace_back(work); }
+            work();
+            for(auto& t: threads) { t.join(); }
 
+            if(cancel || gone)
+            {
+                send("cancelled " + query.id + "\n");
+                return;
+            }
+            auto ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            std::ostringstream os;
+            os << "end " << query.id << " matches=" << matches.load() << " files=" << matched_files.load()
+               << " searched=" << files->size() << " ms=" << std::fixed << std::setprecision(3) << ms << "\n";
+            send(os.str());
+        }
+    };
 
-} // * --- End of namespace fileutils --- * //
+    /** @brief Send a search to a running server and print the results as
+     *  they arrive.
+     *  @return false if the server reported an error.
+     */
+    bool query(std::string const& socket_path, std::string const& pattern
+               , bool use_regex, bool files_only)
+    {
+        if(pattern.find('\n') != std::string::npos) {
+            throw std::runtime_error("Error: the pattern can't contain a newline");
+        }
+        auto addr = posix::make_unix_address(socket_path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        {
+            if(fd >= 0) { ::close(fd); }
+            throw std::runtime_error("Error: no server listening on: "s + socket_path);
+        }
+        std::string flags = use_regex ? "r" : "";
+        if(files_only)    { flags += "l"; }
+        if(flags.empty()) { flags = "-"; }
+        send_all(fd, "search 1 " + flags + " " + pattern + "\n");
+
+        std::string buffer, summary;
+        char chunk[64 * 1024];
+        while(summary.empty())
+        {
+            auto n = ::read(fd, chunk, sizeof(chunk));
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n <= 0) { break; }
+            buffer.append(chunk, static_cast<std::size_t>(n));
+            // Result lines start with '/' (absolute paths).
+            std::size_t pos = 0, eol;
+            while(summary.empty() && (eol = buffer.find('\n', pos)) != std::string::npos)
+            {
+                if(buffer[pos] == '/') { std::cout.write(buffer.data() + pos, static_cast<std::streamsize>(eol + 1 - pos)); }
+                else                   { summary = buffer.substr(pos, eol - pos); }
+                pos = eol + 1;
+            }
+            buffer.erase(0, pos);
+        }
+        ::close(fd);
+        std::cout.flush();
+        if(summary.compare(0, 4, "end ") == 0)
+        {
+            // end ID STATISTICS
+            std::cerr << " [INFO] " << summary.substr(summary.find(' ', 4) + 1) << "\n";
+            return true;
+        }
+        auto message = summary;
+        if(summary.empty()) { message = "Error: connection closed by the server"; }
+        // error ID MESSAGE
+        else if(summary.compare(0, 6, "error ") == 0) { message = summary.substr(summary.find(' ', 6) + 1); }
+        std::cerr << " [ERROR] " << message << "\n";
+        return false;
+    }
+
+} // * --- End of namespace server --- * //
+
+/// Options of the matching lines shared by 'file' and 'dir'.
+struct output_options
+{
+    long before     = -1;   ///< -B (negative: not set)
+    long after      = -1;   ///< -A (negative: not set)
+    long context    = 0;    ///< -C: default of -A and -B
+    long max_count  = -1;
+    bool count      = false;
+    bool files_without_match = false;
+
+    fileutils::search_mode mode(bool noline, bool show_abspath) const
+    {
+        fileutils::search_mode m;
+        m.files_only          = noline;
+        m.files_without_match = files_without_match;
+        m.count               = count;
+        m.max_count           = max_count;
+        m.before              = static_cast<std::size_t>(std::max(before < 0 ? context : before, 0L));
+        m.after               = static_cast<std::size_t>(std::max(after  < 0 ? context : after,  0L));
+        m.show_abspath        = show_abspath;
+        return m;
+    }
+};
+
+void add_output_options(CLI::App* cmd, output_options& opt)
+{
+    cmd->add_option("-A,--after-context", opt.after, "Lines of context after a matching line");
+    cmd->add_option("-B,--before-context", opt.before, "Lines of context before a matching line");
+    cmd->add_option("-C,--context", opt.context, "Lines of context before and after a matching line");
+    cmd->add_option("-m,--max-count", opt.max_count, "Stop reading a file after NUM matching lines");
+    cmd->add_flag("-c,--count", opt.count, "Only print the number of matching lines of every file");
+    cmd->add_flag("-L,--files-without-match", opt.files_without_match
+                  , "Only print the names of the files without a match");
+}
 
 struct text_search_options
 {
@@ -212,6 +2285,8 @@ struct text_search_options
     bool                     use_regex  = false;
     bool                     show_abspath = false;
     bool                     noline     = false;
+    unsigned                 fuzzy      = 0;
+    output_options           output;
 };
 
 struct directory_search_options
@@ -222,10 +2297,245 @@ struct directory_search_options
     bool                     use_regex         = false;
     bool                     noline            = false;
     bool                     not_show_abspath  = false;
-    std::vector<std::string> file_extensions   = {};
+    unsigned                 fuzzy             = 0;
+    selector::Options        files;
+    output_options           output;
+};
 
+struct replace_options
+{
+    std::string              pattern          = "";
+    std::string              replacement      = "";
+    std::string              directory        = ".";
+    bool                     recursive        = false;
+    bool                     use_regex        = false;
+    bool                     case_sensitive   = false;
+    bool                     dry_run          = false;
+    unsigned                 jobs             = 1;
+    selector::Options        files;
 };
 
+/** @brief Replace a pattern in the files of a directory (text-search replace).
+ *
+ *  Files are selected like 'dir' (see selector::FileSelector; symbolic
+ *  links excluded) and processed in parallel. A modified file is written
+ *  to a temporary file in its directory, which gets the mode and owner of
+ *  the original and is renamed over it, so readers see either the old or
+ *  the new contents. Files without matches, and compressed files, are not
+ *  written. Files with several hard links are skipped because the rename
+ *  would break the links.
+ *
+ *  In dry-run mode a unified diff of the changes is printed instead.
+ *  @return false if some file could not be processed.
+ */
+bool replace_in_directory(replace_options const& opt)
+{
+    using namespace std::string_literals;
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+
+    if(opt.pattern.empty()) {
+        throw std::runtime_error("Error: empty pattern");
+    }
+    fileutils::BufferMatcher matcher(opt.pattern, opt.use_regex, !opt.case_sensitive);
+    selector::FileSelector selection(opt.files);
+
+    std::vector<fs::path> files;
+    fileutils::iterate_dirlist(opt.directory, opt.recursive
+        , [&](fs::directory_entry const& p)
+        {
+            // Symbolic links are not followed: the rename would replace the link.
+            std::error_code ec;
+            return p.is_regular_file(ec) && !p.is_symlink(ec)
+                && selection.selects_entry(p.path().native(), opt.directory);
+        }
+        , [&](fs::directory_entry const& p){ files.push_back(p.path()); }
+        , [&](fs::directory_entry const& p){ return selection.prunes_entry(p.path().native(), opt.directory); });
+
+    struct FileResult
+    {
+        std::size_t replacements = 0;
+        std::string output;   // Diff or message
+        bool        error = false;
+    };
+    std::vector<FileResult> results(files.size());
+
+    // Files without matches are only read.
+    auto process = [&](fs::path const& path, FileResult& result, std::string& text
+                       , std::string& folded, std::string& out) -> void
+    {
+        auto fail = [&](std::string const& what)
+        {
+            result.error  = true;
+            result.output = " [ERROR] "s + path.string() + ": " + what + "\n";
+        };
+
+        std::optional<stats::ScopedPhase> phase(stats::phase::read);
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st{};
+        if(fd < 0 || ::fstat(fd, &st) < 0)
+        {
+            fail(std::strerror(errno));
+            if(fd >= 0) { ::close(fd); }
+            return;
+        }
+        text.resize(static_cast<std::size_t>(st.st_size));
+        std::size_t done = 0;
+        while(done < text.size())
+        {
+            auto n = ::read(fd, text.data() + done, text.size() - done);
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n <= 0) { break; }
+            done += static_cast<std::size_t>(n);
+        }
+        text.resize(done);
+        stats::add(stats::counter::files);
+        stats::add(stats::counter::bytes_read, done);
+        // Rewriting a compressed file as text would corrupt it.
+        if(compression::detect(std::string_view(text).substr(0, 6)) != compression::format::none)
+        {
+            ::close(fd);
+            return;
+        }
+
+        phase.reset();
+        phase.emplace(stats::phase::match);
+        std::string_view data = text;
+        std::string_view view = data;
+        if(matcher.folds())
+        {
+            fileutils::BufferMatcher::fold(data, folded);
+            view = folded;
+        }
+
+        // New contents, and the diff hunks in dry-run mode.
+        out.clear();
+        std::size_t copied = 0;
+        std::string diff;
+        matcher.scan_folded(data, view, [&](long number, std::string_view line)
+        {
+            auto begin = static_cast<std::size_t>(line.data() - data.data());
+            out.append(data.substr(copied, begin - copied));
+            auto new_begin = out.size();
+            result.replacements += matcher.replace_line(line, view.substr(begin, line.size())
+                                                        , opt.replacement, out);
+            copied = begin + line.size();
+            if(opt.dry_run)
+            {
+                bool last = copied == data.size();
+                auto n    = std::to_string(number + 1);
+                diff += "@@ -" + n + " +" + n + " @@\n-";
+                diff.append(line);
+                diff += last ? "\n\\ No newline at end of file\n+" : "\n+";
+                diff.append(out, new_begin, std::string::npos);
+                diff += last ? "\n\\ No newline at end of file\n" : "\n";
+            }
+            return true;
+        });
+        if(result.replacements == 0)
+        {
+            ::close(fd);
+            return;
+        }
+        out.append(data.substr(copied));
+        stats::add(stats::counter::matches, result.replacements);
+
+        if(opt.dry_run)
+        {
+            ::close(fd);
+            result.output = "--- " + path.string() + "\n+++ " + path.string() + "\n" + diff;
+            return;
+        }
+        if(st.st_nlink > 1)
+        {
+            ::close(fd);
+            fail("skipped, the file has " + std::to_string(st.st_nlink) + " hard links");
+            return;
+        }
+
+        phase.reset();
+        phase.emplace(stats::phase::output);
+        // Temporary file in the same directory: rename() can't cross file systems.
+        auto tmp = (path.parent_path() / ("." + path.filename().string() + ".cb-XXXXXX")).string();
+        int out_fd = ::mkostemp(tmp.data(), O_CLOEXEC);
+        if(out_fd < 0)
+        {
+            ::close(fd);
+            fail("unable to create a temporary file: "s + std::strerror(errno));
+            return;
+        }
+        std::string error;
+        for(std::size_t written = 0; written < out.size() && error.empty(); )
+        {
+            auto n = ::write(out_fd, out.data() + written, out.size() - written);
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n <= 0) { error = "write failure: "s + std::strerror(errno); }
+            else       { written += static_cast<std::size_t>(n); }
+        }
+        // Owner first: fchown() clears the set-user-ID and set-group-ID bits.
+        if(error.empty() && (st.st_uid != ::geteuid() || st.st_gid != ::getegid())
+           && ::fchown(out_fd, st.st_uid, st.st_gid) < 0) {
+            error = "unable to preserve the owner: "s + std::strerror(errno);
+        }
+        if(error.empty() && ::fchmod(out_fd, st.st_mode & 07777) < 0) {
+            error = "unable to preserve the mode: "s + std::strerror(errno);
+        }
+        // The file must not have been modified since it was read.
+        struct stat now{};
+        if(error.empty() && (::fstat(fd, &now) < 0 || now.st_size != st.st_size
+                             || now.st_mtim.tv_sec != st.st_mtim.tv_sec
+                             || now.st_mtim.tv_nsec != st.st_mtim.tv_nsec)) {
+            error = "modified while being processed";
+        }
+        if(error.empty() && ::rename(tmp.c_str(), path.c_str()) < 0) {
+            error = "rename failure: "s + std::strerror(errno);
+        }
+        ::close(out_fd);
+        ::close(fd);
+        if(!error.empty())
+        {
+            ::unlink(tmp.c_str());
+            fail(error);
+            return;
+        }
+        stats::add(stats::counter::bytes_written, out.size());
+        result.output = "  => " + path.string() + " (" + std::to_string(result.replacements) + ")\n";
+    };
+
+    std::atomic<std::size_t> next{0};
+    auto work = [&]
+    {
+        std::string text, folded, out;
+        for(std::size_t i; (i = next.fetch_add(1)) < files.size(); ) {
+            process(files[i], results[i], text, folded, out);
+        }
+    };
+    std::vector<std::thread> threads;
+    for(unsigned k = 1; k < std::max(opt.jobs, 1u); k++) { threads.emplace_back(work); }
+    work();
+    for(auto& t: threads) { t.join(); }
+
+    std::size_t modified = 0, replacements = 0, errors = 0;
+    for(auto const& r: results)
+    {
+        if(r.error) {
+            std::cerr << r.output;
+            errors++;
+            continue;
+        }
+        std::cout << r.output;
+        modified     += r.replacements > 0;
+        replacements += r.replacements;
+    }
+    auto ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    std::cerr << " [INFO] Files: " << files.size() << " ; " << (opt.dry_run ? "to be modified: " : "modified: ")
+              << modified << " ; replacements: " << replacements << " ; errors: " << errors
+              << " ; time: " << std::fixed << std::setprecision(1) << ms << " ms\n";
+    return errors == 0;
+}
+
+// Benchmarks include this file for its functions (see bench/).
+#ifndef CLIBOX_NO_MAIN
 int main(int argc, char** argv)
 {
     CLI::App app{ "text-search"};
@@ -254,6 +2564,11 @@ int main(int argc, char** argv)
     // If this flag is set, this cmd_file-> does not show the line number
     // ,instead only print the file names where the pattern was found.
     cmd_file->add_flag("--noline", opt_file.noline, "Does not show lines");
+    cmd_file->add_option("--fuzzy", opt_file.fuzzy, "Match lines within K edits of the pattern (text patterns)");
+    add_output_options(cmd_file, opt_file.output);
+
+    stats::Options stats_options;
+    stats::add_options(cmd_file, stats_options);
 
 
     //------------------------------------------------------------------//
@@ -275,9 +2590,73 @@ int main(int argc, char** argv)
                          , "Direcotry to be searched")->required();
     cmd_dir->add_flag("--regex", dir_opt.use_regex, "Use regex");
     cmd_dir->add_flag("--noline", dir_opt.noline, "Does not show lines");
+    cmd_dir->add_option("--fuzzy", dir_opt.fuzzy, "Match lines within K edits of the pattern (text patterns)");
     cmd_dir->add_flag("-r,--recursive", dir_opt.recursive, "Search all subdirectories too");
     cmd_dir->add_flag("--noabs", dir_opt.not_show_abspath, "Do not show absolute path");
-    cmd_dir->add_option("-e,--extension", dir_opt.file_extensions, "File extensions to be searched");
+    selector::add_options(cmd_dir, dir_opt.files);
+    add_output_options(cmd_dir, dir_opt.output);
+    stats::add_options(cmd_dir, stats_options);
+
+    //------------------------------------------------------------------//
+    //               Subcommand REPLACE                                 //
+    //------------------------------------------------------------------//
+
+    replace_options rep_opt;
+    rep_opt.jobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+    auto cmd_replace = app.add_subcommand("replace",
+                                          "Replace a pattern in place in the files of a directory");
+    cmd_replace->add_option("<PATTERN>", rep_opt.pattern, "Text pattern")->required();
+    cmd_replace->add_option("<REPLACEMENT>", rep_opt.replacement
+                            , "Replacement text (with --regex: $1, $& ... refer to the match)")->required();
+    cmd_replace->add_option("<DIRECTORY>", rep_opt.directory, "Directory to be processed")->required();
+    cmd_replace->add_flag("--regex", rep_opt.use_regex, "Use regex");
+    cmd_replace->add_flag("-s,--case-sensitive", rep_opt.case_sensitive, "Do not ignore case");
+    cmd_replace->add_flag("-r,--recursive", rep_opt.recursive, "Process all subdirectories too");
+    selector::add_options(cmd_replace, rep_opt.files);
+    cmd_replace->add_flag("-n,--dry-run", rep_opt.dry_run, "Print a diff of the changes, do not modify files");
+    cmd_replace->add_option("-j,--jobs", rep_opt.jobs, "Number of files processed in parallel");
+    stats::add_options(cmd_replace, stats_options);
+
+    //------------------------------------------------------------------//
+    //               Subcommands SERVE and QUERY                        //
+    //------------------------------------------------------------------//
+    // Resident server keeping the file list and contents in memory, for
+    // editors and scripts running many searches on the same tree.
+
+    auto cmd_serve = app.add_subcommand("serve",
+                                        "Index a directory and answer searches over a Unix socket");
+    cmd_serve->footer("\n A new search or 'cancel' only cancels the search running on the same"
+                      "\n connection; a search ends early when its client disconnects.");
+
+    std::string serve_directory = ".";
+    cmd_serve->add_option("<DIRECTORY>", serve_directory, "Directory to be indexed (recursively)");
+
+    selector::Options serve_files;
+    selector::add_options(cmd_serve, serve_files);
+
+    std::string socket_path = server::default_socket();
+    cmd_serve->add_option("--socket", socket_path, "Socket path");
+
+    std::string serve_cache = "256M";
+    cmd_serve->add_option("--cache", serve_cache, "Memory budget of the file contents (0 => not cached)");
+
+    unsigned serve_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    cmd_serve->add_option("-j,--jobs", serve_jobs, "Number of threads per search");
+
+    auto cmd_query = app.add_subcommand("query", "Search using a running server (see serve)");
+    cmd_query->footer("\n Each run uses its own connection: it does not cancel the searches of"
+                      "\n other runs. Interrupting a run cancels its search on the server.");
+
+    std::string query_pattern;
+    cmd_query->add_option("<PATTERN>", query_pattern, "Text pattern")->required();
+    cmd_query->add_option("--socket", socket_path, "Socket path");
+
+    bool query_regex = false;
+    cmd_query->add_flag("--regex", query_regex, "Use regex");
+
+    bool query_noline = false;
+    cmd_query->add_flag("--noline", query_noline, "Only print the names of the files");
 
 
     // ----- Parse Arguments ---------//
@@ -292,28 +2671,88 @@ int main(int argc, char** argv)
 
     //------ Program Actions ---------//
 
+    // Statistics are reported when main() returns.
+    stats::Session stats_session(stats_options);
+
     // std::cout << "\n Seach results for pattern: '" << opt_file.pattern << "'";
 
     // process subcommand: text-search file
     if(*cmd_file)
     {
-        for (auto const& fname : opt_file.filepaths)
+        auto mode = opt_file.output.mode(opt_file.noline, true);
+        try
         {
-            try
-            {
-                if(!opt_file.use_regex)
-                    fileutils::search_file_for_text(opt_file.pattern, fname, opt_file.noline);
-                else
-                    fileutils::search_file_for_regex(opt_file.pattern, fname, opt_file.noline);
-            } catch (std::logic_error& ex)
-            {
-                std::cerr << " [ERROR / FILE] " << ex.what() << "\n";
-                return  EXIT_FAILURE;
-            } catch  (std::regex_error& ex)
+            fileutils::BufferMatcher matcher(opt_file.pattern, opt_file.use_regex, true, opt_file.fuzzy);
+            // A corrupted compressed file does not stop the search of the others.
+            std::size_t errors = 0;
+            for (auto const& fname : opt_file.filepaths)
             {
-                std::cerr << " [ERROR / REGEX] " << ex.what() << "\n";
-                return EXIT_FAILURE;
+                try { fileutils::search_file(mode, fname, matcher); }
+                catch (std::runtime_error& ex)
+                {
+                    std::cerr << " [ERROR] " << ex.what() << "\n";
+                    errors++;
+                }
             }
+            if(errors > 0) { return EXIT_FAILURE; }
+        } catch (std::regex_error& ex)
+        {
+            std::cerr << " [ERROR / REGEX] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        } catch (std::logic_error& ex)
+        {
+            std::cerr << " [ERROR / FILE] " << ex.what() << "\n";
+            return  EXIT_FAILURE;
+        } catch (std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(*cmd_replace)
+    {
+        try {
+            return replace_in_directory(rep_opt) ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch(std::regex_error& ex)
+        {
+            std::cerr << " [ERROR / REGEX] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(*cmd_serve)
+    {
+        try {
+            auto start = std::chrono::steady_clock::now();
+            server::Server srv(serve_directory, selector::FileSelector(serve_files), socket_path
+                               , posix::parse_size(serve_cache), serve_jobs);
+            auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << " [INFO] Indexed " << srv.index().size() << " files of " << srv.index().root()
+                      << " in " << ms << " ms" << std::endl;
+            std::cerr << " [INFO] Listening on: " << socket_path << std::endl;
+            srv.run();
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(*cmd_query)
+    {
+        try {
+            return server::query(socket_path, query_pattern, query_regex, query_noline)
+                 ? EXIT_SUCCESS : EXIT_FAILURE;
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
         }
     }
 
@@ -322,16 +2761,28 @@ int main(int argc, char** argv)
         std::cout << "   Pattern = " << dir_opt.pattern << std::endl;
         std::cout << " Directory = " << dir_opt.directory << std::endl;
 
-        fileutils::search_directory(  dir_opt.pattern
-                                    , dir_opt.directory
-                                    , dir_opt.recursive
-                                    , dir_opt.noline
-                                    , !dir_opt.not_show_abspath
-                                    , dir_opt.file_extensions
-                                    );
-
+        try {
+            auto errors = fileutils::search_directory(  dir_opt.pattern
+                                        , dir_opt.directory
+                                        , dir_opt.recursive
+                                        , dir_opt.use_regex
+                                        , dir_opt.fuzzy
+                                        , dir_opt.output.mode(dir_opt.noline, !dir_opt.not_show_abspath)
+                                        , selector::FileSelector(dir_opt.files)
+                                        );
+            if(errors > 0) { return EXIT_FAILURE; }
+        } catch(std::regex_error& ex)
+        {
+            std::cerr << " [ERROR / REGEX] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        } catch(std::runtime_error& ex)
+        {
+            std::cerr << " [ERROR] " << ex.what() << "\n";
+            return EXIT_FAILURE;
+        }
         return EXIT_SUCCESS;
     }
 
     return EXIT_SUCCESS;
 }
+#endif // CLIBOX_NO_MAIN